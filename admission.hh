@@ -0,0 +1,31 @@
+#ifndef ADMISSION_HH
+#define ADMISSION_HH
+
+#include "evictor.hh"
+
+// Admission policies decide whether a new key is worth evicting an existing
+// entry for. Without one, every new key is added to the cache, so a scan over
+// keys that are only used once can flush out the keys that are used often.
+class Admission {
+  public:
+    Admission() = default;
+    virtual ~Admission() = default;
+    Admission(const Admission &) = delete; // noncopiable
+    Admission &operator=(const Admission &) = delete;
+
+    // Inform the policy that a key has been accessed (set or get, whether or
+    // not it is in the cache)
+    virtual void record(const key_type &key) = 0;
+
+    // Whether `candidate` (which is not in the cache) should be added to the
+    // cache if `victim` has to be evicted to make space for it
+    virtual bool admit(const key_type &candidate, const key_type &victim) = 0;
+
+    // Inform the policy that a key has been removed from the cache
+    virtual void forget(const key_type &) {}
+
+    // Inform the policy that every key has been removed from the cache
+    virtual void clear() {}
+};
+
+#endif // ADMISSION_HH
@@ -0,0 +1,114 @@
+#include "cache.hh"
+#include "clock_evictor.hh"
+#include "intrusive_lru_evictor.hh"
+#include "request_generator.hh"
+#include "tinylfu_admission.hh"
+
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+
+/// Workload parameters (the same as in request_driver.cc)
+constexpr WorkloadParams PARAMS = {
+    15,   // prob_get
+    8,    // prob_set
+    1,    // prob_del
+    1000, // num_keys
+    0.08, // val_size_dist
+};
+
+/// Number of requests to make for each measurement
+constexpr auto NUM_REQUESTS = 1 << 21; // ~2M
+
+/// Memory limits to measure
+constexpr Cache::size_type MAXMEMS[] = {4 << 10, 8 << 10, 16 << 10};
+
+/// Every `SCAN_INTERVAL` requests, read and set `SCAN_LENGTH` keys that are
+/// never used again (0 to disable scans)
+constexpr auto SCAN_INTERVAL = 1 << 12;
+constexpr auto SCAN_LENGTH = 1 << 9;
+
+/// Make the same requests as request_driver against a local cache (with some
+/// scans mixed in) and return the fraction of GETs that hit
+double measure_hit_rate(Cache &cache, const Workload &workload, bool scans) {
+    // Use a fixed seed so that every configuration sees the same requests
+    RequestGenerator<std::mt19937> generator{42};
+    unsigned long num_gets = 0, num_get_hits = 0, num_scanned = 0;
+    Cache::size_type size;
+    for (auto i = 1U; i <= NUM_REQUESTS; ++i) {
+        const auto request = generator(workload);
+        switch (request.type) {
+        case Request::Type::GET:
+            num_get_hits +=
+                cache.get(key_type{request.key}, size) != nullptr;
+            num_gets++;
+            break;
+        case Request::Type::SET:
+            cache.set(key_type{request.key}, request.value->data(),
+                      request.value->size());
+            break;
+        case Request::Type::DEL:
+            cache.del(key_type{request.key});
+            break;
+        }
+        if (scans && i % SCAN_INTERVAL == 0) {
+            const std::string value(16, 'a');
+            for (auto j = 0U; j < SCAN_LENGTH; ++j) {
+                const auto key = "scan" + std::to_string(num_scanned++);
+                cache.get(key, size);
+                cache.set(key, value.c_str(), value.length() + 1);
+            }
+        }
+    }
+    return static_cast<double>(num_get_hits) / num_gets;
+}
+
+/// Measure the hit rate with the given evictor and admission policy
+template <typename Evictor>
+double measure(const Workload &workload, Cache::size_type maxmem,
+               const std::string &admission_name, bool scans) {
+    Evictor evictor;
+    // Size the sketch and window like `cache_server` does
+    const auto expected_entries = maxmem / 16;
+    std::unique_ptr<Admission> admission;
+    if (admission_name == "tinylfu") {
+        admission = std::make_unique<TinyLfuAdmission>(expected_entries);
+    } else if (admission_name == "w-tinylfu") {
+        admission = std::make_unique<TinyLfuAdmission>(
+            expected_entries, std::max(1U, expected_entries / 100));
+    }
+    Cache cache{maxmem, 0.75f, &evictor, std::hash<key_type>(),
+                Cache::IndexType::CHAINED, admission.get()};
+    return measure_hit_rate(cache, workload, scans);
+}
+
+int main() {
+    const Workload workload{PARAMS};
+    std::cout << "# GET hit rate per eviction and admission policy ("
+              << NUM_REQUESTS << " requests per measurement)" << std::endl;
+    std::cout << "# Scans  Maxmem  Evictor  Admission  Hit rate" << std::endl;
+
+    for (const auto scans : {false, true}) {
+        for (const auto maxmem : MAXMEMS) {
+            for (const auto evictor : {"lru", "clock"}) {
+                for (const auto admission : {"none", "tinylfu", "w-tinylfu"}) {
+                    const auto hit_rate =
+                        std::string{evictor} == "lru"
+                            ? measure<IntrusiveLruEvictor>(workload, maxmem,
+                                                           admission, scans)
+                            : measure<ClockEvictor>(workload, maxmem,
+                                                    admission, scans);
+                    std::cout << "  " << std::setw(5) << std::left
+                              << (scans ? "yes" : "no") << "  " << std::setw(6)
+                              << std::right << maxmem << "  " << std::setw(7)
+                              << std::left << evictor << "  " << std::setw(9)
+                              << admission << "  " << std::fixed
+                              << std::setprecision(1) << hit_rate * 100 << "%"
+                              << std::resetiosflags(std::cout.flags())
+                              << std::endl;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,303 @@
+/// Microbenchmarks of the cache library and the evictors, in-process (no
+/// network), using Google Benchmark. Run with `--benchmark_filter=<regex>` to
+/// pick benchmarks, and see `--help` for the other options.
+
+#include "cache.hh"
+#include "fifo_evictor.hh"
+#include "lru_evictor.hh"
+#include "shared_cache.hh"
+
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/// Number of keys chosen ahead of each timed loop, which it cycles through
+/// (a power of two, so that the next key is a mask away)
+constexpr std::size_t ORDER_SIZE = 1 << 16;
+
+/// Generate `count` distinct keys, with `prefix` in front of each
+std::vector<key_type> make_keys(std::size_t count,
+                                const std::string &prefix = "key") {
+    std::vector<key_type> keys;
+    keys.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        keys.push_back(prefix + std::to_string(i));
+    }
+    return keys;
+}
+
+/// Choose `ORDER_SIZE` keys uniformly at random, each from `hits` with
+/// probability `hit_percent`% and from `misses` otherwise
+std::vector<const key_type *>
+make_order(const std::vector<key_type> &hits,
+           const std::vector<key_type> &misses, unsigned hit_percent = 100) {
+    std::mt19937 random{42};
+    std::uniform_int_distribution<std::size_t> hit_dist{0, hits.size() - 1};
+    std::uniform_int_distribution<std::size_t> miss_dist{0, misses.size() - 1};
+    std::uniform_int_distribution<unsigned> percent{0, 99};
+    std::vector<const key_type *> order(ORDER_SIZE);
+    for (auto &key : order) {
+        key = percent(random) < hit_percent ? &hits[hit_dist(random)]
+                                            : &misses[miss_dist(random)];
+    }
+    return order;
+}
+
+/// Bytes to allow for each entry on top of its value: the arena that holds
+/// the values is limited to `maxmem` too, and also holds each entry's header
+/// and key, rounded up to a chunk size
+constexpr std::size_t ENTRY_OVERHEAD = 64;
+
+/// Make a cache with room for `num_keys` values of `value_size` bytes (with
+/// as much again to spare, so that replacing a value never runs out of
+/// room), using `evictor` (may be nullptr)
+Cache make_cache(std::size_t num_keys, Cache::size_type value_size,
+                 Evictor *evictor) {
+    return Cache{static_cast<Cache::size_type>(
+                     2 * num_keys * (value_size + ENTRY_OVERHEAD)),
+                 0.75f, evictor};
+}
+
+/// Set every key to a value of `value_size` bytes, failing the benchmark
+/// unless they all fit
+void fill(benchmark::State &state, Cache &cache,
+          const std::vector<key_type> &keys, Cache::size_type value_size) {
+    const std::string value(value_size, 'x');
+    for (const auto &key : keys) {
+        cache.set(key, value.data(), value_size);
+    }
+    if (cache.space_used() != keys.size() * value_size) {
+        state.SkipWithError("the keys did not all fit in the cache");
+    }
+}
+
+/// Make an evictor of type `E` (nullptr for `void`, i.e. no evictor)
+template <typename E> std::unique_ptr<Evictor> make_evictor() {
+    if constexpr (std::is_void_v<E>) {
+        return nullptr;
+    } else {
+        return std::make_unique<E>();
+    }
+}
+
+////////////////////////////////////////////////
+// Cache library
+////////////////////////////////////////////////
+
+/// Cache::set() of `range(0)` keys with `range(1)`-byte values in random
+/// order. Without an evictor every key fits, so the sets replace values;
+/// with one, the cache only has room for a quarter of the keys, so most sets
+/// evict another entry.
+template <typename E> void BM_CacheSet(benchmark::State &state) {
+    const auto num_keys = static_cast<std::size_t>(state.range(0));
+    const auto value_size = static_cast<Cache::size_type>(state.range(1));
+    const auto keys = make_keys(num_keys);
+    const auto order = make_order(keys, keys);
+    const std::string value(value_size, 'x');
+
+    auto evictor = make_evictor<E>();
+    auto cache = make_cache(evictor ? num_keys / 8 : num_keys, value_size,
+                            evictor.get());
+    for (const auto &key : keys) {
+        cache.set(key, value.data(), value_size);
+    }
+
+    std::size_t i = 0;
+    for (auto _ : state) {
+        cache.set(*order[i++ & (ORDER_SIZE - 1)], value.data(), value_size);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * value_size);
+}
+BENCHMARK_TEMPLATE(BM_CacheSet, void)
+    ->ArgsProduct({{1 << 10, 1 << 16}, {16, 1024}});
+BENCHMARK_TEMPLATE(BM_CacheSet, FifoEvictor)
+    ->ArgsProduct({{1 << 10, 1 << 16}, {16, 1024}});
+BENCHMARK_TEMPLATE(BM_CacheSet, LruEvictor)
+    ->ArgsProduct({{1 << 10, 1 << 16}, {16, 1024}});
+
+/// Cache::get() of `range(0)` keys with `range(1)`-byte values, of which
+/// `range(2)`% are found (the others are keys that were never set)
+template <typename E> void BM_CacheGet(benchmark::State &state) {
+    const auto num_keys = static_cast<std::size_t>(state.range(0));
+    const auto value_size = static_cast<Cache::size_type>(state.range(1));
+    const auto hit_percent = static_cast<unsigned>(state.range(2));
+    const auto keys = make_keys(num_keys);
+    const auto misses = make_keys(num_keys, "miss");
+    const auto order = make_order(keys, misses, hit_percent);
+
+    auto evictor = make_evictor<E>();
+    auto cache = make_cache(num_keys, value_size, evictor.get());
+    fill(state, cache, keys, value_size);
+
+    Cache::size_type size;
+    std::size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(
+            cache.get(*order[i++ & (ORDER_SIZE - 1)], size));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_CacheGet, void)
+    ->ArgsProduct({{1 << 10, 1 << 16}, {16, 1024}, {0, 50, 100}});
+BENCHMARK_TEMPLATE(BM_CacheGet, LruEvictor)
+    ->ArgsProduct({{1 << 10, 1 << 16}, {16}, {0, 50, 100}});
+
+/// Cache::del() of every one of `range(0)` keys in turn; the cache is
+/// refilled (untimed) whenever it is empty
+template <typename E> void BM_CacheDel(benchmark::State &state) {
+    constexpr Cache::size_type VALUE_SIZE = 16;
+    const auto num_keys = static_cast<std::size_t>(state.range(0));
+    const auto keys = make_keys(num_keys);
+
+    auto evictor = make_evictor<E>();
+    auto cache = make_cache(num_keys, VALUE_SIZE, evictor.get());
+    fill(state, cache, keys, VALUE_SIZE);
+
+    std::size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(cache.del(keys[i]));
+        if (++i == num_keys) {
+            state.PauseTiming();
+            fill(state, cache, keys, VALUE_SIZE);
+            i = 0;
+            state.ResumeTiming();
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_CacheDel, void)->Arg(1 << 10)->Arg(1 << 16);
+BENCHMARK_TEMPLATE(BM_CacheDel, FifoEvictor)->Arg(1 << 10)->Arg(1 << 16);
+
+////////////////////////////////////////////////
+// Shared cache (several threads)
+////////////////////////////////////////////////
+
+/// Cache shared by the threads of a `BM_Shared*` benchmark (set up and torn
+/// down by its first thread, outside of the timed loop, which every thread
+/// starts and ends together)
+std::unique_ptr<SharedCache> shared_cache;
+
+/// Number of keys in the shared cache, and size of their values
+constexpr std::size_t SHARED_KEYS = 1 << 16;
+constexpr Cache::size_type SHARED_VALUE_SIZE = 64;
+
+/// Set up the shared cache with `shards` shards and every key set
+void set_up_shared(const std::vector<key_type> &keys, unsigned shards) {
+    shared_cache = std::make_unique<SharedCache>(
+        static_cast<Cache::size_type>(SHARED_KEYS * SHARED_VALUE_SIZE * 2),
+        shards, [] { return std::make_unique<LruEvictor>(); });
+    const std::string value(SHARED_VALUE_SIZE, 'x');
+    for (const auto &key : keys) {
+        shared_cache->set(key, value);
+    }
+}
+
+/// SharedCache::get_pinned() of keys that are all present, on every thread,
+/// with `range(0)` shards
+void BM_SharedGet(benchmark::State &state) {
+    const auto keys = make_keys(SHARED_KEYS);
+    if (state.thread_index() == 0) {
+        set_up_shared(keys, static_cast<unsigned>(state.range(0)));
+    }
+    // Each thread reads the keys in an order of its own
+    const auto order = make_order(keys, keys);
+    std::size_t i = state.thread_index() * (ORDER_SIZE / 8);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(
+            shared_cache->get_pinned(*order[i++ & (ORDER_SIZE - 1)]));
+    }
+    state.SetItemsProcessed(state.iterations());
+    if (state.thread_index() == 0) {
+        shared_cache = nullptr;
+    }
+}
+BENCHMARK(BM_SharedGet)
+    ->Arg(1)
+    ->Arg(8)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+/// SharedCache::set() of keys that are all present, on every thread, with
+/// `range(0)` shards
+void BM_SharedSet(benchmark::State &state) {
+    const auto keys = make_keys(SHARED_KEYS);
+    if (state.thread_index() == 0) {
+        set_up_shared(keys, static_cast<unsigned>(state.range(0)));
+    }
+    const auto order = make_order(keys, keys);
+    const std::string value(SHARED_VALUE_SIZE, 'y');
+    std::size_t i = state.thread_index() * (ORDER_SIZE / 8);
+
+    for (auto _ : state) {
+        shared_cache->set(*order[i++ & (ORDER_SIZE - 1)], value);
+    }
+    state.SetItemsProcessed(state.iterations());
+    if (state.thread_index() == 0) {
+        shared_cache = nullptr;
+    }
+}
+BENCHMARK(BM_SharedSet)
+    ->Arg(1)
+    ->Arg(8)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+////////////////////////////////////////////////
+// Evictors
+////////////////////////////////////////////////
+
+/// Evictor::touch_key() of `range(0)` keys that the evictor already knows,
+/// in random order
+template <typename E> void BM_EvictorTouch(benchmark::State &state) {
+    const auto keys = make_keys(state.range(0));
+    const auto order = make_order(keys, keys);
+    E evictor;
+    for (const auto &key : keys) {
+        evictor.touch_key(key);
+    }
+
+    std::size_t i = 0;
+    for (auto _ : state) {
+        evictor.touch_key(*order[i++ & (ORDER_SIZE - 1)]);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_EvictorTouch, FifoEvictor)
+    ->Arg(1 << 10)
+    ->Arg(1 << 16)
+    ->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_EvictorTouch, LruEvictor)
+    ->Arg(1 << 10)
+    ->Arg(1 << 16)
+    ->Arg(1 << 20);
+
+/// Evictor::evict() from an evictor that knows `range(0)` keys, followed by
+/// touching the evicted key again so that the number of keys stays the same
+/// (as when a full cache evicts an entry to make room for another)
+template <typename E> void BM_EvictorEvict(benchmark::State &state) {
+    const auto keys = make_keys(state.range(0));
+    E evictor;
+    for (const auto &key : keys) {
+        evictor.touch_key(key);
+    }
+
+    for (auto _ : state) {
+        evictor.touch_key(evictor.evict());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_EvictorEvict, FifoEvictor)
+    ->Arg(1 << 10)
+    ->Arg(1 << 16)
+    ->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_EvictorEvict, LruEvictor)
+    ->Arg(1 << 10)
+    ->Arg(1 << 16)
+    ->Arg(1 << 20);
+
+BENCHMARK_MAIN();
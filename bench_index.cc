@@ -0,0 +1,98 @@
+#include "cache.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+/// Numbers of keys to benchmark with
+constexpr unsigned NUM_KEYS[] = {1 << 10, 1 << 14, 1 << 18, 1 << 20};
+
+/// Number of lookups to time for each measurement
+constexpr auto NUM_LOOKUPS = 1 << 22; // ~4M
+
+/// Size of each value in bytes
+constexpr Cache::size_type VALUE_SIZE = 16;
+
+/// Memory to allow per entry beyond its value (enough for a compact index,
+/// which counts each entry's header, key and slot against maxmem)
+constexpr Cache::size_type ENTRY_OVERHEAD = 64;
+
+/// Name of an index type, as given to `cache_server --index`
+const char *index_name(Cache::IndexType index) {
+    switch (index) {
+    case Cache::IndexType::CHAINED:
+        return "chained";
+    case Cache::IndexType::FLAT:
+        return "flat";
+    case Cache::IndexType::COMPACT:
+        return "compact";
+    }
+    __builtin_unreachable();
+}
+
+/// Time `NUM_LOOKUPS` GETs of the given keys and return the mean time per
+/// lookup in nanoseconds
+double time_lookups(const Cache &cache, const std::vector<key_type> &keys) {
+    std::mt19937 random{42};
+    std::uniform_int_distribution<std::size_t> dist{0, keys.size() - 1};
+    // Choose the keys ahead of time so that only the lookups are timed
+    std::vector<const key_type *> order(NUM_LOOKUPS);
+    for (auto &key : order) {
+        key = &keys[dist(random)];
+    }
+
+    Cache::size_type size;
+    std::size_t found = 0;
+    const auto t0 = std::chrono::steady_clock::now();
+    for (const auto key : order) {
+        found += cache.peek(*key, size) != nullptr;
+    }
+    const auto tf = std::chrono::steady_clock::now();
+    // Make sure the lookups cannot be optimized away
+    if (found > NUM_LOOKUPS) {
+        std::cerr << "impossible" << std::endl;
+    }
+    return std::chrono::duration<double, std::nano>(tf - t0).count() /
+           NUM_LOOKUPS;
+}
+
+int main() {
+    std::cout << "# Mean GET lookup time per index type (" << NUM_LOOKUPS
+              << " lookups per measurement)" << std::endl;
+    std::cout << "#     Keys  Index    Hit (ns/op)  Miss (ns/op)" << std::endl;
+
+    const std::string value(VALUE_SIZE, 'a');
+    for (const auto num_keys : NUM_KEYS) {
+        // Generate the keys that are present and keys that are not
+        std::vector<key_type> hit_keys, miss_keys;
+        for (auto i = 0U; i < num_keys; ++i) {
+            hit_keys.push_back(std::to_string(i));
+            miss_keys.push_back(std::to_string(i) + "-miss");
+        }
+
+        for (const auto index :
+             {Cache::IndexType::CHAINED, Cache::IndexType::FLAT,
+              Cache::IndexType::COMPACT}) {
+            Cache cache{num_keys * (VALUE_SIZE + ENTRY_OVERHEAD), 0.75f,
+                        nullptr, std::hash<key_type>(), index};
+            for (const auto &key : hit_keys) {
+                cache.set(key, value.c_str(), VALUE_SIZE);
+            }
+
+            const auto hit_time = time_lookups(cache, hit_keys);
+            const auto miss_time = time_lookups(cache, miss_keys);
+
+            std::cout << "  " << std::setw(7) << std::right << num_keys
+                      << "  " << std::setw(7) << std::left
+                      << index_name(index) << "  " << std::setw(11)
+                      << std::fixed
+                      << std::setprecision(1) << hit_time << "  "
+                      << miss_time << std::resetiosflags(std::cout.flags())
+                      << std::endl;
+        }
+    }
+}
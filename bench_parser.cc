@@ -0,0 +1,94 @@
+#include "request_parser.hh"
+
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <regex>
+#include <string>
+#include <vector>
+
+/// Number of times to parse each input per measurement
+constexpr auto NUM_PARSES = 1 << 20; // ~1M
+
+/// Regular expressions previously used by the server and client
+const std::regex KEY_RE{R"(/([A-Za-z0-9\._-]+))"};
+const std::regex KEY_VALUE_RE{R"(/([A-Za-z0-9\._-]+)/([A-Za-z0-9\._-]+))"};
+const std::regex KEY_VALUE_JSON_RE{
+    R"re(\{\s*"key"\s*:\s*"([A-Za-z0-9\._-]+)"\s*,\s*)re"
+    R"re("value"\s*:\s*"([A-Za-z0-9\._-]+)"\}\s*)re"};
+
+/// Time `NUM_PARSES` calls of `parse` and return the mean time per call in
+/// nanoseconds (`parse` returns a size so that the work is not optimized
+/// away)
+double time_parses(const std::function<std::size_t()> &parse) {
+    std::size_t total = 0;
+    const auto t0 = std::chrono::steady_clock::now();
+    for (auto i = 0; i < NUM_PARSES; ++i) {
+        total += parse();
+    }
+    const auto tf = std::chrono::steady_clock::now();
+    if (total == 0) {
+        std::cerr << "nothing was parsed" << std::endl;
+    }
+    return std::chrono::duration<double, std::nano>(tf - t0).count() /
+           NUM_PARSES;
+}
+
+/// Print a row of the results table
+void print_row(const std::string &input, double regex_time,
+               double parser_time) {
+    std::cout << "  " << std::setw(12) << std::left << input << "  "
+              << std::setw(13) << std::right << std::fixed
+              << std::setprecision(1) << regex_time << "  " << std::setw(14)
+              << parser_time << "  " << std::setw(7) << regex_time / parser_time
+              << "x" << std::resetiosflags(std::cout.flags()) << std::endl;
+}
+
+int main() {
+    // The same shape of inputs as the server and client see: GET and DELETE
+    // targets, PUT targets and GET response bodies
+    const std::string key(8, 'k');
+    const std::string value(16, 'v');
+    const std::string key_target = "/" + key;
+    const std::string key_value_target = "/" + key + "/" + value;
+    const std::string body =
+        R"({"key":")" + key + R"(","value":")" + value + R"("})";
+
+    std::cout << "# Mean time per parse of request targets and GET response "
+                 "bodies ("
+              << NUM_PARSES << " parses per measurement)" << std::endl;
+    std::cout << "# Input         Regex (ns/op)  Parser (ns/op)  Speedup"
+              << std::endl;
+
+    print_row("/key",
+              time_parses([&] {
+                  // The server used to copy the target into a string first
+                  std::smatch match;
+                  const auto target = key_target;
+                  std::regex_match(target, match, KEY_RE);
+                  return match[1].str().size();
+              }),
+              time_parses(
+                  [&] { return parse_key_target(key_target)->size(); }));
+    print_row("/key/value",
+              time_parses([&] {
+                  std::smatch match;
+                  const auto target = key_value_target;
+                  std::regex_match(target, match, KEY_VALUE_RE);
+                  return match[1].str().size() + match[2].str().size();
+              }),
+              time_parses([&] {
+                  const auto kv_pair = parse_key_value_target(key_value_target);
+                  return kv_pair->first.size() + kv_pair->second.size();
+              }));
+    print_row("JSON body",
+              time_parses([&] {
+                  std::smatch match;
+                  std::regex_search(body, match, KEY_VALUE_JSON_RE);
+                  return match[2].str().size();
+              }),
+              time_parses([&] {
+                  return parse_key_value_json(body)->second.size();
+              }));
+}
@@ -0,0 +1,231 @@
+/*
+ * Compact binary protocol spoken by cache_server on its binary port.
+ *
+ * Every request and response is a frame made up of a fixed-size header (see
+ * `FrameHeader`) followed by the key and then the value. All integers are
+ * big-endian. A client may send any number of requests before reading the
+ * responses; the server answers them in order, and echoes each request's
+ * `opaque` value so that the responses can also be matched up explicitly.
+ */
+
+#ifndef BINARY_PROTOCOL_HH
+#define BINARY_PROTOCOL_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace binary_protocol {
+
+// First byte of every request and response frame
+constexpr uint8_t REQUEST_MAGIC = 0x80;
+constexpr uint8_t RESPONSE_MAGIC = 0x81;
+
+// Size of the encoded header in bytes
+constexpr std::size_t HEADER_SIZE = 16;
+
+// Largest value the server accepts (larger frames close the connection)
+constexpr uint32_t MAX_VALUE_SIZE = 64 << 20; // 64MiB
+
+// Largest key that fits in a frame or batch item (its size is 2 bytes)
+constexpr std::size_t MAX_KEY_SIZE = UINT16_MAX;
+
+enum class Opcode : uint8_t {
+    // Get the value of the key (the response carries the value)
+    GET = 0x00,
+    // Set the key to the value
+    SET = 0x01,
+    // Set the key to the value with a TTL: the value starts with the TTL in
+    // milliseconds as a 4-byte integer, followed by the value to set
+    SET_TTL = 0x02,
+    // Delete the key
+    DEL = 0x04,
+    // Get the space used by the cache (the response carries it as a 4-byte
+    // value; the request has no key)
+    SPACE_USED = 0x10,
+    // Delete every entry (the request has no key)
+    RESET = 0x11,
+    // Get the server's statistics (the response carries them as a JSON
+    // object, the same one `POST /stats` returns; the request has no key)
+    STATS = 0x12,
+    // Batch versions of GET, SET and DEL: the request has no key, and its
+    // value is a batch body (see `BatchReader`) of keys (MGET and MDEL) or
+    // entries (MSET). An MGET response carries a result for each key, and
+    // an MDEL response carries the number of keys deleted as a 4-byte value.
+    MGET = 0x20,
+    MSET = 0x21,
+    MDEL = 0x22,
+};
+
+enum class Status : uint8_t {
+    OK = 0x00,
+    // The key was not in the cache (GET and DEL only)
+    NOT_FOUND = 0x01,
+    // The request was malformed (unknown opcode, missing key, etc.)
+    INVALID = 0x02,
+};
+
+// Header of a frame; encoded as
+//   magic (1) | opcode (1) | key_size (2) | status (1) | reserved (3) |
+//   value_size (4) | opaque (4)
+struct FrameHeader {
+    uint8_t magic;
+    Opcode opcode;
+    uint16_t key_size;
+    // Status of a response (always OK in requests)
+    Status status;
+    uint32_t value_size;
+    // Chosen by the client and copied into the response
+    uint32_t opaque;
+
+    // Size of the key and value following the header
+    std::size_t body_size() const {
+        return std::size_t{key_size} + value_size;
+    }
+};
+
+inline void encode_u16(char *out, uint16_t value) {
+    out[0] = static_cast<char>(value >> 8);
+    out[1] = static_cast<char>(value);
+}
+
+inline void encode_u32(char *out, uint32_t value) {
+    out[0] = static_cast<char>(value >> 24);
+    out[1] = static_cast<char>(value >> 16);
+    out[2] = static_cast<char>(value >> 8);
+    out[3] = static_cast<char>(value);
+}
+
+inline uint16_t decode_u16(const char *in) {
+    const auto bytes = reinterpret_cast<const unsigned char *>(in);
+    return static_cast<uint16_t>(bytes[0] << 8 | bytes[1]);
+}
+
+inline uint32_t decode_u32(const char *in) {
+    const auto bytes = reinterpret_cast<const unsigned char *>(in);
+    return uint32_t{bytes[0]} << 24 | uint32_t{bytes[1]} << 16 |
+           uint32_t{bytes[2]} << 8 | uint32_t{bytes[3]};
+}
+
+// Get the size of a key to encode, throwing `std::invalid_argument` if it is
+// too long (rather than truncating it, which would desynchronize the stream)
+inline uint16_t key_size(std::string_view key) {
+    if (key.size() > MAX_KEY_SIZE) {
+        throw std::invalid_argument{"key is too long"};
+    }
+    return static_cast<uint16_t>(key.size());
+}
+
+// Write the encoded header to `out` (which must have room for
+// `HEADER_SIZE` bytes)
+inline void encode_header(char *out, const FrameHeader &header) {
+    out[0] = static_cast<char>(header.magic);
+    out[1] = static_cast<char>(header.opcode);
+    encode_u16(out + 2, header.key_size);
+    out[4] = static_cast<char>(header.status);
+    out[5] = out[6] = out[7] = 0;
+    encode_u32(out + 8, header.value_size);
+    encode_u32(out + 12, header.opaque);
+}
+
+// Read a header from `in` (which must hold at least `HEADER_SIZE` bytes)
+inline FrameHeader decode_header(const char *in) {
+    return FrameHeader{static_cast<uint8_t>(in[0]),
+                       static_cast<Opcode>(in[1]),
+                       decode_u16(in + 2),
+                       static_cast<Status>(in[4]),
+                       decode_u32(in + 8),
+                       decode_u32(in + 12)};
+}
+
+// Append a complete frame to `out`
+inline void append_frame(std::string &out, uint8_t magic, Opcode opcode,
+                         Status status, uint32_t opaque, std::string_view key,
+                         std::string_view value) {
+    char header[HEADER_SIZE];
+    encode_header(header, FrameHeader{magic, opcode, key_size(key), status,
+                                      static_cast<uint32_t>(value.size()),
+                                      opaque});
+    out.append(header, HEADER_SIZE);
+    out.append(key);
+    out.append(value);
+}
+
+// Append a key to a batch body, encoded as
+//   key_size (2) | key
+inline void append_batch_key(std::string &out, std::string_view key) {
+    char size[2];
+    encode_u16(size, key_size(key));
+    out.append(size, sizeof(size)).append(key);
+}
+
+// Append an entry to a batch body, encoded as
+//   key_size (2) | value_size (4) | key | value
+inline void append_batch_entry(std::string &out, std::string_view key,
+                               std::string_view value) {
+    char sizes[6];
+    encode_u16(sizes, key_size(key));
+    encode_u32(sizes + 2, static_cast<uint32_t>(value.size()));
+    out.append(sizes, sizeof(sizes)).append(key).append(value);
+}
+
+// Append the result of a GET to a batch body, encoded as
+//   status (1) | value_size (4) | value
+inline void append_batch_result(std::string &out, Status status,
+                                std::string_view value) {
+    char header[5];
+    header[0] = static_cast<char>(status);
+    encode_u32(header + 1, static_cast<uint32_t>(value.size()));
+    out.append(header, sizeof(header)).append(value);
+}
+
+// Reads the items of a batch body in order; each method returns false if the
+// body ends in the middle of an item
+class BatchReader {
+  private:
+    std::string_view body;
+
+    // Take the next `size` bytes of the body
+    bool take(std::size_t size, std::string_view &out) {
+        if (body.size() < size) {
+            return false;
+        }
+        out = body.substr(0, size);
+        body.remove_prefix(size);
+        return true;
+    }
+
+  public:
+    explicit BatchReader(std::string_view body) : body{body} {}
+
+    // Whether every item has been read
+    bool done() const {
+        return body.empty();
+    }
+
+    bool read_key(std::string_view &key) {
+        std::string_view size;
+        return take(2, size) && take(decode_u16(size.data()), key);
+    }
+
+    bool read_entry(std::string_view &key, std::string_view &value) {
+        std::string_view sizes;
+        return take(6, sizes) && take(decode_u16(sizes.data()), key) &&
+               take(decode_u32(sizes.data() + 2), value);
+    }
+
+    bool read_result(Status &status, std::string_view &value) {
+        std::string_view header;
+        if (!take(5, header)) {
+            return false;
+        }
+        status = static_cast<Status>(header[0]);
+        return take(decode_u32(header.data() + 1), value);
+    }
+};
+
+} // namespace binary_protocol
+
+#endif // BINARY_PROTOCOL_HH
@@ -4,10 +4,18 @@
 
 #pragma once
 
+#include "admission.hh"
 #include "evictor.hh"
+#include "slab_allocator.hh"
 
+#include <chrono>
 #include <functional>
+#include <future>
 #include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
 
 class Cache {
   private:
@@ -23,10 +31,37 @@ class Cache {
     using size_type = uint32_t;         // Internal indexing to K-V
                                         //               elements
 
+    // How long an entry lives before it expires (zero or less for entries
+    // that never expire)
+    using ttl_type = std::chrono::milliseconds;
+
     // A function that takes a key and returns an index to the
     // internal data
     using hash_func = std::function<std::size_t(key_type)>;
 
+    // Hash table implementations the cache library can use for its entries
+    enum class IndexType {
+        // std::unordered_map (separate chaining, one node per entry)
+        CHAINED,
+        // Open addressing with groups of control bytes (see cache_index.hh)
+        FLAT,
+        // Like FLAT, but each slot only points to its entry, whose key is
+        // stored once, in the same chunk as its value; space_used() and
+        // maxmem then count each entry's whole chunk (rounded up to its slab
+        // size class) and its index slot, not just its value
+        COMPACT,
+    };
+
+    // Protocols the networked client can use to talk to the server
+    enum class Protocol {
+        // HTTP requests with the key in the target and the value as raw
+        // bytes in the body
+        HTTP,
+        // Length-prefixed binary frames (see binary_protocol.hh); the server
+        // must have been started with `--binary-port`
+        BINARY,
+    };
+
     // There are two possible constructors, one for a cache object (library),
     // that initializes the actual cache store, and another for a client
     // that simply accesses the Cache store over the network. The two
@@ -39,11 +74,59 @@ class Cache {
     //    evictor: Eviction policy implementation (if nullptr, no evictions
     //    occur 	and new insertions fail after maxmem has been exceeded). hasher:
     //    Hash function to use on the keys. Defaults to C++'s std::hash.
+    //    index: Hash table implementation to use for the entries.
+    //    admission: Admission policy consulted before evicting an entry to
+    //    make space for a new key (if nullptr, new keys are always added).
     Cache(size_type maxmem, float max_load_factor = 0.75,
-          Evictor *evictor = nullptr, hash_func hasher = std::hash<key_type>());
+          Evictor *evictor = nullptr, hash_func hasher = std::hash<key_type>(),
+          IndexType index = IndexType::CHAINED,
+          Admission *admission = nullptr);
 
     // Create a new Cache networked client with a given host and port.
-    Cache(std::string host, std::string port);
+    Cache(std::string host, std::string port,
+          Protocol protocol = Protocol::HTTP);
+
+    // Address of a server in a cluster
+    struct Server {
+        std::string host;
+        std::string port;
+    };
+
+    // Create a new Cache networked client for a cluster of servers, which
+    // stores each key on `replicas` of them, chosen by consistent hashing
+    // (see hash_ring.hh), so adding or removing a server only moves the
+    // keys it gains or loses. Writes go to every replica of a key, and reads
+    // to the first replica that can be reached; a server that cannot be
+    // reached is skipped for a second before it is tried again. Batch and
+    // pipelined requests are sent to every server involved before any
+    // response is read, so the servers work on them in parallel.
+    // space_used() sums over the servers, so it counts each replica.
+    Cache(const std::vector<Server> &servers,
+          Protocol protocol = Protocol::HTTP, unsigned replicas = 1);
+
+    // Function that creates a networked client (for one server or a cluster)
+    using client_factory = std::function<std::unique_ptr<Cache>()>;
+
+    // Create a new thread-safe networked client, which shares up to
+    // `max_clients` clients created by `make_client` (as they are first
+    // needed) between the threads that use it. Each thread is assigned the
+    // client used by the fewest threads the first time it makes a request,
+    // and then sends every request over that client (waiting while another
+    // thread uses it), so its pipelined requests still complete in order.
+    // get() and mget() return pointers into buffers of the calling thread,
+    // valid until its next call to either. A client whose connection fails
+    // is replaced with a new one when it is next needed.
+    Cache(client_factory make_client, unsigned max_clients);
+
+    // Create a new networked client that sends requests through `client`,
+    // but keeps the values it reads in a near cache of up to `maxmem` bytes
+    // (see near_cache.hh), so repeated GETs of hot keys are served without a
+    // round trip. Each value is kept for at most `ttl`, which bounds how
+    // stale it can be when other clients change it; keys set or deleted
+    // through this client are removed from the near cache right away. Safe
+    // to share between threads if `client` is (get() and mget() then return
+    // pointers into buffers of the calling thread).
+    Cache(std::unique_ptr<Cache> client, size_type maxmem, ttl_type ttl);
 
     ~Cache();
 
@@ -57,19 +140,160 @@ class Cache {
     // copied). If maxmem capacity is exceeded, enough values will be removed
     // From the cache to accomodate the new value. If unable, the new value
     // isn't inserted to the cache.
-    void set(key_type key, val_type val, size_type size);
+    // If ttl is positive, the entry expires once that much time has passed:
+    // get() stops returning it right away, and its memory is reclaimed by
+    // expire() or by a later set() (before anything is evicted).
+    void set(key_type key, val_type val, size_type size,
+             ttl_type ttl = ttl_type::zero());
 
     // Retrieve a pointer to the value associated with key in the cache, or
     // nullptr if not found.
     // Sets the actual size of the returned value (in bytes) in val_size.
     val_type get(key_type key, size_type &val_size) const;
 
+    // Like get(), but does not inform the evictor that the key was accessed,
+    // so it is safe to call concurrently with other const methods.
+    // (Only available for the cache library)
+    val_type peek(key_type key, size_type &val_size) const;
+
+    // Inform the evictor that key was accessed, if it is still in the cache
+    // (the admission policy is informed either way).
+    // Used along with peek() to apply recency updates later, in bulk.
+    // (Only available for the cache library)
+    void touch(key_type key);
+
     // Delete an object from the cache, if it's still there
     bool del(key_type key);
 
+    // Pin a value just returned by get() or peek() (before the cache is next
+    // modified), so that it stays valid and unchanged even if its entry is
+    // replaced, deleted or evicted, until it is passed to unpin(). The memory
+    // of an entry removed while pinned is only reused after that. Pinning is
+    // safe to call concurrently with other const methods, and unpin() with
+    // any method; every pin must be released before the cache is destroyed.
+    // (Only available for the cache library)
+    void pin(val_type val) const;
+    void unpin(val_type val) const;
+
+    // A <key, value> pair for mset(), with the value given as for set()
+    struct KeyValue {
+        key_type key;
+        val_type val;
+        size_type size;
+    };
+
+    // Batch versions of set(), get() and del(), equivalent to calling them
+    // on each key in order, but with a single request for the networked
+    // client.
+    void mset(const std::vector<KeyValue> &entries);
+
+    // Retrieve pointers to the values associated with each key (nullptr for
+    // keys that are not found), setting their sizes in val_sizes. The
+    // pointers are valid until the cache is next modified (for the cache
+    // library) or until the next call to get() or mget() (for the networked
+    // client).
+    std::vector<val_type> mget(const std::vector<key_type> &keys,
+                               std::vector<size_type> &val_sizes) const;
+
+    // Delete each key that is in the cache, and return how many there were
+    size_type mdel(const std::vector<key_type> &keys);
+
     // Compute the total amount of memory used up by all cache values (not keys)
+    // (including expired values that have not been reclaimed yet)
     size_type space_used() const;
 
-    // Delete all data from the cache
+    // Remove every entry whose TTL has passed, and return how many there were.
+    // Only the entries that have come due are visited, so this is cheap to
+    // call periodically. (Only available for the cache library)
+    size_type expire();
+
+    // Call fn(key, val, size, ttl) on every entry that has not expired, in
+    // the order the evictor would evict them (or in no particular order if
+    // it does not report one), where ttl is the time the entry has left to
+    // live (zero if it never expires). fn must not modify the cache; like
+    // peek(), this is safe to call concurrently with other const methods.
+    // (Only available for the cache library)
+    using entry_visitor = std::function<void(
+        std::string_view key, val_type val, size_type size, ttl_type ttl)>;
+    void for_each(const entry_visitor &fn) const;
+
+    // Delete all data from the cache (the library frees a large index on
+    // another thread, so this does not take time proportional to the number
+    // of entries unless some are pinned)
     void reset();
+
+    // Compute the total amount of memory reserved for values, including
+    // allocator overhead (only available for the cache library)
+    size_type space_reserved() const;
+
+    // Get usage statistics for each of the value allocator's size classes
+    // (only available for the cache library)
+    std::vector<SlabAllocator::ClassStats> slab_stats() const;
+
+    // Number of entries evicted to make room for others since the cache was
+    // created (not reset by reset(); only available for the cache library)
+    uint64_t evictions() const;
+
+    // Pipelined versions of set(), get() and del(): the request is sent right
+    // away, and its response is read when the returned future is waited on
+    // (after the responses to every request sent before it), so several
+    // requests can be in flight on the connection at once. The futures must
+    // not be used after the Cache is destroyed. get_async() returns the bytes
+    // of the value exactly as they were set. Other methods wait for every
+    // pipelined request to complete first.
+    // (Only available for the networked client)
+    std::future<void> set_async(key_type key, val_type val, size_type size,
+                                ttl_type ttl = ttl_type::zero());
+    std::future<std::optional<std::string>> get_async(key_type key) const;
+    std::future<bool> del_async(key_type key);
+
+    // Pipelined versions of mset(), mget() and mdel(), which work the same
+    // way. mget_async() returns the values (or std::nullopt for keys that
+    // are not found) instead of pointers to them.
+    // (Only available for the networked client)
+    std::future<void> mset_async(const std::vector<KeyValue> &entries);
+    std::future<std::vector<std::optional<std::string>>>
+    mget_async(const std::vector<key_type> &keys) const;
+    std::future<size_type> mdel_async(const std::vector<key_type> &keys);
+
+    // Function that loads a key's value from the backing store for
+    // get_or_compute(), returning std::nullopt if there is none
+    using loader = std::function<std::optional<std::string>(key_type key)>;
+
+    // Get a key's value, or on a miss load it with `load` and set it with
+    // `ttl`. Concurrent misses are coalesced: while one thread of this
+    // process loads a key through this client, other threads that miss it
+    // wait for that value instead of loading and setting it too (and get the
+    // exception if `load` throws). Returns the bytes of the value exactly as
+    // they were set, or std::nullopt if `load` found none (in which case
+    // nothing is set). With a positive `refresh_after`, a hit on a key that
+    // this client loaded longer ago than that is returned right away and
+    // reloaded on another thread (stale-while-revalidate), so the client
+    // must then be safe to share between threads (a pool, or a near cache in
+    // front of one), or std::invalid_argument is thrown; a failed reload is
+    // retried `refresh_after` later, and a key with no hits for
+    // `refresh_after` may be forgotten, so that it is only loaded again on a
+    // miss.
+    // (Only available for the networked client)
+    std::optional<std::string>
+    get_or_compute(key_type key, const loader &load,
+                   ttl_type ttl = ttl_type::zero(),
+                   ttl_type refresh_after = ttl_type::zero());
+
+    // Numbers of keys read by GETs (including batches) that were found in
+    // the near cache, and that had to be read from the server
+    struct NearCacheStats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+
+    // Get the near cache's statistics (zero for clients without one). Pools
+    // add up the statistics of their clients.
+    // (Only available for the networked client)
+    NearCacheStats near_cache_stats() const;
+
+    // Get the server's statistics as a JSON object (see the README); a
+    // cluster returns a JSON array with an object for each node (null for
+    // nodes that are down). (Only available for the networked client)
+    std::string server_stats() const;
 };
@@ -1,27 +1,462 @@
+#include "binary_protocol.hh"
 #include "cache.hh"
+#include "hash_ring.hh"
+#include "near_cache.hh"
+#include "single_flight.hh"
 
 #include <boost/asio/connect.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/write.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/beast/version.hpp>
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cstdlib>
+#include <deque>
+#include <functional>
 #include <iostream>
-#include <regex>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
 
 namespace beast = boost::beast; // from <boost/beast.hpp>
 namespace http = beast::http;   // from <boost/beast/http.hpp>
 namespace net = boost::asio;    // from <boost/asio.hpp>
 using tcp = net::ip::tcp;       // from <boost/asio/ip/tcp.hpp>
 
-/// Regular expression for parsing JSON responses
-const std::regex KEY_VALUE_JSON_RE{"\\{\\s*\"key\"\\s*:\\s*\"([A-Za-z0-9\\._-]+"
-                                   ")\"\\s*,\\s*\"value\"\\s*:\\s*\"([A-"
-                                   "Za-z0-9\\._-]+)\"\\}\\s*"};
+namespace {
 
+// Media type of raw values in request and response bodies
+constexpr auto OCTET_STREAM = "application/octet-stream";
+
+// Encode the entries of a batch SET request (as in the binary protocol)
+std::string encode_batch_entries(const std::vector<Cache::KeyValue> &entries) {
+    std::string body;
+    for (const auto &entry : entries) {
+        binary_protocol::append_batch_entry(body, entry.key,
+                                            {entry.val, entry.size});
+    }
+    return body;
+}
+
+// Encode the keys of a batch GET or DELETE request (as in the binary
+// protocol)
+std::string encode_batch_keys(const std::vector<key_type> &keys) {
+    std::string body;
+    for (const auto &key : keys) {
+        binary_protocol::append_batch_key(body, key);
+    }
+    return body;
+}
+
+// Decode the result for each of `num_keys` keys from a batch response (encoded
+// as in the binary protocol), returning the values (std::nullopt for keys
+// that were not found)
+std::vector<std::optional<std::string>>
+read_batch_values(std::string_view response, std::size_t num_keys) {
+    binary_protocol::BatchReader reader{response};
+    std::vector<std::optional<std::string>> values(num_keys);
+    for (std::size_t i = 0; i < num_keys; ++i) {
+        binary_protocol::Status status;
+        std::string_view value;
+        if (!reader.read_result(status, value)) {
+            throw std::runtime_error{"server returned invalid response"};
+        }
+        if (status == binary_protocol::Status::OK) {
+            values[i].emplace(value);
+        }
+    }
+    return values;
+}
+
+// Move the values returned by a batch request into `values`; returns pointers
+// to them (nullptr for keys that were not found) and sets their sizes in
+// `val_sizes`
+std::vector<Cache::val_type>
+store_batch_values(std::vector<std::optional<std::string>> &&results,
+                   std::vector<std::string> &values,
+                   std::vector<Cache::size_type> &val_sizes) {
+    values.resize(results.size());
+    val_sizes.assign(results.size(), 0);
+    std::vector<Cache::val_type> pointers(results.size(), nullptr);
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        if (results[i]) {
+            values[i] = std::move(*results[i]);
+            pointers[i] = values[i].data();
+            val_sizes[i] = values[i].size();
+        }
+    }
+    return pointers;
+}
+
+// Buffers for the values returned by `get()` and `mget()`
+struct ValueBuffers {
+    // Last value which was returned by `get()`
+    std::string last_value;
+    // Last values which were returned by `mget()`
+    std::vector<std::string> last_values;
+};
+
+// States of the threads using a `PerThread`, which a thread releases its
+// state from when it exits
+class ThreadStates {
+  public:
+    virtual ~ThreadStates() = default;
+
+    // Release the state of a thread that is exiting
+    virtual void release(std::thread::id thread) = 0;
+};
+
+// Releases the calling thread's state from each `PerThread` it has used when
+// the thread exits (the ones destroyed before then are skipped)
+class ThreadExit {
+  private:
+    std::vector<std::weak_ptr<ThreadStates>> used;
+
+  public:
+    void add(std::weak_ptr<ThreadStates> states) {
+        used.erase(std::remove_if(used.begin(), used.end(),
+                                  [](const std::weak_ptr<ThreadStates> &used) {
+                                      return used.expired();
+                                  }),
+                   used.end());
+        used.push_back(std::move(states));
+    }
+
+    ~ThreadExit() {
+        for (const auto &weak : used) {
+            if (const auto states = weak.lock()) {
+                states->release(std::this_thread::get_id());
+            }
+        }
+    }
+};
+
+thread_local ThreadExit thread_exit;
+
+// State kept for each thread that uses a client shared between threads, which
+// is released when the thread exits
+template <typename State> class PerThread {
+  private:
+    class States final : public ThreadStates {
+      public:
+        std::mutex mutex;
+        std::unordered_map<std::thread::id, State> states;
+        // Called on a thread's state before it is released (guarded by
+        // `mutex`, and reset when the `PerThread` is destroyed)
+        std::function<void(State &)> on_release;
+
+        void release(std::thread::id thread) override {
+            std::lock_guard lock{mutex};
+            const auto state = states.find(thread);
+            if (state == states.end()) {
+                return;
+            }
+            if (on_release) {
+                on_release(state->second);
+            }
+            states.erase(state);
+        }
+    };
+
+    // Shared with the threads that have a state, so that it outlives this if
+    // one of them is exiting while this is being destroyed
+    const std::shared_ptr<States> states = std::make_shared<States>();
+
+  public:
+    explicit PerThread(std::function<void(State &)> on_release = nullptr) {
+        states->on_release = std::move(on_release);
+    }
+
+    ~PerThread() {
+        std::lock_guard lock{states->mutex};
+        states->on_release = nullptr;
+        states->states.clear();
+    }
+
+    PerThread(const PerThread &) = delete;
+    PerThread &operator=(const PerThread &) = delete;
+
+    // Get the calling thread's state, and whether it was just created
+    // (references to it stay valid until the thread exits, since elements
+    // of an unordered_map do not move)
+    std::pair<State &, bool> get() {
+        std::unique_lock lock{states->mutex};
+        auto [state, created] =
+            states->states.try_emplace(std::this_thread::get_id());
+        lock.unlock();
+        if (created) {
+            thread_exit.add(states);
+        }
+        return {state->second, created};
+    }
+};
+
+} // namespace
+
+// Interface implemented by the client for each protocol, along with the
+// bookkeeping for pipelined requests that they share
 class Cache::Impl {
+  private:
+    // Maximum number of pipelined requests waiting for a response; beyond
+    // this, the oldest response is read before sending another request, so
+    // that neither side can block forever on a full socket buffer
+    static constexpr std::size_t MAX_IN_FLIGHT = 128;
+
+    // Functions that read the response to each pipelined request and
+    // complete its future, in the order the requests were sent
+    mutable std::deque<std::function<void()>> pending;
+
+    // Read the response to the oldest pipelined request
+    void read_pending() const {
+        auto read_response = std::move(pending.front());
+        pending.pop_front();
+        read_response();
+    }
+
+  protected:
+    // Read the responses to every pipelined request (must be called before
+    // sending a request whose response will be read right away)
+    void drain() const {
+        while (!pending.empty()) {
+            read_pending();
+        }
+    }
+
+    // Make sure another pipelined request can be sent
+    void make_room() const {
+        if (pending.size() >= MAX_IN_FLIGHT) {
+            read_pending();
+        }
+    }
+
+    // Get a future for the result of a request that has just been sent, where
+    // `read_response` reads its response and returns the result. The response
+    // is read when the future is waited on, after the responses to every
+    // earlier request.
+    template <typename T>
+    std::future<T> enqueue(std::function<T()> read_response) const {
+        auto promise = std::make_shared<std::promise<T>>();
+        auto result = promise->get_future();
+        pending.push_back([promise, read_response = std::move(read_response)] {
+            try {
+                if constexpr (std::is_void_v<T>) {
+                    read_response();
+                    promise->set_value();
+                } else {
+                    promise->set_value(read_response());
+                }
+            } catch (...) {
+                promise->set_exception(std::current_exception());
+            }
+        });
+        return std::async(std::launch::deferred,
+                          [this, result = std::move(result)]() mutable {
+                              while (result.wait_for(std::chrono::seconds{0}) !=
+                                     std::future_status::ready) {
+                                  read_pending();
+                              }
+                              return result.get();
+                          });
+    }
+
+  private:
+    // Loads run by `get_or_compute()` on this client
+    SingleFlight flights;
+    // A key loaded by `get_or_compute()` with a `refresh_after`
+    struct Loaded {
+        // When it was last loaded (or reloaded)
+        std::chrono::steady_clock::time_point at;
+        // When it was last loaded or hit
+        std::chrono::steady_clock::time_point used;
+        ttl_type refresh_after;
+    };
+    // Minimum number of keys in `loaded` before it is swept
+    static constexpr std::size_t MIN_LOADED_SWEEP = 256;
+
+    // The keys loaded with a `refresh_after`, and the reloads running in the
+    // background; guarded by `refresh_mutex`
+    std::mutex refresh_mutex;
+    std::unordered_map<key_type, Loaded> loaded;
+    // Size of `loaded` at which it is next swept
+    std::size_t loaded_sweep_at = MIN_LOADED_SWEEP;
+    std::vector<std::future<void>> refreshes;
+
+    // Record that a key was just loaded, first dropping the keys that had no
+    // hit for a whole refresh window if `loaded` has grown enough since the
+    // last sweep (so that it stays bounded by the keys in use, at an
+    // amortized constant cost); `refresh_mutex` must be held
+    void record_load(const key_type &key, ttl_type refresh_after) {
+        const auto now = std::chrono::steady_clock::now();
+        if (loaded.size() >= loaded_sweep_at) {
+            for (auto entry = loaded.begin(); entry != loaded.end();) {
+                if (now - entry->second.used >= entry->second.refresh_after) {
+                    entry = loaded.erase(entry);
+                } else {
+                    ++entry;
+                }
+            }
+            loaded_sweep_at = std::max(MIN_LOADED_SWEEP, 2 * loaded.size());
+        }
+        loaded[key] = {now, now, refresh_after};
+    }
+
+    // Whether a key loaded by `get_or_compute()` is due to be reloaded, in
+    // which case it is marked as reloaded now so that only one hit starts
+    // its reload (keys this client did not load, or that were dropped for
+    // having no hits, are never reloaded)
+    bool start_refresh(const key_type &key, ttl_type refresh_after) {
+        const auto now = std::chrono::steady_clock::now();
+        std::lock_guard lock{refresh_mutex};
+        const auto entry = loaded.find(key);
+        if (entry == loaded.end()) {
+            return false;
+        }
+        entry->second.used = now;
+        if (now - entry->second.at < refresh_after) {
+            return false;
+        }
+        entry->second.at = now;
+        // Drop the reloads that have finished
+        refreshes.erase(
+            std::remove_if(refreshes.begin(), refreshes.end(),
+                           [](const std::future<void> &refresh) {
+                               return refresh.wait_for(std::chrono::seconds{
+                                          0}) == std::future_status::ready;
+                           }),
+            refreshes.end());
+        return true;
+    }
+
+  public:
+    virtual ~Impl() = default;
+
+    std::optional<std::string> get_or_compute(const key_type &key,
+                                              const loader &load,
+                                              ttl_type ttl,
+                                              ttl_type refresh_after) {
+        // Reloads run on other threads, which the client must allow
+        if (refresh_after > ttl_type::zero() && !thread_safe()) {
+            throw std::invalid_argument{"refresh_after needs a pooled client"};
+        }
+        // Load the value and set it (only run by the thread leading the
+        // key's flight)
+        const auto load_and_set = [this, &key, &load, ttl, refresh_after] {
+            auto value = load(key);
+            if (value) {
+                set(key, value->data(), static_cast<size_type>(value->size()),
+                    ttl);
+            }
+            if (refresh_after > ttl_type::zero()) {
+                std::lock_guard lock{refresh_mutex};
+                if (value) {
+                    record_load(key, refresh_after);
+                } else {
+                    loaded.erase(key);
+                }
+            }
+            return value;
+        };
+        auto value = get_async(key).get();
+        if (!value) {
+            return flights.run(key, load_and_set);
+        }
+        if (refresh_after > ttl_type::zero() && !flights.loading(key) &&
+            start_refresh(key, refresh_after)) {
+            // Reload in the background, keeping the stale value in the cache
+            // if that fails (the loader is copied, since the caller's may be
+            // gone by the time it runs)
+            auto refresh = std::async(
+                std::launch::async, [this, key, load, ttl, refresh_after] {
+                    try {
+                        flights.run_if_idle(key, [&] {
+                            auto fresh = load(key);
+                            if (fresh) {
+                                set(key, fresh->data(),
+                                    static_cast<size_type>(fresh->size()),
+                                    ttl);
+                            }
+                            return fresh;
+                        });
+                    } catch (...) {
+                    }
+                });
+            std::lock_guard lock{refresh_mutex};
+            refreshes.push_back(std::move(refresh));
+        }
+        return value;
+    }
+
+    // Wait for every background reload started by `get_or_compute()` (must be
+    // called before the client is destroyed, since they use it)
+    void finish_refreshes() {
+        std::vector<std::future<void>> running;
+        {
+            std::lock_guard lock{refresh_mutex};
+            running.swap(refreshes);
+        }
+        for (auto &refresh : running) {
+            refresh.wait();
+        }
+    }
+
+    virtual void set(const key_type &key, val_type val, size_type size,
+                     ttl_type ttl) = 0;
+    virtual val_type get(const key_type &key, size_type &val_size) const = 0;
+    virtual bool del(const key_type &key) = 0;
+    virtual void mset(const std::vector<KeyValue> &entries) = 0;
+    virtual std::vector<val_type>
+    mget(const std::vector<key_type> &keys,
+         std::vector<size_type> &val_sizes) const = 0;
+    virtual size_type mdel(const std::vector<key_type> &keys) = 0;
+    virtual size_type space_used() const = 0;
+    virtual void reset() = 0;
+
+    virtual std::future<void> set_async(const key_type &key, val_type val,
+                                        size_type size, ttl_type ttl) = 0;
+    virtual std::future<std::optional<std::string>>
+    get_async(const key_type &key) const = 0;
+    virtual std::future<bool> del_async(const key_type &key) = 0;
+    virtual std::future<void>
+    mset_async(const std::vector<KeyValue> &entries) = 0;
+    virtual std::future<std::vector<std::optional<std::string>>>
+    mget_async(const std::vector<key_type> &keys) const = 0;
+    virtual std::future<size_type>
+    mdel_async(const std::vector<key_type> &keys) = 0;
+
+    virtual NearCacheStats near_cache_stats() const {
+        return {};
+    }
+
+    // Whether the client can be shared between threads
+    virtual bool thread_safe() const {
+        return false;
+    }
+
+    virtual std::string server_stats() const = 0;
+
+    // Create a connection to a server using the given protocol
+    static std::unique_ptr<Impl> make_connection(Protocol protocol,
+                                                 const std::string &host,
+                                                 const std::string &port);
+
+    class Http;
+    class Binary;
+    class Cluster;
+    class Pool;
+    class Near;
+};
+
+class Cache::Impl::Http final : public Cache::Impl {
   private:
     std::string address;
     // I/O context; must persist through runtime
@@ -31,39 +466,53 @@ class Cache::Impl {
     mutable beast::flat_buffer buffer;
     // Last value which was returned by `get()`
     mutable std::string last_value;
+    // Last values which were returned by `mget()`
+    mutable std::vector<std::string> last_values;
 
-  public:
-    Impl(const std::string &address, const std::string &port)
-    : address{address}, stream{context} {
-        tcp::resolver resolver{context};
-        auto const results = resolver.resolve(address, port);
-        stream.connect(results);
-    }
-
-    ~Impl() {
-        beast::error_code error;
-        stream.socket().shutdown(tcp::socket::shutdown_both, error);
-    }
-
-    // Send an HTTP request with an empty body and the specified target
-    void send_request(const http::verb method,
-                      const std::string &target) const {
-        // Create a request with an empty body
-        http::request<http::empty_body> request;
+    // Make an HTTP request with the specified target, asking for values as
+    // raw bytes; a non-empty body is sent as raw bytes too (and is not
+    // copied, so it must outlive the request)
+    http::request<http::buffer_body> make_request(const http::verb method,
+                                                  const std::string &target,
+                                                  std::string_view body) const {
+        // Create a request
+        http::request<http::buffer_body> request;
         // Set the fields
         request.method(method);
         request.version(11);
         request.set(http::field::host, address);
         request.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
+        request.set(http::field::accept, OCTET_STREAM);
         request.target(target);
-        // Send the request
+        if (!body.empty() || method == http::verb::put) {
+            request.set(http::field::content_type, OCTET_STREAM);
+            request.content_length(body.size());
+        }
+        // Point the body at the bytes
+        request.body().data = const_cast<char *>(body.data());
+        request.body().size = body.size();
+        request.body().more = false;
+        return request;
+    }
+
+    // Send an HTTP request made by `make_request`
+    void send_request(const http::verb method, const std::string &target,
+                      std::string_view body = {}) const {
+        http::write(stream, make_request(method, target, body));
+    }
+
+    void send_set(const key_type &key, val_type val, size_type size,
+                  ttl_type ttl) const {
+        // Send a PUT request with the value as the body, and the TTL (if any)
+        // in the `TTL` field
+        auto request = make_request(http::verb::put, "/" + key, {val, size});
+        if (ttl > ttl_type::zero()) {
+            request.set("TTL", std::to_string(ttl.count()));
+        }
         http::write(stream, request);
     }
 
-    void set(key_type &key, val_type val, size_type size) {
-        // Send a PUT request
-        send_request(http::verb::put,
-                     "/" + key + "/" + std::string(val, size - 1));
+    void read_set_response() const {
         // Read the response
         http::response<http::string_body> response;
         http::read(stream, buffer, response);
@@ -73,41 +522,134 @@ class Cache::Impl {
         }
     }
 
-    val_type get(key_type &key, size_type &val_size) const {
-        // Send a GET request
-        send_request(http::verb::get, "/" + key);
+    // Read the response to a GET request into `value`; returns false if the
+    // value was not found
+    bool read_get_response(std::string &value) const {
         // Read the response
         http::response<http::string_body> response;
         http::read(stream, buffer, response);
         // Check whether the value was found
         if (response.result() != http::status::ok) {
-            return nullptr;
+            return false;
         }
-        // Parse the response
-        std::smatch match;
-        if (!std::regex_search(response.body(), match, KEY_VALUE_JSON_RE)) {
-            throw std::runtime_error{"unable to parse response"};
+        // The body is the value
+        value = std::move(response.body());
+        return true;
+    }
+
+    bool read_del_response() const {
+        // Read the response
+        http::response<http::dynamic_body> response;
+        http::read(stream, buffer, response);
+        // Return true if 200 OK, otherwise false
+        return response.result() == http::status::ok;
+    }
+
+    // Send a GET or DELETE request with every key in the target
+    void send_batch_request(const http::verb method,
+                            const std::vector<key_type> &keys) const {
+        std::string target;
+        for (const auto &key : keys) {
+            target.append(target.empty() ? "/" : ",").append(key);
+        }
+        send_request(method, target);
+    }
+
+    // Read the response to a GET request for several keys, which has the
+    // result for each key in the body, encoded as in the binary protocol
+    std::vector<std::optional<std::string>>
+    read_mget_response(std::size_t num_keys) const {
+        http::response<http::string_body> response;
+        http::read(stream, buffer, response);
+        if (response.result() != http::status::ok) {
+            throw std::runtime_error{"server returned invalid status"};
+        }
+        return read_batch_values(response.body(), num_keys);
+    }
+
+    // Read the response to a DELETE request for several keys
+    size_type read_mdel_response() const {
+        http::response<http::empty_body> response;
+        http::read(stream, buffer, response);
+        // Return the value of the `Deleted` field
+        return std::atoi(response.base().at("Deleted").data());
+    }
+
+  public:
+    Http(const std::string &address, const std::string &port)
+    : address{address}, stream{context} {
+        tcp::resolver resolver{context};
+        auto const results = resolver.resolve(address, port);
+        stream.connect(results);
+        stream.socket().set_option(tcp::no_delay{true});
+    }
+
+    ~Http() override {
+        beast::error_code error;
+        stream.socket().shutdown(tcp::socket::shutdown_both, error);
+    }
+
+    void set(const key_type &key, val_type val, size_type size,
+             ttl_type ttl) override {
+        drain();
+        send_set(key, val, size, ttl);
+        read_set_response();
+    }
+
+    val_type get(const key_type &key, size_type &val_size) const override {
+        drain();
+        // Send a GET request
+        send_request(http::verb::get, "/" + key);
+        if (!read_get_response(last_value)) {
+            return nullptr;
         }
-        // Get the value string from the match
-        last_value = match[2];
         // Update `val_size`
-        val_size = last_value.size() + 1;
+        val_size = last_value.size();
         // Return a pointer to the value (must be copied by the caller before
         // `get()` is called again)
         return last_value.c_str();
     }
 
-    bool del(key_type &key) {
+    bool del(const key_type &key) override {
+        drain();
         // Send a DELETE request
         send_request(http::verb::delete_, "/" + key);
-        // Read the response
-        http::response<http::dynamic_body> response;
-        http::read(stream, buffer, response);
-        // Return true if 200 OK, otherwise false
-        return response.result() == http::status::ok;
+        return read_del_response();
+    }
+
+    void mset(const std::vector<KeyValue> &entries) override {
+        drain();
+        // Send a PUT request with every pair in the body
+        send_request(http::verb::put, "/", encode_batch_entries(entries));
+        read_set_response();
+    }
+
+    std::vector<val_type>
+    mget(const std::vector<key_type> &keys,
+         std::vector<size_type> &val_sizes) const override {
+        drain();
+        // A single key gets the response to a single GET
+        if (keys.size() == 1) {
+            val_sizes.assign(1, 0);
+            return {get(keys.front(), val_sizes.front())};
+        }
+        send_batch_request(http::verb::get, keys);
+        return store_batch_values(read_mget_response(keys.size()),
+                                  last_values, val_sizes);
+    }
+
+    size_type mdel(const std::vector<key_type> &keys) override {
+        // A single key gets the response to a single DELETE
+        if (keys.size() == 1) {
+            return del(keys.front());
+        }
+        drain();
+        send_batch_request(http::verb::delete_, keys);
+        return read_mdel_response();
     }
 
-    size_type space_used() const {
+    size_type space_used() const override {
+        drain();
         // Send a HEAD request
         send_request(http::verb::head, "/");
         // Read the response
@@ -117,7 +659,8 @@ class Cache::Impl {
         return std::atoi(response.base().at("Space-Used").data());
     }
 
-    void reset() {
+    void reset() override {
+        drain();
         // Send a POST request
         send_request(http::verb::post, "/reset");
         // Read the response
@@ -128,15 +671,1289 @@ class Cache::Impl {
             throw std::runtime_error{"server returned invalid status"};
         }
     }
+
+    std::string server_stats() const override {
+        drain();
+        // Send a POST request
+        send_request(http::verb::post, "/stats");
+        // Read the response, which must be 200 OK
+        http::response<http::string_body> response;
+        http::read(stream, buffer, response);
+        if (response.result() != http::status::ok) {
+            throw std::runtime_error{"server returned invalid status"};
+        }
+        return std::move(response.body());
+    }
+
+    std::future<void> set_async(const key_type &key, val_type val,
+                                size_type size, ttl_type ttl) override {
+        make_room();
+        send_set(key, val, size, ttl);
+        return enqueue<void>([this] { read_set_response(); });
+    }
+
+    std::future<std::optional<std::string>>
+    get_async(const key_type &key) const override {
+        make_room();
+        send_request(http::verb::get, "/" + key);
+        return enqueue<std::optional<std::string>>(
+            [this]() -> std::optional<std::string> {
+                std::string value;
+                if (!read_get_response(value)) {
+                    return std::nullopt;
+                }
+                return value;
+            });
+    }
+
+    std::future<bool> del_async(const key_type &key) override {
+        make_room();
+        send_request(http::verb::delete_, "/" + key);
+        return enqueue<bool>([this] { return read_del_response(); });
+    }
+
+    std::future<void>
+    mset_async(const std::vector<KeyValue> &entries) override {
+        make_room();
+        send_request(http::verb::put, "/", encode_batch_entries(entries));
+        return enqueue<void>([this] { read_set_response(); });
+    }
+
+    std::future<std::vector<std::optional<std::string>>>
+    mget_async(const std::vector<key_type> &keys) const override {
+        using result_type = std::vector<std::optional<std::string>>;
+        make_room();
+        // A single key gets the response to a single GET
+        if (keys.size() == 1) {
+            send_request(http::verb::get, "/" + keys.front());
+            return enqueue<result_type>([this] {
+                std::string value;
+                result_type values(1);
+                if (read_get_response(value)) {
+                    values.front() = std::move(value);
+                }
+                return values;
+            });
+        }
+        send_batch_request(http::verb::get, keys);
+        return enqueue<result_type>([this, num_keys = keys.size()] {
+            return read_mget_response(num_keys);
+        });
+    }
+
+    std::future<size_type>
+    mdel_async(const std::vector<key_type> &keys) override {
+        make_room();
+        // A single key gets the response to a single DELETE
+        if (keys.size() == 1) {
+            send_request(http::verb::delete_, "/" + keys.front());
+            return enqueue<size_type>(
+                [this]() -> size_type { return read_del_response(); });
+        }
+        send_batch_request(http::verb::delete_, keys);
+        return enqueue<size_type>([this] { return read_mdel_response(); });
+    }
+};
+
+class Cache::Impl::Binary final : public Cache::Impl {
+  private:
+    using Opcode = binary_protocol::Opcode;
+    using Status = binary_protocol::Status;
+
+    // Minimum number of bytes to make room for before each read
+    static constexpr std::size_t READ_SIZE = 4 << 10; // 4KiB
+
+    // I/O context; must persist through runtime
+    net::io_context context;
+    // Mutable for use in const methods
+    mutable tcp::socket socket;
+    // Encoded request (reused to avoid allocating for every request)
+    mutable std::string request;
+    // Bytes received but not yet consumed
+    mutable beast::flat_buffer buffer;
+    // Value carried by the last response (returned by `get()`)
+    mutable std::string last_value;
+    // Last values which were returned by `mget()`
+    mutable std::vector<std::string> last_values;
+    // Opaque value of the last request
+    mutable uint32_t last_opaque = 0;
+
+    // Read from the socket until the buffer holds at least `size` bytes
+    // (reading as much as is available each time)
+    void fill_buffer(std::size_t size) const {
+        while (buffer.size() < size) {
+            const auto wanted = std::max<std::size_t>(size - buffer.size(),
+                                                      READ_SIZE);
+            buffer.commit(socket.read_some(buffer.prepare(wanted)));
+        }
+    }
+
+    // Send a request and return its opaque value
+    uint32_t send(Opcode opcode, std::string_view key = {},
+                  std::string_view value = {}) const {
+        request.clear();
+        binary_protocol::append_frame(request, binary_protocol::REQUEST_MAGIC,
+                                      opcode, Status::OK, ++last_opaque, key,
+                                      value);
+        net::write(socket, net::buffer(request));
+        return last_opaque;
+    }
+
+    // Read the response to the request with the given opaque value, storing
+    // the value of the response in `last_value`
+    Status read_response(uint32_t opaque) const {
+        // Read the response header
+        fill_buffer(binary_protocol::HEADER_SIZE);
+        const auto header = binary_protocol::decode_header(
+            static_cast<const char *>(buffer.data().data()));
+        if (header.magic != binary_protocol::RESPONSE_MAGIC ||
+            header.opaque != opaque) {
+            throw std::runtime_error{"server returned invalid response"};
+        }
+        // Read the rest of the response
+        const auto frame_size =
+            binary_protocol::HEADER_SIZE + header.body_size();
+        fill_buffer(frame_size);
+        const auto data = static_cast<const char *>(buffer.data().data());
+        last_value.assign(data + binary_protocol::HEADER_SIZE + header.key_size,
+                          header.value_size);
+        buffer.consume(frame_size);
+        if (header.status == Status::INVALID) {
+            throw std::runtime_error{"server rejected request"};
+        }
+        return header.status;
+    }
+
+    // Send a request and wait for its response, storing the value of the
+    // response in `last_value`
+    Status call(Opcode opcode, std::string_view key = {},
+                std::string_view value = {}) const {
+        drain();
+        return read_response(send(opcode, key, value));
+    }
+
+    // Send a SET request (with the TTL, if any, in front of the value) and
+    // return its opaque value
+    uint32_t send_set(const key_type &key, val_type val, size_type size,
+                      ttl_type ttl) const {
+        if (ttl <= ttl_type::zero()) {
+            return send(Opcode::SET, key, {val, size});
+        }
+        if (ttl.count() > UINT32_MAX) {
+            throw std::invalid_argument{"TTL is too long"};
+        }
+        std::string value(4, '\0');
+        binary_protocol::encode_u32(value.data(),
+                                    static_cast<uint32_t>(ttl.count()));
+        value.append(val, size);
+        return send(Opcode::SET_TTL, key, value);
+    }
+
+    // Decode the number in the value of the last response
+    size_type read_count() const {
+        if (last_value.size() != 4) {
+            throw std::runtime_error{"server returned invalid response"};
+        }
+        return binary_protocol::decode_u32(last_value.data());
+    }
+
+  public:
+    Binary(const std::string &address, const std::string &port)
+    : socket{context} {
+        tcp::resolver resolver{context};
+        net::connect(socket, resolver.resolve(address, port));
+        socket.set_option(tcp::no_delay{true});
+    }
+
+    ~Binary() override {
+        beast::error_code error;
+        socket.shutdown(tcp::socket::shutdown_both, error);
+    }
+
+    void set(const key_type &key, val_type val, size_type size,
+             ttl_type ttl) override {
+        drain();
+        read_response(send_set(key, val, size, ttl));
+    }
+
+    val_type get(const key_type &key, size_type &val_size) const override {
+        if (call(Opcode::GET, key) != Status::OK) {
+            return nullptr;
+        }
+        // Update `val_size`
+        val_size = last_value.size();
+        // Return a pointer to the value (must be copied by the caller before
+        // `get()` is called again)
+        return last_value.c_str();
+    }
+
+    bool del(const key_type &key) override {
+        return call(Opcode::DEL, key) == Status::OK;
+    }
+
+    void mset(const std::vector<KeyValue> &entries) override {
+        call(Opcode::MSET, {}, encode_batch_entries(entries));
+    }
+
+    std::vector<val_type>
+    mget(const std::vector<key_type> &keys,
+         std::vector<size_type> &val_sizes) const override {
+        call(Opcode::MGET, {}, encode_batch_keys(keys));
+        return store_batch_values(read_batch_values(last_value, keys.size()),
+                                  last_values, val_sizes);
+    }
+
+    size_type mdel(const std::vector<key_type> &keys) override {
+        call(Opcode::MDEL, {}, encode_batch_keys(keys));
+        return read_count();
+    }
+
+    size_type space_used() const override {
+        call(Opcode::SPACE_USED);
+        return read_count();
+    }
+
+    void reset() override {
+        call(Opcode::RESET);
+    }
+
+    std::string server_stats() const override {
+        call(Opcode::STATS);
+        return last_value;
+    }
+
+    std::future<void> set_async(const key_type &key, val_type val,
+                                size_type size, ttl_type ttl) override {
+        make_room();
+        const auto opaque = send_set(key, val, size, ttl);
+        return enqueue<void>([this, opaque] { read_response(opaque); });
+    }
+
+    std::future<std::optional<std::string>>
+    get_async(const key_type &key) const override {
+        make_room();
+        const auto opaque = send(Opcode::GET, key);
+        return enqueue<std::optional<std::string>>(
+            [this, opaque]() -> std::optional<std::string> {
+                if (read_response(opaque) != Status::OK) {
+                    return std::nullopt;
+                }
+                return std::move(last_value);
+            });
+    }
+
+    std::future<bool> del_async(const key_type &key) override {
+        make_room();
+        const auto opaque = send(Opcode::DEL, key);
+        return enqueue<bool>(
+            [this, opaque] { return read_response(opaque) == Status::OK; });
+    }
+
+    std::future<void>
+    mset_async(const std::vector<KeyValue> &entries) override {
+        make_room();
+        const auto opaque =
+            send(Opcode::MSET, {}, encode_batch_entries(entries));
+        return enqueue<void>([this, opaque] { read_response(opaque); });
+    }
+
+    std::future<std::vector<std::optional<std::string>>>
+    mget_async(const std::vector<key_type> &keys) const override {
+        make_room();
+        const auto opaque = send(Opcode::MGET, {}, encode_batch_keys(keys));
+        return enqueue<std::vector<std::optional<std::string>>>(
+            [this, opaque, num_keys = keys.size()] {
+                read_response(opaque);
+                return read_batch_values(last_value, num_keys);
+            });
+    }
+
+    std::future<size_type>
+    mdel_async(const std::vector<key_type> &keys) override {
+        make_room();
+        const auto opaque = send(Opcode::MDEL, {}, encode_batch_keys(keys));
+        return enqueue<size_type>([this, opaque] {
+            read_response(opaque);
+            return read_count();
+        });
+    }
+};
+
+std::unique_ptr<Cache::Impl>
+Cache::Impl::make_connection(Protocol protocol, const std::string &host,
+                             const std::string &port) {
+    switch (protocol) {
+    case Protocol::HTTP:
+        return std::make_unique<Http>(host, port);
+    case Protocol::BINARY:
+        return std::make_unique<Binary>(host, port);
+    }
+    throw std::invalid_argument{"unknown protocol"};
+}
+
+class Cache::Impl::Cluster final : public Cache::Impl {
+  private:
+    using clock = std::chrono::steady_clock;
+
+    // How long a server is skipped for after a request to it fails
+    static constexpr auto RETRY_DELAY = std::chrono::seconds{1};
+
+    struct Node {
+        Server server;
+        // Connection to the server (nullptr while it is being skipped)
+        std::unique_ptr<Impl> connection;
+        // When to try connecting to the server again
+        clock::time_point retry_at;
+    };
+
+    // A request sent to a server, with the future for its result
+    template <typename T> struct Sent {
+        unsigned node;
+        Impl *connection;
+        std::future<T> result;
+    };
+
+    const Protocol protocol;
+    const unsigned replicas;
+    const HashRing ring;
+    // Mutable for use in const methods
+    mutable std::vector<Node> nodes;
+    // Connections to servers that failed, kept until the client is destroyed
+    // since the futures of requests sent on them refer to them
+    mutable std::vector<std::unique_ptr<Impl>> failed;
+    // Last value which was returned by `get()`
+    mutable std::string last_value;
+    // Last values which were returned by `mget()`
+    mutable std::vector<std::string> last_values;
+
+    // Names the servers are placed on the ring by
+    static std::vector<std::string>
+    names_of(const std::vector<Server> &servers) {
+        std::vector<std::string> names;
+        for (const auto &server : servers) {
+            names.push_back(server.host + ":" + server.port);
+        }
+        return names;
+    }
+
+    // Error for a request that no server could be reached for
+    static std::runtime_error unavailable() {
+        return std::runtime_error{"no server is available for the key"};
+    }
+
+    // Get the connection to a server, connecting if needed; returns nullptr
+    // if the server is being skipped after a failure
+    Impl *connect(unsigned node) const {
+        auto &state = nodes[node];
+        if (state.connection == nullptr) {
+            if (clock::now() < state.retry_at) {
+                return nullptr;
+            }
+            try {
+                state.connection = make_connection(
+                    protocol, state.server.host, state.server.port);
+            } catch (const boost::system::system_error &) {
+                state.retry_at = clock::now() + RETRY_DELAY;
+                return nullptr;
+            }
+        }
+        return state.connection.get();
+    }
+
+    // Record that a request on a connection to a server failed, so that the
+    // server is skipped for a while (unless it has been reconnected to since)
+    void fail(unsigned node, Impl *connection) const {
+        auto &state = nodes[node];
+        if (state.connection.get() == connection) {
+            failed.push_back(std::move(state.connection));
+            state.retry_at = clock::now() + RETRY_DELAY;
+        }
+    }
+
+    // Get the first replica of a key that can be reached, or `nodes.size()`
+    // if there is none
+    unsigned first_replica(const key_type &key) const {
+        for (const auto node : ring.nodes_for(key, replicas)) {
+            if (connect(node) != nullptr) {
+                return node;
+            }
+        }
+        return nodes.size();
+    }
+
+    // Get the servers that have a non-empty batch of requests
+    template <typename Batch>
+    static std::vector<unsigned>
+    targets_of(const std::vector<Batch> &batches) {
+        std::vector<unsigned> targets;
+        for (unsigned node = 0; node < batches.size(); ++node) {
+            if (!batches[node].empty()) {
+                targets.push_back(node);
+            }
+        }
+        return targets;
+    }
+
+    // Call `send(connection, node)` for each of the given servers that can be
+    // reached, where `send` sends a request and returns the future for its
+    // result; returns the requests that were sent
+    template <typename T, typename Send>
+    std::vector<Sent<T>> send_to(const std::vector<unsigned> &targets,
+                                 Send &&send) const {
+        std::vector<Sent<T>> sent;
+        for (const auto node : targets) {
+            const auto connection = connect(node);
+            if (connection == nullptr) {
+                continue;
+            }
+            try {
+                sent.push_back({node, connection, send(*connection, node)});
+            } catch (const boost::system::system_error &) {
+                fail(node, connection);
+            }
+        }
+        return sent;
+    }
+
+    // Wait for a request sent by `send_to` and pass its result to
+    // `on_result`; returns false if the server failed instead
+    template <typename T, typename F>
+    bool collect(Sent<T> &sent, F &&on_result) const {
+        try {
+            if constexpr (std::is_void_v<T>) {
+                sent.result.get();
+                on_result();
+            } else {
+                on_result(sent.result.get());
+            }
+            return true;
+        } catch (const boost::system::system_error &) {
+            fail(sent.node, sent.connection);
+            return false;
+        }
+    }
+
+    // Send a request for a key to each of its replicas with `send`, and get
+    // a future that waits for every response and passes each result to
+    // `on_result` (the future fails if no replica responded)
+    template <typename T, typename Send, typename OnResult>
+    std::future<void> write(const key_type &key, Send &&send,
+                            OnResult &&on_result) const {
+        auto sent = send_to<T>(ring.nodes_for(key, replicas),
+                               [&](Impl &connection, unsigned) {
+                                   return send(connection);
+                               });
+        if (sent.empty()) {
+            throw unavailable();
+        }
+        return std::async(std::launch::deferred, [this, sent = std::move(sent),
+                                                  on_result]() mutable {
+            auto responded = false;
+            for (auto &request : sent) {
+                responded |= collect(request, on_result);
+            }
+            if (!responded) {
+                throw unavailable();
+            }
+        });
+    }
+
+    // Get a key from the first replica that responds
+    std::optional<std::string> read(const key_type &key) const {
+        for (const auto node : ring.nodes_for(key, replicas)) {
+            const auto connection = connect(node);
+            if (connection == nullptr) {
+                continue;
+            }
+            try {
+                return connection->get_async(key).get();
+            } catch (const boost::system::system_error &) {
+                fail(node, connection);
+            }
+        }
+        throw unavailable();
+    }
+
+  public:
+    Cluster(const std::vector<Server> &servers, Protocol protocol,
+            unsigned replicas)
+    : protocol{protocol}, replicas{replicas}, ring{names_of(servers)} {
+        if (replicas == 0) {
+            throw std::invalid_argument{"cluster needs at least one replica"};
+        }
+        for (const auto &server : servers) {
+            nodes.push_back({server, nullptr, {}});
+        }
+        // Connect to every server up front (any that cannot be reached yet
+        // are tried again later)
+        for (unsigned node = 0; node < nodes.size(); ++node) {
+            connect(node);
+        }
+    }
+
+    void set(const key_type &key, val_type val, size_type size,
+             ttl_type ttl) override {
+        set_async(key, val, size, ttl).get();
+    }
+
+    val_type get(const key_type &key, size_type &val_size) const override {
+        auto value = read(key);
+        if (!value) {
+            return nullptr;
+        }
+        last_value = std::move(*value);
+        // Update `val_size`
+        val_size = last_value.size();
+        return last_value.c_str();
+    }
+
+    bool del(const key_type &key) override {
+        return del_async(key).get();
+    }
+
+    void mset(const std::vector<KeyValue> &entries) override {
+        mset_async(entries).get();
+    }
+
+    std::vector<val_type>
+    mget(const std::vector<key_type> &keys,
+         std::vector<size_type> &val_sizes) const override {
+        return store_batch_values(mget_async(keys).get(), last_values,
+                                  val_sizes);
+    }
+
+    size_type mdel(const std::vector<key_type> &keys) override {
+        return mdel_async(keys).get();
+    }
+
+    size_type space_used() const override {
+        size_type total = 0;
+        auto responded = false;
+        for (unsigned node = 0; node < nodes.size(); ++node) {
+            const auto connection = connect(node);
+            if (connection == nullptr) {
+                continue;
+            }
+            try {
+                total += connection->space_used();
+                responded = true;
+            } catch (const boost::system::system_error &) {
+                fail(node, connection);
+            }
+        }
+        if (!responded) {
+            throw unavailable();
+        }
+        return total;
+    }
+
+    void reset() override {
+        for (unsigned node = 0; node < nodes.size(); ++node) {
+            const auto connection = connect(node);
+            if (connection == nullptr) {
+                continue;
+            }
+            try {
+                connection->reset();
+            } catch (const boost::system::system_error &) {
+                fail(node, connection);
+            }
+        }
+    }
+
+    std::string server_stats() const override {
+        std::string nodes_stats = "[";
+        auto responded = false;
+        for (unsigned node = 0; node < nodes.size(); ++node) {
+            if (node != 0) {
+                nodes_stats.push_back(',');
+            }
+            const auto connection = connect(node);
+            if (connection != nullptr) {
+                try {
+                    nodes_stats.append(connection->server_stats());
+                    responded = true;
+                    continue;
+                } catch (const boost::system::system_error &) {
+                    fail(node, connection);
+                }
+            }
+            nodes_stats.append("null");
+        }
+        if (!responded) {
+            throw unavailable();
+        }
+        nodes_stats.push_back(']');
+        return nodes_stats;
+    }
+
+    std::future<void> set_async(const key_type &key, val_type val,
+                                size_type size, ttl_type ttl) override {
+        return write<void>(
+            key,
+            [&](Impl &connection) {
+                return connection.set_async(key, val, size, ttl);
+            },
+            [] {});
+    }
+
+    std::future<std::optional<std::string>>
+    get_async(const key_type &key) const override {
+        const auto node = first_replica(key);
+        if (node == nodes.size()) {
+            throw unavailable();
+        }
+        const auto connection = nodes[node].connection.get();
+        std::future<std::optional<std::string>> result;
+        try {
+            result = connection->get_async(key);
+        } catch (const boost::system::system_error &) {
+            fail(node, connection);
+            return std::async(std::launch::deferred,
+                              [this, key] { return read(key); });
+        }
+        return std::async(
+            std::launch::deferred,
+            [this, key, node, connection, result = std::move(result)]() mutable
+            -> std::optional<std::string> {
+                try {
+                    return result.get();
+                } catch (const boost::system::system_error &) {
+                    fail(node, connection);
+                }
+                // Fall back to the other replicas
+                return read(key);
+            });
+    }
+
+    std::future<bool> del_async(const key_type &key) override {
+        auto deleted = std::make_shared<bool>(false);
+        auto done = write<bool>(
+            key, [&](Impl &connection) { return connection.del_async(key); },
+            [deleted](bool result) { *deleted |= result; });
+        return std::async(std::launch::deferred,
+                          [deleted, done = std::move(done)]() mutable {
+                              done.get();
+                              return *deleted;
+                          });
+    }
+
+    std::future<void>
+    mset_async(const std::vector<KeyValue> &entries) override {
+        // Each server gets the entries it is a replica for
+        std::vector<std::vector<std::size_t>> indices(nodes.size());
+        std::vector<KeyValue> batch;
+        for (std::size_t i = 0; i < entries.size(); ++i) {
+            for (const auto node : ring.nodes_for(entries[i].key, replicas)) {
+                indices[node].push_back(i);
+            }
+        }
+        const auto targets = targets_of(indices);
+        auto sent = send_to<void>(targets, [&](Impl &connection,
+                                               unsigned node) {
+            batch.clear();
+            for (const auto i : indices[node]) {
+                batch.push_back(entries[i]);
+            }
+            return connection.mset_async(batch);
+        });
+        return std::async(
+            std::launch::deferred,
+            [this, sent = std::move(sent), indices = std::move(indices),
+             num_entries = entries.size()]() mutable {
+                // Every entry must have reached at least one replica
+                std::vector<bool> stored(num_entries);
+                for (auto &request : sent) {
+                    collect(request, [&] {
+                        for (const auto i : indices[request.node]) {
+                            stored[i] = true;
+                        }
+                    });
+                }
+                if (std::find(stored.begin(), stored.end(), false) !=
+                    stored.end()) {
+                    throw unavailable();
+                }
+            });
+    }
+
+    std::future<std::vector<std::optional<std::string>>>
+    mget_async(const std::vector<key_type> &keys) const override {
+        using result_type = std::vector<std::optional<std::string>>;
+        // Each server gets the keys it is the first reachable replica for
+        std::vector<std::vector<std::size_t>> indices(nodes.size() + 1);
+        for (std::size_t i = 0; i < keys.size(); ++i) {
+            indices[first_replica(keys[i])].push_back(i);
+        }
+        if (!indices.back().empty()) {
+            throw unavailable();
+        }
+        const auto targets = targets_of(indices);
+        std::vector<key_type> batch;
+        auto sent = send_to<result_type>(targets, [&](Impl &connection,
+                                                      unsigned node) {
+            batch.clear();
+            for (const auto i : indices[node]) {
+                batch.push_back(keys[i]);
+            }
+            return connection.mget_async(batch);
+        });
+        // Keys whose server failed before their request was sent
+        std::vector<bool> was_sent(nodes.size());
+        for (const auto &request : sent) {
+            was_sent[request.node] = true;
+        }
+        std::vector<std::size_t> unsent;
+        for (const auto node : targets) {
+            if (!was_sent[node]) {
+                unsent.insert(unsent.end(), indices[node].begin(),
+                              indices[node].end());
+            }
+        }
+        return std::async(
+            std::launch::deferred,
+            [this, keys, sent = std::move(sent), indices = std::move(indices),
+             unsent = std::move(unsent)]() mutable {
+                result_type values(keys.size());
+                for (auto &request : sent) {
+                    const auto &batch = indices[request.node];
+                    if (!collect(request, [&](result_type &&results) {
+                            for (std::size_t j = 0; j < batch.size(); ++j) {
+                                values[batch[j]] = std::move(results[j]);
+                            }
+                        })) {
+                        unsent.insert(unsent.end(), batch.begin(), batch.end());
+                    }
+                }
+                // Fall back to the other replicas of the keys whose server
+                // failed
+                for (const auto i : unsent) {
+                    values[i] = read(keys[i]);
+                }
+                return values;
+            });
+    }
+
+    std::future<size_type>
+    mdel_async(const std::vector<key_type> &keys) override {
+        // Each server gets the keys it is a replica for, in two batches: one
+        // for the keys it is the first reachable replica for, whose
+        // responses count the keys that were deleted, and one for the rest
+        // (so keys whose server fails while the request is in flight are
+        // not counted)
+        std::vector<std::vector<key_type>> counted(nodes.size() + 1);
+        std::vector<std::vector<key_type>> uncounted(nodes.size());
+        for (const auto &key : keys) {
+            const auto first = first_replica(key);
+            counted[first].push_back(key);
+            for (const auto node : ring.nodes_for(key, replicas)) {
+                if (node != first) {
+                    uncounted[node].push_back(key);
+                }
+            }
+        }
+        if (!counted.back().empty()) {
+            throw unavailable();
+        }
+        auto counted_sent = send_to<size_type>(
+            targets_of(counted), [&](Impl &connection, unsigned node) {
+                return connection.mdel_async(counted[node]);
+            });
+        auto uncounted_sent = send_to<size_type>(
+            targets_of(uncounted), [&](Impl &connection, unsigned node) {
+                return connection.mdel_async(uncounted[node]);
+            });
+        return std::async(
+            std::launch::deferred,
+            [this, counted_sent = std::move(counted_sent),
+             uncounted_sent = std::move(uncounted_sent)]() mutable {
+                size_type deleted = 0;
+                for (auto &request : counted_sent) {
+                    collect(request,
+                            [&](size_type count) { deleted += count; });
+                }
+                for (auto &request : uncounted_sent) {
+                    collect(request, [](size_type) {});
+                }
+                return deleted;
+            });
+    }
 };
 
-Cache::Cache(std::string host, std::string port)
-: pImpl_(new Impl{host, port}) {}
+class Cache::Impl::Pool final : public Cache::Impl {
+  private:
+    struct Slot {
+        // Held while the client is in use
+        std::mutex mutex;
+        // Client (nullptr until it is first needed, and after its connection
+        // fails)
+        std::unique_ptr<Cache> client;
+        // Number of live threads assigned to the slot (only increased with
+        // `Pool::mutex` held; decreased without it when a thread exits)
+        std::atomic<unsigned> num_threads{0};
+    };
+
+    // State kept for each thread that uses the pool
+    struct Thread : ValueBuffers {
+        Slot *slot;
+    };
+
+    const client_factory make_client;
+    const unsigned num_slots;
+    const std::unique_ptr<Slot[]> slots;
+    // A thread leaves its slot when it exits (this is destroyed before
+    // `slots`, after which exiting threads no longer touch them)
+    mutable PerThread<Thread> threads{[](Thread &thread) {
+        thread.slot->num_threads.fetch_sub(1, std::memory_order_relaxed);
+    }};
+    // Guards `failed` and assigning threads to slots
+    mutable std::mutex mutex;
+    // Clients whose connection failed, kept until the pool is destroyed
+    // since the futures of requests sent on them refer to them
+    mutable std::vector<std::unique_ptr<Cache>> failed;
+
+    // Get the state of the calling thread, assigning it to the slot with the
+    // fewest live threads if it is new
+    Thread &this_thread() const {
+        auto [thread, created] = threads.get();
+        if (created) {
+            std::lock_guard lock{mutex};
+            auto slot = std::min_element(
+                slots.get(), slots.get() + num_slots,
+                [](const Slot &a, const Slot &b) {
+                    return a.num_threads.load(std::memory_order_relaxed) <
+                           b.num_threads.load(std::memory_order_relaxed);
+                });
+            slot->num_threads.fetch_add(1, std::memory_order_relaxed);
+            thread.slot = slot;
+        }
+        return thread;
+    }
+
+    // Record that a request on a slot's client failed, so that the client is
+    // replaced (unless it has been already); the slot must be locked
+    void fail(Slot &slot, Cache *client) const {
+        if (slot.client.get() == client) {
+            std::lock_guard lock{mutex};
+            failed.push_back(std::move(slot.client));
+        }
+    }
+
+    // Call `fn(client, thread)` with the calling thread's client locked
+    template <typename F> auto with_client(F &&fn) const {
+        auto &thread = this_thread();
+        auto &slot = *thread.slot;
+        std::lock_guard lock{slot.mutex};
+        if (slot.client == nullptr) {
+            slot.client = make_client();
+        }
+        const auto client = slot.client.get();
+        try {
+            return fn(*client, thread);
+        } catch (const boost::system::system_error &) {
+            fail(slot, client);
+            throw;
+        }
+    }
+
+    // Send a pipelined request with `send(client)` on the calling thread's
+    // client, and get a future that locks the client again to wait for the
+    // response
+    template <typename T, typename Send>
+    std::future<T> pipeline(Send &&send) const {
+        return with_client([&](Cache &client, Thread &thread) {
+            return std::async(
+                std::launch::deferred,
+                [this, slot = thread.slot, client = &client,
+                 result = send(client)]() mutable {
+                    std::lock_guard lock{slot->mutex};
+                    try {
+                        return result.get();
+                    } catch (const boost::system::system_error &) {
+                        fail(*slot, client);
+                        throw;
+                    }
+                });
+        });
+    }
+
+  public:
+    Pool(client_factory make_client, unsigned max_clients)
+    : make_client{std::move(make_client)}, num_slots{max_clients},
+      slots{std::make_unique<Slot[]>(max_clients)} {
+        if (max_clients == 0) {
+            throw std::invalid_argument{"pool needs at least one client"};
+        }
+    }
+
+    void set(const key_type &key, val_type val, size_type size,
+             ttl_type ttl) override {
+        with_client([&](Cache &client, Thread &) {
+            client.set(key, val, size, ttl);
+        });
+    }
+
+    val_type get(const key_type &key, size_type &val_size) const override {
+        return with_client([&](Cache &client, Thread &thread) -> val_type {
+            // Take the value from the client rather than pointing into its
+            // buffer, which other threads reuse
+            auto value = client.get_async(key).get();
+            if (!value) {
+                return nullptr;
+            }
+            thread.last_value = std::move(*value);
+            val_size = thread.last_value.size();
+            return thread.last_value.c_str();
+        });
+    }
+
+    bool del(const key_type &key) override {
+        return with_client(
+            [&](Cache &client, Thread &) { return client.del(key); });
+    }
 
-Cache::~Cache() = default;
+    void mset(const std::vector<KeyValue> &entries) override {
+        with_client([&](Cache &client, Thread &) { client.mset(entries); });
+    }
 
-void Cache::set(key_type key, val_type val, size_type size) {
-    pImpl_->set(key, val, size);
+    std::vector<val_type>
+    mget(const std::vector<key_type> &keys,
+         std::vector<size_type> &val_sizes) const override {
+        return with_client([&](Cache &client, Thread &thread) {
+            return store_batch_values(client.mget_async(keys).get(),
+                                      thread.last_values, val_sizes);
+        });
+    }
+
+    size_type mdel(const std::vector<key_type> &keys) override {
+        return with_client(
+            [&](Cache &client, Thread &) { return client.mdel(keys); });
+    }
+
+    size_type space_used() const override {
+        return with_client(
+            [](Cache &client, Thread &) { return client.space_used(); });
+    }
+
+    std::string server_stats() const override {
+        return with_client(
+            [](Cache &client, Thread &) { return client.server_stats(); });
+    }
+
+    void reset() override {
+        with_client([](Cache &client, Thread &) { client.reset(); });
+    }
+
+    std::future<void> set_async(const key_type &key, val_type val,
+                                size_type size, ttl_type ttl) override {
+        return pipeline<void>([&](Cache &client) {
+            return client.set_async(key, val, size, ttl);
+        });
+    }
+
+    std::future<std::optional<std::string>>
+    get_async(const key_type &key) const override {
+        return pipeline<std::optional<std::string>>(
+            [&](Cache &client) { return client.get_async(key); });
+    }
+
+    std::future<bool> del_async(const key_type &key) override {
+        return pipeline<bool>(
+            [&](Cache &client) { return client.del_async(key); });
+    }
+
+    std::future<void>
+    mset_async(const std::vector<KeyValue> &entries) override {
+        return pipeline<void>(
+            [&](Cache &client) { return client.mset_async(entries); });
+    }
+
+    std::future<std::vector<std::optional<std::string>>>
+    mget_async(const std::vector<key_type> &keys) const override {
+        return pipeline<std::vector<std::optional<std::string>>>(
+            [&](Cache &client) { return client.mget_async(keys); });
+    }
+
+    std::future<size_type>
+    mdel_async(const std::vector<key_type> &keys) override {
+        return pipeline<size_type>(
+            [&](Cache &client) { return client.mdel_async(keys); });
+    }
+
+    bool thread_safe() const override {
+        return true;
+    }
+
+    NearCacheStats near_cache_stats() const override {
+        NearCacheStats total;
+        for (unsigned i = 0; i < num_slots; ++i) {
+            std::lock_guard lock{slots[i].mutex};
+            if (slots[i].client != nullptr) {
+                const auto stats = slots[i].client->near_cache_stats();
+                total.hits += stats.hits;
+                total.misses += stats.misses;
+            }
+        }
+        return total;
+    }
+};
+
+class Cache::Impl::Near final : public Cache::Impl {
+  private:
+    using values_type = std::vector<std::optional<std::string>>;
+
+    const std::unique_ptr<Cache> client;
+    // Guards `near`, `writes` and `stats`
+    mutable std::mutex mutex;
+    mutable NearCache near;
+    // Number of times keys have been invalidated; a value read from the
+    // server is only stored if there have been none since it was requested,
+    // since a write may have replaced it in the meantime
+    mutable uint64_t writes = 0;
+    mutable NearCacheStats stats;
+    mutable PerThread<ValueBuffers> buffers;
+
+    // Look up keys in the near cache, storing the values that are found in
+    // `values` (which must have one element per key); returns the indices
+    // of the keys that were not found, and sets `version` to the number of
+    // writes so far
+    std::vector<std::size_t> lookup(const std::vector<key_type> &keys,
+                                    values_type &values,
+                                    uint64_t &version) const {
+        std::vector<std::size_t> missing;
+        std::lock_guard lock{mutex};
+        for (std::size_t i = 0; i < keys.size(); ++i) {
+            if (const auto value = near.get(keys[i])) {
+                values[i] = *value;
+            } else {
+                missing.push_back(i);
+            }
+        }
+        stats.hits += keys.size() - missing.size();
+        stats.misses += missing.size();
+        version = writes;
+        return missing;
+    }
+
+    // Store the values read from the server for the keys at the given
+    // indices (unless a write has happened since `version`), and move them
+    // into `values`
+    void fill(const std::vector<key_type> &keys,
+              const std::vector<std::size_t> &indices, values_type &&read,
+              uint64_t version, values_type &values) const {
+        {
+            std::lock_guard lock{mutex};
+            if (writes == version) {
+                for (std::size_t j = 0; j < indices.size(); ++j) {
+                    if (read[j]) {
+                        near.put(keys[indices[j]], *read[j]);
+                    }
+                }
+            }
+        }
+        for (std::size_t j = 0; j < indices.size(); ++j) {
+            values[indices[j]] = std::move(read[j]);
+        }
+    }
+
+    // Read keys through the near cache, sending a batch request for the
+    // ones it does not have; the returned future stores the values read
+    // from the server when it is waited on
+    std::future<values_type> read(const std::vector<key_type> &keys) const {
+        values_type values(keys.size());
+        uint64_t version;
+        auto missing = lookup(keys, values, version);
+        if (missing.empty()) {
+            return std::async(std::launch::deferred,
+                              [values = std::move(values)]() mutable {
+                                  return std::move(values);
+                              });
+        }
+        std::vector<key_type> missing_keys;
+        for (const auto i : missing) {
+            missing_keys.push_back(keys[i]);
+        }
+        // A single key is read with a single GET
+        auto response =
+            missing_keys.size() == 1
+                ? std::async(std::launch::deferred,
+                             [result = client->get_async(
+                                  missing_keys.front())]() mutable {
+                                 return values_type{result.get()};
+                             })
+                : client->mget_async(missing_keys);
+        return std::async(
+            std::launch::deferred,
+            [this, keys, missing = std::move(missing), version,
+             values = std::move(values),
+             response = std::move(response)]() mutable {
+                fill(keys, missing, response.get(), version, values);
+                return std::move(values);
+            });
+    }
+
+    // Remove keys that are about to be written, or have just been, from the
+    // near cache
+    template <typename Keys, typename KeyOf>
+    void invalidate(const Keys &keys, KeyOf &&key_of) const {
+        std::lock_guard lock{mutex};
+        ++writes;
+        for (const auto &entry : keys) {
+            near.erase(key_of(entry));
+        }
+    }
+
+    // Invalidate keys both before a write is sent, so that later reads on
+    // this client do not see the old values, and after it completes, so that
+    // values read while it was in flight are not kept
+    template <typename T, typename Keys, typename KeyOf, typename Send>
+    std::future<T> write(const Keys &keys, KeyOf &&key_of,
+                         Send &&send) const {
+        invalidate(keys, key_of);
+        return std::async(
+            std::launch::deferred,
+            [this, keys, key_of, result = send()]() mutable {
+                invalidate(keys, key_of);
+                return result.get();
+            });
+    }
+
+    // Remove every value from the near cache
+    void clear() const {
+        std::lock_guard lock{mutex};
+        ++writes;
+        near.clear();
+    }
+
+    static const key_type &key_of(const key_type &key) {
+        return key;
+    }
+
+    static const key_type &entry_key(const KeyValue &entry) {
+        return entry.key;
+    }
+
+  public:
+    Near(std::unique_ptr<Cache> client, size_type maxmem, ttl_type ttl)
+    : client{std::move(client)}, near{maxmem, ttl} {}
+
+    void set(const key_type &key, val_type val, size_type size,
+             ttl_type ttl) override {
+        set_async(key, val, size, ttl).get();
+    }
+
+    val_type get(const key_type &key, size_type &val_size) const override {
+        auto value = std::move(read({key}).get().front());
+        if (!value) {
+            return nullptr;
+        }
+        auto &buffer = buffers.get().first.last_value;
+        buffer = std::move(*value);
+        // Update `val_size`
+        val_size = buffer.size();
+        return buffer.c_str();
+    }
+
+    bool del(const key_type &key) override {
+        return del_async(key).get();
+    }
+
+    void mset(const std::vector<KeyValue> &entries) override {
+        mset_async(entries).get();
+    }
+
+    std::vector<val_type>
+    mget(const std::vector<key_type> &keys,
+         std::vector<size_type> &val_sizes) const override {
+        return store_batch_values(read(keys).get(),
+                                  buffers.get().first.last_values, val_sizes);
+    }
+
+    size_type mdel(const std::vector<key_type> &keys) override {
+        return mdel_async(keys).get();
+    }
+
+    size_type space_used() const override {
+        return client->space_used();
+    }
+
+    std::string server_stats() const override {
+        return client->server_stats();
+    }
+
+    void reset() override {
+        // Clear the near cache before and after, as for other writes
+        clear();
+        client->reset();
+        clear();
+    }
+
+    std::future<void> set_async(const key_type &key, val_type val,
+                                size_type size, ttl_type ttl) override {
+        return write<void>(std::vector<key_type>{key}, key_of, [&] {
+            return client->set_async(key, val, size, ttl);
+        });
+    }
+
+    std::future<std::optional<std::string>>
+    get_async(const key_type &key) const override {
+        return std::async(std::launch::deferred,
+                          [result = read({key})]() mutable {
+                              return std::move(result.get().front());
+                          });
+    }
+
+    std::future<bool> del_async(const key_type &key) override {
+        return write<bool>(std::vector<key_type>{key}, key_of,
+                           [&] { return client->del_async(key); });
+    }
+
+    std::future<void>
+    mset_async(const std::vector<KeyValue> &entries) override {
+        return write<void>(entries, entry_key,
+                           [&] { return client->mset_async(entries); });
+    }
+
+    std::future<values_type>
+    mget_async(const std::vector<key_type> &keys) const override {
+        return read(keys);
+    }
+
+    std::future<size_type>
+    mdel_async(const std::vector<key_type> &keys) override {
+        return write<size_type>(keys, key_of,
+                                [&] { return client->mdel_async(keys); });
+    }
+
+    bool thread_safe() const override {
+        return client->pImpl_->thread_safe();
+    }
+
+    NearCacheStats near_cache_stats() const override {
+        std::lock_guard lock{mutex};
+        return stats;
+    }
+};
+
+Cache::Cache(std::string host, std::string port, Protocol protocol)
+: pImpl_{Impl::make_connection(protocol, host, port)} {}
+
+Cache::Cache(const std::vector<Server> &servers, Protocol protocol,
+             unsigned replicas)
+: pImpl_{std::make_unique<Impl::Cluster>(servers, protocol, replicas)} {}
+
+Cache::Cache(client_factory make_client, unsigned max_clients)
+: pImpl_{std::make_unique<Impl::Pool>(std::move(make_client), max_clients)} {}
+
+Cache::Cache(std::unique_ptr<Cache> client, size_type maxmem, ttl_type ttl)
+: pImpl_{std::make_unique<Impl::Near>(std::move(client), maxmem, ttl)} {}
+
+Cache::~Cache() {
+    pImpl_->finish_refreshes();
+}
+
+void Cache::set(key_type key, val_type val, size_type size, ttl_type ttl) {
+    pImpl_->set(key, val, size, ttl);
 }
 
 Cache::val_type Cache::get(key_type key, size_type &val_size) const {
@@ -147,6 +1964,26 @@ bool Cache::del(key_type key) {
     return pImpl_->del(key);
 }
 
+void Cache::mset(const std::vector<KeyValue> &entries) {
+    if (!entries.empty()) {
+        pImpl_->mset(entries);
+    }
+}
+
+std::vector<Cache::val_type>
+Cache::mget(const std::vector<key_type> &keys,
+            std::vector<size_type> &val_sizes) const {
+    if (keys.empty()) {
+        val_sizes.clear();
+        return {};
+    }
+    return pImpl_->mget(keys, val_sizes);
+}
+
+Cache::size_type Cache::mdel(const std::vector<key_type> &keys) {
+    return keys.empty() ? 0 : pImpl_->mdel(keys);
+}
+
 Cache::size_type Cache::space_used() const {
     return pImpl_->space_used();
 }
@@ -154,3 +1991,57 @@ Cache::size_type Cache::space_used() const {
 void Cache::reset() {
     pImpl_->reset();
 }
+
+std::future<void> Cache::set_async(key_type key, val_type val,
+                                   size_type size, ttl_type ttl) {
+    return pImpl_->set_async(key, val, size, ttl);
+}
+
+std::future<std::optional<std::string>>
+Cache::get_async(key_type key) const {
+    return pImpl_->get_async(key);
+}
+
+std::future<bool> Cache::del_async(key_type key) {
+    return pImpl_->del_async(key);
+}
+
+std::future<void> Cache::mset_async(const std::vector<KeyValue> &entries) {
+    if (entries.empty()) {
+        return std::async(std::launch::deferred, [] {});
+    }
+    return pImpl_->mset_async(entries);
+}
+
+std::future<std::vector<std::optional<std::string>>>
+Cache::mget_async(const std::vector<key_type> &keys) const {
+    if (keys.empty()) {
+        return std::async(std::launch::deferred, [] {
+            return std::vector<std::optional<std::string>>{};
+        });
+    }
+    return pImpl_->mget_async(keys);
+}
+
+std::future<Cache::size_type>
+Cache::mdel_async(const std::vector<key_type> &keys) {
+    if (keys.empty()) {
+        return std::async(std::launch::deferred, [] { return size_type{0}; });
+    }
+    return pImpl_->mdel_async(keys);
+}
+
+std::optional<std::string> Cache::get_or_compute(key_type key,
+                                                 const loader &load,
+                                                 ttl_type ttl,
+                                                 ttl_type refresh_after) {
+    return pImpl_->get_or_compute(key, load, ttl, refresh_after);
+}
+
+Cache::NearCacheStats Cache::near_cache_stats() const {
+    return pImpl_->near_cache_stats();
+}
+
+std::string Cache::server_stats() const {
+    return pImpl_->server_stats();
+}
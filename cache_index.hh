@@ -0,0 +1,718 @@
+/*
+ * Hash tables that can be used by the cache library to map keys to entries.
+ * Both implement the same small interface (find, emplace, take, clear, size),
+ * so the cache can be instantiated with either one. The flat index can also
+ * be told how to get each key from its value, in which case it stores no
+ * copies of the keys. Both grow incrementally, moving a few entries from the
+ * old table to the new one on each insertion.
+ */
+
+#ifndef CACHE_INDEX_HH
+#define CACHE_INDEX_HH
+
+#include "evictor.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+////////////////////////////////////////////////
+// ChainedIndex
+////////////////////////////////////////////////
+
+// Index backed by `std::unordered_map` (one node per entry). Rather than let
+// the map rehash itself when it fills up, the index moves it aside and starts
+// a map with twice as many buckets, then moves a few nodes into it on each
+// insertion (as Redis does). Nodes are moved without reallocating them, so
+// pointers to values stay valid.
+template <typename Value, typename Hasher> class ChainedIndex {
+  private:
+    using map_type = std::unordered_map<key_type, Value, Hasher>;
+
+    // Smallest number of entries to make room for when growing
+    static constexpr std::size_t MIN_GROWTH = 16;
+    // Number of entries moved into the new map by each insertion while the
+    // index grows (few enough that no insertion takes much longer than the
+    // others, and enough to finish well before the new map fills up)
+    static constexpr std::size_t MIGRATE_STEP = 4;
+
+    map_type map;
+    // Entries still to be moved into `map` since it last grew
+    map_type old;
+
+    // Move up to `count` entries from `old` into `map`
+    void migrate(std::size_t count) {
+        for (; count != 0 && !old.empty(); --count) {
+            map.insert(old.extract(old.begin()));
+        }
+        if (old.empty() && old.bucket_count() > 1) {
+            // Free the old map's buckets
+            map_type{0, map.hash_function()}.swap(old);
+            old.max_load_factor(map.max_load_factor());
+        }
+    }
+
+    // Make room for one more entry without the map rehashing itself, by
+    // starting a new map twice as large if needed
+    void reserve_one() {
+        const auto limit = static_cast<std::size_t>(
+            static_cast<float>(map.bucket_count()) * map.max_load_factor());
+        if (map.size() + 1 <= limit) {
+            return;
+        }
+        // The previous map has normally been emptied long before this, but
+        // must be now (which may make `map` rehash itself)
+        migrate(old.size());
+        old.swap(map);
+        map.reserve(std::max(2 * old.size(), MIN_GROWTH));
+    }
+
+  public:
+    // Every key is copied into the index
+    static constexpr bool OWNS_KEYS = true;
+
+    ChainedIndex(float max_load_factor, const Hasher &hasher)
+    : map{0, hasher}, old{0, hasher} {
+        map.max_load_factor(max_load_factor);
+        old.max_load_factor(max_load_factor);
+    }
+
+    // Take every entry of `other`, leaving it empty
+    ChainedIndex(ChainedIndex &&other)
+    : ChainedIndex{other.map.max_load_factor(), other.map.hash_function()} {
+        map.swap(other.map);
+        old.swap(other.old);
+    }
+
+    // Get the value for a key, or nullptr if it is not present
+    Value *find(const key_type &key) {
+        auto entry = map.find(key);
+        if (entry != map.end()) {
+            return &entry->second;
+        }
+        entry = old.find(key);
+        return entry != old.end() ? &entry->second : nullptr;
+    }
+
+    const Value *find(const key_type &key) const {
+        auto entry = map.find(key);
+        if (entry != map.end()) {
+            return &entry->second;
+        }
+        entry = old.find(key);
+        return entry != old.end() ? &entry->second : nullptr;
+    }
+
+    // Get the value for a key, adding `value` if it is not present
+    Value &emplace(const key_type &key, Value value = {}) {
+        migrate(MIGRATE_STEP);
+        if (auto existing = find(key)) {
+            return *existing;
+        }
+        reserve_one();
+        return map.try_emplace(key, std::move(value)).first->second;
+    }
+
+    // Remove a key and return its value, if it was present
+    std::optional<Value> take(const key_type &key) {
+        for (auto table : {&map, &old}) {
+            auto entry = table->find(key);
+            if (entry != table->end()) {
+                std::optional<Value> value{std::move(entry->second)};
+                table->erase(entry);
+                return value;
+            }
+        }
+        return std::nullopt;
+    }
+
+    // Call `fn` on every value
+    template <typename F> void for_each(F &&fn) {
+        for (auto table : {&map, &old}) {
+            for (auto &entry : *table) {
+                fn(entry.second);
+            }
+        }
+    }
+
+    template <typename F> void for_each(F &&fn) const {
+        for (auto table : {&map, &old}) {
+            for (const auto &entry : *table) {
+                fn(entry.second);
+            }
+        }
+    }
+
+    void clear() {
+        map.clear();
+        old.clear();
+    }
+
+    std::size_t size() const {
+        return map.size() + old.size();
+    }
+
+    // Whether entries are still being moved into the table after it grew
+    bool rehashing() const {
+        return !old.empty();
+    }
+};
+
+////////////////////////////////////////////////
+// FlatIndex
+////////////////////////////////////////////////
+
+// Key stored inside a slot of a `FlatIndex`; short keys are stored inline
+// and only longer ones are allocated separately
+class InlineKey {
+  private:
+    static constexpr std::size_t INLINE_CAPACITY = 24;
+
+    uint32_t length;
+    union {
+        char chars[INLINE_CAPACITY];
+        char *heap;
+    };
+
+    bool is_inline() const {
+        return length <= INLINE_CAPACITY;
+    }
+
+  public:
+    explicit InlineKey(std::string_view key)
+    : length{static_cast<uint32_t>(key.size())} {
+        char *dest = is_inline() ? chars : (heap = new char[length]);
+        std::memcpy(dest, key.data(), length);
+    }
+
+    InlineKey(InlineKey &&other) noexcept : length{other.length} {
+        if (is_inline()) {
+            std::memcpy(chars, other.chars, length);
+        } else {
+            heap = other.heap;
+            other.length = 0;
+        }
+    }
+
+    InlineKey(const InlineKey &) = delete;
+    InlineKey &operator=(const InlineKey &) = delete;
+
+    ~InlineKey() {
+        if (!is_inline()) {
+            delete[] heap;
+        }
+    }
+
+    std::string_view view() const {
+        return {is_inline() ? chars : heap, length};
+    }
+
+    bool operator==(std::string_view other) const {
+        return length == other.size() &&
+               std::memcmp(view().data(), other.data(), length) == 0;
+    }
+};
+
+// Slot of a `FlatIndex` that stores a copy of its key
+template <typename Value> struct OwnedKeySlot {
+    InlineKey key;
+    Value value;
+
+    OwnedKeySlot(std::string_view key, Value value)
+    : key{key}, value{std::move(value)} {}
+
+    std::string_view key_view() const {
+        return key.view();
+    }
+
+    bool has_key(std::string_view other) const {
+        return key == other;
+    }
+};
+
+// Slot of a `FlatIndex` that only stores its value, and gets its key from the
+// value with `KeyOf` (so the key must live as long as the value is indexed)
+template <typename Value, typename KeyOf> struct BorrowedKeySlot {
+    Value value;
+
+    BorrowedKeySlot(std::string_view, Value value) : value{std::move(value)} {}
+
+    std::string_view key_view() const {
+        return KeyOf{}(value);
+    }
+
+    bool has_key(std::string_view other) const {
+        return key_view() == other;
+    }
+};
+
+// Hasher for `FlatIndex` that hashes keys directly (statically dispatched)
+struct StringHasher {
+    std::size_t operator()(std::string_view key) const {
+        return std::hash<std::string_view>{}(key);
+    }
+};
+
+// Hasher for `FlatIndex` that calls a user-provided hash function
+template <typename HashFunc> struct FunctionHasher {
+    HashFunc hash;
+
+    std::size_t operator()(std::string_view key) const {
+        return hash(key_type{key});
+    }
+};
+
+// Open-addressing index in the style of Swiss tables. Slots are split into
+// groups of 16, each with a byte of control data per slot holding 7 bits of
+// the slot's hash (or marking it empty/deleted). A lookup compares all 16
+// control bytes of a group at once and only checks the keys whose hash bits
+// match, so most lookups touch one cache line of control bytes and one slot.
+// With a `KeyOf` (a function object that returns the key of a value as a
+// `std::string_view`), slots hold only values, which must never be changed to
+// ones with a different key while they are in the index.
+// When the table is rebuilt (to grow, or to clear out deleted slots), the old
+// one is kept and each insertion moves the entries of its next `MIGRATE_STEP`
+// slots into the new one; lookups check both until the old one is empty.
+template <typename Value, typename Hasher, typename KeyOf = void>
+class FlatIndex {
+  private:
+    using ctrl_type = int8_t;
+    static constexpr ctrl_type EMPTY = -128;
+    static constexpr ctrl_type DELETED = -2;
+    static constexpr std::size_t GROUP_SIZE = 16;
+    // Largest load factor allowed (there must always be empty slots for
+    // lookups to terminate quickly)
+    static constexpr float MAX_LOAD_FACTOR = 0.875f;
+    // Number of slots of the old table moved into the new one by each
+    // insertion while the index is rebuilt
+    static constexpr std::size_t MIGRATE_STEP = GROUP_SIZE;
+
+    struct alignas(GROUP_SIZE) CtrlGroup {
+        ctrl_type bytes[GROUP_SIZE];
+    };
+
+    using Slot = std::conditional_t<std::is_void_v<KeyOf>, OwnedKeySlot<Value>,
+                                    BorrowedKeySlot<Value, KeyOf>>;
+
+    // Bit mask of the slots in a group matching some condition
+    class Group {
+      private:
+#ifdef __SSE2__
+        __m128i ctrl;
+#else
+        const ctrl_type *ctrl;
+#endif
+
+      public:
+        explicit Group(const CtrlGroup &group)
+#ifdef __SSE2__
+        : ctrl{_mm_load_si128(reinterpret_cast<const __m128i *>(group.bytes))} {
+        }
+#else
+        : ctrl{group.bytes} {
+        }
+#endif
+
+        uint32_t match(ctrl_type value) const {
+#ifdef __SSE2__
+            return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(value), ctrl));
+#else
+            uint32_t mask = 0;
+            for (auto i = 0U; i < GROUP_SIZE; ++i) {
+                mask |= static_cast<uint32_t>(ctrl[i] == value) << i;
+            }
+            return mask;
+#endif
+        }
+
+        uint32_t match_empty() const {
+            return match(EMPTY);
+        }
+
+        // Empty and deleted slots are the only ones with a value below -1
+        uint32_t match_empty_or_deleted() const {
+#ifdef __SSE2__
+            return _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), ctrl));
+#else
+            uint32_t mask = 0;
+            for (auto i = 0U; i < GROUP_SIZE; ++i) {
+                mask |= static_cast<uint32_t>(ctrl[i] < -1) << i;
+            }
+            return mask;
+#endif
+        }
+    };
+
+    static std::size_t lowest_bit(uint32_t mask) {
+        return static_cast<std::size_t>(__builtin_ctz(mask));
+    }
+
+    // Split a hash into the bits used to choose the first group (h1) and the
+    // bits stored in the control bytes (h2)
+    static std::size_t h1(std::size_t hash) {
+        return hash >> 7;
+    }
+
+    static ctrl_type h2(std::size_t hash) {
+        return static_cast<ctrl_type>(hash & 0x7f);
+    }
+
+    // Frees the memory of a table's slots (which must be destroyed first)
+    struct FreeSlots {
+        void operator()(Slot *slots) const {
+            ::operator delete(slots);
+        }
+    };
+
+    // Control bytes and slots of one table
+    struct Table {
+        // Number of slots (zero or a power of two that is at least
+        // `GROUP_SIZE`)
+        std::size_t capacity = 0;
+        std::unique_ptr<CtrlGroup[]> ctrl;
+        std::unique_ptr<Slot, FreeSlots> slots;
+
+        Table() = default;
+
+        // Allocate a table with every slot empty
+        explicit Table(std::size_t capacity)
+        : capacity{capacity}, ctrl{new CtrlGroup[capacity / GROUP_SIZE]},
+          slots{static_cast<Slot *>(::operator new(capacity * sizeof(Slot)))} {
+            std::memset(ctrl.get(), EMPTY, capacity);
+        }
+
+        ctrl_type &ctrl_at(std::size_t slot) {
+            return ctrl[slot / GROUP_SIZE].bytes[slot % GROUP_SIZE];
+        }
+
+        ctrl_type ctrl_at(std::size_t slot) const {
+            return ctrl[slot / GROUP_SIZE].bytes[slot % GROUP_SIZE];
+        }
+
+        Slot &slot_at(std::size_t slot) const {
+            return slots.get()[slot];
+        }
+
+        // Visit the groups in probe order for a hash (the triangular sequence
+        // visits every group since the number of groups is a power of two)
+        // until `visit` returns true
+        template <typename F> void probe(std::size_t hash, F &&visit) const {
+            const auto mask = capacity / GROUP_SIZE - 1;
+            auto group = h1(hash) & mask;
+            for (std::size_t step = 1;; ++step) {
+                if (visit(group)) {
+                    return;
+                }
+                group = (group + step) & mask;
+            }
+        }
+
+        // Find the slot containing a key (or `capacity` if it is not
+        // present), skipping the slots below `first` (whose entries have
+        // been moved out)
+        std::size_t find_slot(std::string_view key, std::size_t hash,
+                              std::size_t first = 0) const {
+            if (capacity == 0) {
+                return capacity;
+            }
+            auto result = capacity;
+            probe(hash, [&](std::size_t group_index) {
+                const Group group{ctrl[group_index]};
+                for (auto mask = group.match(h2(hash)); mask != 0;
+                     mask &= mask - 1) {
+                    const auto slot =
+                        group_index * GROUP_SIZE + lowest_bit(mask);
+                    if (slot >= first && slot_at(slot).has_key(key)) {
+                        result = slot;
+                        return true;
+                    }
+                }
+                // The key would have been placed in this group if it had room
+                return group.match_empty() != 0;
+            });
+            return result;
+        }
+
+        // Find an empty or deleted slot to insert a key with the given hash
+        // into
+        std::size_t find_insert_slot(std::size_t hash) const {
+            auto result = capacity;
+            probe(hash, [&](std::size_t group_index) {
+                const auto mask =
+                    Group{ctrl[group_index]}.match_empty_or_deleted();
+                if (mask != 0) {
+                    result = group_index * GROUP_SIZE + lowest_bit(mask);
+                    return true;
+                }
+                return false;
+            });
+            return result;
+        }
+
+        // Mark a slot whose entry has been destroyed as free, and return
+        // whether it could be made empty again. If the group still has an
+        // empty slot, no probe sequence continues past it, so this slot can
+        // be made empty; otherwise it has to be marked deleted so that
+        // lookups keep probing.
+        bool free_slot(std::size_t slot) {
+            if (Group{ctrl[slot / GROUP_SIZE]}.match_empty() != 0) {
+                ctrl_at(slot) = EMPTY;
+                return true;
+            }
+            ctrl_at(slot) = DELETED;
+            return false;
+        }
+    };
+
+    Hasher hasher;
+    const float max_load_factor;
+
+    Table table;
+    // Table whose entries are being moved into `table` since it was rebuilt
+    // (its slots below `migrated` have been moved already)
+    Table old;
+    std::size_t migrated = 0;
+
+    // Number of entries in both tables
+    std::size_t num_entries = 0;
+    // Number of deleted slots in `table`
+    std::size_t num_deleted = 0;
+    // Number of empty slots of `table` that can be filled before rebuilding
+    // it (not counting the ones kept for the entries still in `old`)
+    std::size_t growth_left = 0;
+
+    std::size_t max_entries(std::size_t capacity) const {
+        return static_cast<std::size_t>(capacity * max_load_factor);
+    }
+
+    // Capacity of the first table: the smallest with room for an entry (a
+    // load factor below 1/16 leaves none in a single group)
+    std::size_t min_capacity() const {
+        auto capacity = GROUP_SIZE;
+        while (max_entries(capacity) == 0) {
+            capacity *= 2;
+        }
+        return capacity;
+    }
+
+    // Get the slot containing a key in either table, or nullptr if it is not
+    // present
+    Slot *find_entry(std::string_view key, std::size_t hash) const {
+        const auto slot = table.find_slot(key, hash);
+        if (slot != table.capacity) {
+            return &table.slot_at(slot);
+        }
+        const auto old_slot = old.find_slot(key, hash, migrated);
+        return old_slot != old.capacity ? &old.slot_at(old_slot) : nullptr;
+    }
+
+    // Move the entries in the next `count` slots of `old` into `table`, and
+    // free `old` once they have all been moved
+    void migrate(std::size_t count) {
+        if (old.capacity == 0) {
+            return;
+        }
+        const auto end = std::min(old.capacity, migrated + count);
+        for (; migrated < end; ++migrated) {
+            if (old.ctrl_at(migrated) < 0) {
+                continue;
+            }
+            auto &old_slot = old.slot_at(migrated);
+            const auto hash = hasher(old_slot.key_view());
+            const auto slot = table.find_insert_slot(hash);
+            // The entry's slot was set aside when `table` was built, so
+            // reusing a deleted one leaves room for another entry
+            if (table.ctrl_at(slot) == DELETED) {
+                --num_deleted;
+                ++growth_left;
+            }
+            table.ctrl_at(slot) = h2(hash);
+            new (&table.slot_at(slot)) Slot{std::move(old_slot)};
+            old_slot.~Slot();
+        }
+        if (migrated == old.capacity) {
+            old = Table{};
+            migrated = 0;
+        }
+    }
+
+    // Start moving every entry into a new table with the given capacity
+    // (this also clears out deleted slots)
+    void rehash(std::size_t new_capacity) {
+        // Finish the previous rehash first
+        migrate(old.capacity);
+        old = std::exchange(table, Table{new_capacity});
+        migrated = 0;
+        num_deleted = 0;
+        growth_left = max_entries(new_capacity) - num_entries;
+    }
+
+    // Make room for at least one more entry
+    void reserve_one() {
+        const auto capacity = table.capacity;
+        if (capacity == 0) {
+            return rehash(min_capacity());
+        }
+        // Grow if the table is mostly full of entries, otherwise just clear
+        // out the deleted slots (either way leaves room for another entry)
+        rehash(num_entries + 1 > max_entries(capacity) / 2 ? capacity * 2
+                                                           : capacity);
+    }
+
+    // Destroy the entry in a slot and return its value
+    std::optional<Value> remove(Table &from, std::size_t slot) {
+        std::optional<Value> value{std::move(from.slot_at(slot).value)};
+        from.slot_at(slot).~Slot();
+        --num_entries;
+        return value;
+    }
+
+    // Call `fn` on every slot holding an entry
+    template <typename F> void for_each_slot(F &&fn) const {
+        for (std::size_t slot = 0; slot < table.capacity; ++slot) {
+            if (table.ctrl_at(slot) >= 0) {
+                fn(table.slot_at(slot));
+            }
+        }
+        for (auto slot = migrated; slot < old.capacity; ++slot) {
+            if (old.ctrl_at(slot) >= 0) {
+                fn(old.slot_at(slot));
+            }
+        }
+    }
+
+    void destroy_slots() {
+        for_each_slot([](Slot &slot) { slot.~Slot(); });
+    }
+
+  public:
+    // Whether keys are copied into the index (rather than read from values)
+    static constexpr bool OWNS_KEYS = std::is_void_v<KeyOf>;
+    // Bytes of the table taken by each entry (not counting empty slots)
+    static constexpr std::size_t ENTRY_SIZE = sizeof(Slot) + sizeof(ctrl_type);
+
+    FlatIndex(float max_load_factor, const Hasher &hasher)
+    : hasher{hasher}, max_load_factor{std::clamp(max_load_factor, 0.01f,
+                                                 MAX_LOAD_FACTOR)} {}
+
+    // Take every entry of `other`, leaving it empty
+    FlatIndex(FlatIndex &&other)
+    : hasher{other.hasher}, max_load_factor{other.max_load_factor},
+      table{std::exchange(other.table, {})}, old{std::exchange(other.old, {})},
+      migrated{std::exchange(other.migrated, 0)},
+      num_entries{std::exchange(other.num_entries, 0)},
+      num_deleted{std::exchange(other.num_deleted, 0)},
+      growth_left{std::exchange(other.growth_left, 0)} {}
+
+    FlatIndex(const FlatIndex &) = delete;
+    FlatIndex &operator=(const FlatIndex &) = delete;
+
+    ~FlatIndex() {
+        destroy_slots();
+    }
+
+    // Get the value for a key, or nullptr if it is not present
+    Value *find(const key_type &key) {
+        const auto slot = find_entry(key, hasher(key));
+        return slot != nullptr ? &slot->value : nullptr;
+    }
+
+    const Value *find(const key_type &key) const {
+        const auto slot = find_entry(key, hasher(key));
+        return slot != nullptr ? &slot->value : nullptr;
+    }
+
+    // Get the value for a key, adding `value` if it is not present (with a
+    // `KeyOf`, `value` must have the key). This may move other values, so
+    // pointers to them must not be kept across it.
+    Value &emplace(const key_type &key, Value value = {}) {
+        migrate(MIGRATE_STEP);
+        const auto hash = hasher(key);
+        if (auto existing = find_entry(key, hash)) {
+            return existing->value;
+        }
+        if (growth_left == 0) {
+            reserve_one();
+        }
+        const auto slot = table.find_insert_slot(hash);
+        if (table.ctrl_at(slot) == DELETED) {
+            --num_deleted;
+        } else {
+            --growth_left;
+        }
+        table.ctrl_at(slot) = h2(hash);
+        new (&table.slot_at(slot)) Slot{key, std::move(value)};
+        ++num_entries;
+        return table.slot_at(slot).value;
+    }
+
+    // Remove a key and return its value, if it was present (this never moves
+    // other values)
+    std::optional<Value> take(const key_type &key) {
+        const auto hash = hasher(key);
+        auto slot = table.find_slot(key, hash);
+        if (slot != table.capacity) {
+            auto value = remove(table, slot);
+            if (table.free_slot(slot)) {
+                ++growth_left;
+            } else {
+                ++num_deleted;
+            }
+            return value;
+        }
+        slot = old.find_slot(key, hash, migrated);
+        if (slot == old.capacity) {
+            return std::nullopt;
+        }
+        auto value = remove(old, slot);
+        old.free_slot(slot);
+        // The entry no longer needs the slot set aside for it in `table`
+        ++growth_left;
+        return value;
+    }
+
+    // Call `fn` on every value
+    template <typename F> void for_each(F &&fn) {
+        for_each_slot([&](Slot &slot) { fn(slot.value); });
+    }
+
+    template <typename F> void for_each(F &&fn) const {
+        for_each_slot([&](const Slot &slot) { fn(slot.value); });
+    }
+
+    void clear() {
+        destroy_slots();
+        old = Table{};
+        migrated = 0;
+        if (table.capacity != 0) {
+            std::memset(table.ctrl.get(), EMPTY, table.capacity);
+        }
+        num_entries = 0;
+        num_deleted = 0;
+        growth_left = max_entries(table.capacity);
+    }
+
+    std::size_t size() const {
+        return num_entries;
+    }
+
+    // Whether entries are still being moved into the table after it was
+    // rebuilt
+    bool rehashing() const {
+        return old.capacity != 0;
+    }
+};
+
+#endif // CACHE_INDEX_HH
@@ -1,124 +1,767 @@
 #include "cache.hh"
+#include "cache_index.hh"
+#include "timer_wheel.hh"
 
-#include <numeric>
-#include <unordered_map>
-#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <future>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <system_error>
 
+// Interface implemented by the cache for each kind of index
 class Cache::Impl {
+  public:
+    virtual ~Impl() = default;
+
+    virtual void set(const key_type &key, val_type val, size_type size,
+                     ttl_type ttl) = 0;
+    virtual val_type get(const key_type &key, size_type &val_size) const = 0;
+    virtual val_type peek(const key_type &key, size_type &val_size) const = 0;
+    virtual void touch(const key_type &key) = 0;
+    virtual bool del(const key_type &key) = 0;
+    virtual size_type space_used() const = 0;
+    virtual size_type expire() = 0;
+    virtual void for_each(const entry_visitor &fn) const = 0;
+    virtual void reset() = 0;
+    virtual void pin(val_type val) const = 0;
+    virtual void unpin(val_type val) const = 0;
+    virtual size_type space_reserved() const = 0;
+    virtual std::vector<SlabAllocator::ClassStats> slab_stats() const = 0;
+    virtual uint64_t evictions() const = 0;
+
+    template <typename Index> class Indexed;
+
+    // Create the implementation for the given kind of index
+    static std::unique_ptr<Impl> create(size_type maxmem, float max_load_factor,
+                                        Evictor *evictor,
+                                        const hash_func &hasher,
+                                        IndexType index,
+                                        Admission *admission);
+};
+
+// Each entry is stored in a single chunk from the slab allocator: this header,
+// followed by the value and then the key (so that a pinned value can be
+// traced back to its entry)
+struct Entry {
+    using timer_wheel = TimerWheel<Entry *>;
+
+    // Set in `pins` once the entry has been removed from the cache, so that
+    // it is freed when its last pin is released
+    static constexpr uint32_t DETACHED = 1U << 31;
+
+    // Hook used by intrusive evictors (detached entries waiting to be freed
+    // are linked through `hook.next` instead)
+    EvictionHook hook;
+    uint32_t key_size;
+    Cache::size_type size;
+    // Number of times the value is pinned, plus `DETACHED`
+    std::atomic<uint32_t> pins{0};
+    // Timer for the entry's expiry, if it has a TTL (fits in what would
+    // otherwise be padding)
+    timer_wheel::timer_id timer = timer_wheel::NONE;
+
+    Cache::byte_type *data() {
+        return reinterpret_cast<char *>(this + 1);
+    }
+
+    char *key_data() {
+        return data() + size;
+    }
+
+    std::string_view key() const {
+        return {reinterpret_cast<const char *>(this + 1) + size, key_size};
+    }
+
+    // Size of the chunk holding an entry with the given key and value sizes
+    static std::size_t chunk_size(std::size_t key_size, Cache::size_type size) {
+        return sizeof(Entry) + key_size + size;
+    }
+
+    // Get the entry containing a hook
+    static Entry *from_hook(EvictionHook *hook) {
+        return reinterpret_cast<Entry *>(reinterpret_cast<char *>(hook) -
+                                         offsetof(Entry, hook));
+    }
+
+    // Get the entry containing a value
+    static Entry *from_data(Cache::val_type data) {
+        return reinterpret_cast<Entry *>(const_cast<Cache::byte_type *>(data)) -
+               1;
+    }
+};
+
+// Gets the key of an entry, for an index that reads keys from entries
+struct EntryKey {
+    std::string_view operator()(const Entry *entry) const {
+        return entry->key();
+    }
+};
+
+template <typename Index> class Cache::Impl::Indexed final : public Cache::Impl {
   private:
+    // An index that stores no keys of its own is the compact layout: each
+    // entry's key only exists in its chunk, so an entry can never be left in
+    // the index without one, and `usedmem` counts all of the memory each
+    // entry takes rather than just its value
+    static constexpr bool COMPACT = !Index::OWNS_KEYS;
+
     const size_type maxmem;
     Evictor *const evictor;
+    // Set instead of `evictor` if the evictor is intrusive
+    IntrusiveEvictor *const intrusive;
+    Admission *const admission;
 
     size_type usedmem = 0;
+    // Number of entries evicted so far
+    uint64_t num_evictions = 0;
 
-    using data_type = std::vector<byte_type>;
-    using map_type = std::unordered_map<key_type, data_type, hash_func>;
+    SlabAllocator arena;
+    // Entries are never moved, so the index only stores pointers to them
+    Index entries;
+    // Index emptied by the last `reset()`, being freed on another thread
+    std::future<void> reclaiming;
 
-    map_type entries;
+    // Smallest index that `reset()` frees on another thread rather than
+    // clearing in place
+    static constexpr std::size_t LAZY_RESET_MIN_ENTRIES = 1 << 12;
+    // Number of pinned entries `set()` passes over before it gives up on
+    // making space for an entry (as memcached only searches a few items from
+    // the tail of its LRU), rather than evicting every entry in the cache
+    static constexpr unsigned MAX_PINNED_SKIPS = 5;
 
-  public:
-    Impl(size_type maxmem, float max_load_factor, Evictor *evictor,
-         const hash_func &hasher)
-    : maxmem{maxmem}, evictor{evictor}, entries{map_type{0, hasher}} {
-        entries.max_load_factor(max_load_factor);
-    }
-
-    void set(const key_type &key, val_type val, size_type size) {
-        // Delete the existing entry if present
-        del(key);
-        // Evict if necessary to make space for the entry
-        while (space_used() + size > maxmem) {
-            // Return if there is no evictor or if the entry cannot possibly fit
-            // in the cache even with eviction
-            if (evictor == nullptr || size > maxmem) {
-                return;
+    // Entries with a TTL, by expiry time in milliseconds since `epoch`
+    Entry::timer_wheel timers;
+    const std::chrono::steady_clock::time_point epoch =
+        std::chrono::steady_clock::now();
+
+    // Get the current time in ticks of `timers`
+    Entry::timer_wheel::tick_type now() const {
+        return static_cast<Entry::timer_wheel::tick_type>(
+            std::chrono::duration_cast<ttl_type>(
+                std::chrono::steady_clock::now() - epoch)
+                .count());
+    }
+
+    // Whether an entry's TTL has passed (it is still in the cache until the
+    // timer wheel is advanced past it)
+    bool expired(const Entry *entry) const {
+        return entry->timer != Entry::timer_wheel::NONE &&
+               timers.deadline(entry->timer) <= now();
+    }
+
+    // Cancel an entry's expiry, if it has one
+    void cancel_timer(Entry *entry) {
+        if (entry->timer != Entry::timer_wheel::NONE) {
+            timers.cancel(entry->timer);
+            entry->timer = Entry::timer_wheel::NONE;
+        }
+    }
+
+    // Number of entries whose values are pinned (only updated when an
+    // entry's first pin is taken or its last one is released)
+    mutable std::atomic<size_type> num_pinned{0};
+    // Detached entries whose last pin has been released, waiting to be freed
+    // by the next call to `set()` or `reset()` (a stack linked through
+    // `hook.next`, pushed to by `unpin()` without a lock)
+    mutable std::atomic<EvictionHook *> unpinned{nullptr};
+
+    // Memory charged to `usedmem` for an entry with the given key and value
+    // sizes: the value, or with the compact layout the entry's whole chunk
+    // (rounded up to its size class) and its slot in the index
+    size_type charge(std::size_t key_size, size_type size) const {
+        if constexpr (COMPACT) {
+            return static_cast<size_type>(
+                arena.chunk_size(Entry::chunk_size(key_size, size)) +
+                Index::ENTRY_SIZE);
+        } else {
+            return size;
+        }
+    }
+
+    size_type charge(const Entry *entry) const {
+        return charge(entry->key_size, entry->size);
+    }
+
+    void deallocate(Entry *entry) {
+        const auto chunk_size = Entry::chunk_size(entry->key_size, entry->size);
+        entry->~Entry();
+        arena.deallocate(entry, chunk_size);
+    }
+
+    // Free an entry that has been removed from the cache, or leave it to be
+    // freed once its value is no longer pinned
+    void free_entry(Entry *entry) {
+        const auto pins =
+            entry->pins.fetch_or(Entry::DETACHED, std::memory_order_acq_rel);
+        if (pins == 0) {
+            deallocate(entry);
+        }
+    }
+
+    // Free the entries whose last pin has been released since the last call
+    void collect_unpinned() {
+        auto hook = unpinned.exchange(nullptr, std::memory_order_acquire);
+        while (hook != nullptr) {
+            const auto next = hook->next;
+            deallocate(Entry::from_hook(hook));
+            hook = next;
+        }
+    }
+
+    // Free an entry (it must already have been removed from the index, or
+    // its pointer in the index must be overwritten)
+    void release(Entry *entry) {
+        if (intrusive != nullptr) {
+            intrusive->unlink(entry->hook);
+        }
+        cancel_timer(entry);
+        usedmem -= charge(entry);
+        free_entry(entry);
+    }
+
+    // Move every entry out of the index and free them on another thread
+    // (after the index emptied by the previous call has been freed)
+    void reclaim() {
+        if (reclaiming.valid()) {
+            reclaiming.wait();
+        }
+        auto old = std::make_unique<Index>(std::move(entries));
+        try {
+            reclaiming = std::async(std::launch::async,
+                                    [old = std::move(old)]() mutable {
+                                        old.reset();
+                                    });
+        } catch (const std::system_error &) {
+            // No thread could be started, so the old index was freed here
+        }
+    }
+
+    // Inform the evictor that an entry with the given key has been accessed
+    void touch_entry(const key_type &key, Entry *entry) const {
+        if (intrusive != nullptr) {
+            intrusive->touch(entry->hook);
+        } else if (evictor != nullptr) {
+            evictor->touch_key(key);
+        }
+    }
+
+    // Whether the admission policy (if any) allows evicting `victim` to make
+    // space for `candidate` (nullptr if the key being set is already cached)
+    bool admits(const key_type *candidate, const key_type &victim) const {
+        return candidate == nullptr || admission == nullptr ||
+               admission->admit(*candidate, victim);
+    }
+
+    // Whether an entry's value is pinned (it is not detached, since it is
+    // still in the cache)
+    static bool pinned(const Entry *entry) {
+        return entry->pins.load(std::memory_order_acquire) != 0;
+    }
+
+    // Ask the evictor for an entry to evict and delete it; returns the key of
+    // the entry, or "" if there is nothing to evict or the admission policy
+    // rejects `candidate` (in which case nothing is evicted). Evicting a
+    // pinned entry would free no memory until it is unpinned, so pinned
+    // entries are put back as if they had just been used (they are being
+    // read), counting each one in `skipped`, and "" is returned once that
+    // reaches `MAX_PINNED_SKIPS`.
+    key_type evict_one(const key_type *candidate, unsigned &skipped) {
+        if (intrusive != nullptr) {
+            for (;;) {
+                // Get entry to evict from evictor (it has already been
+                // unlinked)
+                auto hook = intrusive->evict_hook();
+                if (hook == nullptr) {
+                    return "";
+                }
+                auto entry = Entry::from_hook(hook);
+                if (pinned(entry)) {
+                    intrusive->link(*hook);
+                    if (++skipped == MAX_PINNED_SKIPS) {
+                        return "";
+                    }
+                    continue;
+                }
+                key_type entry_key{entry->key_data(), entry->key_size};
+                // Keep the entry if the candidate is not worth evicting it
+                // for (the evictor cannot put it back where it was, so it is
+                // linked again as if it were new)
+                if (!admits(candidate, entry_key)) {
+                    intrusive->link(*hook);
+                    return "";
+                }
+                // Evict the entry
+                entries.take(entry_key);
+                if (admission != nullptr) {
+                    admission->forget(entry_key);
+                }
+                cancel_timer(entry);
+                usedmem -= charge(entry);
+                free_entry(entry);
+                ++num_evictions;
+                return entry_key;
             }
-            // Get entry to evict from evictor
-            auto entry_key = evictor->evict();
-            // Return if evictor does not know what to evict
+        }
+        for (;;) {
+            // Get entry to evict from evictor (if there is one)
+            auto entry_key = evictor != nullptr ? evictor->evict() : "";
             if (entry_key == "") {
-                return;
+                return entry_key;
+            }
+            // The evictor may return keys that are no longer cached, which
+            // can always be evicted
+            const auto slot = entries.find(entry_key);
+            if (slot != nullptr && *slot != nullptr && pinned(*slot)) {
+                evictor->touch_key(entry_key);
+                if (++skipped == MAX_PINNED_SKIPS) {
+                    return "";
+                }
+                continue;
+            }
+            // Keep the entry if the candidate is not worth evicting it for
+            if (slot != nullptr && !admits(candidate, entry_key)) {
+                evictor->touch_key(entry_key);
+                return "";
             }
             // Evict the entry
-            del(entry_key);
+            num_evictions += del(entry_key);
+            return entry_key;
+        }
+    }
+
+    // Evict an entry on a page being moved to another size class, unless it
+    // is pinned (or detached and waiting to be freed)
+    void evict_chunk(Entry *entry) {
+        if (pinned(entry)) {
+            return;
+        }
+        const key_type entry_key{entry->key()};
+        entries.take(entry_key);
+        if (admission != nullptr) {
+            admission->forget(entry_key);
+        }
+        release(entry);
+        ++num_evictions;
+    }
+
+  public:
+    template <typename Hasher>
+    Indexed(size_type maxmem, float max_load_factor, Evictor *evictor,
+            const Hasher &hasher, Admission *admission)
+    : maxmem{maxmem}, evictor{evictor},
+      intrusive{dynamic_cast<IntrusiveEvictor *>(evictor)},
+      admission{admission}, arena{maxmem}, entries{max_load_factor, hasher} {}
+
+    void set(const key_type &key, val_type val, size_type size,
+             ttl_type ttl) override {
+        collect_unpinned();
+        // Reclaim the memory of expired entries before evicting any
+        expire();
+        if (admission != nullptr) {
+            admission->record(key);
+        }
+        // Free the existing entry if present, but keep its place in the index
+        // so that it can be reused (unless the index reads its key from it)
+        auto slot = entries.find(key);
+        // Only new keys are subject to admission
+        const key_type *candidate = slot == nullptr ? &key : nullptr;
+        if constexpr (COMPACT) {
+            if (slot != nullptr) {
+                release(*entries.take(key));
+                slot = nullptr;
+            }
+        } else if (slot != nullptr && *slot != nullptr) {
+            release(*slot);
+            *slot = nullptr;
+        }
+        // Evict if necessary to make space for the entry and allocate it (the
+        // arena may be out of chunks for this size even if `maxmem` has not
+        // been reached)
+        const auto chunk_size = Entry::chunk_size(key.size(), size);
+        const auto needed = charge(key.size(), size);
+        void *chunk = nullptr;
+        // Whether a page can still be moved to the entry's size class
+        auto can_reassign = true;
+        // Number of pinned entries passed over by `evict_one()`
+        unsigned pinned_skipped = 0;
+        // Give up if the entry cannot possibly fit in the cache
+        while (needed <= maxmem) {
+            if (space_used() + needed <= maxmem) {
+                if ((chunk = arena.allocate(chunk_size)) != nullptr) {
+                    break;
+                }
+                // There is room for the entry but no chunk of its size, so
+                // take a page from another size class (evicting the entries
+                // on it) rather than evicting in LRU order until one happens
+                // to empty; stop trying once a page cannot be emptied
+                if (can_reassign) {
+                    if (arena.reassign_page(chunk_size, [&](void *chunk) {
+                            evict_chunk(static_cast<Entry *>(chunk));
+                        })) {
+                        continue;
+                    }
+                    can_reassign = false;
+                }
+            }
+            // Give up if there is nothing left to evict
+            const auto entry_key = evict_one(candidate, pinned_skipped);
+            if (entry_key == "") {
+                break;
+            }
+            if (entry_key == key) {
+                slot = nullptr;
+            }
+        }
+        if (chunk == nullptr) {
+            // The old value is gone either way, so remove it from the index
+            if (slot != nullptr) {
+                entries.take(key);
+            }
+            return;
+        }
+        // Copy the key and the data, add the entry, and update `usedmem`
+        auto entry = new (chunk)
+            Entry{{}, static_cast<uint32_t>(key.size()), size};
+        std::copy(key.begin(), key.end(), entry->key_data());
+        std::copy(val, val + size, entry->data());
+        if (slot == nullptr) {
+            slot = &entries.emplace(key, entry);
+        }
+        *slot = entry;
+        usedmem += needed;
+        if (ttl > ttl_type::zero()) {
+            entry->timer = timers.schedule(
+                entry, now() + static_cast<Entry::timer_wheel::tick_type>(
+                                   ttl.count()));
         }
-        // Copy the data, add the entry, and update `usedmem`
-        usedmem += (entries[key] = data_type{val, val + size}).size();
         // If there is an evictor, inform it that the key has been touched
-        if (evictor != nullptr) {
+        if (intrusive != nullptr) {
+            intrusive->link(entry->hook);
+        } else if (evictor != nullptr) {
             evictor->touch_key(key);
         }
     }
 
-    val_type get(const key_type &key, size_type &val_size) const {
+    val_type get(const key_type &key, size_type &val_size) const override {
+        if (admission != nullptr) {
+            admission->record(key);
+        }
         // Search for an entry matching the key
-        auto entry = entries.find(key);
-        // Check whether an entry was found
-        if (entry != entries.end()) {
+        auto slot = entries.find(key);
+        // Check whether an entry was found (expired entries count as missing)
+        if (slot != nullptr && !expired(*slot)) {
+            auto entry = *slot;
             // If there is an evictor, inform it that the key has been touched
-            if (evictor != nullptr) {
-                evictor->touch_key(key);
-            }
+            touch_entry(key, entry);
             // Set the size and return the data
-            val_size = entry->second.size();
-            return entry->second.data();
+            val_size = entry->size;
+            return entry->data();
         } else {
             // Return nullptr if entry does not exist
             return nullptr;
         }
     }
 
-    bool del(const key_type &key) {
+    val_type peek(const key_type &key,
+                  size_type &val_size) const override {
         // Search for an entry matching the key
-        auto entry = entries.find(key);
+        auto slot = entries.find(key);
+        // Return nullptr if entry does not exist or has expired
+        if (slot == nullptr || expired(*slot)) {
+            return nullptr;
+        }
+        // Set the size and return the data
+        val_size = (*slot)->size;
+        return (*slot)->data();
+    }
+
+    void touch(const key_type &key) override {
+        if (admission != nullptr) {
+            admission->record(key);
+        }
+        // Only inform the evictor about keys that are still in the cache
+        auto slot = entries.find(key);
+        if (slot != nullptr) {
+            touch_entry(key, *slot);
+        }
+    }
+
+    bool del(const key_type &key) override {
+        // Remove the entry matching the key, if there is one
+        auto entry = entries.take(key);
         // Check whether an entry was found
-        if (entry != entries.end()) {
-            // Update `usedmem`
-            usedmem -= entry->second.size();
-            // Delete the entry
-            entries.erase(entry);
-            // Return true (success)
-            return true;
+        if (entry) {
+            // Free the entry and update `usedmem` (the entry may be missing
+            // if its value is being replaced by `set()`)
+            const auto found = *entry != nullptr && !expired(*entry);
+            if (*entry != nullptr) {
+                release(*entry);
+            }
+            if (admission != nullptr) {
+                admission->forget(key);
+            }
+            // Return whether the entry was still live
+            return found;
         } else {
-            // Return true (failure)
+            // Return false (failure)
             return false;
         }
     }
 
-    size_type space_used() const {
+    size_type space_used() const override {
         return usedmem;
     }
 
-    void reset() {
-        // Remove all entries
-        entries.clear();
+    size_type expire() override {
+        if (timers.size() == 0) {
+            return 0;
+        }
+        return static_cast<size_type>(timers.advance(now(), [&](Entry *entry) {
+            // The timer is gone already
+            entry->timer = Entry::timer_wheel::NONE;
+            del(key_type{entry->key_data(), entry->key_size});
+        }));
+    }
+
+    void for_each(const entry_visitor &fn) const override {
+        const auto tick = now();
+        const auto visit = [&](const Entry *entry) {
+            // Skip entries replaced by `set()` and ones that have expired
+            if (entry == nullptr) {
+                return;
+            }
+            auto ttl = ttl_type::zero();
+            if (entry->timer != Entry::timer_wheel::NONE) {
+                const auto deadline = timers.deadline(entry->timer);
+                if (deadline <= tick) {
+                    return;
+                }
+                ttl = ttl_type{deadline - tick};
+            }
+            const auto data = const_cast<Entry *>(entry)->data();
+            fn({data + entry->size, entry->key_size}, data, entry->size, ttl);
+        };
+        if (intrusive != nullptr) {
+            intrusive->for_each_hook([&](const EvictionHook &hook) {
+                visit(Entry::from_hook(const_cast<EvictionHook *>(&hook)));
+            });
+            return;
+        }
+        // Key-based evictors may still know of keys that have been deleted
+        if (evictor != nullptr &&
+            evictor->for_each_key([&](const key_type &key) {
+                const auto slot = entries.find(key);
+                if (slot != nullptr) {
+                    visit(*slot);
+                }
+            })) {
+            return;
+        }
+        entries.for_each(visit);
+    }
+
+    void reset() override {
+        // Entries that are pinned now must stay allocated (no more can be
+        // pinned while the cache is being modified)
+        const auto any_pinned = num_pinned.load(std::memory_order_acquire) != 0;
+        if (any_pinned) {
+            // Free the entries one at a time
+            collect_unpinned();
+            entries.for_each([&](Entry *entry) {
+                if (entry != nullptr) {
+                    free_entry(entry);
+                }
+            });
+        } else {
+            // Every entry is about to be freed along with the arena
+            unpinned.store(nullptr, std::memory_order_relaxed);
+        }
+        // Remove all entries (and free all of them at once if none are
+        // pinned). Freeing a large index takes a while, so it is swapped for
+        // an empty one and freed on another thread; that only touches the
+        // index's own memory, not the entries it points to.
+        if (entries.size() < LAZY_RESET_MIN_ENTRIES) {
+            entries.clear();
+        } else {
+            reclaim();
+        }
+        if (!any_pinned) {
+            arena.clear();
+        }
+        if (intrusive != nullptr) {
+            intrusive->clear();
+        }
+        if (admission != nullptr) {
+            admission->clear();
+        }
+        timers.clear();
         // Reset `usedmem`
         usedmem = 0;
     }
+
+    void pin(val_type val) const override {
+        const auto pins =
+            Entry::from_data(val)->pins.fetch_add(1, std::memory_order_acq_rel);
+        if (pins == 0) {
+            num_pinned.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void unpin(val_type val) const override {
+        auto entry = Entry::from_data(val);
+        const auto pins = entry->pins.fetch_sub(1, std::memory_order_acq_rel);
+        if ((pins & ~Entry::DETACHED) != 1) {
+            return;
+        }
+        // This was the last pin
+        if (pins & Entry::DETACHED) {
+            // Leave the entry to be freed by the next writer
+            auto head = unpinned.load(std::memory_order_relaxed);
+            do {
+                entry->hook.next = head;
+            } while (!unpinned.compare_exchange_weak(
+                head, &entry->hook, std::memory_order_release,
+                std::memory_order_relaxed));
+        }
+        // Only count the entry as unpinned once it has been pushed, so that
+        // `reset()` never frees the arena under a concurrent `unpin()`
+        num_pinned.fetch_sub(1, std::memory_order_release);
+    }
+
+    size_type space_reserved() const override {
+        return static_cast<size_type>(arena.reserved());
+    }
+
+    std::vector<SlabAllocator::ClassStats> slab_stats() const override {
+        return arena.stats();
+    }
+
+    uint64_t evictions() const override {
+        return num_evictions;
+    }
 };
 
+std::unique_ptr<Cache::Impl>
+Cache::Impl::create(size_type maxmem, float max_load_factor, Evictor *evictor,
+                    const hash_func &hasher, IndexType index,
+                    Admission *admission) {
+    switch (index) {
+    case IndexType::CHAINED:
+        return std::make_unique<Indexed<ChainedIndex<Entry *, hash_func>>>(
+            maxmem, max_load_factor, evictor, hasher, admission);
+    case IndexType::FLAT:
+        // Call `std::hash` directly unless a different hash function was
+        // provided
+        if (hasher.target<std::hash<key_type>>() != nullptr) {
+            return std::make_unique<Indexed<FlatIndex<Entry *, StringHasher>>>(
+                maxmem, max_load_factor, evictor, StringHasher{}, admission);
+        }
+        return std::make_unique<
+            Indexed<FlatIndex<Entry *, FunctionHasher<hash_func>>>>(
+            maxmem, max_load_factor, evictor,
+            FunctionHasher<hash_func>{hasher}, admission);
+    case IndexType::COMPACT:
+        if (hasher.target<std::hash<key_type>>() != nullptr) {
+            return std::make_unique<
+                Indexed<FlatIndex<Entry *, StringHasher, EntryKey>>>(
+                maxmem, max_load_factor, evictor, StringHasher{}, admission);
+        }
+        return std::make_unique<Indexed<
+            FlatIndex<Entry *, FunctionHasher<hash_func>, EntryKey>>>(
+            maxmem, max_load_factor, evictor,
+            FunctionHasher<hash_func>{hasher}, admission);
+    }
+    __builtin_unreachable();
+}
+
 Cache::Cache(size_type maxmem, float max_load_factor, Evictor *evictor,
-             hash_func hasher)
-: pImpl_(new Impl{maxmem, max_load_factor, evictor, hasher}) {}
+             hash_func hasher, IndexType index, Admission *admission)
+: pImpl_(Impl::create(maxmem, max_load_factor, evictor, hasher, index,
+                      admission)) {}
 
 Cache::~Cache() = default;
 
-void Cache::set(key_type key, val_type val, size_type size) {
-    pImpl_->set(key, val, size);
+void Cache::set(key_type key, val_type val, size_type size, ttl_type ttl) {
+    pImpl_->set(key, val, size, ttl);
 }
 
 Cache::val_type Cache::get(key_type key, size_type &val_size) const {
     return pImpl_->get(key, val_size);
 }
 
+Cache::val_type Cache::peek(key_type key, size_type &val_size) const {
+    return pImpl_->peek(key, val_size);
+}
+
+void Cache::touch(key_type key) {
+    pImpl_->touch(key);
+}
+
 bool Cache::del(key_type key) {
     return pImpl_->del(key);
 }
 
+void Cache::mset(const std::vector<KeyValue> &entries) {
+    for (const auto &entry : entries) {
+        pImpl_->set(entry.key, entry.val, entry.size, ttl_type::zero());
+    }
+}
+
+std::vector<Cache::val_type>
+Cache::mget(const std::vector<key_type> &keys,
+            std::vector<size_type> &val_sizes) const {
+    std::vector<val_type> values(keys.size());
+    val_sizes.assign(keys.size(), 0);
+    // Reading entries never moves or frees any, so every pointer stays valid
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        values[i] = pImpl_->get(keys[i], val_sizes[i]);
+    }
+    return values;
+}
+
+Cache::size_type Cache::mdel(const std::vector<key_type> &keys) {
+    size_type deleted = 0;
+    for (const auto &key : keys) {
+        deleted += pImpl_->del(key);
+    }
+    return deleted;
+}
+
 Cache::size_type Cache::space_used() const {
     return pImpl_->space_used();
 }
 
+Cache::size_type Cache::expire() {
+    return pImpl_->expire();
+}
+
+void Cache::for_each(const entry_visitor &fn) const {
+    pImpl_->for_each(fn);
+}
+
 void Cache::reset() {
     pImpl_->reset();
 }
+
+void Cache::pin(val_type val) const {
+    pImpl_->pin(val);
+}
+
+void Cache::unpin(val_type val) const {
+    pImpl_->unpin(val);
+}
+
+Cache::size_type Cache::space_reserved() const {
+    return pImpl_->space_reserved();
+}
+
+std::vector<SlabAllocator::ClassStats> Cache::slab_stats() const {
+    return pImpl_->slab_stats();
+}
+
+uint64_t Cache::evictions() const {
+    return pImpl_->evictions();
+}
@@ -1,15 +1,38 @@
+#include "binary_protocol.hh"
 #include "cache.hh"
+#include "clock_evictor.hh"
+#include "fifo_evictor.hh"
+#include "intrusive_lru_evictor.hh"
+#include "lru_evictor.hh"
+#include "request_parser.hh"
+#include "server_stats.hh"
+#include "shared_cache.hh"
+#include "tinylfu_admission.hh"
+#include "trace.hh"
+#include "uring_server.hh"
 
 #include <boost/asio.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/beast/version.hpp>
 #include <boost/program_options.hpp>
+#include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <optional>
-#include <regex>
 #include <string>
+#include <system_error>
 #include <thread>
+#include <utility>
+#include <vector>
 
 namespace net = boost::asio;
 namespace beast = boost::beast;
@@ -23,92 +46,237 @@ constexpr auto DEFAULT_PORT = 4022;
 /// Timeout for reading a request
 constexpr auto SOCKET_TIMEOUT = std::chrono::seconds(10);
 
-/// Regular expressions for parsing request targets
-const std::regex KEY_RE{R"(/([A-Za-z0-9\._-]+))"};
-const std::regex KEY_VALUE_RE{R"(/([A-Za-z0-9\._-]+)/([A-Za-z0-9\._-]+))"};
+/// Bytes of memory limit per key tracked by the frequency sketch of an
+/// admission policy (the sketch uses about 2 bytes per key, and tracks more
+/// keys than fit in the cache so that it remembers evicted keys)
+constexpr Cache::size_type ADMISSION_BYTES_PER_KEY = 16;
 
-/// Thread-safe wrapper over a `Cache`
-class SharedCache {
+/// Media type of raw values in request and response bodies
+constexpr auto OCTET_STREAM = "application/octet-stream";
+
+/// HTTP body for a successful GET response: some text around a value pinned
+/// in the cache, which is written to the socket straight from cache memory
+struct PinnedValueBody {
+    struct value_type {
+        /// Text written before and after the value
+        std::string prefix;
+        std::string_view suffix;
+        /// Pin that keeps `bytes` valid
+        SharedCache::PinnedValue value;
+        /// Part of the pinned value to write
+        std::string_view bytes;
+    };
+
+    static std::uint64_t size(const value_type &body) {
+        return body.prefix.size() + body.bytes.size() + body.suffix.size();
+    }
+
+    /// Provides the whole body as one buffer sequence, so the serializer can
+    /// write it along with the header in a single gathering write
+    class writer {
+      private:
+        const value_type &body;
+
+      public:
+        using const_buffers_type = std::array<net::const_buffer, 3>;
+
+        template <bool isRequest, class Fields>
+        writer(const http::header<isRequest, Fields> &, const value_type &body)
+        : body{body} {}
+
+        void init(beast::error_code &error) {
+            error = {};
+        }
+
+        boost::optional<std::pair<const_buffers_type, bool>>
+        get(beast::error_code &error) {
+            error = {};
+            return {{const_buffers_type{
+                         net::buffer(body.prefix),
+                         net::buffer(body.bytes.data(), body.bytes.size()),
+                         net::buffer(body.suffix.data(), body.suffix.size())},
+                     false}};
+        }
+    };
+};
+
+/// Get the part of a stored value that JSON responses show (values set through
+/// the target are stored with a terminating null byte, which is left out)
+std::string_view json_value(std::string_view value) {
+    if (!value.empty() && value.back() == '\0') {
+        value.remove_suffix(1);
+    }
+    return value;
+}
+
+/// Whether a value can be put in a JSON string without escaping
+bool is_json_safe(std::string_view value) {
+    return std::all_of(value.begin(), value.end(), [](char c) {
+        return c >= 0x20 && c < 0x7f && c != '"' && c != '\\';
+    });
+}
+
+/// Append a value to a JSON string, escaping quotes, backslashes, control
+/// characters and bytes outside of ASCII (the latter as `\u00XX`, so they
+/// read back as Latin-1)
+void append_json_escaped(std::string &out, std::string_view value) {
+    constexpr auto HEX_DIGITS = "0123456789abcdef";
+    for (const auto c : value) {
+        const auto byte = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            out.push_back('\\');
+            out.push_back(c);
+        } else if (byte < 0x20 || byte >= 0x7f) {
+            out.append("\\u00");
+            out.push_back(HEX_DIGITS[byte >> 4]);
+            out.push_back(HEX_DIGITS[byte & 0xf]);
+        } else {
+            out.push_back(c);
+        }
+    }
+}
+
+/// Copy a value given in a target, adding a terminating null byte (so that it
+/// reads back the same way as values set by `cache_client`)
+std::string with_terminator(std::string_view value) {
+    std::string result;
+    result.reserve(value.size() + 1);
+    result.append(value).push_back('\0');
+    return result;
+}
+
+/// Record a request for a key in a trace, unless `trace` is nullptr
+void record_trace(trace::Writer *trace, trace::Op op, std::string_view key,
+                  std::size_t value_size = 0) {
+    if (trace != nullptr) {
+        trace->add(op, key, value_size);
+    }
+}
+
+/// Worker threads of the thread-per-core mode: each thread runs its own I/O
+/// context, pinned to a core, and owns the cache shard with the same index, so
+/// requests for a key can be handed to the thread that owns the key's shard
+class Router {
   private:
-    std::unique_ptr<Cache> cache;
-    std::mutex mutex;
+    std::vector<std::unique_ptr<net::io_context>> contexts;
+    /// Cores the process may run on, which worker threads are pinned to in
+    /// turn (empty if they could not be found, in which case threads are not
+    /// pinned)
+    std::vector<int> cores;
+
+    /// Index of the worker thread running on the current thread
+    static thread_local unsigned current;
+
+    /// Get the cores the process may run on (a CPU count may be unknown, or
+    /// larger than the set the process is confined to)
+    static std::vector<int> allowed_cores() {
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+            std::cerr << "warning: unable to get the allowed cores ("
+                      << std::generic_category().message(errno)
+                      << "), so worker threads are not pinned" << std::endl;
+            return {};
+        }
+        std::vector<int> cores;
+        for (auto core = 0; core < CPU_SETSIZE; ++core) {
+            if (CPU_ISSET(core, &allowed)) {
+                cores.push_back(core);
+            }
+        }
+        return cores;
+    }
 
   public:
-    SharedCache(std::unique_ptr<Cache> cache) : cache{std::move(cache)} {}
+    explicit Router(unsigned num_threads) : cores{allowed_cores()} {
+        for (auto i = 0U; i < num_threads; ++i) {
+            contexts.push_back(std::make_unique<net::io_context>(1));
+        }
+    }
 
-    /// Wrapper over `Cache::set` that takes a string value
-    void set(const std::string &key, const std::string &val) {
-        std::lock_guard lock{mutex};
-        cache->set(key, val.c_str(), val.size() + 1);
+    /// I/O context of a worker thread
+    net::io_context &context(unsigned thread) {
+        return *contexts[thread];
     }
 
-    /// Wrapper over `Cache::get` that copies the returned value into a string
-    /// (returns "" if the value was not found)
-    std::string get(const std::string &key) {
-        std::lock_guard lock{mutex};
-        Cache::size_type size;
-        Cache::val_type value = cache->get(key, size);
-        return value != nullptr ? std::string{value, size - 1} : "";
+    /// Index of the worker thread running on the current thread
+    static unsigned current_thread() {
+        return current;
     }
 
-    /// Wrapper over `Cache::del`
-    bool del(const key_type &key) {
-        std::lock_guard lock{mutex};
-        return cache->del(key);
+    /// Run worker thread `thread` on the current thread, pinned to a core,
+    /// until it is stopped
+    void run(unsigned thread) {
+        current = thread;
+        if (!cores.empty()) {
+            const auto core = cores[thread % cores.size()];
+            cpu_set_t core_set;
+            CPU_ZERO(&core_set);
+            CPU_SET(core, &core_set);
+            const auto error =
+                pthread_setaffinity_np(pthread_self(), sizeof(core_set),
+                                       &core_set);
+            if (error != 0) {
+                std::cerr << "warning: unable to pin worker thread " << thread
+                          << " to core " << core << " ("
+                          << std::generic_category().message(error) << ")"
+                          << std::endl;
+            }
+        }
+        contexts[thread]->run();
     }
 
-    /// Wrapper over `Cache::space_used`
-    Cache::size_type space_used() {
-        std::lock_guard lock{mutex};
-        return cache->space_used();
+    /// Stop every worker thread
+    void stop() {
+        for (auto &context : contexts) {
+            context->stop();
+        }
     }
 
-    /// Wrapper over `Cache::reset`
-    void reset() {
-        std::lock_guard lock{mutex};
-        cache->reset();
+    /// Run a function on worker thread `thread`
+    template <typename F> void post(unsigned thread, F &&fn) {
+        net::post(*contexts[thread], std::forward<F>(fn));
     }
 };
 
+thread_local unsigned Router::current = 0;
+
 /// Class representing a client connection
 class Connection : public std::enable_shared_from_this<Connection> {
   private:
     beast::tcp_stream stream;
     std::shared_ptr<SharedCache> cache;
+    // Worker threads to hand requests to in thread-per-core mode (otherwise
+    // nullptr)
+    std::shared_ptr<Router> router;
+    std::shared_ptr<ServerStats> stats;
+    // Trace that requests are recorded to (nullptr if none is)
+    std::shared_ptr<trace::Writer> trace;
 
     // These values are stored in the class so that they stay alive throughout
     // the duration of an async operation
     using buffer_type = beast::flat_buffer;
-    using request_type = http::request<http::empty_body>;
+    using request_type = http::request<http::string_body>;
+    using parser_type = http::request_parser<http::string_body>;
     using response_type = std::shared_ptr<void>;
-    buffer_type buffer;     // Buffer used by `http::async_read`
-    request_type request;   // Request set by `http::async_read`
-    response_type response; // Response used by `http::async_write`
-
-    /// Extract the key from a target
-    std::optional<std::string> extract_key(const std::string &target) const {
-        // Attempt to match against key regex
-        std::smatch match;
-        if (!std::regex_match(target, match, KEY_RE)) {
-            // No match
-            return std::nullopt;
-        }
-        // Return key
-        return std::optional<std::string>{match[1]};
+    buffer_type buffer;                // Buffer used by `http::async_read`
+    std::optional<parser_type> parser; // Parser used by `http::async_read`
+    response_type response;            // Response used by `http::async_write`
+    // Reused to parse the keys or key-value pairs in a request's target
+    std::vector<std::string_view> keys;
+    std::vector<key_value_view> pairs;
+
+    /// Get a view of a request's target
+    static std::string_view target_of(const request_type &request) {
+        const auto target = request.target();
+        return {target.data(), target.size()};
     }
 
-    /// Extract the key-value pair from a target
-    std::optional<std::pair<std::string, std::string>>
-    extract_key_value(const std::string &target) const {
-        // Attempt to match against key-value regex
-        std::smatch match;
-        if (!std::regex_match(target, match, KEY_VALUE_RE)) {
-            // No match
-            return std::nullopt;
-        }
-        // Return key-value pair
-        return std::make_optional<std::pair<std::string, std::string>>(
-            match[1], match[2]);
+    /// Whether the client asked for raw values rather than JSON
+    static bool wants_raw_values(const request_type &request) {
+        const auto accept = request[http::field::accept];
+        return std::string_view{accept.data(), accept.size()}.find(
+                   OCTET_STREAM) != std::string_view::npos;
     }
 
     /// Make an HTTP response with the specified status
@@ -129,6 +297,70 @@ class Connection : public std::enable_shared_from_this<Connection> {
         return response;
     }
 
+    /// Get the shard holding every key that a request acts on, if there is
+    /// one (leaves the request's keys in `keys` or `pairs`)
+    std::optional<unsigned> shard_of(const request_type &request) {
+        const auto target = target_of(request);
+        std::optional<unsigned> shard;
+        // Returns false if `key` is in a different shard than the others
+        const auto same_shard = [&](std::string_view key) {
+            const auto key_shard = cache->shard_index(key);
+            if (shard && *shard != key_shard) {
+                return false;
+            }
+            shard = key_shard;
+            return true;
+        };
+        switch (request.method()) {
+        case http::verb::get:
+        case http::verb::delete_:
+            keys.clear();
+            if (!parse_key_list_target(target, keys)) {
+                return std::nullopt;
+            }
+            for (const auto key : keys) {
+                if (!same_shard(key)) {
+                    return std::nullopt;
+                }
+            }
+            return shard;
+        case http::verb::put:
+            if (const auto key = parse_key_target(target)) {
+                return cache->shard_index(*key);
+            }
+            pairs.clear();
+            if (!parse_key_value_list_target(target, pairs)) {
+                return std::nullopt;
+            }
+            for (const auto &pair : pairs) {
+                if (!same_shard(pair.first)) {
+                    return std::nullopt;
+                }
+            }
+            return shard;
+        default:
+            return std::nullopt;
+        }
+    }
+
+    /// Handle a request, on the worker thread that owns its keys' shard if
+    /// there is a router (requests for keys in several shards, and requests
+    /// for the whole cache, use the other shards' locks instead)
+    void route_request(request_type &&request) {
+        if (router != nullptr) {
+            const auto shard = shard_of(request);
+            if (shard && *shard != Router::current_thread()) {
+                // The response is written back on this connection's strand
+                return router->post(
+                    *shard, [self = shared_from_this(),
+                             request = std::move(request)]() mutable {
+                        self->handle_request(std::move(request));
+                    });
+            }
+        }
+        handle_request(std::move(request));
+    }
+
     /// Handle a request
     void handle_request(request_type &&request) {
         switch (request.method()) {
@@ -150,57 +382,217 @@ class Connection : public std::enable_shared_from_this<Connection> {
 
     /// Handle a GET request
     void handle_get_request(request_type &&request) {
-        // Extract the key from the target
-        const auto key = extract_key(request.target().to_string());
+        // Extract the keys from the target
+        keys.clear();
         // Send 400 Bad Request if the target did not match
-        if (key == std::nullopt) {
+        if (!parse_key_list_target(target_of(request), keys)) {
             return do_write(
                 make_empty_response(http::status::bad_request, request));
         }
-        // Fetch the value from the cache
-        std::string value = cache->get(*key);
-        // Check whether the value was found
-        if (value != "") {
+        for (const auto key : keys) {
+            record_trace(trace.get(), trace::Op::GET, key);
+        }
+        if (keys.size() > 1) {
+            return handle_batch_get_request(std::move(request));
+        }
+        ServerStats::RequestTimer timer{*stats, ServerStats::Op::GET};
+        const auto key = keys.front();
+        // Pin the value in the cache rather than copying it
+        auto value = cache->get_pinned(key_type{key});
+        // Send 404 Not Found if the value was not found
+        if (!value) {
+            timer.not_found();
+            return do_write(
+                make_empty_response(http::status::not_found, request));
+        }
+        timer.found();
+        auto response =
+            make_response<PinnedValueBody>(http::status::ok, request);
+        auto &body = response.body();
+        if (wants_raw_values(request)) {
+            // Send 200 OK with the value as the body
+            response.set(http::field::content_type, OCTET_STREAM);
+            body.bytes = value.view();
+        } else {
             // Send 200 OK with a JSON body containing the key-value pair
-            auto response =
-                make_response<http::string_body>(http::status::ok, request);
             response.set(http::field::content_type, "application/json");
-            response.body() =
-                R"({"key":")" + *key + R"(","value":")" + value + R"("})";
-            response.prepare_payload();
-            do_write(response);
+            body.prefix.append(R"({"key":")").append(key);
+            body.prefix.append(R"(","value":")");
+            body.suffix = R"("})";
+            const auto shown = json_value(value.view());
+            if (is_json_safe(shown)) {
+                body.bytes = shown;
+            } else {
+                append_json_escaped(body.prefix, shown);
+            }
+        }
+        body.value = std::move(value);
+        response.prepare_payload();
+        do_write(std::move(response));
+    }
+
+    /// Handle a GET request for several keys (in `keys`)
+    void handle_batch_get_request(request_type &&request) {
+        ServerStats::RequestTimer timer{*stats, ServerStats::Op::MGET};
+        // Fetch the values from the cache
+        const auto values =
+            cache->mget(std::vector<key_type>{keys.begin(), keys.end()});
+        const auto num_found = std::count_if(
+            values.begin(), values.end(),
+            [](const std::optional<std::string> &value) {
+                return value.has_value();
+            });
+        timer.found(num_found);
+        timer.not_found(values.size() - num_found);
+        auto response =
+            make_response<http::string_body>(http::status::ok, request);
+        auto &body = response.body();
+        if (wants_raw_values(request)) {
+            // Send 200 OK with the result for each key, encoded as in the
+            // binary protocol
+            response.set(http::field::content_type, OCTET_STREAM);
+            for (const auto &value : values) {
+                binary_protocol::append_batch_result(
+                    body,
+                    value ? binary_protocol::Status::OK
+                          : binary_protocol::Status::NOT_FOUND,
+                    value.value_or(""));
+            }
         } else {
-            // Send 404 Not Found if the value was not found
-            do_write(make_empty_response(http::status::not_found, request));
+            // Send 200 OK with a JSON array of the key-value pairs that were
+            // found
+            response.set(http::field::content_type, "application/json");
+            body.push_back('[');
+            for (std::size_t i = 0; i < keys.size(); ++i) {
+                if (!values[i]) {
+                    continue;
+                }
+                if (body.size() > 1) {
+                    body.push_back(',');
+                }
+                body.append(R"({"key":")").append(keys[i]);
+                body.append(R"(","value":")");
+                append_json_escaped(body, json_value(*values[i]));
+                body.append(R"("})");
+            }
+            body.push_back(']');
+        }
+        response.prepare_payload();
+        do_write(std::move(response));
+    }
+
+    /// Get the TTL given in a request's `TTL` field in milliseconds (zero if
+    /// there is none), or nothing if the field is not a number
+    static std::optional<Cache::ttl_type> ttl_of(const request_type &request) {
+        const auto field = request["TTL"];
+        if (field.empty()) {
+            return Cache::ttl_type::zero();
+        }
+        Cache::ttl_type::rep ttl;
+        const auto end = field.data() + field.size();
+        const auto [last, error] = std::from_chars(field.data(), end, ttl);
+        if (error != std::errc{} || last != end || ttl < 0) {
+            return std::nullopt;
         }
+        return Cache::ttl_type{ttl};
     }
 
     /// Handle a PUT request
     void handle_put_request(request_type &&request) {
-        // Extract the key-value pair from the target
-        const auto kv_pair = extract_key_value(request.target().to_string());
+        const auto target = target_of(request);
+        // Every value set by the request gets the same TTL
+        const auto ttl = ttl_of(request);
+        // Send 400 Bad Request if the TTL is malformed
+        if (!ttl) {
+            return do_write(
+                make_empty_response(http::status::bad_request, request));
+        }
+        // `PUT /` sets every entry in the body, encoded as in the binary
+        // protocol
+        if (target == "/") {
+            ServerStats::RequestTimer timer{*stats, ServerStats::Op::MSET};
+            std::vector<std::pair<key_type, std::string>> entries;
+            binary_protocol::BatchReader reader{request.body()};
+            while (!reader.done()) {
+                std::string_view key, value;
+                // Send 400 Bad Request if the body is malformed
+                if (!reader.read_entry(key, value) ||
+                    key_span(key) != key.size() || key.empty()) {
+                    return do_write(make_empty_response(
+                        http::status::bad_request, request));
+                }
+                entries.emplace_back(key, value);
+            }
+            for (const auto &[key, value] : entries) {
+                record_trace(trace.get(), trace::Op::SET, key, value.size());
+            }
+            cache->mset(entries, *ttl);
+            return do_write(make_empty_response(http::status::ok, request));
+        }
+        // `PUT /key` sets the key to the body
+        if (const auto key = parse_key_target(target)) {
+            ServerStats::RequestTimer timer{*stats, ServerStats::Op::SET};
+            record_trace(trace.get(), trace::Op::SET, *key,
+                         request.body().size());
+            cache->set(key_type{*key}, request.body(), *ttl);
+            return do_write(make_empty_response(http::status::ok, request));
+        }
+        // Otherwise, extract the key-value pairs from the target
+        pairs.clear();
         // Send 400 Bad Request if the target did not match
-        if (kv_pair == std::nullopt) {
+        if (!parse_key_value_list_target(target, pairs)) {
             return do_write(
                 make_empty_response(http::status::bad_request, request));
         }
-        // Set the value and send 200 OK
-        cache->set(kv_pair->first, kv_pair->second);
+        // Record the values with their terminators, as they are stored
+        for (const auto &[key, value] : pairs) {
+            record_trace(trace.get(), trace::Op::SET, key, value.size() + 1);
+        }
+        // Set the values and send 200 OK
+        ServerStats::RequestTimer timer{
+            *stats, pairs.size() == 1 ? ServerStats::Op::SET
+                                      : ServerStats::Op::MSET};
+        if (pairs.size() == 1) {
+            cache->set(key_type{pairs.front().first},
+                       with_terminator(pairs.front().second), *ttl);
+        } else {
+            std::vector<std::pair<key_type, std::string>> entries;
+            entries.reserve(pairs.size());
+            for (const auto &[key, value] : pairs) {
+                entries.emplace_back(key, with_terminator(value));
+            }
+            cache->mset(entries, *ttl);
+        }
         do_write(make_empty_response(http::status::ok, request));
     }
 
     /// Handle a DELETE request
     void handle_delete_request(request_type &&request) {
-        // Extract the key from the target
-        const auto key = extract_key(request.target().to_string());
+        // Extract the keys from the target
+        keys.clear();
         // Send 400 Bad Request if the target did not match
-        if (key == std::nullopt) {
+        if (!parse_key_list_target(target_of(request), keys)) {
             return do_write(
                 make_empty_response(http::status::bad_request, request));
         }
+        for (const auto key : keys) {
+            record_trace(trace.get(), trace::Op::DEL, key);
+        }
+        if (keys.size() > 1) {
+            ServerStats::RequestTimer timer{*stats, ServerStats::Op::MDEL};
+            // Send 200 OK with the number of entries deleted in the `Deleted`
+            // field
+            const auto deleted =
+                cache->mdel(std::vector<key_type>{keys.begin(), keys.end()});
+            auto response = make_empty_response(http::status::ok, request);
+            response.set("Deleted", std::to_string(deleted));
+            return do_write(std::move(response));
+        }
         // Delete the entry
-        const auto status =
-            cache->del(*key) ? http::status::ok : http::status::not_found;
+        ServerStats::RequestTimer timer{*stats, ServerStats::Op::DEL};
+        const auto status = cache->del(key_type{keys.front()})
+                                ? http::status::ok
+                                : http::status::not_found;
         // Send 200 OK if the entry was deleted, or 404 Not Found if it was not
         // in the cache
         do_write(make_empty_response(status, request));
@@ -213,8 +605,8 @@ class Connection : public std::enable_shared_from_this<Connection> {
         // The server technically doesn't accept any content type since
         // everything is in the target, but this works as a substitute
         response.set(http::field::accept, "text/plain");
-        response.set("Space-Used", cache->space_used());
-        do_write(response);
+        response.set("Space-Used", std::to_string(cache->space_used()));
+        do_write(std::move(response));
     }
 
     /// Handle a POST request
@@ -222,50 +614,70 @@ class Connection : public std::enable_shared_from_this<Connection> {
         if (request.target() == "/reset") {
             cache->reset();
             do_write(make_empty_response(http::status::ok, request));
+        } else if (request.target() == "/stats") {
+            // Send 200 OK with the server's statistics as a JSON object (this
+            // is a POST so that `GET /stats` still gets the key "stats")
+            auto response =
+                make_response<http::string_body>(http::status::ok, request);
+            response.set(http::field::content_type, "application/json");
+            response.body() = stats->to_json(cache->shard_stats());
+            response.prepare_payload();
+            do_write(std::move(response));
         } else {
-            // Targets other than `/reset` are not supported
+            // Targets other than `/reset` and `/stats` are not supported
             do_write(make_empty_response(http::status::not_found, request));
         }
     }
 
     /// Read an HTTP request asynchronously
     void do_read() {
-        // Make the request empty before reading
-        request = {};
+        // Start with a new parser for each request, accepting values as large
+        // as the binary protocol does
+        parser.emplace();
+        parser->body_limit(binary_protocol::MAX_VALUE_SIZE);
         // Set the timeout
         stream.expires_after(SOCKET_TIMEOUT);
         // Dispatch the read operation
-        http::async_read(stream, buffer, request,
+        http::async_read(stream, buffer, *parser,
                          beast::bind_front_handler(&Connection::on_read,
                                                    shared_from_this()));
     }
 
     /// Handle the result of a read
-    void on_read(const beast::error_code error, const size_t) {
+    void on_read(const beast::error_code error, const size_t size) {
         // Close the connection if there was an error
         if (error) {
             return do_close();
         }
+        stats->record_bytes(size, 0);
         // Handle the request
-        handle_request(std::move(request));
+        route_request(parser->release());
     }
 
-    /// Write an HTTP response asynchronously
-    template <typename Body>
-    void do_write(const http::response<Body> &response_) {
-        const auto response_ptr =
+    /// Write an HTTP response asynchronously (may be called from another
+    /// thread, when the request was handed to it)
+    template <typename Body> void do_write(http::response<Body> &&response_) {
+        auto response_ptr =
             std::make_shared<http::response<Body>>(std::move(response_));
-        // Dispatch the write operation
-        http::async_write(stream, *response_ptr,
-                          beast::bind_front_handler(&Connection::on_write,
-                                                    shared_from_this(),
-                                                    response_ptr->need_eof()));
-        // Keep a type-erased pointer to the response
-        response = std::move(response_ptr);
+        // Start the write on the connection's strand (right away, unless this
+        // is another worker thread)
+        net::dispatch(stream.get_executor(), [self = shared_from_this(),
+                                              response_ptr = std::move(
+                                                  response_ptr)]() mutable {
+            // Dispatch the write operation
+            http::async_write(self->stream, *response_ptr,
+                              beast::bind_front_handler(
+                                  &Connection::on_write, self,
+                                  response_ptr->need_eof()));
+            // Keep a type-erased pointer to the response
+            self->response = std::move(response_ptr);
+        });
     }
 
     /// Handle the result of a write
-    void on_write(const bool close, const beast::error_code error, size_t) {
+    void on_write(const bool close, const beast::error_code error,
+                  const size_t size) {
+        stats->record_bytes(0, size);
         // Close the connection if there was an error or if the response
         // requires an EOF
         if (error || close) {
@@ -284,8 +696,19 @@ class Connection : public std::enable_shared_from_this<Connection> {
     }
 
   public:
-    Connection(tcp::socket &&socket, std::shared_ptr<SharedCache> cache)
-    : stream{std::move(socket)}, cache{std::move(cache)} {}
+    Connection(tcp::socket &&socket, std::shared_ptr<SharedCache> cache,
+               std::shared_ptr<Router> router,
+               std::shared_ptr<ServerStats> stats,
+               std::shared_ptr<trace::Writer> trace)
+    : stream{std::move(socket)}, cache{std::move(cache)},
+      router{std::move(router)}, stats{std::move(stats)},
+      trace{std::move(trace)} {
+        this->stats->connection_opened();
+    }
+
+    ~Connection() {
+        stats->connection_closed();
+    }
 
     /// Start reading requests
     void run() {
@@ -293,39 +716,357 @@ class Connection : public std::enable_shared_from_this<Connection> {
     }
 };
 
-/// Class representing a TCP listener capable of accepting `Connection`s
-class Listener : public std::enable_shared_from_this<Listener> {
+/// Handler for requests in the binary protocol (see binary_protocol.hh),
+/// independent of how the bytes are received and sent, so that it serves both
+/// `BinaryConnection` and the io_uring event loop
+class BinaryHandler {
+  private:
+    std::shared_ptr<SharedCache> cache;
+    std::shared_ptr<ServerStats> stats;
+    // Trace that requests are recorded to (nullptr if none is)
+    std::shared_ptr<trace::Writer> trace;
+
+    /// Read the keys in a batch body (none of which may be empty)
+    static std::optional<std::vector<key_type>>
+    read_batch_keys(std::string_view body) {
+        std::vector<key_type> keys;
+        binary_protocol::BatchReader reader{body};
+        while (!reader.done()) {
+            std::string_view key;
+            if (!reader.read_key(key) || key.empty()) {
+                return std::nullopt;
+            }
+            keys.emplace_back(key);
+        }
+        return keys;
+    }
+
+    /// Handle one request frame, appending the response to `output`
+    void handle_frame(const binary_protocol::FrameHeader &header,
+                      std::string_view key, std::string_view value,
+                      std::string &output) {
+        using binary_protocol::Opcode;
+        using binary_protocol::Status;
+        using Op = ServerStats::Op;
+        using RequestTimer = ServerStats::RequestTimer;
+
+        const auto respond = [&](Status status, std::string_view value = {}) {
+            binary_protocol::append_frame(
+                output, binary_protocol::RESPONSE_MAGIC, header.opcode,
+                status, header.opaque, {}, value);
+        };
+
+        // Requests for a single entry must have a key
+        const auto needs_key = header.opcode == Opcode::GET ||
+                               header.opcode == Opcode::SET ||
+                               header.opcode == Opcode::SET_TTL ||
+                               header.opcode == Opcode::DEL;
+        if (needs_key && key.empty()) {
+            return respond(Status::INVALID);
+        }
+        switch (header.opcode) {
+        case Opcode::GET: {
+            record_trace(trace.get(), trace::Op::GET, key);
+            RequestTimer timer{*stats, Op::GET};
+            // Copy the value straight from cache memory into the output
+            const auto result = cache->get_pinned(key_type{key});
+            if (result) {
+                timer.found();
+                return respond(Status::OK, result.view());
+            }
+            timer.not_found();
+            return respond(Status::NOT_FOUND);
+        }
+        case Opcode::SET: {
+            record_trace(trace.get(), trace::Op::SET, key, value.size());
+            RequestTimer timer{*stats, Op::SET};
+            cache->set(key_type{key}, value);
+            return respond(Status::OK);
+        }
+        case Opcode::SET_TTL: {
+            if (value.size() < 4) {
+                return respond(Status::INVALID);
+            }
+            record_trace(trace.get(), trace::Op::SET, key, value.size() - 4);
+            RequestTimer timer{*stats, Op::SET};
+            const Cache::ttl_type ttl{
+                binary_protocol::decode_u32(value.data())};
+            cache->set(key_type{key}, value.substr(4), ttl);
+            return respond(Status::OK);
+        }
+        case Opcode::DEL: {
+            record_trace(trace.get(), trace::Op::DEL, key);
+            RequestTimer timer{*stats, Op::DEL};
+            return respond(cache->del(key_type{key}) ? Status::OK
+                                                     : Status::NOT_FOUND);
+        }
+        case Opcode::SPACE_USED: {
+            char space_used[4];
+            binary_protocol::encode_u32(space_used, cache->space_used());
+            return respond(Status::OK, {space_used, sizeof(space_used)});
+        }
+        case Opcode::RESET:
+            cache->reset();
+            return respond(Status::OK);
+        case Opcode::STATS:
+            return respond(Status::OK, stats->to_json(cache->shard_stats()));
+        case Opcode::MGET: {
+            const auto keys = read_batch_keys(value);
+            if (!keys) {
+                return respond(Status::INVALID);
+            }
+            for (const auto &batch_key : *keys) {
+                record_trace(trace.get(), trace::Op::GET, batch_key);
+            }
+            RequestTimer timer{*stats, Op::MGET};
+            const auto values = cache->mget(*keys);
+            std::string results;
+            for (const auto &result : values) {
+                if (result) {
+                    timer.found();
+                } else {
+                    timer.not_found();
+                }
+                binary_protocol::append_batch_result(
+                    results, result ? Status::OK : Status::NOT_FOUND,
+                    result.value_or(""));
+            }
+            return respond(Status::OK, results);
+        }
+        case Opcode::MSET: {
+            RequestTimer timer{*stats, Op::MSET};
+            std::vector<std::pair<key_type, std::string>> entries;
+            binary_protocol::BatchReader reader{value};
+            while (!reader.done()) {
+                std::string_view entry_key, entry_value;
+                if (!reader.read_entry(entry_key, entry_value) ||
+                    entry_key.empty()) {
+                    return respond(Status::INVALID);
+                }
+                entries.emplace_back(entry_key, entry_value);
+            }
+            for (const auto &[entry_key, entry_value] : entries) {
+                record_trace(trace.get(), trace::Op::SET, entry_key,
+                             entry_value.size());
+            }
+            cache->mset(entries);
+            return respond(Status::OK);
+        }
+        case Opcode::MDEL: {
+            const auto keys = read_batch_keys(value);
+            if (!keys) {
+                return respond(Status::INVALID);
+            }
+            for (const auto &batch_key : *keys) {
+                record_trace(trace.get(), trace::Op::DEL, batch_key);
+            }
+            RequestTimer timer{*stats, Op::MDEL};
+            char deleted[4];
+            binary_protocol::encode_u32(deleted, cache->mdel(*keys));
+            return respond(Status::OK, {deleted, sizeof(deleted)});
+        }
+        }
+        // Unknown opcode
+        respond(Status::INVALID);
+    }
+
+  public:
+    BinaryHandler(std::shared_ptr<SharedCache> cache,
+                  std::shared_ptr<ServerStats> stats,
+                  std::shared_ptr<trace::Writer> trace)
+    : cache{std::move(cache)}, stats{std::move(stats)},
+      trace{std::move(trace)} {}
+
+    /// Handle every complete frame at the start of `input`, appending the
+    /// responses to `output`; returns the number of bytes used, or nothing if
+    /// the input is malformed and the connection should be closed
+    std::optional<std::size_t> operator()(std::string_view input,
+                                          std::string &output) {
+        const auto output_size = output.size();
+        std::size_t used = 0;
+        while (input.size() - used >= binary_protocol::HEADER_SIZE) {
+            const auto data = input.data() + used;
+            const auto header = binary_protocol::decode_header(data);
+            if (header.magic != binary_protocol::REQUEST_MAGIC ||
+                header.value_size > binary_protocol::MAX_VALUE_SIZE) {
+                return std::nullopt;
+            }
+            // Wait for the rest of the frame
+            const auto frame_size =
+                binary_protocol::HEADER_SIZE + header.body_size();
+            if (input.size() - used < frame_size) {
+                break;
+            }
+            const auto key = data + binary_protocol::HEADER_SIZE;
+            handle_frame(header, {key, header.key_size},
+                         {key + header.key_size, header.value_size}, output);
+            used += frame_size;
+        }
+        if (used != 0) {
+            stats->record_bytes(used, output.size() - output_size);
+        }
+        return used;
+    }
+};
+
+/// Class representing a client connection speaking the binary protocol
+class BinaryConnection : public std::enable_shared_from_this<BinaryConnection> {
+  private:
+    /// Number of bytes to make room for before each read
+    static constexpr auto READ_SIZE = 16U << 10; // 16KiB
+
+    beast::tcp_stream stream;
+    std::shared_ptr<ServerStats> stats;
+    BinaryHandler handler;
+
+    /// Bytes received but not yet handled (at most one partial frame after
+    /// the complete frames have been handled)
+    beast::flat_buffer input;
+    /// Responses to every request in the last read, written all at once
+    std::string output;
+
+    /// Read more requests asynchronously
+    void do_read() {
+        // Set the timeout
+        stream.expires_after(SOCKET_TIMEOUT);
+        // Dispatch the read operation
+        stream.async_read_some(
+            input.prepare(READ_SIZE),
+            beast::bind_front_handler(&BinaryConnection::on_read,
+                                      shared_from_this()));
+    }
+
+    /// Handle the result of a read
+    void on_read(const beast::error_code error, const size_t size) {
+        // Close the connection if there was an error
+        if (error) {
+            return do_close();
+        }
+        input.commit(size);
+        const auto used = handler(
+            {static_cast<const char *>(input.data().data()), input.size()},
+            output);
+        if (!used) {
+            return do_close();
+        }
+        input.consume(*used);
+        // Keep reading if no frame was complete yet
+        if (output.empty()) {
+            return do_read();
+        }
+        // Dispatch the write operation for all of the responses
+        net::async_write(stream, net::buffer(output),
+                         beast::bind_front_handler(&BinaryConnection::on_write,
+                                                   shared_from_this()));
+    }
+
+    /// Handle the result of a write
+    void on_write(const beast::error_code error, size_t) {
+        // Close the connection if there was an error
+        if (error) {
+            return do_close();
+        }
+        output.clear();
+        // Read more requests
+        do_read();
+    }
+
+    /// Close the connection gracefully
+    void do_close() {
+        beast::error_code error;
+        stream.socket().shutdown(tcp::socket::shutdown_send, error);
+    }
+
+  public:
+    /// Requests are always handled on the connection's own thread (handing
+    /// them to other worker threads would break up the batches of responses
+    /// written at once), so the router is not used
+    BinaryConnection(tcp::socket &&socket, std::shared_ptr<SharedCache> cache,
+                     std::shared_ptr<Router>,
+                     std::shared_ptr<ServerStats> stats,
+                     std::shared_ptr<trace::Writer> trace)
+    : stream{std::move(socket)}, stats{std::move(stats)},
+      handler{std::move(cache), this->stats, std::move(trace)} {
+        this->stats->connection_opened();
+    }
+
+    ~BinaryConnection() {
+        stats->connection_closed();
+    }
+
+    /// Start reading requests
+    void run() {
+        do_read();
+    }
+};
+
+/// Open an acceptor and bind it to an endpoint; with `reuse_port`, several
+/// acceptors may be bound to the same endpoint, and the kernel spreads
+/// connections between them
+void open_acceptor(tcp::acceptor &acceptor, const tcp::endpoint &endpoint,
+                   bool reuse_port) {
+    acceptor.open(endpoint.protocol());
+    acceptor.set_option(net::socket_base::reuse_address(true));
+    if (reuse_port) {
+        using reuse_port_option =
+            net::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+        acceptor.set_option(reuse_port_option(true));
+    }
+    acceptor.bind(endpoint);
+    acceptor.listen();
+}
+
+/// Class representing a TCP listener capable of accepting connections of type
+/// `ConnectionType` (`Connection` or `BinaryConnection`)
+template <typename ConnectionType>
+class Listener : public std::enable_shared_from_this<Listener<ConnectionType>> {
   private:
     net::io_context &context;
     tcp::acceptor acceptor;
     std::shared_ptr<SharedCache> cache;
+    std::shared_ptr<Router> router;
+    std::shared_ptr<ServerStats> stats;
+    std::shared_ptr<trace::Writer> trace;
 
     /// Accept an incoming connection asynchronously
     void do_accept() {
-        acceptor.async_accept(net::make_strand(context),
-                              beast::bind_front_handler(&Listener::on_accept,
-                                                        shared_from_this()));
+        acceptor.async_accept(
+            net::make_strand(context),
+            beast::bind_front_handler(&Listener::on_accept,
+                                      this->shared_from_this()));
     }
 
     /// Handle the result of an accept
     void on_accept(const beast::error_code error, tcp::socket &&socket) {
         // Create a connection for this socket if the accept succeeded
         if (!error) {
-            std::make_shared<Connection>(std::move(socket), cache)->run();
+            // Send each response right away, instead of holding it back
+            // while an earlier one is unacknowledged (which stalls pipelined
+            // requests until the client's delayed ACK)
+            beast::error_code option_error;
+            socket.set_option(tcp::no_delay{true}, option_error);
+            std::make_shared<ConnectionType>(std::move(socket), cache, router,
+                                             stats, trace)
+                ->run();
         }
         // Keep accepting connections
         do_accept();
     }
 
   public:
+    /// Create a listener for connections that use `router` and record
+    /// requests to `trace` (either may be nullptr); with a router, every
+    /// worker thread has its own listener bound to the same endpoint, and the
+    /// kernel spreads connections between them
     Listener(net::io_context &context, const tcp::endpoint &endpoint,
-             std::shared_ptr<SharedCache> cache)
-    : context{context}, acceptor{net::make_strand(context)}, cache{cache} {
+             std::shared_ptr<SharedCache> cache,
+             std::shared_ptr<ServerStats> stats,
+             std::shared_ptr<trace::Writer> trace,
+             std::shared_ptr<Router> router = nullptr)
+    : context{context}, acceptor{net::make_strand(context)}, cache{cache},
+      router{router}, stats{stats}, trace{trace} {
         // Configure the acceptor and bind it to the endpoint
-        acceptor.open(endpoint.protocol());
-        acceptor.set_option(net::socket_base::reuse_address(true));
-        acceptor.bind(endpoint);
-        acceptor.listen();
+        open_acceptor(acceptor, endpoint, router != nullptr);
     }
 
     /// Start accepting connections
@@ -334,6 +1075,139 @@ class Listener : public std::enable_shared_from_this<Listener> {
     }
 };
 
+/// Class that removes expired entries from the cache in the background, at a
+/// fixed interval
+class Expirer : public std::enable_shared_from_this<Expirer> {
+  private:
+    net::steady_timer timer;
+    std::shared_ptr<SharedCache> cache;
+    const std::chrono::milliseconds interval;
+
+    /// Wait for the next interval asynchronously
+    void do_wait() {
+        timer.expires_after(interval);
+        timer.async_wait(
+            beast::bind_front_handler(&Expirer::on_wait, shared_from_this()));
+    }
+
+    /// Handle the end of an interval
+    void on_wait(const beast::error_code error) {
+        if (error) {
+            return;
+        }
+        cache->expire();
+        do_wait();
+    }
+
+  public:
+    Expirer(net::io_context &context, std::shared_ptr<SharedCache> cache,
+            std::chrono::milliseconds interval)
+    : timer{context}, cache{cache}, interval{interval} {}
+
+    /// Start removing expired entries
+    void run() {
+        do_wait();
+    }
+};
+
+/// Class that saves the cache to a snapshot file at a fixed interval, on a
+/// thread of its own so that writing the file never holds up the I/O contexts
+/// (the cache's shards are only locked while their entries are collected)
+class Snapshotter {
+  private:
+    std::shared_ptr<SharedCache> cache;
+    const std::string path;
+    const std::chrono::seconds interval;
+
+    std::mutex mutex;
+    std::condition_variable stop_requested;
+    bool stopping = false;
+    std::thread thread;
+
+    /// Save the cache every interval until stopped
+    void run() {
+        std::unique_lock lock{mutex};
+        while (!stop_requested.wait_for(lock, interval,
+                                        [&] { return stopping; })) {
+            lock.unlock();
+            save();
+            lock.lock();
+        }
+    }
+
+  public:
+    /// Start saving the cache to `path` every `interval` (never, if the
+    /// interval is zero)
+    Snapshotter(std::shared_ptr<SharedCache> cache, std::string path,
+                std::chrono::seconds interval)
+    : cache{std::move(cache)}, path{std::move(path)}, interval{interval} {
+        if (interval.count() != 0) {
+            thread = std::thread{[this] { run(); }};
+        }
+    }
+
+    /// Stop saving the cache in the background
+    ~Snapshotter() {
+        {
+            const std::lock_guard lock{mutex};
+            stopping = true;
+        }
+        stop_requested.notify_one();
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    /// Save the cache now (errors are reported rather than thrown, since the
+    /// next attempt may succeed)
+    void save() {
+        try {
+            cache->save(path);
+        } catch (const std::system_error &error) {
+            std::cerr << "error: unable to save snapshot: " << error.what()
+                      << std::endl;
+        }
+    }
+};
+
+/// Get a function that creates evictors of the named type (returns nullptr
+/// for "none", or throws `std::invalid_argument` if the name is unknown)
+SharedCache::evictor_factory make_evictor_factory(const std::string &name) {
+    if (name == "none") {
+        return nullptr;
+    } else if (name == "fifo") {
+        return [] { return std::make_unique<FifoEvictor>(); };
+    } else if (name == "lru") {
+        return [] { return std::make_unique<LruEvictor>(); };
+    } else if (name == "intrusive-lru") {
+        return [] { return std::make_unique<IntrusiveLruEvictor>(); };
+    } else if (name == "clock") {
+        return [] { return std::make_unique<ClockEvictor>(); };
+    }
+    throw std::invalid_argument{"unknown evictor '" + name + "'"};
+}
+
+/// Get a function that creates admission policies of the named type (returns
+/// nullptr for "none", or throws `std::invalid_argument` if the name is
+/// unknown)
+SharedCache::admission_factory
+make_admission_factory(const std::string &name) {
+    if (name == "none") {
+        return nullptr;
+    } else if (name == "tinylfu" || name == "w-tinylfu") {
+        // The window holds 1% as many keys as the sketch tracks
+        const auto windowed = name == "w-tinylfu";
+        return [windowed](Cache::size_type maxmem) {
+            const auto expected_entries = maxmem / ADMISSION_BYTES_PER_KEY;
+            const auto window_size =
+                windowed ? std::max(1U, expected_entries / 100) : 0;
+            return std::make_unique<TinyLfuAdmission>(expected_entries,
+                                                      window_size);
+        };
+    }
+    throw std::invalid_argument{"unknown admission policy '" + name + "'"};
+}
+
 /// Use a resolver to get the first endpoint associated with the specified
 /// address and port
 tcp::endpoint get_endpoint(const std::string &address, uint16_t port) {
@@ -358,8 +1232,56 @@ int run_server(const int argc, const char *const argv[]) {
                           "set server address");
     options.add_options()("port,p", po::value<uint16_t>()->default_value(4022),
                           "set server port");
+    options.add_options()(
+        "binary-port", po::value<uint16_t>()->default_value(0),
+        "set port for the binary protocol (0 to only serve HTTP)");
     options.add_options()("threads,t", po::value<unsigned>()->default_value(1),
                           "set number of threads");
+    options.add_options()("shards", po::value<unsigned>()->default_value(1),
+                          "set number of independently locked cache shards");
+    options.add_options()(
+        "thread-per-core",
+        "give each thread its own I/O context, listeners and cache shard, "
+        "pinned to a core, and hand HTTP requests to the thread that owns "
+        "their keys (--shards defaults to --threads)");
+    options.add_options()(
+        "io-uring",
+        "serve the binary protocol with io_uring event loops on --threads "
+        "threads of their own, instead of with the HTTP worker threads");
+    options.add_options()(
+        "locking", po::value<std::string>()->default_value("exclusive"),
+        "set shard locking mode for GET requests (exclusive or shared)");
+    options.add_options()("index",
+                          po::value<std::string>()->default_value("chained"),
+                          "set hash table implementation (chained, flat or "
+                          "compact, which also counts each entry's overhead "
+                          "against --maxmem)");
+    options.add_options()("evictor",
+                          po::value<std::string>()->default_value("none"),
+                          "set eviction policy (none, fifo, lru, "
+                          "intrusive-lru or clock)");
+    options.add_options()("admission",
+                          po::value<std::string>()->default_value("none"),
+                          "set admission policy for new keys (none, tinylfu "
+                          "or w-tinylfu)");
+    options.add_options()(
+        "expire-interval", po::value<unsigned>()->default_value(100),
+        "set milliseconds between removals of expired entries (0 to leave "
+        "them to later SET requests)");
+    options.add_options()("snapshot", po::value<std::string>(),
+                          "save the cache to a snapshot file periodically "
+                          "and on shutdown");
+    options.add_options()(
+        "snapshot-interval", po::value<unsigned>()->default_value(60),
+        "set seconds between snapshots (0 to only save on shutdown)");
+    options.add_options()(
+        "record-trace", po::value<std::string>(),
+        "record every request for a key to a trace file, which "
+        "request_driver can replay");
+    options.add_options()(
+        "load", po::value<std::string>(),
+        "load a snapshot file at startup, if it exists (may be the same file "
+        "as --snapshot)");
 
     // Parse command-line arguments
     po::variables_map config;
@@ -383,34 +1305,206 @@ int run_server(const int argc, const char *const argv[]) {
     const auto maxmem = config["maxmem"].as<Cache::size_type>();
     const auto host = config["server"].as<std::string>();
     const auto port = config["port"].as<uint16_t>();
+    const auto binary_port = config["binary-port"].as<uint16_t>();
     const auto num_threads = config["threads"].as<unsigned>();
+    const auto thread_per_core = config.count("thread-per-core") != 0;
+    const auto io_uring = config.count("io-uring") != 0;
+    const auto num_shards = thread_per_core && config["shards"].defaulted()
+                                ? num_threads
+                                : config["shards"].as<unsigned>();
+    const auto locking = config["locking"].as<std::string>();
+    const auto index_name = config["index"].as<std::string>();
+    const auto evictor_name = config["evictor"].as<std::string>();
+    const auto admission_name = config["admission"].as<std::string>();
+    const std::chrono::milliseconds expire_interval{
+        config["expire-interval"].as<unsigned>()};
+    const auto snapshot_path = config.count("snapshot")
+                                   ? config["snapshot"].as<std::string>()
+                                   : std::string{};
+    const std::chrono::seconds snapshot_interval{
+        config["snapshot-interval"].as<unsigned>()};
+    const auto load_path = config.count("load")
+                               ? config["load"].as<std::string>()
+                               : std::string{};
+    const auto trace_path = config.count("record-trace")
+                                ? config["record-trace"].as<std::string>()
+                                : std::string{};
+
+    // Validate configuration values
+    if (num_shards == 0) {
+        std::cerr << "error: the number of shards must be at least 1"
+                  << std::endl;
+        return 1;
+    }
+    if (thread_per_core && num_shards != num_threads) {
+        std::cerr << "error: --thread-per-core needs one shard per thread"
+                  << std::endl;
+        return 1;
+    }
+    if (io_uring && binary_port == 0) {
+        std::cerr << "error: --io-uring needs --binary-port" << std::endl;
+        return 1;
+    }
+    SharedCache::LockMode lock_mode;
+    if (locking == "exclusive") {
+        lock_mode = SharedCache::LockMode::EXCLUSIVE;
+    } else if (locking == "shared") {
+        lock_mode = SharedCache::LockMode::SHARED;
+    } else {
+        std::cerr << "error: unknown locking mode '" << locking << "'"
+                  << std::endl;
+        return 1;
+    }
+    Cache::IndexType index;
+    if (index_name == "chained") {
+        index = Cache::IndexType::CHAINED;
+    } else if (index_name == "flat") {
+        index = Cache::IndexType::FLAT;
+    } else if (index_name == "compact") {
+        index = Cache::IndexType::COMPACT;
+    } else {
+        std::cerr << "error: unknown index '" << index_name << "'"
+                  << std::endl;
+        return 1;
+    }
+    SharedCache::evictor_factory make_evictor;
+    SharedCache::admission_factory make_admission;
+    try {
+        make_evictor = make_evictor_factory(evictor_name);
+        make_admission = make_admission_factory(admission_name);
+    } catch (const std::invalid_argument &error) {
+        std::cerr << "error: " << error.what() << std::endl;
+        return 1;
+    }
 
     // Resolve the endpoint
     const auto endpoint = get_endpoint(host, port);
 
-    // Create the I/O context
+    // Create the I/O context shared by every thread (or the worker threads'
+    // own I/O contexts in thread-per-core mode)
     net::io_context context{static_cast<int>(num_threads)};
+    std::shared_ptr<Router> router;
+    if (thread_per_core) {
+        router = std::make_shared<Router>(num_threads);
+    }
+    auto &main_context = router ? router->context(0) : context;
+
+    // Add a handler to stop the I/O contexts (and the io_uring event loops)
+    // on SIGINT/SIGTERM
+    std::vector<std::unique_ptr<UringServer>> uring_servers;
+    net::signal_set quit_signals{main_context, SIGINT, SIGTERM};
+    quit_signals.async_wait([&](beast::error_code const &, int) {
+        if (router) {
+            router->stop();
+        } else {
+            context.stop();
+        }
+        for (const auto &server : uring_servers) {
+            server->stop();
+        }
+    });
 
-    // Add a handler to stop the I/O context on SIGINT/SIGTERM
-    net::signal_set quit_signals{context, SIGINT, SIGTERM};
-    quit_signals.async_wait(
-        [&](beast::error_code const &, int) { context.stop(); });
+    // Create the cache and the listeners (one of each kind per worker thread
+    // in thread-per-core mode)
+    auto cache = std::make_shared<SharedCache>(
+        maxmem, num_shards, make_evictor, lock_mode, index, make_admission);
+    auto stats = std::make_shared<ServerStats>();
+    std::shared_ptr<trace::Writer> trace;
+    if (!trace_path.empty()) {
+        trace = std::make_shared<trace::Writer>(trace_path);
+    }
 
-    // Create the cache and the listener
-    auto cache = std::make_shared<SharedCache>(std::make_unique<Cache>(maxmem));
-    std::make_shared<Listener>(context, endpoint, cache)->run();
+    // Restore the cache from a snapshot before accepting any connections
+    std::string load_message;
+    if (!load_path.empty()) {
+        const auto start = std::chrono::steady_clock::now();
+        try {
+            const auto num_loaded = cache->load(load_path);
+            const auto elapsed =
+                std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+            load_message = "loaded " + std::to_string(num_loaded) +
+                           " entries from " + load_path + " in " +
+                           std::to_string(elapsed) + " ms";
+        } catch (const std::system_error &error) {
+            // Start cold if there is no snapshot yet
+            if (error.code() != std::errc::no_such_file_or_directory) {
+                std::cerr << "error: " << error.what() << std::endl;
+                return 1;
+            }
+            load_message = "no snapshot at " + load_path + ", starting empty";
+        } catch (const std::runtime_error &error) {
+            std::cerr << "error: " << error.what() << std::endl;
+            return 1;
+        }
+    }
+    std::unique_ptr<Snapshotter> snapshotter;
+    if (!snapshot_path.empty()) {
+        snapshotter = std::make_unique<Snapshotter>(cache, snapshot_path,
+                                                    snapshot_interval);
+    }
+    const auto binary_endpoint =
+        binary_port != 0 ? get_endpoint(host, binary_port) : tcp::endpoint{};
+    for (auto i = 0U; i < (router ? num_threads : 1); ++i) {
+        auto &listener_context = router ? router->context(i) : context;
+        std::make_shared<Listener<Connection>>(listener_context, endpoint,
+                                               cache, stats, trace, router)
+            ->run();
+        if (binary_port != 0 && !io_uring) {
+            std::make_shared<Listener<BinaryConnection>>(
+                listener_context, binary_endpoint, cache, stats, trace, router)
+                ->run();
+        }
+    }
+    if (io_uring) {
+        // Each event loop accepts connections on its own socket, and handles
+        // them entirely on its own thread
+        for (auto i = 0U; i < num_threads; ++i) {
+            tcp::acceptor acceptor{main_context};
+            open_acceptor(acceptor, binary_endpoint, num_threads > 1);
+            uring_servers.push_back(std::make_unique<UringServer>(
+                acceptor.release(), BinaryHandler{cache, stats, trace},
+                [stats](bool opened) {
+                    if (opened) {
+                        stats->connection_opened();
+                    } else {
+                        stats->connection_closed();
+                    }
+                }));
+        }
+    }
+    if (expire_interval.count() != 0) {
+        std::make_shared<Expirer>(main_context, cache, expire_interval)->run();
+    }
 
     // Queue sending a message indicating that that the server has been started
-    context.post([&] {
+    main_context.post([&] {
         std::cout << "running on " << endpoint.address() << " port "
-                  << endpoint.port() << std::endl;
+                  << endpoint.port();
+        if (binary_port != 0) {
+            std::cout << " (binary protocol on port " << binary_port
+                      << (io_uring ? " with io_uring" : "") << ")";
+        }
+        std::cout << std::endl;
+        if (!load_message.empty()) {
+            std::cout << load_message << std::endl;
+        }
     });
 
-    // Run the I/O context on `threads` worker threads
+    // Run the I/O context on `threads` worker threads, and each io_uring
+    // event loop on a thread of its own
     std::vector<std::thread> threads;
-    threads.reserve(num_threads);
+    threads.reserve(num_threads + uring_servers.size());
     for (auto i = 0U; i < num_threads; ++i) {
-        threads.emplace_back([&context] { context.run(); });
+        if (router) {
+            threads.emplace_back([&router, i] { router->run(i); });
+        } else {
+            threads.emplace_back([&context] { context.run(); });
+        }
+    }
+    for (const auto &server : uring_servers) {
+        threads.emplace_back([&server] { server->run(); });
     }
 
     // Wait for all of the worker threads to exit
@@ -418,6 +1512,16 @@ int run_server(const int argc, const char *const argv[]) {
         thread.join();
     }
 
+    // Save the cache one last time, once nothing can modify it
+    if (snapshotter) {
+        snapshotter->save();
+    }
+
+    // Write out the rest of the trace, once no more requests can be recorded
+    if (trace) {
+        trace->flush();
+    }
+
     // Terminate normally
     return 0;
 }
@@ -429,5 +1533,8 @@ int main(const int argc, const char *const argv[]) {
     } catch (boost::system::system_error &error) {
         std::cerr << "error: " << error.what() << std::endl;
         return 2;
+    } catch (std::system_error &error) {
+        std::cerr << "error: " << error.what() << std::endl;
+        return 2;
     }
 }
@@ -0,0 +1,82 @@
+#include "clock_evictor.hh"
+
+// Value of `EvictionHook::bits` for an entry that has been referenced since
+// the hand last passed it
+constexpr uint32_t REFERENCED = 1;
+
+ClockEvictor::ClockEvictor() {
+    clear();
+}
+
+void ClockEvictor::advance() {
+    hand = hand->next;
+    if (hand == &head) {
+        hand = head.next;
+    }
+}
+
+void ClockEvictor::link(EvictionHook &hook) {
+    hook.bits.store(0, std::memory_order_relaxed);
+    // Insert the entry just behind the hand (if the ring is empty, `hand` is
+    // the sentinel, so this appends to the ring)
+    hook.prev = hand->prev;
+    hook.next = hand;
+    hand->prev->next = &hook;
+    hand->prev = &hook;
+    if (hand == &head) {
+        hand = &hook;
+    }
+}
+
+void ClockEvictor::touch(EvictionHook &hook) {
+    // Avoid writing to the entry's cache line if the bit is already set
+    if (hook.bits.load(std::memory_order_relaxed) != REFERENCED) {
+        hook.bits.store(REFERENCED, std::memory_order_relaxed);
+    }
+}
+
+void ClockEvictor::unlink(EvictionHook &hook) {
+    if (hand == &hook) {
+        advance();
+        // The entry was the only one in the ring
+        if (hand == &hook) {
+            hand = &head;
+        }
+    }
+    hook.prev->next = hook.next;
+    hook.next->prev = hook.prev;
+    hook.prev = hook.next = nullptr;
+}
+
+EvictionHook *ClockEvictor::evict_hook() {
+    if (hand == &head) {
+        return nullptr;
+    }
+    // Give each referenced entry a second chance (this terminates within one
+    // revolution since every bit passed is cleared)
+    while (hand->bits.load(std::memory_order_relaxed) == REFERENCED) {
+        hand->bits.store(0, std::memory_order_relaxed);
+        advance();
+    }
+    auto hook = hand;
+    unlink(*hook);
+    return hook;
+}
+
+void ClockEvictor::clear() {
+    head.prev = head.next = &head;
+    hand = &head;
+}
+
+void ClockEvictor::for_each_hook(
+    const std::function<void(const EvictionHook &)> &fn) const {
+    if (hand == &head) {
+        return;
+    }
+    // Go once around the ring, starting at the hand (skipping the sentinel)
+    auto hook = hand;
+    do {
+        fn(*hook);
+        hook = hook->next == &head ? head.next : hook->next;
+    } while (hook != hand);
+}
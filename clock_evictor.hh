@@ -0,0 +1,37 @@
+#ifndef CLOCK_EVICTOR_HH
+#define CLOCK_EVICTOR_HH
+
+#include "evictor.hh"
+
+// CLOCK (second chance) evictor: entries sit in a ring threaded through their
+// hooks, and touching an entry only sets its reference bit atomically, so GETs
+// can touch entries concurrently without a lock. To evict, the hand sweeps the
+// ring, clearing reference bits until it finds an entry without one.
+class ClockEvictor final : public IntrusiveEvictor {
+  private:
+    // Sentinel of the ring (never evicted); new entries are inserted just
+    // behind the hand so that they are visited last
+    EvictionHook head;
+    // Next entry to consider for eviction (`&head` if the ring is empty)
+    EvictionHook *hand;
+
+    // Move the hand to the next entry, skipping the sentinel
+    void advance();
+
+  public:
+    ClockEvictor();
+
+    void link(EvictionHook &hook) override;
+    void touch(EvictionHook &hook) override;
+    void unlink(EvictionHook &hook) override;
+    EvictionHook *evict_hook() override;
+    void clear() override;
+    void for_each_hook(
+        const std::function<void(const EvictionHook &)> &fn) const override;
+
+    bool concurrent_touch() const override {
+        return true;
+    }
+};
+
+#endif // CLOCK_EVICTOR_HH
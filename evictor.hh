@@ -4,6 +4,10 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
 #include <string>
 
 // Data type to use as keys for Cache and Evictors:
@@ -26,4 +30,63 @@ class Evictor {
   // Request evictor for the next key to evict, and remove it from evictor.
   // If evictor doesn't know what to evict, return an empty key ("").
   virtual const key_type evict() = 0;
+
+  // Whether several threads may touch keys at the same time (touches still
+  // must not overlap with any other call):
+  virtual bool concurrent_touch() const { return false; }
+
+  // Call fn on each key the evictor knows of, from the next one it would
+  // evict to the last (used to save the cache in eviction order). Returns
+  // false without calling fn if the evictor keeps no such order:
+  virtual bool for_each_key(
+      const std::function<void(const key_type&)>&) const {
+    return false;
+  }
+};
+
+// Links embedded in each cache entry for evictors that keep their bookkeeping
+// inside the entries themselves (see IntrusiveEvictor below).
+struct EvictionHook {
+  EvictionHook* prev = nullptr;
+  EvictionHook* next = nullptr;
+  // Per-entry state for the evictor's own use (e.g. a reference bit), atomic
+  // so that it can be updated by concurrent touches
+  std::atomic<uint32_t> bits{0};
+};
+
+// Base class for eviction policies that track cache entries through the
+// EvictionHook inside each entry instead of by key, so the cache can inform
+// them of accesses without copying keys or allocating.
+// An intrusive evictor can only be used by one Cache at a time, and only
+// through that Cache: the key-based interface above is not supported.
+class IntrusiveEvictor : public Evictor {
+ public:
+  void touch_key(const key_type&) override {
+    throw std::logic_error("intrusive evictors can only be used by a Cache");
+  }
+
+  const key_type evict() override {
+    throw std::logic_error("intrusive evictors can only be used by a Cache");
+  }
+
+  // Inform evictor that a new entry has been added to the cache:
+  virtual void link(EvictionHook& hook) = 0;
+
+  // Inform evictor that an entry has been accessed:
+  virtual void touch(EvictionHook& hook) = 0;
+
+  // Inform evictor that an entry has been removed from the cache:
+  virtual void unlink(EvictionHook& hook) = 0;
+
+  // Request evictor for the next entry to evict, and unlink it from evictor.
+  // If evictor doesn't know what to evict, return nullptr.
+  virtual EvictionHook* evict_hook() = 0;
+
+  // Forget every entry at once (the cache has been reset):
+  virtual void clear() = 0;
+
+  // Call fn on each linked entry, from the next one it would evict to the
+  // last:
+  virtual void for_each_hook(
+      const std::function<void(const EvictionHook&)>& fn) const = 0;
 };
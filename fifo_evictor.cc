@@ -16,3 +16,11 @@ const key_type FifoEvictor::evict() {
         return key;
     }
 }
+
+bool FifoEvictor::for_each_key(
+    const std::function<void(const key_type &)> &fn) const {
+    for (const auto &key : queue) {
+        fn(key);
+    }
+    return true;
+}
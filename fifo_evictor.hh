@@ -14,6 +14,8 @@ class FifoEvictor : public Evictor {
   public:
     void touch_key(const key_type &key) override;
     const key_type evict() override;
+    bool for_each_key(
+        const std::function<void(const key_type &)> &fn) const override;
 };
 
 #endif // FIFO_EVICTOR_HH
@@ -0,0 +1,107 @@
+/*
+ * Consistent hash ring used by the networked client to spread keys over a
+ * cluster of servers. Each node is placed at many points on a ring of 64-bit
+ * hashes (its virtual nodes), and a key belongs to the node of the first
+ * point at or after the key's hash; its replicas are the next distinct nodes
+ * around the ring. Adding or removing a node only moves the keys whose first
+ * point changes, about 1/n of them, and the virtual nodes keep the load
+ * balanced. Points are placed by hashing the nodes' names, so every client
+ * given the same names routes keys the same way, whatever order they are in.
+ */
+
+#ifndef HASH_RING_HH
+#define HASH_RING_HH
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+class HashRing {
+  public:
+    // Points each node is placed at by default (as in ketama)
+    static constexpr unsigned POINTS_PER_NODE = 160;
+
+  private:
+    // Points on the ring, as (hash, node index), sorted by hash
+    std::vector<std::pair<uint64_t, unsigned>> points;
+    unsigned num_nodes;
+
+  public:
+    // Hash used for both keys and points. This is FNV-1a followed by
+    // MurmurHash3's finalizer (FNV-1a alone barely mixes the last bytes of
+    // similar strings); unlike std::hash, it is the same for every build, so
+    // clients built separately agree on where keys go.
+    static uint64_t hash(std::string_view bytes) {
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (const auto byte : bytes) {
+            hash ^= static_cast<unsigned char>(byte);
+            hash *= 0x100000001b3ULL;
+        }
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ULL;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    // Create a ring of nodes with the given (distinct) names
+    explicit HashRing(const std::vector<std::string> &names,
+                      unsigned points_per_node = POINTS_PER_NODE)
+    : num_nodes{static_cast<unsigned>(names.size())} {
+        if (names.empty() || points_per_node == 0) {
+            throw std::invalid_argument{"hash ring has no points"};
+        }
+        points.reserve(names.size() * points_per_node);
+        for (unsigned node = 0; node < num_nodes; ++node) {
+            for (unsigned i = 0; i < points_per_node; ++i) {
+                points.emplace_back(
+                    hash(names[node] + "-" + std::to_string(i)), node);
+            }
+        }
+        // Ties (which are vanishingly rare) go to the node whose name sorts
+        // first, so that they do not depend on the order of the names
+        std::sort(points.begin(), points.end(),
+                  [&](const auto &a, const auto &b) {
+                      return a.first != b.first
+                                 ? a.first < b.first
+                                 : names[a.second] < names[b.second];
+                  });
+    }
+
+    // Number of nodes
+    unsigned size() const {
+        return num_nodes;
+    }
+
+    // Get the indices of the first `count` distinct nodes for a key (or of
+    // every node, if there are fewer), starting with the one it belongs to
+    std::vector<unsigned> nodes_for(std::string_view key,
+                                    unsigned count = 1) const {
+        count = std::min(count, num_nodes);
+        std::vector<unsigned> nodes;
+        nodes.reserve(count);
+        auto point =
+            std::lower_bound(points.begin(), points.end(), hash(key),
+                             [](const auto &candidate, uint64_t key_hash) {
+                                 return candidate.first < key_hash;
+                             });
+        while (nodes.size() < count) {
+            if (point == points.end()) {
+                point = points.begin();
+            }
+            if (std::find(nodes.begin(), nodes.end(), point->second) ==
+                nodes.end()) {
+                nodes.push_back(point->second);
+            }
+            ++point;
+        }
+        return nodes;
+    }
+};
+
+#endif // HASH_RING_HH
@@ -0,0 +1,51 @@
+#include "intrusive_lru_evictor.hh"
+
+IntrusiveLruEvictor::IntrusiveLruEvictor() {
+    clear();
+}
+
+void IntrusiveLruEvictor::push_back(EvictionHook &hook) {
+    hook.prev = head.prev;
+    hook.next = &head;
+    head.prev->next = &hook;
+    head.prev = &hook;
+}
+
+void IntrusiveLruEvictor::link(EvictionHook &hook) {
+    push_back(hook);
+}
+
+void IntrusiveLruEvictor::touch(EvictionHook &hook) {
+    // Move the entry to the back of the queue (unless it already is)
+    if (head.prev != &hook) {
+        unlink(hook);
+        push_back(hook);
+    }
+}
+
+void IntrusiveLruEvictor::unlink(EvictionHook &hook) {
+    hook.prev->next = hook.next;
+    hook.next->prev = hook.prev;
+    hook.prev = hook.next = nullptr;
+}
+
+EvictionHook *IntrusiveLruEvictor::evict_hook() {
+    if (head.next == &head) {
+        return nullptr;
+    } else {
+        auto hook = head.next;
+        unlink(*hook);
+        return hook;
+    }
+}
+
+void IntrusiveLruEvictor::clear() {
+    head.prev = head.next = &head;
+}
+
+void IntrusiveLruEvictor::for_each_hook(
+    const std::function<void(const EvictionHook &)> &fn) const {
+    for (auto hook = head.next; hook != &head; hook = hook->next) {
+        fn(*hook);
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef INTRUSIVE_LRU_EVICTOR_HH
+#define INTRUSIVE_LRU_EVICTOR_HH
+
+#include "evictor.hh"
+
+// LRU evictor whose queue is a circular list threaded through the entries'
+// hooks, so touching an entry is an O(1) splice with no allocation
+class IntrusiveLruEvictor final : public IntrusiveEvictor {
+  private:
+    // Sentinel of the queue; `head.next` is the least recently used entry and
+    // `head.prev` is the most recently used one
+    EvictionHook head;
+
+    // Insert a hook at the back (most recently used end) of the queue
+    void push_back(EvictionHook &hook);
+
+  public:
+    IntrusiveLruEvictor();
+
+    void link(EvictionHook &hook) override;
+    void touch(EvictionHook &hook) override;
+    void unlink(EvictionHook &hook) override;
+    EvictionHook *evict_hook() override;
+    void clear() override;
+    void for_each_hook(
+        const std::function<void(const EvictionHook &)> &fn) const override;
+};
+
+#endif // INTRUSIVE_LRU_EVICTOR_HH
@@ -0,0 +1,125 @@
+/*
+ * Latency histogram used by the request driver and the server's statistics,
+ * in the style of HdrHistogram. Values (nanoseconds) are counted in buckets
+ * whose width grows with the value, so every value is recorded to within
+ * 1/SUB_BUCKETS of itself (under 1%) in a fixed amount of memory, however
+ * many values there are. Recording is a few instructions, and histograms
+ * recorded on separate threads can be merged to get percentiles of them all.
+ */
+
+#ifndef LATENCY_HISTOGRAM_HH
+#define LATENCY_HISTOGRAM_HH
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+class LatencyHistogram {
+  public:
+    using value_type = uint64_t;
+
+  private:
+    // Each power of two at or above 2 * SUB_BUCKETS is split into
+    // SUB_BUCKETS buckets of equal width; smaller values have a bucket each
+    static constexpr unsigned SUB_BUCKET_BITS = 7;
+    static constexpr value_type SUB_BUCKETS = value_type{1} << SUB_BUCKET_BITS;
+    // The largest values are shifted right by 64 - SUB_BUCKET_BITS - 1 bits,
+    // which puts them in the last SUB_BUCKETS buckets
+    static constexpr std::size_t NUM_BUCKETS =
+        (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    std::array<uint64_t, NUM_BUCKETS> counts{};
+    uint64_t total = 0;
+    value_type min_value = UINT64_MAX;
+    value_type max_value = 0;
+    // Sum of the values, for the mean (as a double, since a sum of 64-bit
+    // nanosecond counts could overflow)
+    double sum = 0;
+
+    // Number of bits a value is shifted right by to get its bucket within
+    // its power of two
+    static unsigned shift_of(value_type value) {
+        const unsigned width = value == 0 ? 0 : 64 - __builtin_clzll(value);
+        return width > SUB_BUCKET_BITS + 1 ? width - SUB_BUCKET_BITS - 1 : 0;
+    }
+
+    static std::size_t bucket_of(value_type value) {
+        const auto shift = shift_of(value);
+        return shift * SUB_BUCKETS + (value >> shift);
+    }
+
+    // Largest value that is counted in a bucket
+    static value_type highest_in(std::size_t bucket) {
+        if (bucket < 2 * SUB_BUCKETS) {
+            return bucket;
+        }
+        const auto shift = bucket / SUB_BUCKETS - 1;
+        const auto sub_bucket = bucket - shift * SUB_BUCKETS;
+        return ((sub_bucket + 1) << shift) - 1;
+    }
+
+  public:
+    // Count a value `times` times
+    void record(value_type value, uint64_t times = 1) {
+        if (times == 0) {
+            return;
+        }
+        counts[bucket_of(value)] += times;
+        total += times;
+        min_value = std::min(min_value, value);
+        max_value = std::max(max_value, value);
+        sum += static_cast<double>(value) * times;
+    }
+
+    // Count every value counted by another histogram
+    void merge(const LatencyHistogram &other) {
+        for (std::size_t i = 0; i < NUM_BUCKETS; ++i) {
+            counts[i] += other.counts[i];
+        }
+        total += other.total;
+        min_value = std::min(min_value, other.min_value);
+        max_value = std::max(max_value, other.max_value);
+        sum += other.sum;
+    }
+
+    // Number of values counted
+    uint64_t count() const {
+        return total;
+    }
+
+    // Smallest and largest values counted (0 if there are none)
+    value_type min() const {
+        return total == 0 ? 0 : min_value;
+    }
+    value_type max() const {
+        return max_value;
+    }
+
+    // Mean of the values counted (0 if there are none)
+    double mean() const {
+        return total == 0 ? 0 : sum / total;
+    }
+
+    // Get the value that `fraction` (between 0 and 1) of the values counted
+    // are at or below, rounded up to the largest value in its bucket but no
+    // larger than the largest value counted (0 if there are none)
+    value_type percentile(double fraction) const {
+        if (total == 0) {
+            return 0;
+        }
+        const auto rank = std::max<uint64_t>(
+            1, static_cast<uint64_t>(std::ceil(fraction * total)));
+        uint64_t seen = 0;
+        for (std::size_t i = 0; i < NUM_BUCKETS; ++i) {
+            seen += counts[i];
+            if (seen >= rank) {
+                return std::min(highest_in(i), max_value);
+            }
+        }
+        return max_value;
+    }
+};
+
+#endif // LATENCY_HISTOGRAM_HH
@@ -22,3 +22,11 @@ const key_type LruEvictor::evict() {
         return key;
     }
 }
+
+bool LruEvictor::for_each_key(
+    const std::function<void(const key_type &)> &fn) const {
+    for (const auto &key : queue) {
+        fn(key);
+    }
+    return true;
+}
@@ -1,5 +1,14 @@
 reset
 
+# Plot the committed results, or others with
+#   gnuplot -e "data='results.csv'" multi_performance.gnuplot
+# where results.csv was written by `request_driver --csv` (whose all_p95_us
+# column is the 6th)
+if (!exists("data")) data = "multi_performance.dat"
+is_csv = strlen(data) > 4 && data[strlen(data) - 3:] eq ".csv"
+if (is_csv) set datafile separator ","
+latency = is_csv ? 6 : 3
+
 # Output as SVG
 set terminal svg size 800, 500 rounded linewidth 2
 set output  "multi_performance.svg"
@@ -25,7 +34,7 @@ set grid                     # Enable grid lines (easier to read)
 
 # Plot data using lines with circle points
 set style data linespoints
-plot "multi_performance.dat" using 1:2 axes x1y1 \
+plot data index 0 using 1:2 axes x1y1 \
      title "Mean Throughput" pointtype 7 pointsize 0.75, \
-     "multi_performance.dat" using 1:3 axes x1y2 \
+     data index 0 using 1:(column(latency)) axes x1y2 \
      title "95th% Latency" pointtype 7 pointsize 0.75
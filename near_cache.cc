@@ -0,0 +1,64 @@
+#include "near_cache.hh"
+
+#include <utility>
+
+NearCache::NearCache(size_type maxmem, ttl_type ttl)
+: maxmem{maxmem}, ttl{ttl} {}
+
+void NearCache::remove(entries_type::iterator entry) {
+    used -= entry->second.value.size();
+    entries.erase(entry);
+}
+
+const std::string *NearCache::get(const key_type &key) {
+    const auto entry = entries.find(key);
+    if (entry == entries.end()) {
+        return nullptr;
+    }
+    if (entry->second.expires_at <= clock::now()) {
+        evictor.unlink(entry->second);
+        remove(entry);
+        return nullptr;
+    }
+    evictor.touch(entry->second);
+    return &entry->second.value;
+}
+
+void NearCache::put(const key_type &key, std::string value,
+                    ttl_type value_ttl) {
+    erase(key);
+    if (value.size() > maxmem) {
+        return;
+    }
+    // Evict the least recently used values until the new one fits
+    while (used + value.size() > maxmem) {
+        const auto hook = evictor.evict_hook();
+        if (hook == nullptr) {
+            break;
+        }
+        remove(entries.find(*static_cast<Entry *>(hook)->key));
+    }
+    const auto lifetime = value_ttl > ttl_type::zero() && value_ttl < ttl
+                              ? value_ttl
+                              : ttl;
+    used += value.size();
+    const auto entry =
+        entries.try_emplace(key, std::move(value), clock::now() + lifetime)
+            .first;
+    entry->second.key = &entry->first;
+    evictor.link(entry->second);
+}
+
+void NearCache::erase(const key_type &key) {
+    const auto entry = entries.find(key);
+    if (entry != entries.end()) {
+        evictor.unlink(entry->second);
+        remove(entry);
+    }
+}
+
+void NearCache::clear() {
+    entries.clear();
+    evictor.clear();
+    used = 0;
+}
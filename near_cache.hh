@@ -0,0 +1,79 @@
+/*
+ * Small in-process cache of values read from the cache server, used by the
+ * networked client to serve repeated GETs of hot keys without a round trip
+ * (see the near cache constructor in cache.hh). Values are kept for at most a
+ * fixed TTL, which bounds how stale they can be when other clients change
+ * them, and the least recently used ones are evicted (by an
+ * `IntrusiveLruEvictor`, so that values that expire or are erased leave its
+ * queue too) once their sizes add up to `maxmem`.
+ */
+
+#ifndef NEAR_CACHE_HH
+#define NEAR_CACHE_HH
+
+#include "evictor.hh"
+#include "intrusive_lru_evictor.hh"
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+class NearCache {
+  public:
+    using size_type = uint32_t;
+    using ttl_type = std::chrono::milliseconds;
+
+  private:
+    using clock = std::chrono::steady_clock;
+
+    // Linked into the evictor's queue through its `EvictionHook` base
+    struct Entry : EvictionHook {
+        std::string value;
+        clock::time_point expires_at;
+        // Key of the entry in `entries`
+        const key_type *key = nullptr;
+
+        Entry(std::string value, clock::time_point expires_at)
+        : value{std::move(value)}, expires_at{expires_at} {}
+    };
+    using entries_type = std::unordered_map<key_type, Entry>;
+
+    const size_type maxmem;
+    const ttl_type ttl;
+    entries_type entries;
+    IntrusiveLruEvictor evictor;
+    size_type used = 0;
+
+    // Remove an entry that the evictor has already unlinked
+    void remove(entries_type::iterator entry);
+
+  public:
+    // Create a near cache holding up to `maxmem` bytes of values, each for up
+    // to `ttl`
+    NearCache(size_type maxmem, ttl_type ttl);
+
+    // Get the value stored for a key, or nullptr if there is none or it has
+    // expired (the pointer is valid until the near cache is next modified)
+    const std::string *get(const key_type &key);
+
+    // Store a value for a key, replacing any other, for the near cache's TTL
+    // or `value_ttl` if that is positive and shorter; values larger than
+    // `maxmem` are not stored
+    void put(const key_type &key, std::string value,
+             ttl_type value_ttl = ttl_type::zero());
+
+    // Remove the value stored for a key, if any
+    void erase(const key_type &key);
+
+    // Remove every value
+    void clear();
+
+    // Total size of the values stored (including expired ones)
+    size_type space_used() const {
+        return used;
+    }
+};
+
+#endif // NEAR_CACHE_HH
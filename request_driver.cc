@@ -1,18 +1,36 @@
 #include "cache.hh"
+#include "latency_histogram.hh"
 #include "request_generator.hh"
+#include "trace.hh"
 
 #include <algorithm>
+#include <array>
 #include <boost/process.hpp>
+#include <boost/program_options.hpp>
 #include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <deque>
+#include <fstream>
 #include <functional>
 #include <future>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
 #include <thread>
+#include <utility>
 #include <vector>
 
-/// Workload parameters (currently these roughly mimic the ETC workload)
-constexpr WorkloadParams PARAMS = {
+/// Default workload parameters (these roughly mimic the ETC workload), which
+/// the command-line options override
+constexpr WorkloadParams DEFAULT_PARAMS = {
     15,   // prob_get
     8,    // prob_set
     1,    // prob_del
@@ -20,27 +38,103 @@ constexpr WorkloadParams PARAMS = {
     0.08, // val_size_dist
 };
 
-/// Number of requests per thread
-constexpr auto NUM_REQUESTS = 1 << 20; // ~1M (1,048,576)
+/// Snapshot file the server saves to on shutdown before it is restarted warm
+constexpr auto SNAPSHOT_PATH = "request_driver.snapshot";
+/// Number of consecutive GET requests whose hit rate is measured while
+/// waiting for it to recover after a restart, and the fraction of the hit
+/// rate before the restart that counts as recovered
+constexpr auto HIT_RATE_WINDOW = 1000U;
+constexpr auto HIT_RATE_RECOVERED = 0.95;
 
-/// Maximum number of threads to spawn (should be a power of 2)
-constexpr auto NUM_THREADS_MAX = 128;
-/// Amount to increase number of threads by each iteration
-constexpr auto NUM_THREADS_STEP = 4;
+/// Fraction of the offered rate that must be completed for the server to be
+/// keeping up
+constexpr auto OPEN_LOOP_KEPT_UP = 0.95;
 
-/// Server parameters
-constexpr auto SERVER_ADDRESS = "localhost";
-constexpr auto SERVER_PORT = "4022";
-constexpr auto SERVER_MAXMEM = 1 << 16; // 64KiB
-const auto SERVER_THREADS = std::max(1U, std::thread::hardware_concurrency());
+/// Time the replaying clients are given to connect before the first request
+/// is due
+constexpr auto TRACE_START_DELAY = std::chrono::milliseconds{100};
+
+/// How the open-loop clients space out their requests: at exponentially
+/// distributed intervals (as independent users would) or at a fixed interval
+enum class Arrivals { POISSON, FIXED };
+
+/// How the driver runs, set once from the command line before any client
+/// starts (the defaults here are the defaults of the options)
+struct Settings {
+    /// Server parameters (only `server_address` and the ports are used with
+    /// `remote`, which sends requests to a server that is already running
+    /// instead of spawning one, and skips measuring restarts)
+    bool remote = false;
+    std::string server_address = "localhost";
+    uint16_t server_port = 4022;
+    uint16_t server_binary_port = 4023;
+    Cache::size_type server_maxmem = 1 << 16; // 64KiB
+    unsigned server_threads =
+        std::max(1U, std::thread::hardware_concurrency());
+    std::string server_evictor = "none";
+    std::string server_admission = "none";
+
+    /// Protocol used by the clients
+    Cache::Protocol client_protocol = Cache::Protocol::HTTP;
+    /// Number of requests each client keeps in flight on its connection (1
+    /// waits for each response before sending the next request)
+    unsigned pipeline_depth = 1;
+    /// Number of consecutive requests each client sends together as batch
+    /// requests, with one batch for each type of request (1 sends each
+    /// request on its own; batches are not pipelined)
+    unsigned batch_size = 1;
+    /// Size of each client's near cache in bytes (0 for no near cache), and
+    /// how long it keeps each value
+    Cache::size_type near_cache_maxmem = 0;
+    std::chrono::milliseconds near_cache_ttl{100};
+
+    /// Number of requests per closed-loop client, or (if `duration` is not
+    /// zero) how long each closed-loop client sends requests for instead
+    unsigned num_requests = 1 << 20; // ~1M (1,048,576)
+    std::chrono::duration<double> duration{0};
+
+    /// Maximum number of closed-loop client threads to spawn, and the amount
+    /// to increase the number of threads by each iteration
+    unsigned num_threads_max = 128;
+    unsigned num_threads_step = 4;
+
+    /// How the open-loop clients space out their requests
+    Arrivals open_loop_arrivals = Arrivals::POISSON;
+    /// Total rates (req/s) the open-loop clients offer, in increasing order;
+    /// the sweep stops after the first rate at which the server falls behind
+    std::vector<unsigned> open_loop_rates = {
+        1000, 2000, 4000, 8000, 16000, 32000, 48000, 64000, 96000, 128000};
+    /// Number of open-loop clients (on separate threads) the rate is split
+    /// over, and how long each rate is offered for
+    unsigned open_loop_clients = 4;
+    std::chrono::duration<double> open_loop_duration{2};
+
+    /// Which measurements to make after warming up the cache
+    bool closed_loop = true;
+    bool open_loop = true;
+    bool restarts = true;
+
+    /// Trace recorded by `cache_server --record-trace` to replay instead of
+    /// the synthetic workload (empty for none)
+    std::string trace_path;
+    /// Number of clients (on separate threads) that replay the trace; each
+    /// sends the requests for the keys that hash to it, so the requests for
+    /// a key are sent in the order they were recorded
+    unsigned trace_clients = 4;
+    /// Speed to replay the trace at, relative to the speed it was recorded
+    /// at (0 to send requests as fast as `pipeline_depth` allows)
+    double trace_speed = 1.0;
+};
+Settings settings;
 
 using generator_type = RequestGenerator<std::mt19937>;
+using clock_type = std::chrono::high_resolution_clock;
 
 // Utility function to measure duration in milliseconds
 float measure_latency(std::function<void()> fn) {
-    const auto t0 = std::chrono::high_resolution_clock::now();
+    const auto t0 = clock_type::now();
     fn();
-    const auto tf = std::chrono::high_resolution_clock::now();
+    const auto tf = clock_type::now();
     const auto ns =
         std::chrono::duration_cast<std::chrono::nanoseconds>(tf - t0).count();
     return ns / 1e6f;
@@ -55,6 +149,19 @@ struct RequestStatistics {
     unsigned num_get_hits = 0;
     // Number of DEL requests that deleted a value
     unsigned num_del_hits = 0;
+    // Number of keys read by GET requests that were found in the client's
+    // near cache
+    unsigned num_near_hits = 0;
+
+    RequestStatistics &operator+=(const RequestStatistics &other) {
+        num_gets += other.num_gets;
+        num_sets += other.num_sets;
+        num_dels += other.num_dels;
+        num_get_hits += other.num_get_hits;
+        num_del_hits += other.num_del_hits;
+        num_near_hits += other.num_near_hits;
+        return *this;
+    }
 
     friend std::ostream &operator<<(std::ostream &stream,
                                     const RequestStatistics &stats) {
@@ -78,209 +185,1441 @@ struct RequestStatistics {
         stream << "num_del_hits: " << stats.num_del_hits << " ("
                << format_percent(stats.num_del_hits, stats.num_dels) << ")"
                << std::endl;
+        stream << "   near_hits: " << stats.num_near_hits << " ("
+               << format_percent(stats.num_near_hits, stats.num_gets) << ")"
+               << std::endl;
 
         return stream;
     }
 };
 
-using latency_stats_type = std::pair<std::vector<float>, RequestStatistics>;
+// Latencies in nanoseconds of each type of request
+struct RequestLatencies {
+    LatencyHistogram gets;
+    LatencyHistogram sets;
+    LatencyHistogram dels;
 
-// Measure the completion time of `nreq` requests in milliseconds and record
-// statistics on request frequency, hit rate, etc.
-latency_stats_type baseline_latencies(const unsigned nreq,
-                                      const WorkloadParams &params) {
-    // Create the cache client
-    Cache cache{SERVER_ADDRESS, SERVER_PORT};
+    LatencyHistogram &of(Request::Type type) {
+        switch (type) {
+        case Request::Type::GET:
+            return gets;
+        case Request::Type::SET:
+            return sets;
+        case Request::Type::DEL:
+            return dels;
+        }
+        __builtin_unreachable();
+    }
 
-    RequestStatistics stats;
-    std::vector<float> latencies;
-    latencies.reserve(nreq);
+    // Latencies of every request
+    LatencyHistogram all() const {
+        auto all = gets;
+        all.merge(sets);
+        all.merge(dels);
+        return all;
+    }
+
+    RequestLatencies &operator+=(const RequestLatencies &other) {
+        gets.merge(other.gets);
+        sets.merge(other.sets);
+        dels.merge(other.dels);
+        return *this;
+    }
+};
 
+using latency_stats_type = std::pair<RequestLatencies, RequestStatistics>;
+
+// Nanoseconds from `start` until now
+LatencyHistogram::value_type nanoseconds_since(clock_type::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               clock_type::now() - start)
+        .count();
+}
+
+// Number of requests a closed-loop client may send, and the time by which it
+// must stop sending them
+struct Budget {
+    unsigned requests;
+    clock_type::time_point deadline = clock_type::time_point::max();
+
+    // Whether a client that has sent `sent` requests may send another
+    bool allows(unsigned sent) const {
+        return sent < requests && (deadline == clock_type::time_point::max() ||
+                                   clock_type::now() < deadline);
+    }
+};
+
+// The budget of each closed-loop client started now: `settings.num_requests`
+// requests, or as many as it can send in `settings.duration` if that is set
+Budget closed_loop_budget() {
+    if (settings.duration.count() <= 0) {
+        return Budget{settings.num_requests};
+    }
+    return Budget{std::numeric_limits<unsigned>::max(),
+                  clock_type::now() +
+                      std::chrono::duration_cast<clock_type::duration>(
+                          settings.duration)};
+}
+
+// Make the requests `budget` allows in batches of `settings.batch_size`,
+// recording the completion time of each batch for every request in it, and
+// statistics on request frequency, hit rate, etc. (the GETs in a batch are
+// sent first, then the SETs, and then the DELs)
+void batched_latencies(Cache &cache, const Budget &budget,
+                       const Workload &workload, RequestLatencies &latencies,
+                       RequestStatistics &stats) {
     generator_type generator;
-    for (auto i = 0u; i < nreq; ++i) {
-        // Generate a request
-        const auto request = generator(params);
-        // Create a function to handle the result
-        std::function<void()> request_fn;
+    std::vector<Request> requests;
+    std::vector<key_type> get_keys;
+    std::vector<Cache::KeyValue> set_entries;
+    std::vector<key_type> del_keys;
+    std::vector<Cache::size_type> sizes;
+    for (auto i = 0u; budget.allows(i); i += settings.batch_size) {
+        // Generate a batch of requests and split it up by type
+        requests.clear();
+        get_keys.clear();
+        set_entries.clear();
+        del_keys.clear();
+        const auto batch_size =
+            std::min(settings.batch_size, budget.requests - i);
+        for (auto j = 0u; j < batch_size; ++j) {
+            requests.push_back(generator(workload));
+        }
+        for (const auto &request : requests) {
+            switch (request.type) {
+            case Request::Type::GET:
+                get_keys.emplace_back(request.key);
+                break;
+            case Request::Type::SET:
+                set_entries.push_back(
+                    {key_type{request.key}, request.value->data(),
+                     static_cast<Cache::size_type>(request.value->size())});
+                break;
+            case Request::Type::DEL:
+                del_keys.emplace_back(request.key);
+                break;
+            }
+        }
+
+        // Measure latency of the batch
+        const auto start = clock_type::now();
+        for (const auto value : cache.mget(get_keys, sizes)) {
+            stats.num_get_hits += value != nullptr;
+        }
+        cache.mset(set_entries);
+        stats.num_del_hits += cache.mdel(del_keys);
+        const auto latency = nanoseconds_since(start);
+        latencies.gets.record(latency, get_keys.size());
+        latencies.sets.record(latency, set_entries.size());
+        latencies.dels.record(latency, del_keys.size());
+        stats.num_gets += get_keys.size();
+        stats.num_sets += set_entries.size();
+        stats.num_dels += del_keys.size();
+    }
+}
+
+// Requests which have been sent but not completed, each with the time its
+// latency counts from and the future for its result (only the one for its
+// type is valid)
+class InFlight {
+  private:
+    struct Sent {
+        Request::Type type;
+        clock_type::time_point start;
+        std::future<std::optional<std::string>> get;
+        std::future<void> set;
+        std::future<bool> del;
+    };
+
+    std::deque<Sent> requests;
+    RequestLatencies &latencies;
+    RequestStatistics &stats;
+
+  public:
+    // Record latencies in `latencies`, and results in `stats`
+    InFlight(RequestLatencies &latencies, RequestStatistics &stats)
+    : latencies{latencies}, stats{stats} {}
 
+    // Send a request without waiting for its response, counting its latency
+    // from `start`
+    void send(Cache &cache, const Request &request,
+              clock_type::time_point start) {
+        auto &sent = requests.emplace_back();
+        sent.type = request.type;
+        sent.start = start;
         switch (request.type) {
         case Request::Type::GET:
-            request_fn = [&] {
-                Cache::size_type size;
-                stats.num_get_hits += cache.get(request.key, size) != nullptr;
-                stats.num_gets++;
-            };
+            sent.get = cache.get_async(key_type{request.key});
+            break;
+        case Request::Type::SET: {
+            const auto value = *request.value;
+            sent.set = cache.set_async(key_type{request.key}, value.data(),
+                                       value.size());
+            break;
+        }
+        case Request::Type::DEL:
+            sent.del = cache.del_async(key_type{request.key});
+            break;
+        }
+    }
+
+    // Wait for the oldest request and record its latency and result
+    void complete_oldest() {
+        auto &sent = requests.front();
+        switch (sent.type) {
+        case Request::Type::GET:
+            stats.num_get_hits += sent.get.get().has_value();
+            stats.num_gets++;
             break;
         case Request::Type::SET:
-            request_fn = [&] {
-                const std::string value = *request.value;
-                cache.set(request.key, value.c_str(), value.length() + 1);
-                stats.num_sets++;
-            };
+            sent.set.get();
+            stats.num_sets++;
             break;
         case Request::Type::DEL:
-            request_fn = [&] {
-                stats.num_del_hits += cache.del(request.key);
-                stats.num_dels++;
-            };
+            stats.num_del_hits += sent.del.get();
+            stats.num_dels++;
             break;
         }
+        latencies.of(sent.type).record(nanoseconds_since(sent.start));
+        requests.pop_front();
+    }
 
-        // Measure latency of request
-        latencies.push_back(measure_latency(request_fn));
+    // Wait for every request
+    void complete_all() {
+        while (!requests.empty()) {
+            complete_oldest();
+        }
     }
 
-    return std::make_pair(latencies, stats);
+    std::size_t size() const {
+        return requests.size();
+    }
+
+    bool empty() const {
+        return requests.empty();
+    }
+};
+
+// Create a client using `settings.client_protocol`, with a near cache of
+// `settings.near_cache_maxmem` bytes if that is not zero
+std::unique_ptr<Cache> make_client() {
+    auto client = std::make_unique<Cache>(
+        settings.server_address,
+        std::to_string(settings.client_protocol == Cache::Protocol::BINARY
+                           ? settings.server_binary_port
+                           : settings.server_port),
+        settings.client_protocol);
+    if (settings.near_cache_maxmem == 0) {
+        return client;
+    }
+    return std::make_unique<Cache>(std::move(client),
+                                   settings.near_cache_maxmem,
+                                   settings.near_cache_ttl);
 }
 
-// Measure the completion time of `nreq` requests in milliseconds per client for
-// `nthreads` clients on separate threads and record statistics on request
+// Measure the completion time of the requests `budget` allows and record
+// statistics on request frequency, hit rate, etc.
+latency_stats_type baseline_latencies(const Budget &budget,
+                                      const Workload &workload) {
+    // Create the cache client
+    const auto client = make_client();
+    auto &cache = *client;
+
+    latency_stats_type result;
+    auto &[latencies, stats] = result;
+
+    if (settings.batch_size > 1) {
+        batched_latencies(cache, budget, workload, latencies, stats);
+    } else {
+        InFlight in_flight{latencies, stats};
+        generator_type generator;
+        for (auto i = 0u; budget.allows(i); ++i) {
+            // Generate a request and send it
+            const auto request = generator(workload);
+            in_flight.send(cache, request, clock_type::now());
+            if (in_flight.size() >= settings.pipeline_depth) {
+                in_flight.complete_oldest();
+            }
+        }
+        // Wait for the remaining requests
+        in_flight.complete_all();
+    }
+    stats.num_near_hits = cache.near_cache_stats().hits;
+
+    return result;
+}
+
+// Measure the completion time of the requests `budget` allows each of
+// `nthreads` clients on separate threads, and record statistics on request
 // frequency, hit rate, etc.
-latency_stats_type threaded_latencies(const unsigned nreq,
+latency_stats_type threaded_latencies(const Budget &budget,
                                       const unsigned nthreads,
-                                      const WorkloadParams &params) {
-    RequestStatistics stats;
-    std::vector<float> latencies;
-    latencies.reserve(nreq * nthreads);
-
-    // Spawn `nthreads` threads, each making `nreq` requests
+                                      const Workload &workload) {
+    // Spawn `nthreads` threads, each making the requests the budget allows
     std::vector<std::future<latency_stats_type>> futures;
     futures.reserve(nthreads);
     for (auto i = 0U; i < nthreads; ++i) {
-        futures.push_back(std::async(std::launch::async, [nreq, &params] {
-            return baseline_latencies(nreq, params);
+        futures.push_back(std::async(std::launch::async, [&budget, &workload] {
+            return baseline_latencies(budget, workload);
         }));
     }
 
     // Wait for each thread to finish and add the result to the total
+    latency_stats_type total;
     for (auto &future : futures) {
-        future.wait();
+        const auto result = future.get();
+        total.first += result.first;
+        total.second += result.second;
+    }
+    return total;
+}
+
+// Measure the completion time of requests from one closed-loop client and
+// return the mean throughput (req/s) and the latencies
+std::pair<float, RequestLatencies>
+baseline_performance(const Workload &workload) {
+    RequestLatencies latencies;
+    // Calculate the total amount of time of all of the requests (pipelined
+    // requests overlap, so their latencies cannot simply be summed)
+    const auto total_time = measure_latency([&] {
+        latencies = baseline_latencies(closed_loop_budget(), workload).first;
+    });
+    // Calculate the mean throughput using the total time
+    const auto mean_throughput = latencies.all().count() / (total_time / 1e3f);
+    return std::pair{mean_throughput, latencies};
+}
+
+// Measure the completion time of requests from `nthreads` closed-loop clients
+// on separate threads and return the mean throughput (req/s) and the
+// latencies
+std::pair<float, RequestLatencies>
+threaded_performance(const unsigned nthreads, const Workload &workload) {
+    RequestLatencies latencies;
+    // Calculate the total amount of time of all of the requests
+    const auto total_time = measure_latency([&] {
+        latencies =
+            threaded_latencies(closed_loop_budget(), nthreads, workload).first;
+    });
+    // Calculate the mean throughput using the total time
+    const auto mean_throughput = latencies.all().count() / (total_time / 1e3f);
+    return std::pair{mean_throughput, latencies};
+}
+
+// Column headings for `print_latencies()`
+constexpr auto LATENCY_COLUMNS =
+    "Op   50%        90%        99%        99.9%      Max (µs)";
+
+// Print a row of latency percentiles in microseconds for all requests and
+// then for each type, each starting with `prefix`
+void print_latencies(const std::string &prefix,
+                     const RequestLatencies &latencies) {
+    const std::pair<const char *, LatencyHistogram> rows[] = {
+        {"all", latencies.all()},
+        {"get", latencies.gets},
+        {"set", latencies.sets},
+        {"del", latencies.dels}};
+    for (const auto &[op, histogram] : rows) {
+        std::cout << prefix << op << "  " << std::fixed
+                  << std::setprecision(1);
+        for (const auto fraction : {0.5, 0.9, 0.99, 0.999}) {
+            std::cout << std::setw(9) << std::left
+                      << histogram.percentile(fraction) / 1e3 << "  ";
+        }
+        std::cout << histogram.max() / 1e3
+                  << std::resetiosflags(std::cout.flags()) << std::endl;
+    }
+}
+
+// Throughput and latencies measured at one point of a sweep: with `clients`
+// closed-loop clients, or with open-loop clients offering `offered` req/s in
+// total (0 for closed-loop clients and trace replays)
+struct Measurement {
+    unsigned clients = 0;
+    unsigned offered = 0;
+    float throughput = 0;
+    RequestLatencies latencies;
+};
+
+// How quickly the hit rate recovered after the server was restarted, either
+// "cold" or from a "snapshot" (`recovery_ms` is negative if it never did)
+struct Restart {
+    std::string from;
+    double first_hit_rate;
+    float recovery_ms;
+};
+
+// Everything a run measures, for `write_json()` and `write_csv()`
+struct Results {
+    // Statistics of the warm-up (or of the replay, when a trace is replayed)
+    RequestStatistics stats;
+    std::vector<Measurement> closed_loop;
+    std::vector<Measurement> open_loop;
+    std::optional<Measurement> replay;
+    // Hit rate before the restarts (0 if restarts were not measured)
+    double warm_hit_rate = 0;
+    std::vector<Restart> restarts;
+};
 
-        auto result = future.get();
-        auto thread_latencies = result.first;
-        auto thread_stats = result.second;
+// Send `nreq` requests at `rate` req/s on average, spaced out according to
+// `settings.open_loop_arrivals`, without waiting for earlier responses, and
+// record the latency of each from when it was due to be sent (rather than
+// from when it was sent, so that a server that falls behind is charged for
+// the time requests spend waiting to be sent)
+latency_stats_type open_loop_latencies(const unsigned nreq, const double rate,
+                                       const Workload &workload) {
+    const auto client = make_client();
+    latency_stats_type result;
+    InFlight in_flight{result.first, result.second};
 
-        latencies.insert(latencies.end(), thread_latencies.begin(),
-                         thread_latencies.end());
+    generator_type generator;
+    std::mt19937 arrival_rng{std::random_device{}()};
+    std::exponential_distribution<double> poisson_interval{rate};
+    const auto interval = [&] {
+        const std::chrono::duration<double> seconds{
+            settings.open_loop_arrivals == Arrivals::POISSON
+                ? poisson_interval(arrival_rng)
+                : 1 / rate};
+        return std::chrono::duration_cast<clock_type::duration>(seconds);
+    };
 
-        stats.num_gets += thread_stats.num_gets;
-        stats.num_sets += thread_stats.num_sets;
-        stats.num_dels += thread_stats.num_dels;
-        stats.num_get_hits += thread_stats.num_get_hits;
-        stats.num_del_hits += thread_stats.num_del_hits;
+    auto due = clock_type::now() + interval();
+    for (auto i = 0u; i < nreq; ++i) {
+        const auto request = generator(workload);
+        // Read responses until the request is due (reading one may take past
+        // that, in which case the request is sent late), and wait if there
+        // are none
+        while (!in_flight.empty() && clock_type::now() < due) {
+            in_flight.complete_oldest();
+        }
+        std::this_thread::sleep_until(due);
+        in_flight.send(*client, request, due);
+        due += interval();
     }
+    in_flight.complete_all();
 
-    return std::make_pair(latencies, stats);
+    return result;
 }
 
-// Measure the completion time of `nreq` requests and return the mean
-// throughput (req/s) and the 95th-percentile latency (ms)
-std::pair<float, float> baseline_performance(const unsigned nreq,
-                                             const WorkloadParams &params) {
-    // Get the request latency numbers
-    auto latencies = baseline_latencies(nreq, params).first;
-    // Calculate the total amount of time of all of the requests
-    const auto total_time =
-        std::accumulate(latencies.begin(), latencies.end(), 0.0f);
-    // Calculate the mean throughput using the total time
-    const auto mean_throughput = nreq / (total_time / 1e3f);
+// Offer `rate` req/s in total for `settings.open_loop_duration`, split over
+// `settings.open_loop_clients` open-loop clients on separate threads, and
+// return the throughput completed (req/s) and the latencies
+std::pair<float, RequestLatencies>
+open_loop_performance(const unsigned rate, const Workload &workload) {
+    const auto client_rate =
+        static_cast<double>(rate) / settings.open_loop_clients;
+    const auto nreq = static_cast<unsigned>(
+        client_rate * settings.open_loop_duration.count());
 
-    // Sort the latency numbers and get the 95th-percentile latency
-    std::sort(latencies.begin(), latencies.end(), std::greater<float>());
-    const auto latency = latencies[static_cast<unsigned>(nreq * 0.95)];
+    RequestLatencies latencies;
+    const auto total_time = measure_latency([&] {
+        std::vector<std::future<latency_stats_type>> futures;
+        for (auto i = 0U; i < settings.open_loop_clients; ++i) {
+            futures.push_back(
+                std::async(std::launch::async, [nreq, client_rate, &workload] {
+                    return open_loop_latencies(nreq, client_rate, workload);
+                }));
+        }
+        for (auto &future : futures) {
+            latencies += future.get().first;
+        }
+    });
+    const auto completed = latencies.all().count();
+    return std::pair{completed / (total_time / 1e3f), latencies};
+}
 
-    // Return mean throughput and latency
-    return std::pair{mean_throughput, latency};
+// Measure the latency seen by open-loop clients at each rate in
+// `settings.open_loop_rates` until the server falls behind, and report the
+// throughput completed and latency percentiles for each
+void open_loop_sweep(const Workload &workload, Results &results) {
+    std::cout << "# Offered (req/s)  Completed (req/s)  " << LATENCY_COLUMNS
+              << std::endl;
+    for (const auto rate : settings.open_loop_rates) {
+        const auto [throughput, latencies] =
+            open_loop_performance(rate, workload);
+        std::stringstream prefix;
+        prefix << "  " << std::setw(15) << std::left << rate << "  "
+               << std::setw(17) << static_cast<unsigned>(throughput) << "  ";
+        print_latencies(prefix.str(), latencies);
+        results.open_loop.push_back(
+            {settings.open_loop_clients, rate, throughput, latencies});
+        if (throughput < rate * OPEN_LOOP_KEPT_UP) {
+            break;
+        }
+    }
 }
 
-// Measure the completion time of `nreq` requests per client for `nthreads`
-// clients on separate threads and return the mean throughput (req/s) and the
-// 95th-percentile latency (ms)
-std::pair<float, float> threaded_performance(const unsigned nreq,
-                                             const unsigned nthreads,
-                                             const WorkloadParams &params) {
-    std::vector<float> latencies;
-    // Calculate the total amount of time of all of the requests
-    const auto total_time = measure_latency(
-        [&] { latencies = threaded_latencies(nreq, nthreads, params).first; });
-    // Calculate the mean throughput using the total time
-    const auto mean_throughput = (nreq * nthreads) / (total_time / 1e3f);
+// Make the request that a trace record describes. The key is the record's,
+// and a SET's value is the size recorded (at least 1) of 'a's ending in a
+// null byte, taken from the end of `values`, which is made longer if need be
+// (requests are sent right away, so that making it longer does not affect
+// any earlier request).
+Request request_of(const trace::Record &record, std::string &values) {
+    switch (record.op) {
+    case trace::Op::GET:
+        return Request::get(record.key);
+    case trace::Op::SET: {
+        const auto size = std::max<std::size_t>(record.value_size, 1);
+        if (values.size() < size) {
+            values.assign(size - 1, 'a');
+            values.push_back('\0');
+        }
+        return Request::set(record.key, std::string_view{values}.substr(
+                                            values.size() - size));
+    }
+    case trace::Op::DEL:
+        return Request::del(record.key);
+    }
+    __builtin_unreachable();
+}
+
+// Replay the requests in the trace at `path` for the keys that hash to client
+// `client` of `nclients`: each is sent when it is due at
+// `settings.trace_speed` after `start`, with its latency counted from then,
+// or as soon as `settings.pipeline_depth` allows if the speed is 0
+latency_stats_type trace_latencies(const std::string &path,
+                                   const unsigned client,
+                                   const unsigned nclients,
+                                   const clock_type::time_point start) {
+    trace::Reader reader{path};
+    const auto cache = make_client();
+    latency_stats_type result;
+    InFlight in_flight{result.first, result.second};
+
+    const std::hash<std::string_view> hash;
+    std::string values;
+    trace::Record record;
+    while (reader.next(record)) {
+        if (hash(record.key) % nclients != client) {
+            continue;
+        }
+        const auto request = request_of(record, values);
+        if (settings.trace_speed > 0) {
+            const auto due =
+                start + std::chrono::duration_cast<clock_type::duration>(
+                            record.timestamp / settings.trace_speed);
+            while (!in_flight.empty() && clock_type::now() < due) {
+                in_flight.complete_oldest();
+            }
+            std::this_thread::sleep_until(due);
+            in_flight.send(*cache, request, due);
+        } else {
+            in_flight.send(*cache, request, clock_type::now());
+            if (in_flight.size() >= settings.pipeline_depth) {
+                in_flight.complete_oldest();
+            }
+        }
+    }
+    in_flight.complete_all();
+    result.second.num_near_hits = cache->near_cache_stats().hits;
+
+    return result;
+}
+
+// Replay the trace at `path` over `settings.trace_clients` clients on
+// separate threads, and report the hit rates, the throughput and the
+// latencies
+void replay_trace(const std::string &path, Results &results) {
+    latency_stats_type total;
+    const auto total_time = measure_latency([&] {
+        const auto start = clock_type::now() + TRACE_START_DELAY;
+        std::vector<std::future<latency_stats_type>> futures;
+        for (auto i = 0U; i < settings.trace_clients; ++i) {
+            futures.push_back(std::async(std::launch::async, [&path, i, start] {
+                return trace_latencies(path, i, settings.trace_clients, start);
+            }));
+        }
+        for (auto &future : futures) {
+            const auto result = future.get();
+            total.first += result.first;
+            total.second += result.second;
+        }
+    });
 
-    // Sort the latency numbers and get the 95th-percentile latency
-    std::sort(latencies.begin(), latencies.end(), std::greater<float>());
-    const auto latency = latencies[static_cast<unsigned>(nreq * 0.95)];
+    std::stringstream stats_lines{};
+    stats_lines << total.second;
+    std::cout << "# Replay Statistics:" << std::endl;
+    for (std::string line; std::getline(stats_lines, line);) {
+        std::cout << "#   " << line << std::endl;
+    }
+    std::cout << "#" << std::endl;
+    std::cout << "# Mean Req/s  " << LATENCY_COLUMNS << std::endl;
+    const auto completed = total.first.all().count();
+    const auto throughput = completed / (total_time / 1e3f);
+    std::stringstream prefix;
+    prefix << "  " << std::setw(10) << std::left
+           << static_cast<unsigned>(throughput) << "  ";
+    print_latencies(prefix.str(), total.first);
 
-    // Return mean throughput and latency
-    return std::pair{mean_throughput, latency};
+    results.stats = total.second;
+    results.replay = Measurement{settings.trace_clients, 0, throughput,
+                                 total.first};
 }
 
-/// Spawn the server as a child process and run the provided function after it
-/// has started
-void run_with_server(const std::function<void()> &inner) {
+/// Spawn the server as a child process (with any extra arguments given) and
+/// run the provided function after it has started, or just run the function
+/// against the running server if `settings.remote` is set
+void run_with_server(const std::function<void()> &inner,
+                     const std::vector<std::string> &extra_args = {}) {
+    if (settings.remote) {
+        inner();
+        return;
+    }
+    std::vector<std::string> args{"--server",
+                                  settings.server_address,
+                                  "--port",
+                                  std::to_string(settings.server_port),
+                                  "--binary-port",
+                                  std::to_string(settings.server_binary_port),
+                                  "--maxmem",
+                                  std::to_string(settings.server_maxmem),
+                                  "--threads",
+                                  std::to_string(settings.server_threads),
+                                  "--evictor",
+                                  settings.server_evictor,
+                                  "--admission",
+                                  settings.server_admission};
+    args.insert(args.end(), extra_args.begin(), extra_args.end());
     /// Spawn the server as a child process, capturing stdout
     boost::process::ipstream std_out;
-    boost::process::child server(
-        "./cache_server", "--server", SERVER_ADDRESS, "--port", SERVER_PORT,
-        "--maxmem", std::to_string(SERVER_MAXMEM), "--threads",
-        std::to_string(SERVER_THREADS), boost::process::std_out > std_out);
+    boost::process::child server("./cache_server", boost::process::args(args),
+                                 boost::process::std_out > std_out);
     // Wait for the line that says the server is running
     std::string line;
     std::getline(std_out, line);
     // Run the provided function
     inner();
-    // Terminate the server process (a bit unclean, but there doesn't seem to be
-    // a nice platform-independent way to send SIGINT)
-    server.terminate();
+    // Stop the server with SIGTERM, so that it shuts down cleanly (saving a
+    // snapshot if it was asked to)
+    kill(server.id(), SIGTERM);
     server.wait();
 }
 
-int main() {
-    std::cout << "# Workload Parameters:" << std::endl;
-    std::cout << "#   prob_get = " << PARAMS.prob_get
-              << ", prob_set = " << PARAMS.prob_set
-              << ", prob_del = " << PARAMS.prob_del
-              << ", num_keys = " << PARAMS.num_keys
-              << ", val_size_dist = " << PARAMS.val_size_dist << std::endl;
-    std::cout << "#" << std::endl;
+/// Client that sends requests one at a time, keeping track of the GET hit
+/// rate over the last `HIT_RATE_WINDOW` GETs
+class HitRateWindow {
+  private:
+    Cache cache{settings.server_address,
+                std::to_string(settings.server_binary_port),
+                Cache::Protocol::BINARY};
+    generator_type generator;
+    // Whether each of the last GETs hit, and how many of them did
+    std::deque<bool> window;
+    unsigned window_hits = 0;
 
-    std::cout << "# Server Parameters:" << std::endl;
-    std::cout << "#   address = " << SERVER_ADDRESS
-              << ", port = " << SERVER_PORT << ", maxmem = " << SERVER_MAXMEM
-              << ", threads = " << SERVER_THREADS << std::endl;
-    std::cout << "#" << std::endl;
+  public:
+    /// Send one request
+    void send(const Workload &workload) {
+        const auto request = generator(workload);
+        switch (request.type) {
+        case Request::Type::GET: {
+            const auto hit =
+                cache.get_async(key_type{request.key}).get().has_value();
+            window.push_back(hit);
+            window_hits += hit;
+            if (window.size() > HIT_RATE_WINDOW) {
+                window_hits -= window.front();
+                window.pop_front();
+            }
+            break;
+        }
+        case Request::Type::SET: {
+            const auto value = *request.value;
+            cache.set(key_type{request.key}, value.data(), value.size());
+            break;
+        }
+        case Request::Type::DEL:
+            cache.del(key_type{request.key});
+            break;
+        }
+    }
 
-    std::cout << "# Sending " << NUM_REQUESTS << " requests per client thread"
+    /// Whether the window has `HIT_RATE_WINDOW` GETs in it
+    bool full() const {
+        return window.size() == HIT_RATE_WINDOW;
+    }
+
+    /// Hit rate of the GETs in the window
+    double hit_rate() const {
+        return static_cast<double>(window_hits) /
+               std::max<std::size_t>(1, window.size());
+    }
+};
+
+/// Measure how long a restarted server takes to get back to the hit rate it
+/// had before the restart, starting empty and starting from a snapshot, and
+/// report both along with the hit rate of the first GETs after the restart
+void measure_restarts(const Workload &workload, Results &results) {
+    // Warm up a server, measure its hit rate once warm, and save it on
+    // shutdown
+    std::remove(SNAPSHOT_PATH);
+    double warm_hit_rate = 0;
+    run_with_server(
+        [&] {
+            baseline_latencies(closed_loop_budget(), workload);
+            HitRateWindow client;
+            while (!client.full()) {
+                client.send(workload);
+            }
+            warm_hit_rate = client.hit_rate();
+        },
+        {"--snapshot", SNAPSHOT_PATH, "--snapshot-interval", "0"});
+    const auto target = warm_hit_rate * HIT_RATE_RECOVERED;
+
+    std::cout << "# Warm GET hit rate: "
+              << static_cast<int>(warm_hit_rate * 100) << "%" << std::endl;
+    std::cout << "# Restart    First " << HIT_RATE_WINDOW
+              << " GETs' hit rate  Time to "
+              << static_cast<int>(HIT_RATE_RECOVERED * 100)
+              << "% of warm hit rate (ms, from spawning the server)"
               << std::endl;
-    std::cout << "#" << std::endl;
+    for (const auto warm : {false, true}) {
+        const auto start = std::chrono::steady_clock::now();
+        double first_hit_rate = 0;
+        float elapsed = -1;
+        run_with_server(
+            [&] {
+                HitRateWindow client;
+                for (auto i = 0U; i < settings.num_requests; ++i) {
+                    client.send(workload);
+                    if (!client.full()) {
+                        continue;
+                    }
+                    if (first_hit_rate == 0) {
+                        first_hit_rate = client.hit_rate();
+                    }
+                    if (client.hit_rate() >= target) {
+                        elapsed = std::chrono::duration<float, std::milli>(
+                                      std::chrono::steady_clock::now() - start)
+                                      .count();
+                        break;
+                    }
+                }
+            },
+            warm ? std::vector<std::string>{"--load", SNAPSHOT_PATH}
+                 : std::vector<std::string>{});
+        std::cout << "  " << std::setw(9) << std::left
+                  << (warm ? "snapshot" : "cold") << "  " << std::setw(24)
+                  << std::to_string(static_cast<int>(first_hit_rate * 100)) +
+                         "%"
+                  << std::resetiosflags(std::cout.flags()) << "  ";
+        if (elapsed < 0) {
+            std::cout << "not reached";
+        } else {
+            std::cout << std::fixed << std::setprecision(1) << elapsed
+                      << std::resetiosflags(std::cout.flags());
+        }
+        std::cout << std::endl;
+        results.restarts.push_back(
+            {warm ? "snapshot" : "cold", first_hit_rate, elapsed});
+    }
+    results.warm_hit_rate = warm_hit_rate;
+    std::remove(SNAPSHOT_PATH);
+}
 
-    // Spawn the server as a child process
-    run_with_server([] {
-        // Warm up the cache
-        baseline_performance(NUM_REQUESTS, PARAMS);
+// Percentiles of each type of request, in the order they are written out
+constexpr std::pair<const char *, double> PERCENTILES[] = {
+    {"p50", 0.5}, {"p90", 0.9}, {"p95", 0.95}, {"p99", 0.99}, {"p999", 0.999}};
 
-        std::cout << "# Threads  Mean Req/s  95% Latency (µs)" << std::endl;
+// Latencies of all requests and then of each type, named
+std::vector<std::pair<const char *, LatencyHistogram>>
+named_latencies(const RequestLatencies &latencies) {
+    return {{"all", latencies.all()},
+            {"get", latencies.gets},
+            {"set", latencies.sets},
+            {"del", latencies.dels}};
+}
 
-        // Start at `NUM_THREADS_MIN` and go up to `NUM_THREADS_MAX`, doubling
-        // the number of threads each iteration
-        for (auto threads = 0; threads <= NUM_THREADS_MAX;
-             threads += NUM_THREADS_STEP) {
-            // Require at least one thread
-            const auto nthreads = std::max(1, threads);
+// Format a number for JSON or CSV
+std::string format_number(double value) {
+    std::ostringstream out;
+    out << std::setprecision(10) << value;
+    return out.str();
+}
 
-            // Measure throughput and latency
-            const auto perf =
-                threaded_performance(NUM_REQUESTS, nthreads, PARAMS);
+// Quote and escape a string for JSON
+std::string json_string(std::string_view value) {
+    std::string out = "\"";
+    for (const auto c : value) {
+        if (c == '"' || c == '\\') {
+            out.push_back('\\');
+            out.push_back(c);
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escape[7];
+            std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+            out.append(escape);
+        } else {
+            out.push_back(c);
+        }
+    }
+    out.push_back('"');
+    return out;
+}
 
-            // Output values
-            std::cout << "  " << std::setw(7) << std::left << nthreads
-                      << std::resetiosflags(std::cout.flags());
-            std::cout << "  " << std::setw(10) << std::left
-                      << static_cast<unsigned>(perf.first)
-                      << std::resetiosflags(std::cout.flags());
-            std::cout << "  " << std::fixed << std::setprecision(1)
-                      << perf.second * 1000.0f
-                      << std::resetiosflags(std::cout.flags());
-            std::cout << std::endl;
+// Format the value of a command-line option as JSON
+std::string json_value(const boost::any &value) {
+    if (const auto v = boost::any_cast<bool>(&value)) {
+        return *v ? "true" : "false";
+    } else if (const auto v = boost::any_cast<unsigned>(&value)) {
+        return std::to_string(*v);
+    } else if (const auto v = boost::any_cast<uint16_t>(&value)) {
+        return std::to_string(*v);
+    } else if (const auto v = boost::any_cast<double>(&value)) {
+        return format_number(*v);
+    } else if (const auto v = boost::any_cast<std::string>(&value)) {
+        return json_string(*v);
+    } else if (const auto v = boost::any_cast<std::vector<unsigned>>(&value)) {
+        std::string out = "[";
+        for (const auto element : *v) {
+            out.append(out.size() > 1 ? "," : "").append(
+                std::to_string(element));
         }
-    });
+        return out + "]";
+    } else if (const auto v =
+                   boost::any_cast<std::vector<std::string>>(&value)) {
+        std::string out = "[";
+        for (const auto &element : *v) {
+            out.append(out.size() > 1 ? "," : "").append(json_string(element));
+        }
+        return out + "]";
+    }
+    return "null";
+}
+
+// Append a member to the JSON object at the end of `out`, whose value is
+// already formatted as JSON
+void append_member(std::string &out, const char *name,
+                   const std::string &value) {
+    if (out.back() != '{') {
+        out.push_back(',');
+    }
+    out.append(json_string(name)).append(":").append(value);
+}
+
+// Format request statistics as a JSON object
+std::string stats_json(const RequestStatistics &stats) {
+    std::string out = "{";
+    append_member(out, "num_gets", std::to_string(stats.num_gets));
+    append_member(out, "num_sets", std::to_string(stats.num_sets));
+    append_member(out, "num_dels", std::to_string(stats.num_dels));
+    append_member(out, "num_get_hits", std::to_string(stats.num_get_hits));
+    append_member(out, "num_del_hits", std::to_string(stats.num_del_hits));
+    append_member(out, "num_near_hits", std::to_string(stats.num_near_hits));
+    return out + "}";
+}
+
+// Format a measurement as a JSON object, with the latencies of each type of
+// request in nanoseconds
+std::string measurement_json(const Measurement &measurement) {
+    std::string out = "{";
+    append_member(out, "clients", std::to_string(measurement.clients));
+    if (measurement.offered != 0) {
+        append_member(out, "offered_rps", std::to_string(measurement.offered));
+    }
+    append_member(out, "throughput_rps",
+                  format_number(measurement.throughput));
+    out.append(",\"latency\":{");
+    for (const auto &[op, histogram] :
+         named_latencies(measurement.latencies)) {
+        std::string latency = "{";
+        append_member(latency, "count", std::to_string(histogram.count()));
+        append_member(latency, "mean_ns", format_number(histogram.mean()));
+        for (const auto &[name, fraction] : PERCENTILES) {
+            append_member(latency, (std::string{name} + "_ns").c_str(),
+                          std::to_string(histogram.percentile(fraction)));
+        }
+        append_member(latency, "max_ns", std::to_string(histogram.max()));
+        append_member(out, op, latency + "}");
+    }
+    return out + "}}";
+}
+
+// Write the settings and the results of a run to `out` as a JSON object
+void write_json(std::ostream &out,
+                const boost::program_options::variables_map &config,
+                const Results &results) {
+    std::string json = "{";
+
+    std::string options = "{";
+    for (const auto &[name, value] : config) {
+        append_member(options, name.c_str(), json_value(value.value()));
+    }
+    append_member(json, "settings", options + "}");
+    append_member(json, results.replay ? "replay_stats" : "warm_up_stats",
+                  stats_json(results.stats));
+
+    const auto measurements = [](const std::vector<Measurement> &sweep) {
+        std::string out = "[";
+        for (const auto &measurement : sweep) {
+            out.append(out.size() > 1 ? "," : "")
+                .append(measurement_json(measurement));
+        }
+        return out + "]";
+    };
+    append_member(json, "closed_loop", measurements(results.closed_loop));
+    append_member(json, "open_loop", measurements(results.open_loop));
+    if (results.replay) {
+        append_member(json, "replay", measurement_json(*results.replay));
+    }
+
+    std::string restarts = "{";
+    append_member(restarts, "warm_hit_rate",
+                  format_number(results.warm_hit_rate));
+    std::string runs = "[";
+    for (const auto &restart : results.restarts) {
+        std::string run = "{";
+        append_member(run, "from", json_string(restart.from));
+        append_member(run, "first_hit_rate",
+                      format_number(restart.first_hit_rate));
+        append_member(run, "recovery_ms",
+                      restart.recovery_ms < 0
+                          ? "null"
+                          : format_number(restart.recovery_ms));
+        runs.append(runs.size() > 1 ? "," : "").append(run + "}");
+    }
+    append_member(restarts, "runs", runs + "]");
+    append_member(json, "restarts", restarts + "}");
+
+    out << json << "}" << std::endl;
+}
+
+// Write the latency columns of a CSV row (or their headings)
+void write_csv_latencies(std::ostream &out, const RequestLatencies *latencies) {
+    for (const auto &[op, histogram] :
+         named_latencies(latencies ? *latencies : RequestLatencies{})) {
+        if (latencies == nullptr) {
+            out << "," << op << "_count";
+            for (const auto &[name, fraction] : PERCENTILES) {
+                out << "," << op << "_" << name << "_us";
+            }
+            out << "," << op << "_max_us";
+            continue;
+        }
+        out << "," << histogram.count();
+        for (const auto &[name, fraction] : PERCENTILES) {
+            out << "," << format_number(histogram.percentile(fraction) / 1e3);
+        }
+        out << "," << format_number(histogram.max() / 1e3);
+    }
+    out << std::endl;
+}
+
+// Write the settings and the results of a run to `out` as CSV: the
+// settings as comments, and then a table for each kind of measurement that
+// was made (separated by two blank lines, so gnuplot can pick one with
+// `index`), with latencies in microseconds
+void write_csv(std::ostream &out,
+               const boost::program_options::variables_map &config,
+               const Results &results) {
+    for (const auto &[name, value] : config) {
+        out << "# " << name << " = " << json_value(value.value()) << std::endl;
+    }
+    auto first = true;
+    const auto begin_table = [&](const char *title, const char *columns) {
+        out << (first ? "" : "\n\n") << "# " << title << std::endl
+            << columns;
+        write_csv_latencies(out, nullptr);
+        first = false;
+    };
+
+    if (!results.closed_loop.empty()) {
+        begin_table("Closed-loop clients", "clients,throughput_rps");
+        for (const auto &measurement : results.closed_loop) {
+            out << measurement.clients << ","
+                << format_number(measurement.throughput);
+            write_csv_latencies(out, &measurement.latencies);
+        }
+    }
+    if (!results.open_loop.empty()) {
+        begin_table("Open-loop clients", "offered_rps,completed_rps");
+        for (const auto &measurement : results.open_loop) {
+            out << measurement.offered << ","
+                << format_number(measurement.throughput);
+            write_csv_latencies(out, &measurement.latencies);
+        }
+    }
+    if (results.replay) {
+        begin_table("Trace replay", "clients,throughput_rps");
+        out << results.replay->clients << ","
+            << format_number(results.replay->throughput);
+        write_csv_latencies(out, &results.replay->latencies);
+    }
+    if (!results.restarts.empty()) {
+        out << (first ? "" : "\n\n") << "# Restarts (warm hit rate "
+            << format_number(results.warm_hit_rate) << ")" << std::endl
+            << "from,first_hit_rate,recovery_ms" << std::endl;
+        for (const auto &restart : results.restarts) {
+            out << restart.from << "," << format_number(restart.first_hit_rate)
+                << ","
+                << (restart.recovery_ms < 0
+                        ? ""
+                        : format_number(restart.recovery_ms))
+                << std::endl;
+        }
+    }
+}
+
+// Join numbers with spaces, for the default value of a list option
+std::string join(const std::vector<unsigned> &values) {
+    std::string out;
+    for (const auto value : values) {
+        out.append(out.empty() ? "" : " ").append(std::to_string(value));
+    }
+    return out;
+}
+
+int main(const int argc, const char *const argv[]) {
+    namespace po = boost::program_options;
+    const Settings defaults;
+
+    // Configure command-line options
+    po::options_description options{"Usage"};
+    options.add_options()("help,h", "show this help message");
+
+    po::options_description server_options{"Server"};
+    server_options.add_options()(
+        "remote", po::bool_switch(),
+        "send requests to a server that is already running at --server, "
+        "instead of spawning one (restarts are not measured)");
+    server_options.add_options()(
+        "server,s", po::value<std::string>()->default_value(
+                        defaults.server_address),
+        "set server address");
+    server_options.add_options()(
+        "port,p", po::value<uint16_t>()->default_value(defaults.server_port),
+        "set server port");
+    server_options.add_options()(
+        "binary-port",
+        po::value<uint16_t>()->default_value(defaults.server_binary_port),
+        "set server port for the binary protocol");
+    server_options.add_options()(
+        "maxmem,m",
+        po::value<Cache::size_type>()->default_value(defaults.server_maxmem),
+        "set spawned server's cache memory limit in bytes");
+    server_options.add_options()(
+        "server-threads",
+        po::value<unsigned>()->default_value(defaults.server_threads),
+        "set spawned server's number of threads");
+    server_options.add_options()(
+        "evictor",
+        po::value<std::string>()->default_value(defaults.server_evictor),
+        "set spawned server's eviction policy");
+    server_options.add_options()(
+        "admission",
+        po::value<std::string>()->default_value(defaults.server_admission),
+        "set spawned server's admission policy");
+
+    po::options_description client_options{"Clients"};
+    client_options.add_options()(
+        "protocol", po::value<std::string>()->default_value("http"),
+        "set protocol used by the clients (http or binary)");
+    client_options.add_options()(
+        "pipeline",
+        po::value<unsigned>()->default_value(defaults.pipeline_depth),
+        "set number of requests each client keeps in flight");
+    client_options.add_options()(
+        "batch", po::value<unsigned>()->default_value(defaults.batch_size),
+        "set number of requests each client sends together as batches (1 "
+        "for no batches)");
+    client_options.add_options()(
+        "near-cache",
+        po::value<Cache::size_type>()->default_value(
+            defaults.near_cache_maxmem),
+        "set size of each client's near cache in bytes (0 for none)");
+    client_options.add_options()(
+        "near-cache-ttl",
+        po::value<unsigned>()->default_value(defaults.near_cache_ttl.count()),
+        "set milliseconds each client's near cache keeps a value");
+
+    po::options_description run_options{"Measurements"};
+    run_options.add_options()(
+        "phases",
+        po::value<std::vector<std::string>>()
+            ->multitoken()
+            ->default_value({"closed", "open", "restarts"},
+                            "closed open restarts"),
+        "set measurements to make after warming up (closed, open and/or "
+        "restarts)");
+    run_options.add_options()(
+        "requests,n",
+        po::value<unsigned>()->default_value(defaults.num_requests),
+        "set number of requests each closed-loop client sends");
+    run_options.add_options()(
+        "duration", po::value<double>()->default_value(0),
+        "set seconds each closed-loop client sends requests for, instead of "
+        "a number of requests (0 to send --requests)");
+    run_options.add_options()(
+        "threads-max",
+        po::value<unsigned>()->default_value(defaults.num_threads_max),
+        "set largest number of closed-loop client threads");
+    run_options.add_options()(
+        "threads-step",
+        po::value<unsigned>()->default_value(defaults.num_threads_step),
+        "set increase in closed-loop client threads from one measurement to "
+        "the next");
+    run_options.add_options()(
+        "rates",
+        po::value<std::vector<unsigned>>()->multitoken()->default_value(
+            defaults.open_loop_rates, join(defaults.open_loop_rates)),
+        "set total rates (req/s) the open-loop clients offer, in increasing "
+        "order");
+    run_options.add_options()(
+        "arrivals", po::value<std::string>()->default_value("poisson"),
+        "set how open-loop clients space out requests (poisson or fixed)");
+    run_options.add_options()(
+        "open-loop-clients",
+        po::value<unsigned>()->default_value(defaults.open_loop_clients),
+        "set number of open-loop clients");
+    run_options.add_options()(
+        "open-loop-duration",
+        po::value<double>()->default_value(
+            defaults.open_loop_duration.count()),
+        "set seconds each rate is offered for");
+    run_options.add_options()(
+        "trace", po::value<std::string>(),
+        "replay a trace recorded by cache_server --record-trace instead of "
+        "the synthetic workload");
+    run_options.add_options()(
+        "trace-clients",
+        po::value<unsigned>()->default_value(defaults.trace_clients),
+        "set number of clients replaying the trace");
+    run_options.add_options()(
+        "trace-speed",
+        po::value<double>()->default_value(defaults.trace_speed),
+        "set speed to replay the trace at, relative to the recorded speed (0 "
+        "for as fast as --pipeline allows)");
+
+    po::options_description output_options{"Output"};
+    output_options.add_options()(
+        "json", po::value<std::string>(),
+        "also write the settings and results to a JSON file");
+    output_options.add_options()(
+        "csv", po::value<std::string>(),
+        "also write the settings and results to a CSV file (one table per "
+        "kind of measurement)");
+
+    po::options_description workload_options{"Workload"};
+    workload_options.add_options()(
+        "get", po::value<unsigned>()->default_value(DEFAULT_PARAMS.prob_get),
+        "set relative frequency of GET requests");
+    workload_options.add_options()(
+        "set", po::value<unsigned>()->default_value(DEFAULT_PARAMS.prob_set),
+        "set relative frequency of SET requests");
+    workload_options.add_options()(
+        "del", po::value<unsigned>()->default_value(DEFAULT_PARAMS.prob_del),
+        "set relative frequency of DEL requests");
+    workload_options.add_options()(
+        "keys", po::value<unsigned>()->default_value(DEFAULT_PARAMS.num_keys),
+        "set number of keys to choose between");
+    workload_options.add_options()(
+        "key-dist", po::value<std::string>()->default_value("geometric"),
+        "set key distribution (geometric, uniform, zipf or hotspot)");
+    workload_options.add_options()(
+        "zipf-skew",
+        po::value<double>()->default_value(DEFAULT_PARAMS.zipf_skew, "0.99"),
+        "set exponent of the zipf key distribution");
+    workload_options.add_options()(
+        "hot-keys",
+        po::value<double>()->default_value(DEFAULT_PARAMS.hot_key_fraction,
+                                           "0.2"),
+        "set fraction of the keys that are hot in the hotspot key "
+        "distribution");
+    workload_options.add_options()(
+        "hot-requests",
+        po::value<double>()->default_value(
+            DEFAULT_PARAMS.hot_request_fraction, "0.8"),
+        "set fraction of the requests for hot keys in the hotspot key "
+        "distribution");
+    workload_options.add_options()(
+        "value-size-dist",
+        po::value<double>()->default_value(DEFAULT_PARAMS.val_size_dist,
+                                           "0.08"),
+        "set probability of the geometric distribution of value sizes");
+
+    options.add(server_options)
+        .add(client_options)
+        .add(run_options)
+        .add(workload_options)
+        .add(output_options);
+
+    // Parse command-line arguments
+    po::variables_map config;
+    try {
+        po::store(po::parse_command_line(argc, argv, options), config);
+        po::notify(config);
+    } catch (const po::error &error) {
+        // Show usage if arguments were invalid
+        std::cerr << "error: " << error.what() << std::endl << std::endl;
+        std::cerr << options << std::endl;
+        return 1;
+    }
+
+    // Show help if help flag is present
+    if (config.count("help")) {
+        std::cerr << options << std::endl;
+        return 0;
+    }
+
+    // Get the settings
+    settings.remote = config["remote"].as<bool>();
+    settings.server_address = config["server"].as<std::string>();
+    settings.server_port = config["port"].as<uint16_t>();
+    settings.server_binary_port = config["binary-port"].as<uint16_t>();
+    settings.server_maxmem = config["maxmem"].as<Cache::size_type>();
+    settings.server_threads = config["server-threads"].as<unsigned>();
+    settings.server_evictor = config["evictor"].as<std::string>();
+    settings.server_admission = config["admission"].as<std::string>();
+    settings.pipeline_depth = config["pipeline"].as<unsigned>();
+    settings.batch_size = config["batch"].as<unsigned>();
+    settings.near_cache_maxmem = config["near-cache"].as<Cache::size_type>();
+    settings.near_cache_ttl =
+        std::chrono::milliseconds{config["near-cache-ttl"].as<unsigned>()};
+    settings.num_requests = config["requests"].as<unsigned>();
+    settings.duration =
+        std::chrono::duration<double>{config["duration"].as<double>()};
+    settings.num_threads_max = config["threads-max"].as<unsigned>();
+    settings.num_threads_step = config["threads-step"].as<unsigned>();
+    settings.open_loop_rates = config["rates"].as<std::vector<unsigned>>();
+    settings.open_loop_clients = config["open-loop-clients"].as<unsigned>();
+    settings.open_loop_duration = std::chrono::duration<double>{
+        config["open-loop-duration"].as<double>()};
+    settings.trace_path = config.count("trace")
+                              ? config["trace"].as<std::string>()
+                              : std::string{};
+    settings.trace_clients = config["trace-clients"].as<unsigned>();
+    settings.trace_speed = config["trace-speed"].as<double>();
+
+    // Validate the settings
+    const auto protocol = config["protocol"].as<std::string>();
+    if (protocol == "http") {
+        settings.client_protocol = Cache::Protocol::HTTP;
+    } else if (protocol == "binary") {
+        settings.client_protocol = Cache::Protocol::BINARY;
+    } else {
+        std::cerr << "error: unknown protocol '" << protocol << "'"
+                  << std::endl;
+        return 1;
+    }
+    const auto arrivals = config["arrivals"].as<std::string>();
+    if (arrivals == "poisson") {
+        settings.open_loop_arrivals = Arrivals::POISSON;
+    } else if (arrivals == "fixed") {
+        settings.open_loop_arrivals = Arrivals::FIXED;
+    } else {
+        std::cerr << "error: unknown arrivals '" << arrivals << "'"
+                  << std::endl;
+        return 1;
+    }
+    settings.closed_loop = settings.open_loop = settings.restarts = false;
+    for (const auto &phase : config["phases"].as<std::vector<std::string>>()) {
+        if (phase == "closed") {
+            settings.closed_loop = true;
+        } else if (phase == "open") {
+            settings.open_loop = true;
+        } else if (phase == "restarts") {
+            settings.restarts = true;
+        } else {
+            std::cerr << "error: unknown phase '" << phase << "'" << std::endl;
+            return 1;
+        }
+    }
+    if (settings.pipeline_depth == 0 || settings.batch_size == 0 ||
+        settings.num_threads_step == 0 || settings.open_loop_clients == 0 ||
+        settings.trace_clients == 0) {
+        std::cerr << "error: --pipeline, --batch, --threads-step, "
+                     "--open-loop-clients and --trace-clients must be at "
+                     "least 1"
+                  << std::endl;
+        return 1;
+    }
+
+    // Get the workload parameters
+    auto params = DEFAULT_PARAMS;
+    params.prob_get = config["get"].as<unsigned>();
+    params.prob_set = config["set"].as<unsigned>();
+    params.prob_del = config["del"].as<unsigned>();
+    params.num_keys = config["keys"].as<unsigned>();
+    params.val_size_dist = config["value-size-dist"].as<double>();
+    params.zipf_skew = config["zipf-skew"].as<double>();
+    params.hot_key_fraction = config["hot-keys"].as<double>();
+    params.hot_request_fraction = config["hot-requests"].as<double>();
+    const auto key_dist_name = config["key-dist"].as<std::string>();
+    if (key_dist_name == "geometric") {
+        params.key_dist = KeyDistribution::GEOMETRIC;
+    } else if (key_dist_name == "uniform") {
+        params.key_dist = KeyDistribution::UNIFORM;
+    } else if (key_dist_name == "zipf") {
+        params.key_dist = KeyDistribution::ZIPF;
+    } else if (key_dist_name == "hotspot") {
+        params.key_dist = KeyDistribution::HOTSPOT;
+    } else {
+        std::cerr << "error: unknown key distribution '" << key_dist_name
+                  << "'" << std::endl;
+        return 1;
+    }
+
+    // Render the keys and values once, for every client to share
+    std::unique_ptr<const Workload> workload_ptr;
+    try {
+        workload_ptr = std::make_unique<const Workload>(params);
+    } catch (const std::invalid_argument &error) {
+        std::cerr << "error: " << error.what() << std::endl;
+        return 1;
+    }
+    const auto &workload = *workload_ptr;
+
+    // Open the output files before running anything, so that a bad path
+    // does not waste a run
+    std::ofstream json_file, csv_file;
+    for (const auto &[name, file] :
+         {std::pair{"json", &json_file}, std::pair{"csv", &csv_file}}) {
+        if (!config.count(name)) {
+            continue;
+        }
+        const auto path = config[name].as<std::string>();
+        file->open(path);
+        if (!*file) {
+            std::cerr << "error: unable to open " << path << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "# Server Parameters:" << std::endl;
+    std::cout << "#   address = " << settings.server_address
+              << ", port = " << settings.server_port
+              << ", binary_port = " << settings.server_binary_port;
+    if (settings.remote) {
+        std::cout << " (remote)";
+    } else {
+        std::cout << ", maxmem = " << settings.server_maxmem
+                  << ", threads = " << settings.server_threads
+                  << ", evictor = " << settings.server_evictor
+                  << ", admission = " << settings.server_admission;
+    }
+    std::cout << std::endl << "#" << std::endl;
+
+    const auto protocol_name =
+        settings.client_protocol == Cache::Protocol::BINARY ? "binary"
+                                                            : "HTTP";
+    Results results;
+    if (!settings.trace_path.empty()) {
+        // Replay the trace instead of the synthetic workload
+        std::cout << "# Replaying " << settings.trace_path << " on "
+                  << settings.trace_clients << " clients over "
+                  << protocol_name << " at ";
+        if (settings.trace_speed > 0) {
+            std::cout << settings.trace_speed << "x the recorded speed";
+        } else {
+            std::cout << "full speed with up to " << settings.pipeline_depth
+                      << " in flight";
+        }
+        std::cout << std::endl << "#" << std::endl;
+        run_with_server([&] { replay_trace(settings.trace_path, results); });
+    } else {
+        std::cout << "# Workload Parameters:" << std::endl;
+        std::cout << "#   prob_get = " << params.prob_get
+                  << ", prob_set = " << params.prob_set
+                  << ", prob_del = " << params.prob_del
+                  << ", num_keys = " << params.num_keys
+                  << ", val_size_dist = " << params.val_size_dist
+                  << std::endl;
+        std::cout << "#   key_dist = " << key_dist_name;
+        if (params.key_dist == KeyDistribution::ZIPF) {
+            std::cout << ", zipf_skew = " << params.zipf_skew;
+        } else if (params.key_dist == KeyDistribution::HOTSPOT) {
+            std::cout << ", hot_keys = " << params.hot_key_fraction
+                      << ", hot_requests = " << params.hot_request_fraction;
+        }
+        std::cout << std::endl << "#" << std::endl;
+
+        std::cout << "# Sending ";
+        if (settings.duration.count() > 0) {
+            std::cout << "requests for " << settings.duration.count() << "s";
+        } else {
+            std::cout << settings.num_requests << " requests";
+        }
+        std::cout << " per client thread over " << protocol_name
+                  << (settings.batch_size > 1
+                          ? " in batches of " +
+                                std::to_string(settings.batch_size)
+                          : " with up to " +
+                                std::to_string(settings.pipeline_depth) +
+                                " in flight")
+                  << std::endl;
+        std::cout << "# Open-loop clients: " << settings.open_loop_clients
+                  << " with "
+                  << (settings.open_loop_arrivals == Arrivals::POISSON
+                          ? "Poisson"
+                          : "fixed-rate")
+                  << " arrivals, each rate offered for "
+                  << settings.open_loop_duration.count() << "s" << std::endl;
+        std::cout << "#" << std::endl;
+
+        // Spawn the server as a child process (unless it is remote)
+        run_with_server([&] {
+            // Warm up the cache and report the hit rates seen while doing so
+            results.stats =
+                baseline_latencies(closed_loop_budget(), workload).second;
+            std::stringstream stats_lines{};
+            stats_lines << results.stats;
+            std::cout << "# Warm-up Statistics:" << std::endl;
+            for (std::string line; std::getline(stats_lines, line);) {
+                std::cout << "#   " << line << std::endl;
+            }
+            std::cout << "#" << std::endl;
+
+            if (settings.closed_loop) {
+                std::cout << "# Threads  Mean Req/s  " << LATENCY_COLUMNS
+                          << std::endl;
+
+                // Start at one thread and go up to
+                // `settings.num_threads_max`, adding
+                // `settings.num_threads_step` threads each iteration
+                for (auto threads = 0U; threads <= settings.num_threads_max;
+                     threads += settings.num_threads_step) {
+                    // Require at least one thread
+                    const auto nthreads = std::max(1U, threads);
+
+                    // Measure throughput and latency
+                    const auto [throughput, latencies] =
+                        threaded_performance(nthreads, workload);
+                    results.closed_loop.push_back(
+                        {nthreads, 0, throughput, latencies});
+
+                    // Output values
+                    std::stringstream prefix;
+                    prefix << "  " << std::setw(7) << std::left << nthreads
+                           << "  " << std::setw(10)
+                           << static_cast<unsigned>(throughput) << "  ";
+                    print_latencies(prefix.str(), latencies);
+                }
+                std::cout << "#" << std::endl;
+            }
+
+            // Measure latency against offered load, which the closed-loop
+            // clients above understate once the server queues requests:
+            // each waits for a response before sending its next request, so
+            // requests that would have arrived during a slow response are
+            // never sent
+            if (settings.open_loop) {
+                open_loop_sweep(workload, results);
+                std::cout << "#" << std::endl;
+            }
+        });
+
+        // Measure how quickly the hit rate recovers after restarting the
+        // server, which can only be done with a server of our own
+        if (settings.restarts && settings.remote) {
+            std::cout << "# Restarts are not measured against a remote server"
+                      << std::endl;
+        } else if (settings.restarts) {
+            measure_restarts(workload, results);
+        }
+    }
+
+    if (json_file.is_open()) {
+        write_json(json_file, config, results);
+    }
+    if (csv_file.is_open()) {
+        write_csv(csv_file, config, results);
+    }
 }
@@ -1,23 +1,148 @@
 #include "request_generator.hh"
 
+#include <cmath>
 #include <iostream>
+#include <stdexcept>
+
+namespace {
+
+// Negative natural log of the probability past which a geometric
+// distribution is cut short (about one in ten million)
+constexpr double GEOMETRIC_TAIL = 16.1;
+
+// Smallest value that a geometric distribution with probability `p` exceeds
+// with a probability of less than e^-`GEOMETRIC_TAIL`
+unsigned geometric_bound(double p) {
+    if (p >= 1) {
+        return 0;
+    }
+    return static_cast<unsigned>(std::ceil(GEOMETRIC_TAIL / -std::log1p(-p)));
+}
+
+// Probability of the geometric distribution of keys with `num_keys` keys
+double key_geometric_p(unsigned num_keys) {
+    return num_keys > 1 ? 1.0 / (num_keys - 1) : 1.0;
+}
+
+// Number of keys to render for a workload
+unsigned rendered_keys(const WorkloadParams &params) {
+    if (params.key_dist != KeyDistribution::GEOMETRIC) {
+        return params.num_keys;
+    }
+    return std::max(params.num_keys,
+                    geometric_bound(key_geometric_p(params.num_keys)));
+}
+
+// Number of hot keys in a hotspot distribution (at least one)
+unsigned hot_keys(const WorkloadParams &params) {
+    const auto hot = std::lround(params.num_keys * params.hot_key_fraction);
+    return static_cast<unsigned>(
+        std::clamp<long>(hot, 1, static_cast<long>(params.num_keys)));
+}
+
+// Check that a workload's parameters make sense, returning them if so
+const WorkloadParams &validate(const WorkloadParams &params) {
+    if (params.prob_get + params.prob_set + params.prob_del == 0) {
+        throw std::invalid_argument(
+            "at least one request type must have a nonzero probability");
+    }
+    if (params.num_keys == 0) {
+        throw std::invalid_argument("there must be at least one key");
+    }
+    if (!(params.val_size_dist > 0 && params.val_size_dist <= 1)) {
+        throw std::invalid_argument(
+            "the value size distribution must be in (0, 1]");
+    }
+    if (!(params.zipf_skew >= 0)) {
+        throw std::invalid_argument("the Zipf skew must not be negative");
+    }
+    if (!(params.hot_key_fraction > 0 && params.hot_key_fraction <= 1) ||
+        !(params.hot_request_fraction >= 0 &&
+          params.hot_request_fraction <= 1)) {
+        throw std::invalid_argument(
+            "the hotspot fractions must be between 0 and 1");
+    }
+    return params;
+}
+
+} // namespace
 
 ////////////////////////////////////////////////
 // Request
 ////////////////////////////////////////////////
 
-Request::Request(Request::Type type, std::string key,
-                 std::optional<std::string> value)
-: type{type}, key{std::move(key)}, value{std::move(value)} {}
+Request::Request(Request::Type type, std::string_view key,
+                 std::optional<std::string_view> value)
+: type{type}, key{key}, value{value} {}
+
+Request Request::get(std::string_view key) {
+    return Request{Type::GET, key};
+}
+
+Request Request::set(std::string_view key, std::string_view value) {
+    return Request{Type::SET, key, value};
+}
+
+Request Request::del(std::string_view key) {
+    return Request{Type::DEL, key};
+}
+
+////////////////////////////////////////////////
+// Workload
+////////////////////////////////////////////////
+
+Workload::Workload(const WorkloadParams &params)
+: params{validate(params)},
+  type_param{0, params.prob_get + params.prob_set + params.prob_del - 1},
+  key_param{0, params.num_keys - 1}, hot_param{0, hot_keys(params) - 1},
+  cold_param{hot_keys(params) < params.num_keys
+                 ? key_param_type{hot_keys(params), params.num_keys - 1}
+                 : key_param},
+  key_geometric_param{key_geometric_p(params.num_keys)},
+  value_geometric_param{params.val_size_dist} {
+    // Render every key
+    const auto num_keys = rendered_keys(params);
+    key_offsets.reserve(num_keys + 1);
+    for (auto i = 0U; i < num_keys; ++i) {
+        key_offsets.push_back(key_chars.size());
+        key_chars += std::to_string(i);
+    }
+    key_offsets.push_back(key_chars.size());
+
+    values.assign(geometric_bound(params.val_size_dist) + 1, 'a');
+    values.push_back('\0');
+
+    if (params.key_dist == KeyDistribution::ZIPF) {
+        zipf_cdf_.reserve(params.num_keys);
+        double total = 0;
+        for (auto rank = 1U; rank <= params.num_keys; ++rank) {
+            total += 1 / std::pow(rank, params.zipf_skew);
+            zipf_cdf_.push_back(total);
+        }
+        for (auto &probability : zipf_cdf_) {
+            probability /= total;
+        }
+    }
+}
+
+unsigned Workload::num_keys() const {
+    return key_offsets.size() - 1;
+}
+
+std::string_view Workload::key(unsigned index) const {
+    return std::string_view{key_chars}.substr(
+        key_offsets[index], key_offsets[index + 1] - key_offsets[index]);
+}
 
-Request Request::get(std::string key) {
-    return Request{Type::GET, std::move(key)};
+unsigned Workload::max_value_size() const {
+    return values.size() - 2;
 }
 
-Request Request::set(std::string key, std::string value) {
-    return Request{Type::SET, std::move(key), std::make_optional(value)};
+std::string_view Workload::value(unsigned size) const {
+    // The last `size + 2` bytes of the buffer, which end with its null byte
+    return std::string_view{values}.substr(values.size() - (size + 2));
 }
 
-Request Request::del(std::string key) {
-    return Request{Type::DEL, std::move(key)};
+const std::vector<double> &Workload::zipf_cdf() const {
+    return zipf_cdf_;
 }
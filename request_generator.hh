@@ -1,9 +1,30 @@
 #ifndef REQUEST_GENERATOR_H
 #define REQUEST_GENERATOR_H
 
+#include <algorithm>
+#include <cstdint>
 #include <functional>
 #include <optional>
 #include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// How the key of each request is chosen out of `WorkloadParams::num_keys`
+enum class KeyDistribution {
+    // Geometric, with a mean of `num_keys - 1` (keys past `num_keys` are
+    // chosen too, less and less often)
+    GEOMETRIC,
+    // Every key equally often
+    UNIFORM,
+    // Zipfian: the key of rank r (from 1) is chosen in proportion to
+    // 1 / r^`zipf_skew`
+    ZIPF,
+    // A fraction `hot_key_fraction` of the keys gets a fraction
+    // `hot_request_fraction` of the requests, uniformly within the hot and
+    // the cold keys
+    HOTSPOT,
+};
 
 struct WorkloadParams {
     // Probabilities for each request type (by ratio)
@@ -14,44 +35,114 @@ struct WorkloadParams {
     unsigned num_keys;
     // Geometric distribution probability used to calculate value size
     double val_size_dist;
+    // Distribution of keys, and the parameters of the ones that have any
+    KeyDistribution key_dist = KeyDistribution::GEOMETRIC;
+    double zipf_skew = 0.99;
+    double hot_key_fraction = 0.2;
+    double hot_request_fraction = 0.8;
 };
 
+// A request for a key. The key and the value point into the `Workload` that
+// generated the request (or whatever else the request was made from), so
+// they must outlive it.
 struct Request {
     enum class Type { GET, SET, DEL };
 
     const Type type;
-    const std::string key;
-    const std::optional<std::string> value;
+    const std::string_view key;
+    // Bytes to set for a SET, the last of which is a terminating null byte
+    const std::optional<std::string_view> value;
 
-    static Request get(std::string key);
-    static Request set(std::string key, std::string value);
-    static Request del(std::string key);
+    static Request get(std::string_view key);
+    static Request set(std::string_view key, std::string_view value);
+    static Request del(std::string_view key);
 
   private:
-    Request(Type type, std::string key,
-            std::optional<std::string> value = std::nullopt);
+    Request(Type type, std::string_view key,
+            std::optional<std::string_view> value = std::nullopt);
+};
+
+// Everything about a workload that can be worked out before generating any
+// requests: the distributions of the request types, keys and value sizes,
+// every key rendered as a string and a buffer that every value is a view
+// into. A Workload never changes, so generators on several threads can share
+// one.
+class Workload {
+  public:
+    using key_param_type = std::uniform_int_distribution<unsigned>::param_type;
+    using geometric_param_type =
+        std::geometric_distribution<unsigned>::param_type;
+
+  private:
+    // Every key, one after another, and the offset at which each starts (with
+    // the offset of the end of the last one after them)
+    std::string key_chars;
+    std::vector<std::uint32_t> key_offsets;
+    // `max_value_size() + 1` 'a's followed by a null byte
+    std::string values;
+    // Cumulative probability of each key index of a Zipf distribution
+    std::vector<double> zipf_cdf_;
+
+  public:
+    const WorkloadParams params;
+
+    // Distribution of request types
+    const key_param_type type_param;
+    // Distributions of key indices: `key_param` for any key, and `hot_param`
+    // and `cold_param` for the hot and cold keys of a hotspot distribution
+    const key_param_type key_param;
+    const key_param_type hot_param;
+    const key_param_type cold_param;
+    // Geometric distributions of key indices and value sizes
+    const geometric_param_type key_geometric_param;
+    const geometric_param_type value_geometric_param;
+
+    explicit Workload(const WorkloadParams &params);
+
+    Workload(const Workload &) = delete;
+    Workload &operator=(const Workload &) = delete;
+
+    // Number of keys rendered: `num_keys`, or enough more keys for a
+    // geometric distribution that only about one in ten million requests
+    // would be for a key past them (generators choose again if so)
+    unsigned num_keys() const;
+    // The key at `index` (less than `num_keys()`)
+    std::string_view key(unsigned index) const;
+
+    // Largest value size that a geometric draw is used for, chosen like
+    // `num_keys()` (generators choose again past it)
+    unsigned max_value_size() const;
+    // The value for a geometric draw of `size` (at most `max_value_size()`):
+    // `size + 1` 'a's and a terminating null byte
+    std::string_view value(unsigned size) const;
+
+    // Cumulative probability of each key index, for a Zipf distribution
+    // (empty for other distributions)
+    const std::vector<double> &zipf_cdf() const;
 };
 
 template <typename Rand> class RequestGenerator {
   private:
     Rand random;
+    std::uniform_int_distribution<unsigned> uniform;
+    std::geometric_distribution<unsigned> geometric;
+    std::uniform_real_distribution<double> unit;
 
-    Request::Type generate_type(const WorkloadParams &params);
-    std::string generate_key(const WorkloadParams &params);
-    std::string generate_value(const WorkloadParams &params);
+    Request::Type generate_type(const Workload &workload);
+    std::string_view generate_key(const Workload &workload);
+    std::string_view generate_value(const Workload &workload);
 
   public:
     RequestGenerator();
-    Request operator()(const WorkloadParams &params);
+    // Create a generator that always produces the same requests
+    explicit RequestGenerator(typename Rand::result_type seed);
+    Request operator()(const Workload &workload);
 };
 
 template <typename Rand>
-Request::Type
-RequestGenerator<Rand>::generate_type(const WorkloadParams &params) {
-    const unsigned total = params.prob_get + params.prob_set + params.prob_del;
-    auto dist = std::uniform_int_distribution<unsigned>{0, total - 1};
-
-    const unsigned value = dist(random);
+Request::Type RequestGenerator<Rand>::generate_type(const Workload &workload) {
+    const auto &params = workload.params;
+    const unsigned value = uniform(random, workload.type_param);
     if (value < params.prob_get) {
         return Request::Type::GET;
     } else if (value < params.prob_get + params.prob_set) {
@@ -62,17 +153,43 @@ RequestGenerator<Rand>::generate_type(const WorkloadParams &params) {
 }
 
 template <typename Rand>
-std::string RequestGenerator<Rand>::generate_key(const WorkloadParams &params) {
-    auto dist =
-        std::geometric_distribution<unsigned>(1.0 / (params.num_keys - 1));
-    return std::to_string(dist(random));
+std::string_view
+RequestGenerator<Rand>::generate_key(const Workload &workload) {
+    unsigned index = 0;
+    switch (workload.params.key_dist) {
+    case KeyDistribution::GEOMETRIC:
+        do {
+            index = geometric(random, workload.key_geometric_param);
+        } while (index >= workload.num_keys());
+        break;
+    case KeyDistribution::UNIFORM:
+        index = uniform(random, workload.key_param);
+        break;
+    case KeyDistribution::ZIPF: {
+        const auto &cdf = workload.zipf_cdf();
+        const auto rank =
+            std::upper_bound(cdf.begin(), cdf.end(), unit(random)) -
+            cdf.begin();
+        index = std::min(static_cast<unsigned>(rank), workload.num_keys() - 1);
+        break;
+    }
+    case KeyDistribution::HOTSPOT:
+        index = unit(random) < workload.params.hot_request_fraction
+                    ? uniform(random, workload.hot_param)
+                    : uniform(random, workload.cold_param);
+        break;
+    }
+    return workload.key(index);
 }
 
 template <typename Rand>
-std::string
-RequestGenerator<Rand>::generate_value(const WorkloadParams &params) {
-    auto dist = std::geometric_distribution<unsigned>(params.val_size_dist);
-    return std::string(dist(random) + 1, 'a');
+std::string_view
+RequestGenerator<Rand>::generate_value(const Workload &workload) {
+    unsigned size;
+    do {
+        size = geometric(random, workload.value_geometric_param);
+    } while (size > workload.max_value_size());
+    return workload.value(size);
 }
 
 template <typename Rand>
@@ -80,14 +197,20 @@ RequestGenerator<Rand>::RequestGenerator()
 : random{Rand{std::random_device{}()}} {}
 
 template <typename Rand>
-Request RequestGenerator<Rand>::operator()(const WorkloadParams &params) {
-    switch (generate_type(params)) {
+RequestGenerator<Rand>::RequestGenerator(typename Rand::result_type seed)
+: random{Rand{seed}} {}
+
+template <typename Rand>
+Request RequestGenerator<Rand>::operator()(const Workload &workload) {
+    switch (generate_type(workload)) {
     case Request::Type::GET:
-        return Request::get(generate_key(params));
-    case Request::Type::SET:
-        return Request::set(generate_key(params), generate_value(params));
+        return Request::get(generate_key(workload));
+    case Request::Type::SET: {
+        const auto key = generate_key(workload);
+        return Request::set(key, generate_value(workload));
+    }
     case Request::Type::DEL:
-        return Request::del(generate_key(params));
+        return Request::del(generate_key(workload));
     }
     __builtin_unreachable();
 }
@@ -0,0 +1,235 @@
+/*
+ * Parsers for the targets of HTTP requests and the bodies of GET responses.
+ * Keys and values may only contain the characters [A-Za-z0-9._-]. These
+ * parsers accept exactly what the regular expressions they replace did, but
+ * only return views into their input, so they never allocate (except for
+ * the batch parsers, which append views to a vector the caller can reuse).
+ *
+ * Batch requests list several keys (or "key/value" pairs) in the target,
+ * separated by commas, and a batch GET response body is a JSON array of
+ * {"key":"...","value":"..."} objects.
+ */
+
+#ifndef REQUEST_PARSER_HH
+#define REQUEST_PARSER_HH
+
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using key_value_view = std::pair<std::string_view, std::string_view>;
+
+// Whether a character may appear in a key or value
+inline bool is_key_char(char c) {
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+           (c >= '0' && c <= '9') || c == '.' || c == '_' || c == '-';
+}
+
+// Whether a character is whitespace (as matched by `\s` in a regex)
+inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' ||
+           c == '\v';
+}
+
+// Length of the run of key characters at the start of `text`
+inline std::size_t key_span(std::string_view text) {
+    std::size_t length = 0;
+    while (length < text.size() && is_key_char(text[length])) {
+        ++length;
+    }
+    return length;
+}
+
+// Parse a target of the form "/key"
+inline std::optional<std::string_view>
+parse_key_target(std::string_view target) {
+    if (target.size() < 2 || target[0] != '/') {
+        return std::nullopt;
+    }
+    target.remove_prefix(1);
+    if (key_span(target) != target.size()) {
+        return std::nullopt;
+    }
+    return target;
+}
+
+// Parse a target of the form "/key/value"
+inline std::optional<key_value_view>
+parse_key_value_target(std::string_view target) {
+    if (target.empty() || target[0] != '/') {
+        return std::nullopt;
+    }
+    target.remove_prefix(1);
+    const auto key_length = key_span(target);
+    if (key_length == 0 || key_length + 1 >= target.size() ||
+        target[key_length] != '/') {
+        return std::nullopt;
+    }
+    const auto value = target.substr(key_length + 1);
+    if (key_span(value) != value.size()) {
+        return std::nullopt;
+    }
+    return key_value_view{target.substr(0, key_length), value};
+}
+
+// Parse a target of the form "/key,key,..." (with at least one key),
+// appending the keys to `keys`; returns false if the target did not match
+inline bool parse_key_list_target(std::string_view target,
+                                  std::vector<std::string_view> &keys) {
+    if (target.empty() || target[0] != '/') {
+        return false;
+    }
+    target.remove_prefix(1);
+    for (;;) {
+        const auto length = key_span(target);
+        if (length == 0) {
+            return false;
+        }
+        keys.push_back(target.substr(0, length));
+        if (length == target.size()) {
+            return true;
+        }
+        if (target[length] != ',') {
+            return false;
+        }
+        target.remove_prefix(length + 1);
+    }
+}
+
+// Parse a target of the form "/key/value,key/value,..." (with at least one
+// pair), appending the pairs to `pairs`; returns false if the target did not
+// match
+inline bool parse_key_value_list_target(std::string_view target,
+                                        std::vector<key_value_view> &pairs) {
+    if (target.empty() || target[0] != '/') {
+        return false;
+    }
+    target.remove_prefix(1);
+    for (;;) {
+        const auto key_length = key_span(target);
+        if (key_length == 0 || key_length == target.size() ||
+            target[key_length] != '/') {
+            return false;
+        }
+        const auto key = target.substr(0, key_length);
+        target.remove_prefix(key_length + 1);
+        const auto value_length = key_span(target);
+        if (value_length == 0) {
+            return false;
+        }
+        pairs.emplace_back(key, target.substr(0, value_length));
+        if (value_length == target.size()) {
+            return true;
+        }
+        if (target[value_length] != ',') {
+            return false;
+        }
+        target.remove_prefix(value_length + 1);
+    }
+}
+
+// Parse a GET response body of the form {"key":"...","value":"..."} at the
+// start of `body`, allowing whitespace between the tokens
+inline std::optional<key_value_view>
+parse_key_value_json_at(std::string_view body) {
+    const auto skip_space = [&] {
+        while (!body.empty() && is_space(body[0])) {
+            body.remove_prefix(1);
+        }
+    };
+    // Consume `token` (after any whitespace) if it comes next
+    const auto expect = [&](std::string_view token) {
+        skip_space();
+        if (body.substr(0, token.size()) != token) {
+            return false;
+        }
+        body.remove_prefix(token.size());
+        return true;
+    };
+    // Consume a quoted string of key characters
+    const auto string = [&]() -> std::optional<std::string_view> {
+        if (!expect("\"")) {
+            return std::nullopt;
+        }
+        const auto length = key_span(body);
+        if (length == 0 || length == body.size() || body[length] != '"') {
+            return std::nullopt;
+        }
+        const auto result = body.substr(0, length);
+        body.remove_prefix(length + 1);
+        return result;
+    };
+
+    if (!expect("{") || !expect("\"key\"") || !expect(":")) {
+        return std::nullopt;
+    }
+    const auto key = string();
+    if (!key || !expect(",") || !expect("\"value\"") || !expect(":")) {
+        return std::nullopt;
+    }
+    const auto value = string();
+    // The closing brace must come right after the value
+    if (!value || body.empty() || body[0] != '}') {
+        return std::nullopt;
+    }
+    return key_value_view{*key, *value};
+}
+
+// Parse a GET response body containing {"key":"...","value":"..."} (anywhere
+// in the body, like `std::regex_search`)
+inline std::optional<key_value_view>
+parse_key_value_json(std::string_view body) {
+    for (auto start = body.find('{'); start != std::string_view::npos;
+         start = body.find('{', start + 1)) {
+        if (const auto result = parse_key_value_json_at(body.substr(start))) {
+            return result;
+        }
+    }
+    return std::nullopt;
+}
+
+// Parse a batch GET response body of the form
+// [{"key":"...","value":"..."},...] (possibly empty), allowing whitespace
+// between the tokens, and append the pairs to `pairs`; returns false if the
+// body did not match
+inline bool parse_key_value_json_array(std::string_view body,
+                                       std::vector<key_value_view> &pairs) {
+    const auto skip_space = [&] {
+        while (!body.empty() && is_space(body[0])) {
+            body.remove_prefix(1);
+        }
+    };
+    skip_space();
+    if (body.empty() || body[0] != '[') {
+        return false;
+    }
+    body.remove_prefix(1);
+    skip_space();
+    if (!body.empty() && body[0] == ']') {
+        return true;
+    }
+    for (;;) {
+        const auto pair = parse_key_value_json_at(body);
+        if (!pair) {
+            return false;
+        }
+        pairs.push_back(*pair);
+        // Skip to just past the closing brace (which follows the value)
+        body.remove_prefix(pair->second.data() + pair->second.size() + 2 -
+                           body.data());
+        skip_space();
+        if (body.empty()) {
+            return false;
+        }
+        if (body[0] == ']') {
+            return true;
+        }
+        if (body[0] != ',') {
+            return false;
+        }
+        body.remove_prefix(1);
+    }
+}
+
+#endif // REQUEST_PARSER_HH
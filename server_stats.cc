@@ -0,0 +1,150 @@
+#include "server_stats.hh"
+
+#include <atomic>
+
+namespace {
+
+/// Names of the types of request in JSON, in the order of `ServerStats::Op`
+constexpr std::array<const char *, ServerStats::NUM_OPS> OP_NAMES = {
+    "get", "set", "del", "mget", "mset", "mdel"};
+
+/// Source of `ServerStats::id`s (0 is never used, so that a thread that has
+/// not recorded anything yet never matches)
+std::atomic<uint64_t> next_id{1};
+
+/// Append `"name":value` to a JSON object, preceded by a comma unless it is
+/// the first member
+void append_member(std::string &out, const char *name, uint64_t value) {
+    if (out.back() != '{') {
+        out.push_back(',');
+    }
+    out.append("\"").append(name).append("\":").append(std::to_string(value));
+}
+
+} // namespace
+
+ServerStats::Totals &ServerStats::Totals::operator+=(const Totals &other) {
+    for (std::size_t i = 0; i < NUM_OPS; ++i) {
+        service_ns[i].merge(other.service_ns[i]);
+    }
+    get_hits += other.get_hits;
+    get_misses += other.get_misses;
+    bytes_in += other.bytes_in;
+    bytes_out += other.bytes_out;
+    connections_opened += other.connections_opened;
+    connections_closed += other.connections_closed;
+    return *this;
+}
+
+ServerStats::ServerStats() : id{next_id.fetch_add(1)} {}
+
+ServerStats::ThreadStats &ServerStats::local() {
+    // The statistics the calling thread used last (almost always the only
+    // ones it uses), so that the map is only searched when that changes
+    thread_local uint64_t cached_id = 0;
+    thread_local ThreadStats *cached = nullptr;
+    if (cached_id != id) {
+        const std::lock_guard lock{threads_mutex};
+        auto &stats = threads[std::this_thread::get_id()];
+        if (stats == nullptr) {
+            stats = std::make_unique<ThreadStats>();
+        }
+        cached = stats.get();
+        cached_id = id;
+    }
+    return *cached;
+}
+
+void ServerStats::record_request(Op op, clock::duration service_time,
+                                 unsigned hits, unsigned misses) {
+    auto &stats = local();
+    const std::lock_guard lock{stats.mutex};
+    stats.totals.service_ns[static_cast<std::size_t>(op)].record(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(service_time)
+            .count());
+    stats.totals.get_hits += hits;
+    stats.totals.get_misses += misses;
+}
+
+void ServerStats::record_bytes(std::size_t in, std::size_t out) {
+    auto &stats = local();
+    const std::lock_guard lock{stats.mutex};
+    stats.totals.bytes_in += in;
+    stats.totals.bytes_out += out;
+}
+
+void ServerStats::connection_opened() {
+    auto &stats = local();
+    const std::lock_guard lock{stats.mutex};
+    ++stats.totals.connections_opened;
+}
+
+void ServerStats::connection_closed() {
+    auto &stats = local();
+    const std::lock_guard lock{stats.mutex};
+    ++stats.totals.connections_closed;
+}
+
+ServerStats::Totals ServerStats::totals() const {
+    Totals totals;
+    const std::lock_guard lock{threads_mutex};
+    for (const auto &[thread, stats] : threads) {
+        const std::lock_guard stats_lock{stats->mutex};
+        totals += stats->totals;
+    }
+    return totals;
+}
+
+std::string ServerStats::to_json(
+    const std::vector<SharedCache::ShardStats> &shards) const {
+    const auto totals = this->totals();
+    std::string out = "{";
+
+    out.append("\"connections\":{");
+    append_member(out, "active",
+                  totals.connections_opened - totals.connections_closed);
+    append_member(out, "opened", totals.connections_opened);
+    out.append("},\"bytes\":{");
+    append_member(out, "in", totals.bytes_in);
+    append_member(out, "out", totals.bytes_out);
+    out.append("}");
+    append_member(out, "get_hits", totals.get_hits);
+    append_member(out, "get_misses", totals.get_misses);
+    uint64_t evictions = 0;
+    for (const auto &shard : shards) {
+        evictions += shard.evictions;
+    }
+    append_member(out, "evictions", evictions);
+
+    out.append(",\"ops\":{");
+    for (std::size_t i = 0; i < NUM_OPS; ++i) {
+        const auto &histogram = totals.service_ns[i];
+        if (i != 0) {
+            out.push_back(',');
+        }
+        out.append("\"").append(OP_NAMES[i]).append("\":{");
+        append_member(out, "count", histogram.count());
+        append_member(out, "mean_ns",
+                      static_cast<uint64_t>(histogram.mean()));
+        append_member(out, "p50_ns", histogram.percentile(0.5));
+        append_member(out, "p90_ns", histogram.percentile(0.9));
+        append_member(out, "p99_ns", histogram.percentile(0.99));
+        append_member(out, "p999_ns", histogram.percentile(0.999));
+        append_member(out, "max_ns", histogram.max());
+        out.push_back('}');
+    }
+
+    out.append("},\"shards\":[");
+    for (std::size_t i = 0; i < shards.size(); ++i) {
+        if (i != 0) {
+            out.push_back(',');
+        }
+        out.push_back('{');
+        append_member(out, "evictions", shards[i].evictions);
+        append_member(out, "lock_waits", shards[i].lock_waits);
+        append_member(out, "lock_wait_ns", shards[i].lock_wait_ns);
+        out.push_back('}');
+    }
+    out.append("]}");
+    return out;
+}
@@ -0,0 +1,127 @@
+/*
+ * Statistics kept by cache_server: how many requests of each type it has
+ * handled and how long they took to serve, how many keys GETs found, how many
+ * bytes it has received and sent, and how many connections are open. Every
+ * thread records into statistics of its own, guarded by a mutex that only a
+ * reader of the statistics ever contends for, and reading them adds up every
+ * thread's, so recording never makes requests on different threads wait for
+ * each other.
+ */
+
+#ifndef SERVER_STATS_HH
+#define SERVER_STATS_HH
+
+#include "latency_histogram.hh"
+#include "shared_cache.hh"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class ServerStats {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    /// Types of request whose service times are recorded
+    enum class Op { GET, SET, DEL, MGET, MSET, MDEL };
+    static constexpr std::size_t NUM_OPS = 6;
+
+    /// Statistics of one thread, or the totals over every thread
+    struct Totals {
+        /// Time taken to serve each type of request, in nanoseconds (from
+        /// when it was parsed until its response was ready to be sent)
+        std::array<LatencyHistogram, NUM_OPS> service_ns;
+        /// Number of keys read by GETs (including batches) that were found,
+        /// and that were not
+        uint64_t get_hits = 0;
+        uint64_t get_misses = 0;
+        /// Number of bytes received and sent on every connection
+        uint64_t bytes_in = 0;
+        uint64_t bytes_out = 0;
+        /// Number of connections accepted and closed
+        uint64_t connections_opened = 0;
+        uint64_t connections_closed = 0;
+
+        Totals &operator+=(const Totals &other);
+    };
+
+    /// Measures the service time of a request from when it is created to
+    /// when it is destroyed, and records it then
+    class RequestTimer {
+      private:
+        ServerStats &stats;
+        const Op op;
+        const clock::time_point start = clock::now();
+        unsigned hits = 0;
+        unsigned misses = 0;
+
+      public:
+        RequestTimer(ServerStats &stats, Op op) : stats{stats}, op{op} {}
+
+        RequestTimer(const RequestTimer &) = delete;
+        RequestTimer &operator=(const RequestTimer &) = delete;
+
+        ~RequestTimer() {
+            stats.record_request(op, clock::now() - start, hits, misses);
+        }
+
+        /// Count keys that the request found, or did not find
+        void found(unsigned count = 1) {
+            hits += count;
+        }
+        void not_found(unsigned count = 1) {
+            misses += count;
+        }
+    };
+
+  private:
+    struct ThreadStats {
+        std::mutex mutex;
+        Totals totals;
+    };
+
+    /// Distinguishes this instance from every other one, for the threads'
+    /// cached pointers to their statistics
+    const uint64_t id;
+    mutable std::mutex threads_mutex;
+    std::unordered_map<std::thread::id, std::unique_ptr<ThreadStats>> threads;
+
+    /// Get the calling thread's statistics
+    ThreadStats &local();
+
+  public:
+    ServerStats();
+
+    ServerStats(const ServerStats &) = delete;
+    ServerStats &operator=(const ServerStats &) = delete;
+
+    /// Record that a request was served in `service_time`, finding `hits` of
+    /// the keys it read and not finding `misses` of them
+    void record_request(Op op, clock::duration service_time, unsigned hits = 0,
+                        unsigned misses = 0);
+
+    /// Record bytes received and sent on a connection
+    void record_bytes(std::size_t in, std::size_t out);
+
+    /// Record that a connection was accepted, or closed
+    void connection_opened();
+    void connection_closed();
+
+    /// Add up every thread's statistics (each thread's are read in turn, so
+    /// the result is not an atomic snapshot)
+    Totals totals() const;
+
+    /// Format the totals along with the cache's shard statistics as a JSON
+    /// object
+    std::string
+    to_json(const std::vector<SharedCache::ShardStats> &shards) const;
+};
+
+#endif // SERVER_STATS_HH
@@ -0,0 +1,424 @@
+#include "shared_cache.hh"
+#include "snapshot.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+
+namespace {
+
+/// Get pointers to each key, for `SharedCache::for_each_shard`
+std::vector<const key_type *> pointers_to(const std::vector<key_type> &keys) {
+    std::vector<const key_type *> pointers;
+    pointers.reserve(keys.size());
+    for (const auto &key : keys) {
+        pointers.push_back(&key);
+    }
+    return pointers;
+}
+
+} // namespace
+
+SharedCache::SharedCache(Cache::size_type maxmem, unsigned num_shards,
+                         const evictor_factory &make_evictor,
+                         LockMode lock_mode, Cache::IndexType index,
+                         const admission_factory &make_admission)
+: num_shards{num_shards}, lock_mode{lock_mode}, shards{new Shard[num_shards]} {
+    if (num_shards == 0) {
+        throw std::invalid_argument{"number of shards must be at least 1"};
+    }
+    for (auto i = 0U; i < num_shards; ++i) {
+        // Split `maxmem` evenly, giving the remainder to the first shards
+        const Cache::size_type shard_maxmem =
+            maxmem / num_shards + (i < maxmem % num_shards ? 1 : 0);
+        auto &shard = shards[i];
+        if (make_evictor) {
+            shard.evictor = make_evictor();
+        }
+        if (make_admission) {
+            shard.admission = make_admission(shard_maxmem);
+        }
+        shard.cache = std::make_unique<Cache>(
+            shard_maxmem, 0.75f, shard.evictor.get(), std::hash<key_type>(),
+            index, shard.admission.get());
+        shard.touches.reserve(TOUCH_BUFFER_SIZE);
+        shard.draining.reserve(TOUCH_BUFFER_SIZE);
+    }
+}
+
+unsigned SharedCache::shard_index(std::string_view key) const {
+    // The shards' hash tables use the low bits of the same hash (which is the
+    // same for a string and a view of it), so mix it and use the high bits to
+    // pick the shard
+    const uint64_t hash = std::hash<std::string_view>{}(key);
+    const auto mixed = (hash * 0x9e3779b97f4a7c15ULL) >> 32;
+    return mixed % num_shards;
+}
+
+SharedCache::Shard &SharedCache::shard_for(const key_type &key) const {
+    return shards[shard_index(key)];
+}
+
+void SharedCache::for_each_shard(
+    const std::vector<const key_type *> &keys,
+    const std::function<void(Shard &, const std::vector<std::size_t> &)> &fn)
+    const {
+    if (num_shards == 1) {
+        std::vector<std::size_t> indices(keys.size());
+        std::iota(indices.begin(), indices.end(), 0);
+        return fn(shards[0], indices);
+    }
+    // Bucket the indices by shard (each bucket stays in order)
+    std::vector<std::vector<std::size_t>> buckets(num_shards);
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        buckets[shard_index(*keys[i])].push_back(i);
+    }
+    for (auto i = 0U; i < num_shards; ++i) {
+        if (!buckets[i].empty()) {
+            fn(shards[i], buckets[i]);
+        }
+    }
+}
+
+void SharedCache::record_touch(Shard &shard, const key_type &key) const {
+    bool full;
+    {
+        // Drop the touch rather than wait if another reader is recording one
+        std::unique_lock lock{shard.touch_mutex, std::try_to_lock};
+        if (!lock) {
+            return;
+        }
+        if (shard.touches.size() < TOUCH_BUFFER_SIZE) {
+            shard.touches.push_back(key);
+        }
+        full = shard.touches.size() == TOUCH_BUFFER_SIZE;
+    }
+    // If the buffer is full, drain it now if nobody else holds the shard
+    // (otherwise the next writer will)
+    if (full && shard.mutex.try_lock()) {
+        std::unique_lock lock{shard.mutex, std::adopt_lock};
+        drain_touches(shard);
+    }
+}
+
+void SharedCache::drain_touches(Shard &shard) const {
+    if (shard.evictor == nullptr && shard.admission == nullptr) {
+        return;
+    }
+    // Take the buffered touches, leaving the (empty) spare buffer in their
+    // place so readers can keep recording
+    {
+        std::lock_guard lock{shard.touch_mutex};
+        if (shard.touches.empty()) {
+            return;
+        }
+        shard.touches.swap(shard.draining);
+    }
+    for (const auto &key : shard.draining) {
+        shard.cache->touch(key);
+    }
+    shard.draining.clear();
+}
+
+template <typename Lock> Lock SharedCache::lock_timed(Shard &shard) {
+    Lock lock{shard.mutex, std::try_to_lock};
+    if (!lock) {
+        const auto start = std::chrono::steady_clock::now();
+        lock.lock();
+        const auto waited = std::chrono::steady_clock::now() - start;
+        shard.lock_waits.fetch_add(1, std::memory_order_relaxed);
+        shard.lock_wait_ns.fetch_add(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(waited)
+                .count(),
+            std::memory_order_relaxed);
+    }
+    return lock;
+}
+
+std::unique_lock<std::shared_mutex>
+SharedCache::lock_exclusive(Shard &shard) const {
+    auto lock = lock_timed<std::unique_lock<std::shared_mutex>>(shard);
+    if (lock_mode == LockMode::SHARED) {
+        drain_touches(shard);
+    }
+    return lock;
+}
+
+std::shared_lock<std::shared_mutex> SharedCache::lock_shared(Shard &shard) {
+    return lock_timed<std::shared_lock<std::shared_mutex>>(shard);
+}
+
+void SharedCache::set(const key_type &key, std::string_view val,
+                      Cache::ttl_type ttl) {
+    auto &shard = shard_for(key);
+    const auto lock = lock_exclusive(shard);
+    shard.cache->set(key, val.data(), val.size(), ttl);
+}
+
+template <typename F>
+bool SharedCache::read(const key_type &key, F &&on_value) {
+    auto &shard = shard_for(key);
+    Cache::size_type size;
+    if (lock_mode == LockMode::EXCLUSIVE) {
+        const auto lock = lock_exclusive(shard);
+        Cache::val_type value = shard.cache->get(key, size);
+        if (value == nullptr) {
+            return false;
+        }
+        on_value(*shard.cache, value, size);
+        return true;
+    }
+    // Evictors whose touches are thread-safe can be touched directly under
+    // the shared lock (admission policies cannot)
+    const auto buffer_touches =
+        shard.admission != nullptr ||
+        (shard.evictor != nullptr && !shard.evictor->concurrent_touch());
+    // Otherwise read the value under a shared lock without touching the
+    // evictor, and buffer the touch
+    bool found;
+    {
+        const auto lock = lock_shared(shard);
+        Cache::val_type value = buffer_touches ? shard.cache->peek(key, size)
+                                               : shard.cache->get(key, size);
+        found = value != nullptr;
+        if (found) {
+            on_value(*shard.cache, value, size);
+        } else if (shard.admission == nullptr) {
+            return false;
+        }
+    }
+    if (buffer_touches) {
+        record_touch(shard, key);
+    }
+    return found;
+}
+
+std::string SharedCache::get(const key_type &key) {
+    std::string result;
+    read(key, [&](const Cache &, Cache::val_type value, Cache::size_type size) {
+        result.assign(value, size);
+    });
+    return result;
+}
+
+SharedCache::PinnedValue SharedCache::get_pinned(const key_type &key) {
+    PinnedValue result;
+    read(key, [&](const Cache &cache, Cache::val_type value,
+                  Cache::size_type size) {
+        cache.pin(value);
+        result = PinnedValue{cache, value, size};
+    });
+    return result;
+}
+
+bool SharedCache::del(const key_type &key) {
+    auto &shard = shard_for(key);
+    const auto lock = lock_exclusive(shard);
+    return shard.cache->del(key);
+}
+
+void SharedCache::mset(
+    const std::vector<std::pair<key_type, std::string>> &entries,
+    Cache::ttl_type ttl) {
+    std::vector<const key_type *> keys;
+    keys.reserve(entries.size());
+    for (const auto &entry : entries) {
+        keys.push_back(&entry.first);
+    }
+    for_each_shard(keys, [&](Shard &shard,
+                             const std::vector<std::size_t> &indices) {
+        const auto lock = lock_exclusive(shard);
+        for (const auto i : indices) {
+            const auto &[key, val] = entries[i];
+            shard.cache->set(key, val.data(), val.size(), ttl);
+        }
+    });
+}
+
+std::vector<std::optional<std::string>>
+SharedCache::mget(const std::vector<key_type> &keys) {
+    std::vector<std::optional<std::string>> results(keys.size());
+    const auto key_ptrs = pointers_to(keys);
+    for_each_shard(key_ptrs, [&](Shard &shard,
+                                 const std::vector<std::size_t> &indices) {
+        Cache::size_type size;
+        if (lock_mode == LockMode::EXCLUSIVE) {
+            const auto lock = lock_exclusive(shard);
+            for (const auto i : indices) {
+                Cache::val_type value = shard.cache->get(keys[i], size);
+                if (value != nullptr) {
+                    results[i].emplace(value, size);
+                }
+            }
+            return;
+        }
+        // As in `get`, read under a shared lock and buffer the touches
+        const auto buffer_touches =
+            shard.admission != nullptr ||
+            (shard.evictor != nullptr && !shard.evictor->concurrent_touch());
+        {
+            const auto lock = lock_shared(shard);
+            for (const auto i : indices) {
+                Cache::val_type value =
+                    buffer_touches ? shard.cache->peek(keys[i], size)
+                                   : shard.cache->get(keys[i], size);
+                if (value != nullptr) {
+                    results[i].emplace(value, size);
+                }
+            }
+        }
+        if (buffer_touches) {
+            for (const auto i : indices) {
+                // Misses only matter to the admission policy
+                if (results[i] || shard.admission != nullptr) {
+                    record_touch(shard, keys[i]);
+                }
+            }
+        }
+    });
+    return results;
+}
+
+unsigned SharedCache::mdel(const std::vector<key_type> &keys) {
+    unsigned deleted = 0;
+    const auto key_ptrs = pointers_to(keys);
+    for_each_shard(key_ptrs, [&](Shard &shard,
+                                 const std::vector<std::size_t> &indices) {
+        const auto lock = lock_exclusive(shard);
+        for (const auto i : indices) {
+            deleted += shard.cache->del(keys[i]);
+        }
+    });
+    return deleted;
+}
+
+Cache::size_type SharedCache::space_used() {
+    Cache::size_type total = 0;
+    for (auto i = 0U; i < num_shards; ++i) {
+        const auto lock = lock_shared(shards[i]);
+        total += shards[i].cache->space_used();
+    }
+    return total;
+}
+
+unsigned SharedCache::expire() {
+    unsigned expired = 0;
+    for (auto i = 0U; i < num_shards; ++i) {
+        const auto lock = lock_exclusive(shards[i]);
+        expired += shards[i].cache->expire();
+    }
+    return expired;
+}
+
+void SharedCache::reset() {
+    for (auto i = 0U; i < num_shards; ++i) {
+        const auto lock = lock_exclusive(shards[i]);
+        shards[i].cache->reset();
+    }
+}
+
+std::vector<SharedCache::ShardStats> SharedCache::shard_stats() {
+    std::vector<ShardStats> stats(num_shards);
+    for (auto i = 0U; i < num_shards; ++i) {
+        auto &shard = shards[i];
+        stats[i].lock_waits = shard.lock_waits.load(std::memory_order_relaxed);
+        stats[i].lock_wait_ns =
+            shard.lock_wait_ns.load(std::memory_order_relaxed);
+        // Not counted as a wait, so that reading the statistics does not
+        // change them
+        const std::shared_lock lock{shard.mutex};
+        stats[i].evictions = shard.cache->evictions();
+    }
+    return stats;
+}
+
+std::size_t SharedCache::save(const std::string &path) {
+    snapshot::Writer writer{path};
+    struct SavedKey {
+        key_type key;
+        Cache::ttl_type ttl;
+    };
+    std::vector<SavedKey> keys;
+    // Values of the current batch (empty for keys that are gone), and the
+    // value larger than `SAVE_COPY_MAX` that ends it, if any
+    std::vector<std::optional<std::string>> copies;
+    PinnedValue pinned;
+    for (auto i = 0U; i < num_shards; ++i) {
+        auto &shard = shards[i];
+        {
+            const auto lock = lock_shared(shard);
+            shard.cache->for_each([&](std::string_view key, Cache::val_type,
+                                      Cache::size_type, Cache::ttl_type ttl) {
+                keys.push_back({key_type{key}, ttl});
+            });
+        }
+        const auto collected = std::chrono::steady_clock::now();
+        for (std::size_t first = 0; first < keys.size();) {
+            // Copy a batch of values, so that the shard is not locked while
+            // they are written and its entries can still be evicted
+            {
+                const auto lock = lock_shared(shard);
+                std::size_t batch_bytes = 0;
+                for (auto j = first;
+                     j < keys.size() && batch_bytes < SAVE_BATCH_BYTES &&
+                     !pinned;
+                     ++j) {
+                    Cache::size_type size;
+                    const auto val = shard.cache->peek(keys[j].key, size);
+                    auto &copy = copies.emplace_back();
+                    if (val == nullptr) {
+                        continue;
+                    }
+                    if (size > SAVE_COPY_MAX) {
+                        shard.cache->pin(val);
+                        pinned = PinnedValue{*shard.cache, val, size};
+                    } else {
+                        copy.emplace(val, size);
+                    }
+                    batch_bytes += size;
+                }
+            }
+            // Write the batch without holding the shard's lock
+            const auto elapsed = std::chrono::duration_cast<Cache::ttl_type>(
+                std::chrono::steady_clock::now() - collected);
+            for (std::size_t j = 0; j < copies.size(); ++j) {
+                const auto &key = keys[first + j];
+                const auto is_pinned = pinned && j + 1 == copies.size();
+                // Skip entries deleted or expired since they were collected
+                if (!copies[j] && !is_pinned) {
+                    continue;
+                }
+                auto ttl = key.ttl;
+                if (ttl > Cache::ttl_type::zero()) {
+                    ttl -= elapsed;
+                    if (ttl <= Cache::ttl_type::zero()) {
+                        continue;
+                    }
+                }
+                writer.add(key.key, is_pinned ? pinned.view() : *copies[j],
+                           ttl);
+            }
+            pinned = PinnedValue{};
+            first += copies.size();
+            copies.clear();
+        }
+        keys.clear();
+    }
+    writer.commit();
+    return writer.size();
+}
+
+std::size_t SharedCache::load(const std::string &path) {
+    snapshot::Reader reader{path};
+    std::size_t num_read = 0;
+    snapshot::Entry entry;
+    key_type key;
+    while (reader.next(entry)) {
+        key.assign(entry.key);
+        set(key, entry.value, entry.ttl);
+        ++num_read;
+    }
+    return num_read;
+}
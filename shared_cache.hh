@@ -0,0 +1,265 @@
+#ifndef SHARED_CACHE_HH
+#define SHARED_CACHE_HH
+
+#include "admission.hh"
+#include "cache.hh"
+#include "evictor.hh"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/// Thread-safe cache made up of `num_shards` independent `Cache`s, each with
+/// its own lock and its own evictor. Keys are assigned to shards by hash, so
+/// requests for different keys usually do not contend with each other.
+class SharedCache {
+  public:
+    /// Function used to create a new evictor for each shard (may return
+    /// nullptr if the shards should not evict)
+    using evictor_factory = std::function<std::unique_ptr<Evictor>()>;
+
+    /// Function used to create a new admission policy for each shard, given
+    /// the shard's memory limit (may return nullptr to admit every key)
+    using admission_factory =
+        std::function<std::unique_ptr<Admission>(Cache::size_type maxmem)>;
+
+    /// A value pinned in the cache (see `Cache::pin`), or no value; the value
+    /// is unpinned when this is destroyed, which must happen before the cache
+    /// is destroyed (but may happen on any thread, without locking)
+    class PinnedValue {
+      private:
+        const Cache *cache = nullptr;
+        Cache::val_type value = nullptr;
+        Cache::size_type size = 0;
+
+        void release() {
+            if (value != nullptr) {
+                cache->unpin(value);
+            }
+        }
+
+      public:
+        PinnedValue() = default;
+
+        /// Take ownership of a pin on `value` (of `size` bytes)
+        PinnedValue(const Cache &cache, Cache::val_type value,
+                    Cache::size_type size)
+        : cache{&cache}, value{value}, size{size} {}
+
+        PinnedValue(PinnedValue &&other) noexcept
+        : cache{other.cache}, value{std::exchange(other.value, nullptr)},
+          size{other.size} {}
+
+        PinnedValue &operator=(PinnedValue &&other) noexcept {
+            if (this != &other) {
+                release();
+                cache = other.cache;
+                value = std::exchange(other.value, nullptr);
+                size = other.size;
+            }
+            return *this;
+        }
+
+        ~PinnedValue() {
+            release();
+        }
+
+        /// Whether there is a value
+        explicit operator bool() const {
+            return value != nullptr;
+        }
+
+        /// View of the value
+        std::string_view view() const {
+            return value != nullptr ? std::string_view{value, size}
+                                    : std::string_view{};
+        }
+    };
+
+    /// How GET requests lock a shard
+    enum class LockMode {
+        /// Every request locks the shard exclusively
+        EXCLUSIVE,
+        /// GET requests share the lock and record the keys they read in a
+        /// small buffer; the buffered touches are applied to the evictor by
+        /// the next request that holds the lock exclusively (evictors that
+        /// support concurrent touches are touched directly instead, unless
+        /// there is an admission policy, which needs every access recorded
+        /// under the exclusive lock; misses are buffered for it too)
+        SHARED,
+    };
+
+  private:
+    /// Maximum number of buffered touches per shard; touches are dropped
+    /// when the buffer is full, which only makes recency approximate
+    static constexpr auto TOUCH_BUFFER_SIZE = 64U;
+
+    /// Number of bytes of values `save` copies out of a shard each time it
+    /// locks it, and the size above which it pins a value instead (only one
+    /// at a time, since pinned entries cannot be evicted)
+    static constexpr auto SAVE_BATCH_BYTES = std::size_t{1} << 20; // 1MiB
+    static constexpr auto SAVE_COPY_MAX = Cache::size_type{64} << 10; // 64KiB
+
+    struct alignas(64) Shard {
+        std::shared_mutex mutex;
+        std::unique_ptr<Evictor> evictor;
+        std::unique_ptr<Admission> admission;
+        std::unique_ptr<Cache> cache;
+
+        // Keys read under a shared lock that have not been touched yet
+        std::mutex touch_mutex;
+        std::vector<key_type> touches;
+        // Spare buffer swapped with `touches` when draining (guarded by
+        // `mutex` held exclusively)
+        std::vector<key_type> draining;
+
+        // Number of times a request found `mutex` held and had to wait for
+        // it, and how long it waited in total (requests that get the lock
+        // right away never touch these)
+        std::atomic<uint64_t> lock_waits{0};
+        std::atomic<uint64_t> lock_wait_ns{0};
+    };
+
+    const unsigned num_shards;
+    const LockMode lock_mode;
+    std::unique_ptr<Shard[]> shards;
+
+    /// Get the shard responsible for a key
+    Shard &shard_for(const key_type &key) const;
+
+    /// Call `fn(shard, indices)` once for each shard responsible for any of
+    /// `keys`, with the indices of its keys in their original order
+    void for_each_shard(
+        const std::vector<const key_type *> &keys,
+        const std::function<void(Shard &, const std::vector<std::size_t> &)>
+            &fn) const;
+
+    /// Record that a key was read under a shared lock (never blocks; must be
+    /// called after the shared lock is released)
+    void record_touch(Shard &shard, const key_type &key) const;
+
+    /// Apply buffered touches to the evictor and admission policy
+    /// (`shard.mutex` must be held exclusively)
+    void drain_touches(Shard &shard) const;
+
+    /// Lock a shard with a lock of type `Lock` (exclusive or shared),
+    /// recording how long it waited if the shard was already locked
+    template <typename Lock> static Lock lock_timed(Shard &shard);
+
+    /// Lock a shard exclusively and apply any buffered touches
+    std::unique_lock<std::shared_mutex> lock_exclusive(Shard &shard) const;
+
+    /// Lock a shard for reading
+    static std::shared_lock<std::shared_mutex> lock_shared(Shard &shard);
+
+    /// Look up a key, locking and touching its shard as `get` does, and call
+    /// `on_value(cache, value, size)` while the shard is still locked if the
+    /// key is found; returns whether it was
+    template <typename F> bool read(const key_type &key, F &&on_value);
+
+  public:
+    /// Create a cache with `maxmem` bytes split evenly between `num_shards`
+    /// shards
+    SharedCache(Cache::size_type maxmem, unsigned num_shards = 1,
+                const evictor_factory &make_evictor = nullptr,
+                LockMode lock_mode = LockMode::EXCLUSIVE,
+                Cache::IndexType index = Cache::IndexType::CHAINED,
+                const admission_factory &make_admission = nullptr);
+
+    SharedCache(const SharedCache &) = delete;
+    SharedCache &operator=(const SharedCache &) = delete;
+
+    /// Wrapper over `Cache::set` that stores the bytes of `val` exactly (with
+    /// no terminating null byte)
+    void set(const key_type &key, std::string_view val,
+             Cache::ttl_type ttl = Cache::ttl_type::zero());
+
+    /// Wrapper over `Cache::get` that copies the returned value into a string
+    /// (returns "" if the value was not found, so empty values cannot be told
+    /// apart from missing ones)
+    std::string get(const key_type &key);
+
+    /// Like `get`, but pins the value in the cache instead of copying it
+    PinnedValue get_pinned(const key_type &key);
+
+    /// Wrapper over `Cache::del`
+    bool del(const key_type &key);
+
+    /// Batch version of `set`, locking each shard once (every entry gets the
+    /// same TTL)
+    void mset(const std::vector<std::pair<key_type, std::string>> &entries,
+              Cache::ttl_type ttl = Cache::ttl_type::zero());
+
+    /// Batch version of `get`, locking each shard once (values that were not
+    /// found are returned as std::nullopt, so empty values are returned as "")
+    std::vector<std::optional<std::string>>
+    mget(const std::vector<key_type> &keys);
+
+    /// Batch version of `del`, locking each shard once; returns the number of
+    /// keys that were deleted
+    unsigned mdel(const std::vector<key_type> &keys);
+
+    /// Sum of `Cache::space_used` over all shards (each shard is locked in
+    /// turn, so the result is not an atomic snapshot)
+    Cache::size_type space_used();
+
+    /// Remove expired entries from each shard in turn (see `Cache::expire`);
+    /// returns the number removed
+    unsigned expire();
+
+    /// Reset each shard in turn
+    void reset();
+
+    /// Save every entry to a snapshot file (see snapshot.hh), shard by shard,
+    /// each in the order its evictor would evict them, and return how many
+    /// were saved. A shard is only locked (shared) while the keys of its
+    /// entries are collected, and then while each batch of their values is
+    /// copied (up to `SAVE_BATCH_BYTES`, or a single value larger than
+    /// `SAVE_COPY_MAX`, which is pinned rather than copied); each batch is
+    /// written out after the lock is released. Entries changed while the
+    /// shard is being saved are saved with their new values (or not at all
+    /// if they were deleted), and touches still buffered in `SHARED` mode
+    /// are not reflected in the order. Throws `std::system_error` if the
+    /// file cannot be written.
+    std::size_t save(const std::string &path);
+
+    /// Set every entry in a snapshot file written by `save` (that has not
+    /// expired since), in the order they were saved, so that the evictors
+    /// end up in the same order; returns the number of entries read. Throws
+    /// `std::system_error` if the file cannot be read, and
+    /// `std::runtime_error` if it is not a valid snapshot.
+    std::size_t load(const std::string &path);
+
+    /// Statistics of a shard
+    struct ShardStats {
+        /// Number of entries evicted to make room for others
+        uint64_t evictions = 0;
+        /// Number of times a request had to wait for the shard's lock, and
+        /// the total time it waited
+        uint64_t lock_waits = 0;
+        uint64_t lock_wait_ns = 0;
+    };
+
+    /// Get the statistics of each shard (each shard is locked in turn, so
+    /// the result is not an atomic snapshot)
+    std::vector<ShardStats> shard_stats();
+
+    /// Number of shards
+    unsigned shard_count() const {
+        return num_shards;
+    }
+
+    /// Get the index of the shard responsible for a key (the same for every
+    /// instance with the same number of shards)
+    unsigned shard_index(std::string_view key) const;
+};
+
+#endif // SHARED_CACHE_HH
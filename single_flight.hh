@@ -0,0 +1,122 @@
+/*
+ * Coalesces concurrent loads of the same key within a process, used by the
+ * networked client's get_or_compute() (see cache.hh). While one thread runs
+ * the loader for a key, every other thread that asks for the same key waits
+ * for that thread's result instead of running the loader too, so a hot key
+ * that expires or is evicted is loaded from the backing store once rather
+ * than once per thread that misses it.
+ */
+
+#ifndef SINGLE_FLIGHT_HH
+#define SINGLE_FLIGHT_HH
+
+#include "evictor.hh"
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+class SingleFlight {
+  public:
+    // Result of a load: the value, or std::nullopt if there is none
+    using value_type = std::optional<std::string>;
+
+  private:
+    // A load in progress, whose result every thread waiting on it shares
+    struct Flight {
+        std::promise<value_type> promise;
+        std::shared_future<value_type> result = promise.get_future().share();
+    };
+
+    std::mutex mutex;
+    std::unordered_map<key_type, std::shared_ptr<Flight>> flights;
+    std::atomic<uint64_t> num_loads{0};
+    std::atomic<uint64_t> num_coalesced{0};
+
+    // Get the flight loading a key, and whether the calling thread has just
+    // started it (and so must run the loader)
+    std::pair<std::shared_ptr<Flight>, bool> join(const key_type &key) {
+        std::lock_guard lock{mutex};
+        auto [flight, created] = flights.try_emplace(key);
+        if (created) {
+            flight->second = std::make_shared<Flight>();
+        }
+        return {flight->second, created};
+    }
+
+    // Run the loader of a flight the calling thread started, and hand its
+    // result (or exception) to every thread waiting on it
+    template <typename Load>
+    value_type lead(const key_type &key, Flight &flight, Load &&load) {
+        ++num_loads;
+        try {
+            auto value = load();
+            flight.promise.set_value(value);
+            finish(key);
+            return value;
+        } catch (...) {
+            flight.promise.set_exception(std::current_exception());
+            finish(key);
+            throw;
+        }
+    }
+
+    // Remove a key's flight once its result is set, so that the next thread
+    // to ask for the key loads it again (threads that joined the flight keep
+    // their reference to it)
+    void finish(const key_type &key) {
+        std::lock_guard lock{mutex};
+        flights.erase(key);
+    }
+
+  public:
+    // Load a key's value with `load()`, unless another thread is loading it
+    // already, in which case wait for that thread's result instead (if its
+    // loader throws, the exception is thrown here too)
+    template <typename Load> value_type run(const key_type &key, Load &&load) {
+        auto [flight, leader] = join(key);
+        if (!leader) {
+            ++num_coalesced;
+            return flight->result.get();
+        }
+        return lead(key, *flight, std::forward<Load>(load));
+    }
+
+    // Like run(), but return right away (false) without loading or waiting if
+    // another thread is loading the key already; returns true once `load()`
+    // has returned, or rethrows its exception
+    template <typename Load>
+    bool run_if_idle(const key_type &key, Load &&load) {
+        auto [flight, leader] = join(key);
+        if (!leader) {
+            return false;
+        }
+        lead(key, *flight, std::forward<Load>(load));
+        return true;
+    }
+
+    // Whether a thread is loading a key
+    bool loading(const key_type &key) {
+        std::lock_guard lock{mutex};
+        return flights.count(key) != 0;
+    }
+
+    // Number of times a loader was run, and number of calls to run() that
+    // waited for another thread's load instead
+    uint64_t loads() const {
+        return num_loads.load(std::memory_order_relaxed);
+    }
+
+    uint64_t coalesced() const {
+        return num_coalesced.load(std::memory_order_relaxed);
+    }
+};
+
+#endif // SINGLE_FLIGHT_HH
@@ -0,0 +1,324 @@
+#include "slab_allocator.hh"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+// Smallest chunk size (must be able to hold a free list pointer)
+constexpr SlabAllocator::size_type MIN_CHUNK_SIZE = 16;
+// Ratio between the chunk sizes of consecutive size classes
+constexpr double GROWTH_FACTOR = 1.25;
+// Alignment of every chunk
+constexpr std::size_t CHUNK_ALIGN = 8;
+
+// Smallest and largest page sizes
+constexpr std::size_t MIN_PAGE_SIZE = 4 << 10; // 4KiB
+constexpr std::size_t MAX_PAGE_SIZE = 1 << 20; // 1MiB
+// Target number of pages for the memory limit (small limits use small pages so
+// that there are enough pages to go around the size classes)
+constexpr std::size_t TARGET_PAGES = 32;
+// Minimum number of pages, so that even tiny limits can hold chunks from more
+// than one size class at a time
+constexpr std::size_t MIN_PAGES = 8;
+
+std::size_t align_up(std::size_t size, std::size_t align) {
+    return (size + align - 1) / align * align;
+}
+
+// Choose a power-of-two page size for a memory limit
+std::size_t choose_page_size(std::size_t memory_limit) {
+    auto page_size = MIN_PAGE_SIZE;
+    while (page_size < MAX_PAGE_SIZE && page_size * TARGET_PAGES < memory_limit) {
+        page_size *= 2;
+    }
+    return page_size;
+}
+
+} // namespace
+
+SlabAllocator::SlabAllocator(std::size_t memory_limit)
+: page_size{choose_page_size(memory_limit)},
+  header_size{align_up(sizeof(Page), 2 * CHUNK_ALIGN)},
+  max_pages{std::max(MIN_PAGES, (memory_limit + page_size - 1) / page_size)} {
+    // Build the size classes, ending with a class of one chunk per page
+    const auto max_chunk_size =
+        static_cast<size_type>((page_size - header_size) / CHUNK_ALIGN *
+                               CHUNK_ALIGN);
+    for (size_type chunk_size = MIN_CHUNK_SIZE;
+         chunk_size < max_chunk_size / 2;
+         chunk_size = static_cast<size_type>(
+             align_up(chunk_size * GROWTH_FACTOR, CHUNK_ALIGN))) {
+        classes.push_back({chunk_size, max_chunk_size / chunk_size});
+    }
+    classes.push_back({max_chunk_size, 1});
+    all_pages.reserve(max_pages);
+}
+
+SlabAllocator::~SlabAllocator() {
+    for (auto page : all_pages) {
+        std::free(page);
+    }
+    while (large != nullptr) {
+        auto page = large;
+        large = large->next;
+        std::free(page);
+    }
+}
+
+SlabAllocator::Page *SlabAllocator::page_of(const void *ptr) const {
+    // Pages are aligned to `page_size`, and a large allocation's data always
+    // starts in its first page
+    const auto address = reinterpret_cast<std::uintptr_t>(ptr);
+    return reinterpret_cast<Page *>(address & ~(page_size - 1));
+}
+
+SlabAllocator::size_type SlabAllocator::class_for(size_type size) const {
+    return static_cast<size_type>(
+        std::lower_bound(classes.begin(), classes.end(), size,
+                         [](const SizeClass &size_class, size_type size) {
+                             return size_class.chunk_size < size;
+                         }) -
+        classes.begin());
+}
+
+void SlabAllocator::unlink(Page *&list, Page *page) {
+    if (page->prev != nullptr) {
+        page->prev->next = page->next;
+    } else {
+        list = page->next;
+    }
+    if (page->next != nullptr) {
+        page->next->prev = page->prev;
+    }
+    page->prev = page->next = nullptr;
+}
+
+void SlabAllocator::push(Page *&list, Page *page) {
+    page->prev = nullptr;
+    page->next = list;
+    if (list != nullptr) {
+        list->prev = page;
+    }
+    list = page;
+}
+
+SlabAllocator::Page *SlabAllocator::take_page() {
+    // Reuse an empty page if there is one
+    if (empty_pages != nullptr) {
+        auto page = empty_pages;
+        unlink(empty_pages, page);
+        return page;
+    }
+    // Otherwise reserve a new page if the limit allows it
+    if (num_pages >= max_pages) {
+        return nullptr;
+    }
+    auto page = static_cast<Page *>(std::aligned_alloc(page_size, page_size));
+    if (page == nullptr) {
+        throw std::bad_alloc{};
+    }
+    all_pages.push_back(page);
+    ++num_pages;
+    return page;
+}
+
+void SlabAllocator::return_page(Page *page) {
+    push(empty_pages, page);
+}
+
+std::size_t SlabAllocator::chunk_size(size_type size) const {
+    if (size > classes.back().chunk_size) {
+        return align_up(header_size + size, page_size);
+    }
+    return classes[class_for(size)].chunk_size;
+}
+
+void *SlabAllocator::allocate(size_type size) {
+    if (size > classes.back().chunk_size) {
+        return allocate_large(size);
+    }
+    const auto class_index = class_for(size);
+    auto &size_class = classes[class_index];
+
+    // Get a page with a free chunk, taking a new one if necessary
+    auto page = size_class.partial;
+    if (page == nullptr) {
+        page = take_page();
+        if (page == nullptr) {
+            return nullptr;
+        }
+        page->class_index = class_index;
+        page->chunks_used = 0;
+        page->num_pages = 1;
+        page->free_chunks = nullptr;
+        page->next_unused = reinterpret_cast<char *>(page) + header_size;
+        push(size_class.partial, page);
+        ++size_class.num_pages;
+    }
+
+    // Take a previously freed chunk, or else the next never-used one
+    void *chunk;
+    if (page->free_chunks != nullptr) {
+        chunk = page->free_chunks;
+        page->free_chunks = *static_cast<void **>(chunk);
+    } else {
+        chunk = page->next_unused;
+        page->next_unused += size_class.chunk_size;
+    }
+
+    ++page->chunks_used;
+    ++size_class.chunks_used;
+    size_class.bytes_used += size;
+    // Full pages are not kept in the partial list
+    if (page->chunks_used == size_class.chunks_per_page) {
+        unlink(size_class.partial, page);
+    }
+    return chunk;
+}
+
+void SlabAllocator::deallocate(void *ptr, size_type size) {
+    auto page = page_of(ptr);
+    if (page->class_index == LARGE_CLASS) {
+        return deallocate_large(page, size);
+    }
+    auto &size_class = classes[page->class_index];
+    const auto was_full = page->chunks_used == size_class.chunks_per_page;
+
+    // Add the chunk to the page's free list
+    *static_cast<void **>(ptr) = page->free_chunks;
+    page->free_chunks = ptr;
+    --page->chunks_used;
+    --size_class.chunks_used;
+    size_class.bytes_used -= size;
+
+    if (page->chunks_used == 0) {
+        // Give the empty page back so that any size class can use it
+        if (!was_full) {
+            unlink(size_class.partial, page);
+        }
+        --size_class.num_pages;
+        return_page(page);
+    } else if (was_full) {
+        push(size_class.partial, page);
+    }
+}
+
+void *SlabAllocator::allocate_large(size_type size) {
+    const auto pages_needed = (header_size + size + page_size - 1) / page_size;
+    // Release empty pages to the system until the allocation fits
+    while (num_pages + pages_needed > max_pages && empty_pages != nullptr) {
+        auto page = empty_pages;
+        unlink(empty_pages, page);
+        all_pages.erase(std::find(all_pages.begin(), all_pages.end(), page));
+        std::free(page);
+        --num_pages;
+    }
+    if (num_pages + pages_needed > max_pages) {
+        return nullptr;
+    }
+    auto page = static_cast<Page *>(
+        std::aligned_alloc(page_size, pages_needed * page_size));
+    if (page == nullptr) {
+        throw std::bad_alloc{};
+    }
+    page->class_index = LARGE_CLASS;
+    page->chunks_used = 1;
+    page->num_pages = static_cast<size_type>(pages_needed);
+    page->free_chunks = nullptr;
+    page->next_unused = nullptr;
+    push(large, page);
+    num_pages += pages_needed;
+    large_pages += pages_needed;
+    large_bytes_used += size;
+    ++large_chunks_used;
+    return reinterpret_cast<char *>(page) + header_size;
+}
+
+void SlabAllocator::deallocate_large(Page *page, size_type size) {
+    unlink(large, page);
+    num_pages -= page->num_pages;
+    large_pages -= page->num_pages;
+    --large_chunks_used;
+    large_bytes_used -= size;
+    std::free(page);
+}
+
+bool SlabAllocator::reassign_page(size_type size,
+                                  const chunk_evictor &evict) {
+    const auto target =
+        size > classes.back().chunk_size ? LARGE_CLASS : class_for(size);
+    // Emptying the page with the fewest chunks in use evicts the least
+    Page *victim = nullptr;
+    for (auto page : all_pages) {
+        if (page->chunks_used != 0 && page->class_index != target &&
+            (victim == nullptr || page->chunks_used < victim->chunks_used)) {
+            victim = page;
+        }
+    }
+    if (victim == nullptr) {
+        return false;
+    }
+
+    // The chunks in use are the ones before `next_unused` that are not on
+    // the free list (found before any of them is freed)
+    const auto chunk_size = classes[victim->class_index].chunk_size;
+    const auto first = reinterpret_cast<char *>(victim) + header_size;
+    const auto num_chunks =
+        static_cast<std::size_t>(victim->next_unused - first) / chunk_size;
+    std::vector<bool> is_free(num_chunks);
+    for (auto chunk = victim->free_chunks; chunk != nullptr;
+         chunk = *static_cast<void **>(chunk)) {
+        is_free[static_cast<std::size_t>(static_cast<char *>(chunk) - first) /
+                chunk_size] = true;
+    }
+    for (std::size_t i = 0; i < num_chunks; ++i) {
+        if (!is_free[i]) {
+            evict(first + i * chunk_size);
+        }
+    }
+    // An emptied page has been returned to the pool by `deallocate()`
+    return victim->chunks_used == 0;
+}
+
+void SlabAllocator::clear() {
+    for (auto &size_class : classes) {
+        size_class.num_pages = 0;
+        size_class.chunks_used = 0;
+        size_class.bytes_used = 0;
+        size_class.partial = nullptr;
+    }
+    // Every small page is now empty
+    empty_pages = nullptr;
+    for (auto page : all_pages) {
+        page->chunks_used = 0;
+        push(empty_pages, page);
+    }
+    // Large allocations are not pooled
+    while (large != nullptr) {
+        auto page = large;
+        large = large->next;
+        num_pages -= page->num_pages;
+        std::free(page);
+    }
+    large_pages = 0;
+    large_chunks_used = 0;
+    large_bytes_used = 0;
+}
+
+std::vector<SlabAllocator::ClassStats> SlabAllocator::stats() const {
+    std::vector<ClassStats> result;
+    result.reserve(classes.size() + 1);
+    for (const auto &size_class : classes) {
+        result.push_back(
+            {size_class.chunk_size, size_class.num_pages,
+             size_class.chunks_used,
+             size_class.num_pages * size_class.chunks_per_page -
+                 size_class.chunks_used,
+             size_class.bytes_used});
+    }
+    result.push_back({0, static_cast<size_type>(large_pages),
+                      large_chunks_used, 0, large_bytes_used});
+    return result;
+}
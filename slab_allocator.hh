@@ -0,0 +1,145 @@
+/*
+ * Slab allocator used to store cache values.
+ * Memory is reserved in fixed-size pages, and each page is carved into chunks
+ * of a single size class (in the style of memcached). Freed chunks and empty
+ * pages are kept for reuse, so a cache in steady state does not call
+ * malloc/free at all, and the total memory reserved never exceeds the limit
+ * given at construction (rounded up to a whole number of pages, with a small
+ * minimum number of pages).
+ */
+
+#ifndef SLAB_ALLOCATOR_HH
+#define SLAB_ALLOCATOR_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+class SlabAllocator {
+  public:
+    using size_type = uint32_t;
+
+    // Usage statistics for a single size class
+    struct ClassStats {
+        size_type chunk_size;      // Size of each chunk in bytes
+        size_type num_pages;       // Number of pages owned by the class
+        size_type chunks_used;     // Number of chunks handed out
+        size_type chunks_free;     // Number of free chunks in owned pages
+        std::size_t bytes_used;    // Bytes requested for the used chunks
+    };
+
+  private:
+    // Header at the start of every page
+    struct Page {
+        size_type class_index;  // Size class (or `LARGE_CLASS`)
+        size_type chunks_used;  // Number of chunks handed out
+        size_type num_pages;    // Number of pages spanned (large pages only)
+        void *free_chunks;      // Singly linked list of free chunks
+        char *next_unused;      // Start of the never-used tail of the page
+        // Links in the class's list of pages with free chunks (or in the list
+        // of empty pages)
+        Page *prev;
+        Page *next;
+    };
+
+    struct SizeClass {
+        size_type chunk_size;
+        size_type chunks_per_page;
+        size_type num_pages = 0;
+        size_type chunks_used = 0;
+        std::size_t bytes_used = 0;
+        // Pages with at least one free chunk
+        Page *partial = nullptr;
+    };
+
+    static constexpr size_type LARGE_CLASS = UINT32_MAX;
+
+    const std::size_t page_size;
+    const std::size_t header_size;
+    const std::size_t max_pages;
+
+    std::vector<SizeClass> classes;
+
+    // Number of pages reserved (in use or empty)
+    std::size_t num_pages = 0;
+    // Allocations larger than the largest size class, each of which gets
+    // its own run of pages
+    Page *large = nullptr;
+    std::size_t large_pages = 0;
+    size_type large_chunks_used = 0;
+    std::size_t large_bytes_used = 0;
+    // Pages that are reserved but not owned by any class
+    Page *empty_pages = nullptr;
+    // Every page reserved from the system (freed on destruction)
+    std::vector<Page *> all_pages;
+
+    // Get the header of the page containing `ptr`
+    Page *page_of(const void *ptr) const;
+
+    // Get the size class index for an allocation of `size` bytes
+    size_type class_for(size_type size) const;
+
+    // Get an empty page, reserving a new one if allowed (nullptr if not)
+    Page *take_page();
+    // Return an empty page to the pool
+    void return_page(Page *page);
+
+    void *allocate_large(size_type size);
+    void deallocate_large(Page *page, size_type size);
+
+    static void unlink(Page *&list, Page *page);
+    static void push(Page *&list, Page *page);
+
+  public:
+    // Create an allocator that reserves at most `memory_limit` bytes (rounded
+    // up to a whole number of pages, and at least a few pages)
+    explicit SlabAllocator(std::size_t memory_limit);
+    ~SlabAllocator();
+
+    SlabAllocator(const SlabAllocator &) = delete;
+    SlabAllocator &operator=(const SlabAllocator &) = delete;
+
+    // Allocate a chunk of at least `size` bytes, or return nullptr if the
+    // memory limit has been reached and the chunk's size class has no free
+    // chunks
+    void *allocate(size_type size);
+
+    // Number of bytes that an allocation of `size` bytes actually takes: the
+    // chunk size of its size class, or the whole pages of a large allocation
+    std::size_t chunk_size(size_type size) const;
+
+    // Free a chunk previously returned by `allocate()` for `size` bytes
+    void deallocate(void *ptr, size_type size);
+
+    // Function that frees a chunk in use by passing it to `deallocate()`, or
+    // leaves it in use if it cannot be freed yet
+    using chunk_evictor = std::function<void(void *chunk)>;
+
+    // Make a page available to an allocation of `size` bytes that failed
+    // because its size class has no free chunk and no page can be reserved
+    // (as memcached's slab rebalancing does): pick the page of another class
+    // with the fewest chunks in use and call `evict` on each of them. Returns
+    // whether the page was emptied, in which case the next allocation of any
+    // size can take it; large allocations may need several pages.
+    bool reassign_page(size_type size, const chunk_evictor &evict);
+
+    // Free every chunk at once (the pages stay reserved for reuse)
+    void clear();
+
+    // Total number of bytes reserved from the system
+    std::size_t reserved() const {
+        return num_pages * page_size;
+    }
+
+    // Maximum number of bytes that may be reserved
+    std::size_t limit() const {
+        return max_pages * page_size;
+    }
+
+    // Statistics for each size class, from smallest to largest chunk size,
+    // followed by one entry for large allocations (with a chunk size of 0)
+    std::vector<ClassStats> stats() const;
+};
+
+#endif // SLAB_ALLOCATOR_HH
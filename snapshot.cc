@@ -0,0 +1,211 @@
+#include "snapshot.hh"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+namespace {
+
+constexpr char MAGIC[8] = {'C', 'S', 'N', 'A', 'P', '0', '0', '1'};
+constexpr std::size_t HEADER_SIZE = sizeof(MAGIC) + 8;
+constexpr std::size_t ENTRY_HEADER_SIZE = 4 + 4 + 8;
+
+/// Bytes buffered before they are written out
+constexpr std::size_t BUFFER_SIZE = 1 << 20; // 1MiB
+
+void append_u32(std::string &out, std::uint32_t value) {
+    for (auto i = 0; i < 4; ++i) {
+        out.push_back(static_cast<char>(value >> (8 * i)));
+    }
+}
+
+void append_u64(std::string &out, std::uint64_t value) {
+    for (auto i = 0; i < 8; ++i) {
+        out.push_back(static_cast<char>(value >> (8 * i)));
+    }
+}
+
+std::uint64_t decode_u64(const char *in, unsigned bytes = 8) {
+    std::uint64_t value = 0;
+    for (auto i = 0U; i < bytes; ++i) {
+        value |= std::uint64_t{static_cast<unsigned char>(in[i])} << (8 * i);
+    }
+    return value;
+}
+
+/// Current time in milliseconds since the Unix epoch
+std::uint64_t now_ms() {
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch())
+            .count());
+}
+
+std::system_error system_error(const std::string &what) {
+    return {errno, std::generic_category(), what};
+}
+
+} // namespace
+
+namespace snapshot {
+
+Writer::Writer(std::string path)
+: path{std::move(path)}, temp_path{this->path + ".tmp"} {
+    fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+              0644);
+    if (fd < 0) {
+        throw system_error("unable to create " + temp_path);
+    }
+    // Leave room for the header, which is written once the number of entries
+    // is known
+    buffer.reserve(BUFFER_SIZE);
+    buffer.assign(HEADER_SIZE, '\0');
+}
+
+Writer::~Writer() {
+    if (!committed) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        unlink(temp_path.c_str());
+    }
+}
+
+void Writer::write_all(std::string_view bytes) {
+    for (std::size_t written = 0; written < bytes.size();) {
+        const auto result =
+            write(fd, bytes.data() + written, bytes.size() - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw system_error("unable to write " + temp_path);
+        }
+        written += static_cast<std::size_t>(result);
+    }
+}
+
+void Writer::flush() {
+    write_all(buffer);
+    buffer.clear();
+}
+
+void Writer::add(std::string_view key, std::string_view value,
+                 Cache::ttl_type ttl) {
+    append_u32(buffer, static_cast<std::uint32_t>(key.size()));
+    append_u32(buffer, static_cast<std::uint32_t>(value.size()));
+    append_u64(buffer, ttl > Cache::ttl_type::zero()
+                           ? now_ms() + static_cast<std::uint64_t>(ttl.count())
+                           : 0);
+    // Large values are written straight from the caller's memory
+    if (value.size() >= BUFFER_SIZE) {
+        buffer.append(key);
+        flush();
+        write_all(value);
+    } else {
+        buffer.append(key);
+        buffer.append(value);
+        if (buffer.size() >= BUFFER_SIZE) {
+            flush();
+        }
+    }
+    ++num_entries;
+}
+
+void Writer::commit() {
+    flush();
+    // Fill in the header
+    buffer.assign(MAGIC, sizeof(MAGIC));
+    append_u64(buffer, num_entries);
+    if (pwrite(fd, buffer.data(), buffer.size(), 0) !=
+        static_cast<ssize_t>(buffer.size())) {
+        throw system_error("unable to write " + temp_path);
+    }
+    // Make sure the snapshot is on disk before it replaces the old one
+    if (fsync(fd) != 0) {
+        throw system_error("unable to sync " + temp_path);
+    }
+    close(fd);
+    fd = -1;
+    if (rename(temp_path.c_str(), path.c_str()) != 0) {
+        throw system_error("unable to rename " + temp_path);
+    }
+    committed = true;
+}
+
+Reader::Reader(const std::string &path) {
+    const auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw system_error("unable to open " + path);
+    }
+    struct stat stats;
+    if (fstat(fd, &stats) != 0) {
+        const auto error = system_error("unable to read " + path);
+        close(fd);
+        throw error;
+    }
+    file_size = static_cast<std::size_t>(stats.st_size);
+    if (file_size < HEADER_SIZE) {
+        close(fd);
+        throw std::runtime_error(path + " is not a snapshot");
+    }
+    const auto mapping =
+        mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        throw system_error("unable to map " + path);
+    }
+    data = static_cast<const char *>(mapping);
+    // Entries are read once, from start to end
+    madvise(mapping, file_size, MADV_SEQUENTIAL | MADV_WILLNEED);
+    if (std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0) {
+        munmap(mapping, file_size);
+        throw std::runtime_error(path + " is not a snapshot");
+    }
+    num_entries = decode_u64(data + sizeof(MAGIC));
+    offset = HEADER_SIZE;
+}
+
+Reader::~Reader() {
+    munmap(const_cast<char *>(data), file_size);
+}
+
+bool Reader::next(Entry &entry) {
+    const auto now = now_ms();
+    while (num_read < num_entries) {
+        if (file_size - offset < ENTRY_HEADER_SIZE) {
+            throw std::runtime_error("snapshot is truncated");
+        }
+        const auto key_size = decode_u64(data + offset, 4);
+        const auto value_size = decode_u64(data + offset + 4, 4);
+        const auto expires_at = decode_u64(data + offset + 8);
+        offset += ENTRY_HEADER_SIZE;
+        if (file_size - offset < key_size + value_size) {
+            throw std::runtime_error("snapshot is truncated");
+        }
+        const auto key = data + offset;
+        offset += key_size + value_size;
+        ++num_read;
+        // Skip entries that have expired since the snapshot was saved
+        if (expires_at != 0 && expires_at <= now) {
+            continue;
+        }
+        entry.key = {key, key_size};
+        entry.value = {key + key_size, value_size};
+        entry.ttl = Cache::ttl_type{
+            expires_at != 0 ? static_cast<Cache::ttl_type::rep>(
+                                  expires_at - now)
+                            : 0};
+        return true;
+    }
+    return false;
+}
+
+} // namespace snapshot
@@ -0,0 +1,106 @@
+/*
+ * On-disk snapshots of a cache's entries, used by cache_server to restart
+ * warm. A snapshot is a 16-byte header (the magic "CSNAP001" and the number
+ * of entries, as a little-endian u64) followed by the entries, each one:
+ *
+ *     u32 key_size | u32 value_size | u64 expires_at | key | value
+ *
+ * where `expires_at` is the entry's expiry time in milliseconds since the
+ * Unix epoch (0 if it never expires), so that time spent between saving and
+ * loading a snapshot counts against the entries' TTLs. All integers are
+ * little-endian.
+ */
+
+#ifndef SNAPSHOT_HH
+#define SNAPSHOT_HH
+
+#include "cache.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace snapshot {
+
+/// An entry read from a snapshot (the views point into the mapped file)
+struct Entry {
+    std::string_view key;
+    std::string_view value;
+    /// Time the entry has left to live (zero if it never expires)
+    Cache::ttl_type ttl;
+};
+
+/// Writes a snapshot to a temporary file, which atomically replaces the
+/// snapshot at the given path once it is complete (so readers never see a
+/// partial snapshot, and a failed write leaves the old one in place)
+class Writer {
+  private:
+    const std::string path;
+    const std::string temp_path;
+    int fd;
+    std::string buffer;
+    std::uint64_t num_entries = 0;
+    bool committed = false;
+
+    /// Write bytes to the file
+    void write_all(std::string_view bytes);
+    /// Write out the buffer
+    void flush();
+
+  public:
+    /// Create the temporary file (throws `std::system_error` on failure, as
+    /// do the other methods)
+    explicit Writer(std::string path);
+    /// Remove the temporary file unless `commit()` succeeded
+    ~Writer();
+
+    Writer(const Writer &) = delete;
+    Writer &operator=(const Writer &) = delete;
+
+    /// Add an entry (a zero or negative TTL means it never expires)
+    void add(std::string_view key, std::string_view value,
+             Cache::ttl_type ttl);
+
+    /// Write out every entry, sync the file, and put it in place
+    void commit();
+
+    /// Number of entries added
+    std::uint64_t size() const {
+        return num_entries;
+    }
+};
+
+/// Reads a snapshot by mapping it into memory, so loading it reads the file
+/// straight from the page cache without copying it into a buffer first
+class Reader {
+  private:
+    const char *data = nullptr;
+    std::size_t file_size = 0;
+    std::size_t offset;
+    std::uint64_t num_entries = 0;
+    std::uint64_t num_read = 0;
+
+  public:
+    /// Map a snapshot (throws `std::system_error` if it cannot be opened, and
+    /// `std::runtime_error` if it is not a snapshot)
+    explicit Reader(const std::string &path);
+    ~Reader();
+
+    Reader(const Reader &) = delete;
+    Reader &operator=(const Reader &) = delete;
+
+    /// Read the next entry that has not expired, in the order they were
+    /// added; returns false after the last one (throws `std::runtime_error`
+    /// if the snapshot is truncated)
+    bool next(Entry &entry);
+
+    /// Number of entries in the snapshot (including expired ones)
+    std::uint64_t size() const {
+        return num_entries;
+    }
+};
+
+} // namespace snapshot
+
+#endif // SNAPSHOT_HH
@@ -0,0 +1,143 @@
+#include "cache.hh"
+#include "intrusive_lru_evictor.hh"
+#include "lru_evictor.hh"
+#include "test_common.hh"
+#include "tinylfu_admission.hh"
+
+#include <string>
+
+////////////////////////////////////////////////
+// FrequencySketch Unit Tests
+////////////////////////////////////////////////
+
+TEST_CASE("FrequencySketch counts accesses up to 15") {
+    FrequencySketch sketch{64};
+    REQUIRE_EQ(sketch.frequency(1), 0);
+    for (auto i = 1U; i <= 20; ++i) {
+        sketch.increment(1);
+        REQUIRE_EQ(sketch.frequency(1), std::min(i, 15U));
+    }
+    REQUIRE_EQ(sketch.frequency(2), 0);
+
+    sketch.clear();
+    REQUIRE_EQ(sketch.frequency(1), 0);
+}
+
+TEST_CASE("FrequencySketch halves its counters periodically") {
+    // The counters are halved every 10 * 8 increments
+    FrequencySketch sketch{8};
+    for (auto i = 0U; i < 10; ++i) {
+        sketch.increment(1);
+    }
+    for (uint64_t hash = 2; hash < 2 + 69; ++hash) {
+        sketch.increment(hash);
+    }
+    // Other keys may share some counters, but halving them all halves the
+    // estimate
+    const auto frequency = sketch.frequency(1);
+    REQUIRE_GE(frequency, 10);
+    sketch.increment(100);
+    REQUIRE_EQ(sketch.frequency(1), frequency / 2);
+}
+
+////////////////////////////////////////////////
+// TinyLfuAdmission Unit Tests
+////////////////////////////////////////////////
+
+TEST_CASE("TinyLfuAdmission only admits keys used more often than the "
+          "victim") {
+    TinyLfuAdmission admission{1024};
+    admission.record("hot");
+    admission.record("hot");
+    admission.record("cold");
+    REQUIRE_EQ(admission.frequency("hot"), 2);
+    REQUIRE_FALSE(admission.admit("cold", "hot"));
+    REQUIRE(admission.admit("hot", "cold"));
+    // Ties are rejected
+    admission.record("cold");
+    REQUIRE_FALSE(admission.admit("cold", "hot"));
+}
+
+TEST_CASE("TinyLfuAdmission admits new keys into its window") {
+    TinyLfuAdmission admission{64, 2};
+    for (auto i = 0U; i < 4; ++i) {
+        admission.record("hot");
+    }
+    // The window has room for two keys
+    REQUIRE(admission.admit("new1", "hot"));
+    REQUIRE(admission.admit("new2", "hot"));
+    REQUIRE_FALSE(admission.admit("new3", "hot"));
+    // Keys in the window can be replaced by new keys
+    REQUIRE(admission.admit("new3", "new1"));
+    // Keys leave the window when they are accessed again or removed
+    admission.record("new2");
+    admission.forget("new3");
+    REQUIRE(admission.admit("new4", "hot"));
+    REQUIRE(admission.admit("new5", "hot"));
+    REQUIRE_FALSE(admission.admit("new6", "hot"));
+    // Resetting the cache empties the window
+    admission.clear();
+    REQUIRE(admission.admit("new6", "hot"));
+    REQUIRE(admission.admit("new7", "hot"));
+    REQUIRE_FALSE(admission.admit("new8", "hot"));
+}
+
+////////////////////////////////////////////////
+// Cache with Admission Unit Tests
+////////////////////////////////////////////////
+
+// Create a cache with enough space for a single entry, use one key many
+// times, then scan over other keys that are each used once, and return
+// whether the first key survived
+template <typename Evictor> bool survives_scan(Admission *admission) {
+    Evictor evictor;
+    const std::string value = "val";
+    Cache cache{static_cast<Cache::size_type>(value.size() + 1), 0.75f,
+                &evictor, std::hash<key_type>(), Cache::IndexType::CHAINED,
+                admission};
+
+    Cache::size_type size;
+    cache.set("hot", value.c_str(), value.size() + 1);
+    for (auto i = 0; i < 4; ++i) {
+        REQUIRE_NE(cache.get("hot", size), nullptr);
+    }
+    for (auto i = 0; i < 100; ++i) {
+        const auto key = "scan" + std::to_string(i);
+        REQUIRE_EQ(cache.get(key, size), nullptr);
+        cache.set(key, value.c_str(), value.size() + 1);
+    }
+    REQUIRE_LE(cache.space_used(), value.size() + 1);
+    return cache.get("hot", size) != nullptr;
+}
+
+TEST_CASE("Cache without admission lets a scan evict a hot key") {
+    REQUIRE_FALSE(survives_scan<LruEvictor>(nullptr));
+    REQUIRE_FALSE(survives_scan<IntrusiveLruEvictor>(nullptr));
+}
+
+TEST_CASE("Cache with TinyLfuAdmission keeps a hot key during a scan") {
+    TinyLfuAdmission admission{1024};
+    REQUIRE(survives_scan<LruEvictor>(&admission));
+    TinyLfuAdmission intrusive_admission{1024};
+    REQUIRE(survives_scan<IntrusiveLruEvictor>(&intrusive_admission));
+}
+
+TEST_CASE("Cache with TinyLfuAdmission admits keys once they are used more "
+          "than the victim") {
+    LruEvictor evictor;
+    TinyLfuAdmission admission{1024};
+    const std::string value = "val";
+    Cache cache{static_cast<Cache::size_type>(value.size() + 1), 0.75f,
+                &evictor, std::hash<key_type>(), Cache::IndexType::CHAINED,
+                &admission};
+
+    Cache::size_type size;
+    cache.set("old", value.c_str(), value.size() + 1);
+    // The new key is rejected until it has been accessed more often
+    cache.set("new", value.c_str(), value.size() + 1);
+    REQUIRE_EQ(cache.get("new", size), nullptr);
+    REQUIRE_NE(cache.get("old", size), nullptr);
+    cache.set("new", value.c_str(), value.size() + 1);
+    REQUIRE_NE(cache.get("new", size), nullptr);
+    REQUIRE_EQ(cache.get("old", size), nullptr);
+}
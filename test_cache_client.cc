@@ -4,50 +4,139 @@
 #include "cache.hh"
 #include "test_common.hh"
 
+#include <algorithm>
+#include <atomic>
 #include <boost/process.hpp>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
 #include <functional>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <vector>
 
-/// Server address and port
+/// Server address and ports
 constexpr auto SERVER_ADDRESS = "localhost";
 constexpr auto SERVER_PORT = "4022";
+constexpr auto SERVER_BINARY_PORT = "4023";
 
-/// Returns a new client
-Cache make_client() {
-    return Cache{SERVER_ADDRESS, SERVER_PORT};
+/// Protocols to run each test with
+struct HttpProtocol {
+    static constexpr auto PROTOCOL = Cache::Protocol::HTTP;
+    static constexpr auto PORT = SERVER_PORT;
+};
+struct BinaryProtocol {
+    static constexpr auto PROTOCOL = Cache::Protocol::BINARY;
+    static constexpr auto PORT = SERVER_BINARY_PORT;
+};
+#define PROTOCOLS HttpProtocol, BinaryProtocol
+
+/// Returns the bytes a value is stored as when set along with its terminating
+/// null byte, as the tests do
+std::string with_terminator(const std::string &value) {
+    return {value.c_str(), value.length() + 1};
 }
 
-/// Spawn the server as a child process and run the provided function after it
-/// has started
-void run_with_server(const Cache::size_type maxmem,
-                     const std::function<void()> &inner) {
-    /// Spawn the server as a child process, capturing stdout
-    boost::process::ipstream std_out;
-    boost::process::child server(
-        "./cache_server", "--server", SERVER_ADDRESS, "--port", SERVER_PORT,
-        "--maxmem", std::to_string(maxmem), boost::process::std_out > std_out);
-    // Wait for the line that says the server is running
-    std::string line;
-    std::getline(std_out, line);
+/// Returns a new client using the given protocol
+template <typename Protocol> Cache make_client() {
+    return Cache{SERVER_ADDRESS, Protocol::PORT, Protocol::PROTOCOL};
+}
+
+/// Returns the port `offset` ports after `port`
+std::string port_after(const char *port, unsigned offset) {
+    return std::to_string(std::stoi(port) + offset);
+}
+
+/// Returns the addresses of `count` servers spawned by `run_with_servers`,
+/// for the given protocol
+template <typename Protocol>
+std::vector<Cache::Server> cluster_servers(unsigned count) {
+    std::vector<Cache::Server> servers;
+    for (auto i = 0U; i < count; ++i) {
+        servers.push_back({SERVER_ADDRESS, port_after(Protocol::PORT, 2 * i)});
+    }
+    return servers;
+}
+
+/// Spawn `count` servers as child processes (with any extra arguments given)
+/// and run the provided function, which is given the servers, after they
+/// have all started. The first server uses the usual ports, and each of the
+/// others the two ports after the previous one's.
+void run_with_servers(
+    unsigned count, const Cache::size_type maxmem,
+    const std::function<void(std::vector<boost::process::child> &)> &inner,
+    const std::vector<std::string> &extra_args = {}) {
+    std::vector<boost::process::child> servers;
+    // The servers' stdout, which must stay open while they run
+    std::vector<std::unique_ptr<boost::process::ipstream>> outputs;
+    for (auto i = 0U; i < count; ++i) {
+        std::vector<std::string> args{
+            "--server",      SERVER_ADDRESS,
+            "--port",        port_after(SERVER_PORT, 2 * i),
+            "--binary-port", port_after(SERVER_BINARY_PORT, 2 * i),
+            "--maxmem",      std::to_string(maxmem)};
+        args.insert(args.end(), extra_args.begin(), extra_args.end());
+        // Sockets from the previous server may still hold the port for a
+        // short time after it is killed, so retry until the server starts
+        for (auto attempt = 0;; ++attempt) {
+            /// Spawn the server as a child process, capturing stdout
+            auto std_out = std::make_unique<boost::process::ipstream>();
+            boost::process::child server("./cache_server",
+                                         boost::process::args(args),
+                                         boost::process::std_out > *std_out);
+            // Wait for the line that says the server is running
+            std::string line;
+            if (std::getline(*std_out, line)) {
+                servers.push_back(std::move(server));
+                outputs.push_back(std::move(std_out));
+                break;
+            }
+            // The server exited without starting; try again
+            server.wait();
+            REQUIRE_LT(attempt, 50);
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
     // Run the provided function
-    inner();
-    // Terminate the server process (a bit unclean, but there doesn't seem to be
-    // a nice platform-independent way to send SIGINT)
-    server.terminate();
+    inner(servers);
+    // Terminate the server processes (a bit unclean, but there doesn't seem
+    // to be a nice platform-independent way to send SIGINT)
+    for (auto &server : servers) {
+        if (server.running()) {
+            server.terminate();
+        }
+        server.wait();
+    }
+}
+
+/// Spawn the server as a child process (with any extra arguments given) and
+/// run the provided function after it has started
+void run_with_server(const Cache::size_type maxmem,
+                     const std::function<void()> &inner,
+                     const std::vector<std::string> &extra_args = {}) {
+    run_with_servers(
+        1, maxmem, [&](std::vector<boost::process::child> &) { inner(); },
+        extra_args);
 }
 
 ////////////////////////////////////////////////
 // Cache Client Unit Tests
 ////////////////////////////////////////////////
 
-TEST_CASE("Cache::used_space() on empty cache returns 0") {
-    run_with_server(0, [&] { REQUIRE_EQ(make_client().space_used(), 0); });
+TEST_CASE_TEMPLATE("Cache::used_space() on empty cache returns 0", Protocol,
+                   PROTOCOLS) {
+    run_with_server(
+        0, [&] { REQUIRE_EQ(make_client<Protocol>().space_used(), 0); });
 }
 
-TEST_CASE("Cache::get() on empty cache returns nullptr") {
+TEST_CASE_TEMPLATE("Cache::get() on empty cache returns nullptr", Protocol,
+                   PROTOCOLS) {
     run_with_server(0, [&] {
-        auto cache = make_client();
+        auto cache = make_client<Protocol>();
 
         // Assert that entries are not in the cache
         for (auto &entry : ENTRIES) {
@@ -57,9 +146,10 @@ TEST_CASE("Cache::get() on empty cache returns nullptr") {
     });
 }
 
-TEST_CASE("Cache::set() succeeds when cache has enough space") {
+TEST_CASE_TEMPLATE("Cache::set() succeeds when cache has enough space",
+                   Protocol, PROTOCOLS) {
     run_with_server(ENTRIES_SIZE, [&] {
-        auto cache = make_client();
+        auto cache = make_client<Protocol>();
         auto space_used = 0;
 
         // Add entries to the cache
@@ -86,13 +176,14 @@ TEST_CASE("Cache::set() succeeds when cache has enough space") {
     });
 }
 
-TEST_CASE("Cache::set() fails when cache has no evictor and lacks enough "
-          "free space") {
+TEST_CASE_TEMPLATE("Cache::set() fails when cache has no evictor and lacks "
+                   "enough free space",
+                   Protocol, PROTOCOLS) {
     // Create a cache with enough space for all but the last entry
     const Cache::size_type MAXMEM =
         ENTRIES_SIZE - (LAST_ENTRY.second.length() + 1);
     run_with_server(MAXMEM, [&] {
-        auto cache = make_client();
+        auto cache = make_client<Protocol>();
 
         // Add entries to the cache
         for (auto &entry : ENTRIES) {
@@ -108,12 +199,13 @@ TEST_CASE("Cache::set() fails when cache has no evictor and lacks enough "
     });
 }
 
-TEST_CASE("Cache::set() fails when entry cannot possibly fit") {
+TEST_CASE_TEMPLATE("Cache::set() fails when entry cannot possibly fit",
+                   Protocol, PROTOCOLS) {
     // Create a cache with less free space than the size of the first entry
     const auto MAXMEM =
         static_cast<Cache::size_type>(FIRST_ENTRY.first.length());
     run_with_server(MAXMEM, [&] {
-        auto cache = make_client();
+        auto cache = make_client<Protocol>();
 
         // Add the entry to the cache
         cache.set(FIRST_ENTRY.first, FIRST_ENTRY.second.c_str(),
@@ -126,10 +218,11 @@ TEST_CASE("Cache::set() fails when entry cannot possibly fit") {
     });
 }
 
-TEST_CASE("Cache::set() replaces existing entry if present") {
+TEST_CASE_TEMPLATE("Cache::set() replaces existing entry if present", Protocol,
+                   PROTOCOLS) {
     // Create a cache with enough space for all of the entries
     run_with_server(ENTRIES_SIZE, [&] {
-        auto cache = make_client();
+        auto cache = make_client<Protocol>();
 
         // Use the key of the first entry
         auto &key = FIRST_ENTRY.first;
@@ -151,9 +244,10 @@ TEST_CASE("Cache::set() replaces existing entry if present") {
     });
 }
 
-TEST_CASE("Cache::del() succeeds when value is in cache") {
+TEST_CASE_TEMPLATE("Cache::del() succeeds when value is in cache", Protocol,
+                   PROTOCOLS) {
     run_with_server(ENTRIES_SIZE, [&] {
-        auto cache = make_client();
+        auto cache = make_client<Protocol>();
         auto space_used = 0;
 
         // Add entries to the cache
@@ -174,9 +268,10 @@ TEST_CASE("Cache::del() succeeds when value is in cache") {
     });
 }
 
-TEST_CASE("Cache::del() fails when value is not in cache") {
+TEST_CASE_TEMPLATE("Cache::del() fails when value is not in cache", Protocol,
+                   PROTOCOLS) {
     run_with_server(ENTRIES_SIZE, [&] {
-        auto cache = make_client();
+        auto cache = make_client<Protocol>();
 
         // Assert that all deletions fail
         for (auto &entry : ENTRIES) {
@@ -187,9 +282,10 @@ TEST_CASE("Cache::del() fails when value is not in cache") {
     });
 }
 
-TEST_CASE("Cache::reset() removes all entries") {
+TEST_CASE_TEMPLATE("Cache::reset() removes all entries", Protocol,
+                   PROTOCOLS) {
     run_with_server(ENTRIES_SIZE, [&] {
-        auto cache = make_client();
+        auto cache = make_client<Protocol>();
 
         // Add entries to the cache
         for (auto &entry : ENTRIES) {
@@ -209,3 +305,928 @@ TEST_CASE("Cache::reset() removes all entries") {
         REQUIRE_EQ(cache.space_used(), 0);
     });
 }
+
+TEST_CASE_TEMPLATE("Cache pipelined requests complete in order", Protocol,
+                   PROTOCOLS) {
+    run_with_server(ENTRIES_SIZE, [&] {
+        auto cache = make_client<Protocol>();
+
+        // Send every request before waiting on any of them
+        std::vector<std::future<void>> sets;
+        for (auto &entry : ENTRIES) {
+            sets.push_back(cache.set_async(entry.first, entry.second.c_str(),
+                                           entry.second.length() + 1));
+        }
+        auto deleted = cache.del_async(FIRST_ENTRY.first);
+        auto missing = cache.del_async(FIRST_ENTRY.first);
+        std::vector<std::future<std::optional<std::string>>> gets;
+        for (auto &entry : ENTRIES) {
+            gets.push_back(cache.get_async(entry.first));
+        }
+
+        // Wait on the last request first, which must complete the others
+        auto last = std::move(gets.back());
+        gets.pop_back();
+        CHECK_EQ(last.get(), with_terminator(LAST_ENTRY.second));
+        for (auto &set : sets) {
+            set.get();
+        }
+        CHECK(deleted.get());
+        CHECK(!missing.get());
+        auto entry = ENTRIES.begin();
+        CHECK(!gets.front().get());
+        for (auto get = std::next(gets.begin()); get != gets.end(); ++get) {
+            CHECK_EQ(get->get(), with_terminator((++entry)->second));
+        }
+        // Assert that synchronous requests see the pipelined ones
+        REQUIRE_EQ(cache.space_used(),
+                   ENTRIES_SIZE - (FIRST_ENTRY.second.length() + 1));
+    });
+}
+
+TEST_CASE_TEMPLATE("Cache pipelines more requests than fit in flight",
+                   Protocol, PROTOCOLS) {
+    constexpr auto NUM_REQUESTS = 1000;
+    run_with_server(ENTRIES_SIZE, [&] {
+        auto cache = make_client<Protocol>();
+
+        cache.set(FIRST_ENTRY.first, FIRST_ENTRY.second.c_str(),
+                  FIRST_ENTRY.second.length() + 1);
+        std::vector<std::future<std::optional<std::string>>> gets;
+        for (auto i = 0; i < NUM_REQUESTS; ++i) {
+            gets.push_back(cache.get_async(FIRST_ENTRY.first));
+        }
+        for (auto &get : gets) {
+            REQUIRE_EQ(get.get(), with_terminator(FIRST_ENTRY.second));
+        }
+    });
+}
+
+TEST_CASE_TEMPLATE("Cache batch requests act on every key", Protocol,
+                   PROTOCOLS) {
+    run_with_server(ENTRIES_SIZE, [&] {
+        auto cache = make_client<Protocol>();
+
+        // Add every entry in one batch
+        std::vector<Cache::KeyValue> entries;
+        std::vector<key_type> keys;
+        for (auto &entry : ENTRIES) {
+            entries.push_back({entry.first, entry.second.c_str(),
+                               static_cast<Cache::size_type>(
+                                   entry.second.length() + 1)});
+            keys.push_back(entry.first);
+        }
+        cache.mset(entries);
+        REQUIRE_EQ(cache.space_used(), ENTRIES_SIZE);
+
+        // Delete the first entry and a missing key, and then a single key
+        REQUIRE_EQ(cache.mdel({FIRST_ENTRY.first, "missing"}), 1);
+        REQUIRE_EQ(cache.mdel({FIRST_ENTRY.first}), 0);
+
+        // Assert that every value but the first is returned, in order
+        std::vector<Cache::size_type> sizes;
+        const auto values = cache.mget(keys, sizes);
+        REQUIRE_EQ(values.size(), keys.size());
+        CHECK_EQ(values.front(), nullptr);
+        auto i = 1U;
+        for (auto entry = std::next(ENTRIES.begin()); entry != ENTRIES.end();
+             ++entry, ++i) {
+            REQUIRE_NE(values[i], nullptr);
+            CHECK_EQ(std::string{values[i]}, entry->second);
+            CHECK_EQ(sizes[i], entry->second.length() + 1);
+        }
+        // Assert that batches of one key and empty batches work too
+        REQUIRE_EQ(cache.mget({LAST_ENTRY.first}, sizes).size(), 1);
+        CHECK_EQ(std::string{cache.mget({LAST_ENTRY.first}, sizes).front()},
+                 LAST_ENTRY.second);
+        CHECK(cache.mget({}, sizes).empty());
+        CHECK_EQ(cache.mdel({}), 0);
+    });
+}
+
+TEST_CASE_TEMPLATE("Cache pipelined batch requests complete in order",
+                   Protocol, PROTOCOLS) {
+    run_with_server(ENTRIES_SIZE, [&] {
+        auto cache = make_client<Protocol>();
+
+        std::vector<Cache::KeyValue> entries;
+        std::vector<key_type> keys;
+        for (auto &entry : ENTRIES) {
+            entries.push_back({entry.first, entry.second.c_str(),
+                               static_cast<Cache::size_type>(
+                                   entry.second.length() + 1)});
+            keys.push_back(entry.first);
+        }
+
+        // Send every request before waiting on any of them
+        auto set = cache.mset_async(entries);
+        auto deleted = cache.mdel_async({FIRST_ENTRY.first, "missing"});
+        auto values = cache.mget_async(keys);
+        auto single = cache.mget_async({LAST_ENTRY.first});
+        auto deleted_single = cache.mdel_async({LAST_ENTRY.first});
+
+        // Wait on the last request first, which must complete the others
+        CHECK_EQ(deleted_single.get(), 1);
+        set.get();
+        CHECK_EQ(deleted.get(), 1);
+        const auto results = values.get();
+        REQUIRE_EQ(results.size(), keys.size());
+        CHECK(!results.front());
+        auto i = 1U;
+        for (auto entry = std::next(ENTRIES.begin()); entry != ENTRIES.end();
+             ++entry, ++i) {
+            CHECK_EQ(results[i], with_terminator(entry->second));
+        }
+        CHECK_EQ(single.get(), std::vector<std::optional<std::string>>{
+                                   with_terminator(LAST_ENTRY.second)});
+        // Assert that empty batches work too
+        cache.mset_async({}).get();
+        CHECK(cache.mget_async({}).get().empty());
+        CHECK_EQ(cache.mdel_async({}).get(), 0);
+    });
+}
+
+TEST_CASE_TEMPLATE("Cache stores values with arbitrary bytes", Protocol,
+                   PROTOCOLS) {
+    // Bytes that cannot appear in a URL path segment or a C string
+    const std::string value{"a/b, c\0d\"\\\x80\xff\n", 13};
+    const std::string key = "binary";
+    run_with_server(1 << 10, [&] {
+        auto cache = make_client<Protocol>();
+
+        cache.set(key, value.data(), value.size());
+        REQUIRE_EQ(cache.space_used(), value.size());
+
+        // Assert that every way of reading the value returns the same bytes
+        Cache::size_type size = 0;
+        const auto result = cache.get(key, size);
+        REQUIRE_NE(result, nullptr);
+        CHECK_EQ(std::string{result, size}, value);
+        CHECK_EQ(cache.get_async(key).get(), value);
+        std::vector<Cache::size_type> sizes;
+        const auto results = cache.mget({key, "missing"}, sizes);
+        REQUIRE_NE(results.front(), nullptr);
+        CHECK_EQ(std::string{results.front(), sizes.front()}, value);
+        CHECK_EQ(results.back(), nullptr);
+
+        // Assert that batches of values with arbitrary bytes are stored
+        // exactly too
+        cache.mset({{key, value.data() + 1, 5}, {"other", value.data(), 13}});
+        const auto batch = cache.mget({key, "other"}, sizes);
+        REQUIRE_NE(batch[0], nullptr);
+        REQUIRE_NE(batch[1], nullptr);
+        CHECK_EQ(std::string{batch[0], sizes[0]}, value.substr(1, 5));
+        CHECK_EQ(std::string{batch[1], sizes[1]}, value);
+
+        // Assert that an empty value is found by every way of reading it
+        cache.set("empty", value.data(), 0);
+        REQUIRE_NE(cache.get("empty", size), nullptr);
+        CHECK_EQ(size, 0);
+        CHECK_EQ(cache.get_async("empty").get(), "");
+        const auto empty = cache.mget({"empty", "missing"}, sizes);
+        REQUIRE_NE(empty.front(), nullptr);
+        CHECK_EQ(sizes.front(), 0);
+        CHECK_EQ(empty.back(), nullptr);
+        const auto empty_async = cache.mget_async({"empty", "missing"}).get();
+        CHECK_EQ(empty_async.front(), "");
+        CHECK_FALSE(empty_async.back());
+    });
+}
+
+TEST_CASE_TEMPLATE("Cache rejects keys too long to encode", Protocol,
+                   PROTOCOLS) {
+    // Key sizes are 2 bytes in binary frames and in batch bodies
+    const std::string key(UINT16_MAX + 1, 'k');
+    const std::string value = "value";
+    run_with_server(1 << 10, [&] {
+        auto cache = make_client<Protocol>();
+        std::vector<Cache::size_type> sizes;
+        if (Protocol::PROTOCOL == Cache::Protocol::BINARY) {
+            Cache::size_type size = 0;
+            CHECK_THROWS_AS(cache.set(key, value.data(), value.size()),
+                            std::invalid_argument);
+            CHECK_THROWS_AS(cache.get(key, size), std::invalid_argument);
+            CHECK_THROWS_AS(cache.del(key), std::invalid_argument);
+            CHECK_THROWS_AS(cache.get_async(key), std::invalid_argument);
+            CHECK_THROWS_AS(cache.mget({"other", key}, sizes),
+                            std::invalid_argument);
+            CHECK_THROWS_AS(cache.mdel({key}), std::invalid_argument);
+        }
+        // HTTP sends batch SETs in the same format
+        CHECK_THROWS_AS(cache.mset({{key, value.data(), 5}}),
+                        std::invalid_argument);
+
+        // Nothing was sent, so the connection is still in sync
+        cache.set("other", value.data(), value.size());
+        Cache::size_type size = 0;
+        const auto result = cache.get("other", size);
+        REQUIRE_NE(result, nullptr);
+        CHECK_EQ(std::string{result, size}, value);
+    });
+}
+
+TEST_CASE_TEMPLATE("Cache::server_stats() counts the server's requests",
+                   Protocol, PROTOCOLS) {
+    run_with_server(ENTRIES_SIZE, [&] {
+        auto cache = make_client<Protocol>();
+        const auto &[key, value] = FIRST_ENTRY;
+        cache.set(key, value.c_str(), value.length() + 1);
+        Cache::size_type size;
+        REQUIRE_NE(cache.get(key, size), nullptr);
+        REQUIRE_EQ(cache.get("missing", size), nullptr);
+        std::vector<Cache::size_type> sizes;
+        cache.mget({key, "missing"}, sizes);
+        REQUIRE(cache.del(key));
+
+        // Assert that every request and key read was counted
+        const auto stats = cache.server_stats();
+        const auto has = [&](const std::string &member) {
+            return stats.find(member) != std::string::npos;
+        };
+        CHECK(has(R"("connections":{"active":1,"opened":1})"));
+        CHECK(has(R"("get_hits":2,"get_misses":2,"evictions":0)"));
+        CHECK(has(R"("get":{"count":2,)"));
+        CHECK(has(R"("set":{"count":1,)"));
+        CHECK(has(R"("del":{"count":1,)"));
+        CHECK(has(R"("mget":{"count":1,)"));
+        CHECK(has(R"("shards":[{"evictions":0,"lock_waits":0,)"));
+        CHECK(!has(R"("bytes":{"in":0,)"));
+    });
+}
+
+TEST_CASE_TEMPLATE("Cache::set() with a TTL expires the entry", Protocol,
+                   PROTOCOLS) {
+    using namespace std::chrono_literals;
+    run_with_server(ENTRIES_SIZE, [&] {
+        auto cache = make_client<Protocol>();
+        Cache::size_type size;
+
+        const auto &[key, value] = FIRST_ENTRY;
+        cache.set(key, value.c_str(), value.length() + 1, 10ms);
+        cache.set(LAST_ENTRY.first, value.c_str(), value.length() + 1, 1h);
+        std::this_thread::sleep_for(30ms);
+        CHECK_EQ(cache.get(key, size), nullptr);
+        CHECK_NE(cache.get(LAST_ENTRY.first, size), nullptr);
+
+        // Assert that the server removes the expired entry in the background
+        for (auto attempt = 0; cache.space_used() != value.length() + 1;
+             ++attempt) {
+            REQUIRE_LT(attempt, 100);
+            std::this_thread::sleep_for(10ms);
+        }
+    });
+}
+
+TEST_CASE_TEMPLATE("Cache works with a thread-per-core server", Protocol,
+                   PROTOCOLS) {
+    constexpr auto NUM_KEYS = 200;
+    run_with_server(
+        NUM_KEYS * 64,
+        [&] {
+            auto cache = make_client<Protocol>();
+
+            // Set keys owned by every thread, one at a time and in batches
+            std::vector<Cache::KeyValue> entries;
+            std::vector<key_type> keys;
+            Cache::size_type expected = 0;
+            for (auto i = 0; i < NUM_KEYS; ++i) {
+                keys.push_back("key" + std::to_string(i));
+            }
+            for (auto i = 0; i < NUM_KEYS; ++i) {
+                const auto &key = keys[i];
+                if (i % 2 == 0) {
+                    cache.set(key, key.c_str(), key.length() + 1);
+                } else {
+                    entries.push_back(
+                        {key, key.c_str(),
+                         static_cast<Cache::size_type>(key.length() + 1)});
+                }
+                expected += key.length() + 1;
+            }
+            cache.mset(entries);
+            REQUIRE_EQ(cache.space_used(), expected);
+
+            // Assert that every key reads back, one at a time and in a batch
+            Cache::size_type size;
+            for (const auto &key : keys) {
+                const auto value = cache.get(key, size);
+                REQUIRE_NE(value, nullptr);
+                CHECK_EQ(std::string{value}, key);
+            }
+            std::vector<Cache::size_type> sizes;
+            const auto values = cache.mget(keys, sizes);
+            for (auto i = 0; i < NUM_KEYS; ++i) {
+                REQUIRE_NE(values[i], nullptr);
+                CHECK_EQ(std::string{values[i]}, keys[i]);
+            }
+
+            // Assert that deletes and resets reach every thread's shard
+            CHECK(cache.del(keys.front()));
+            CHECK(!cache.del(keys.front()));
+            CHECK_EQ(cache.mdel(keys), NUM_KEYS - 1);
+            cache.set(keys.front(), "x", 2);
+            cache.reset();
+            CHECK_EQ(cache.space_used(), 0);
+        },
+        {"--thread-per-core", "--threads", "4"});
+}
+
+TEST_CASE("Cache works with an io_uring server") {
+    constexpr auto NUM_REQUESTS = 1000;
+    // Larger than a receive buffer, so it arrives in many parts
+    const std::string large(1 << 20, 'x');
+    run_with_server(
+        4 << 20,
+        [&] {
+            // Use more connections than event loops
+            auto cache = make_client<BinaryProtocol>();
+            auto second = make_client<BinaryProtocol>();
+            auto third = make_client<BinaryProtocol>();
+            Cache *const clients[] = {&cache, &second, &third};
+
+            // Assert that pipelined requests on every connection complete
+            const auto &[key, value] = FIRST_ENTRY;
+            cache.set(key, value.c_str(), value.length() + 1);
+            std::vector<std::future<std::optional<std::string>>> gets;
+            for (auto i = 0; i < NUM_REQUESTS; ++i) {
+                gets.push_back(clients[i % 3]->get_async(key));
+            }
+            for (auto &get : gets) {
+                REQUIRE_EQ(get.get(), with_terminator(value));
+            }
+
+            // Assert that a value split over many reads and writes round
+            // trips, along with batches and deletes
+            cache.set("large", large.data(), large.size());
+            Cache::size_type size;
+            const auto result = third.get("large", size);
+            REQUIRE_NE(result, nullptr);
+            CHECK_EQ(std::string{result, size}, large);
+            std::vector<Cache::size_type> sizes;
+            const auto values = cache.mget({key, "large", "missing"}, sizes);
+            CHECK_EQ(std::string{values[0], sizes[0]}, with_terminator(value));
+            CHECK_EQ(sizes[1], large.size());
+            CHECK_EQ(values[2], nullptr);
+            CHECK_EQ(cache.mdel({key, "large"}), 2);
+            CHECK_EQ(cache.space_used(), 0);
+        },
+        {"--io-uring", "--threads", "2"});
+}
+
+TEST_CASE("Cache contents survive a restart from a snapshot") {
+    using namespace std::chrono_literals;
+    constexpr auto PATH = "test_cache_client.snapshot";
+    std::remove(PATH);
+    // Save a snapshot every second, and wait for one that has every entry
+    run_with_server(
+        ENTRIES_SIZE,
+        [&] {
+            auto cache = make_client<HttpProtocol>();
+            for (auto &entry : ENTRIES) {
+                cache.set(entry.first, entry.second.c_str(),
+                          entry.second.length() + 1);
+            }
+            for (auto attempt = 0; !std::ifstream{PATH}; ++attempt) {
+                REQUIRE_LT(attempt, 300);
+                std::this_thread::sleep_for(10ms);
+            }
+        },
+        {"--snapshot", PATH, "--snapshot-interval", "1"});
+
+    // Assert that a new server starts with every entry
+    run_with_server(
+        ENTRIES_SIZE,
+        [&] {
+            auto cache = make_client<BinaryProtocol>();
+            REQUIRE_EQ(cache.space_used(), ENTRIES_SIZE);
+            for (auto &entry : ENTRIES) {
+                CHECK_EQ(cache.get_async(entry.first).get(),
+                         with_terminator(entry.second));
+            }
+        },
+        {"--load", PATH});
+    std::remove(PATH);
+}
+
+TEST_CASE_TEMPLATE("Cache cluster spreads keys over the servers", Protocol,
+                   PROTOCOLS) {
+    constexpr auto NUM_SERVERS = 3U;
+    constexpr auto NUM_KEYS = 300U;
+    constexpr auto VALUE = "value";
+    constexpr auto VALUE_SIZE = 6U;
+    run_with_servers(
+        NUM_SERVERS, NUM_KEYS * VALUE_SIZE,
+        [&](std::vector<boost::process::child> &) {
+            Cache cluster{cluster_servers<Protocol>(NUM_SERVERS),
+                          Protocol::PROTOCOL};
+            std::vector<key_type> keys;
+            std::vector<Cache::KeyValue> entries;
+            for (auto i = 0U; i < NUM_KEYS; ++i) {
+                keys.push_back("key" + std::to_string(i));
+            }
+            for (auto i = 0U; i < NUM_KEYS / 2; ++i) {
+                cluster.set(keys[i], VALUE, VALUE_SIZE);
+            }
+            for (auto i = NUM_KEYS / 2; i < NUM_KEYS; ++i) {
+                entries.push_back({keys[i], VALUE, VALUE_SIZE});
+            }
+            cluster.mset(entries);
+            REQUIRE_EQ(cluster.space_used(), NUM_KEYS * VALUE_SIZE);
+
+            // Assert that every server has some of the keys, and only one
+            // server has each key
+            std::vector<Cache::size_type> counts;
+            Cache::size_type total = 0;
+            for (const auto &server : cluster_servers<Protocol>(NUM_SERVERS)) {
+                Cache cache{server.host, server.port, Protocol::PROTOCOL};
+                std::vector<Cache::size_type> sizes;
+                const auto values = cache.mget(keys, sizes);
+                const auto count = static_cast<Cache::size_type>(
+                    std::count_if(values.begin(), values.end(),
+                                  [](auto value) { return value != nullptr; }));
+                CHECK_GT(count, NUM_KEYS / NUM_SERVERS / 2);
+                CHECK_EQ(cache.space_used(), count * VALUE_SIZE);
+                total += count;
+            }
+            CHECK_EQ(total, NUM_KEYS);
+
+            // Assert that the cluster finds every key, one at a time, in a
+            // batch and pipelined
+            Cache::size_type size = 0;
+            for (const auto &key : keys) {
+                REQUIRE_NE(cluster.get(key, size), nullptr);
+                CHECK_EQ(size, VALUE_SIZE);
+            }
+            std::vector<Cache::size_type> sizes;
+            const auto values = cluster.mget(keys, sizes);
+            CHECK(std::all_of(values.begin(), values.end(),
+                              [](auto value) { return value != nullptr; }));
+            std::vector<std::future<std::optional<std::string>>> gets;
+            for (const auto &key : keys) {
+                gets.push_back(cluster.get_async(key));
+            }
+            for (auto &get : gets) {
+                CHECK_EQ(get.get(), with_terminator(VALUE));
+            }
+
+            // Assert that deletes reach every server
+            CHECK(cluster.del(keys.front()));
+            CHECK_EQ(cluster.mdel(keys), NUM_KEYS - 1);
+            CHECK_EQ(cluster.space_used(), 0);
+        });
+}
+
+TEST_CASE_TEMPLATE("Cache cluster reads from another replica when a server "
+                   "is down",
+                   Protocol, PROTOCOLS) {
+    constexpr auto NUM_SERVERS = 3U;
+    constexpr auto NUM_KEYS = 100U;
+    constexpr auto VALUE = "value";
+    constexpr auto VALUE_SIZE = 6U;
+    run_with_servers(
+        NUM_SERVERS, NUM_KEYS * VALUE_SIZE,
+        [&](std::vector<boost::process::child> &servers) {
+            Cache cluster{cluster_servers<Protocol>(NUM_SERVERS),
+                          Protocol::PROTOCOL, 2};
+            std::vector<key_type> keys;
+            for (auto i = 0U; i < NUM_KEYS; ++i) {
+                keys.push_back("key" + std::to_string(i));
+                cluster.set(keys.back(), VALUE, VALUE_SIZE);
+            }
+            // Every key is stored twice
+            REQUIRE_EQ(cluster.space_used(), 2 * NUM_KEYS * VALUE_SIZE);
+
+            // Stop a server and assert that every key can still be read, one
+            // at a time, pipelined and in a batch
+            servers.front().terminate();
+            servers.front().wait();
+            Cache::size_type size = 0;
+            for (const auto &key : keys) {
+                REQUIRE_NE(cluster.get(key, size), nullptr);
+            }
+            std::vector<std::future<std::optional<std::string>>> gets;
+            for (const auto &key : keys) {
+                gets.push_back(cluster.get_async(key));
+            }
+            for (auto &get : gets) {
+                CHECK_EQ(get.get(), with_terminator(VALUE));
+            }
+            std::vector<Cache::size_type> sizes;
+            const auto values = cluster.mget(keys, sizes);
+            CHECK(std::all_of(values.begin(), values.end(),
+                              [](auto value) { return value != nullptr; }));
+
+            // Assert that writes still reach the remaining replicas
+            const std::string other = "other";
+            cluster.set(keys.front(), other.c_str(), other.length() + 1);
+            REQUIRE_NE(cluster.get(keys.front(), size), nullptr);
+            CHECK_EQ(size, other.length() + 1);
+            CHECK_EQ(cluster.mdel(keys), NUM_KEYS);
+            CHECK_EQ(cluster.space_used(), 0);
+        });
+}
+
+/// Returns a thread-safe client sharing `max_clients` clients using the given
+/// protocol
+template <typename Protocol> Cache make_pool(unsigned max_clients) {
+    return Cache{[] {
+                     return std::make_unique<Cache>(
+                         SERVER_ADDRESS, Protocol::PORT, Protocol::PROTOCOL);
+                 },
+                 max_clients};
+}
+
+TEST_CASE_TEMPLATE("Pooled Cache can be shared between threads", Protocol,
+                   PROTOCOLS) {
+    constexpr auto NUM_THREADS = 8U;
+    constexpr auto NUM_KEYS = 100U;
+    run_with_server(1 << 20, [&] {
+        auto cache = make_pool<Protocol>(2);
+        std::atomic<unsigned> num_read{0};
+        std::vector<int> passed(NUM_THREADS);
+        std::vector<std::thread> threads;
+        for (auto t = 0U; t < NUM_THREADS; ++t) {
+            threads.emplace_back([&, t] {
+                const auto key_of = [t](unsigned i) {
+                    return std::to_string(t) + "_" + std::to_string(i);
+                };
+                const auto value_of = [t](unsigned i) {
+                    return std::to_string(t) + "/" + std::to_string(i);
+                };
+                auto ok = true;
+                // Read a value, and assert that it is intact once every
+                // other thread has read one too
+                cache.set(key_of(0), value_of(0).c_str(),
+                          value_of(0).length() + 1);
+                Cache::size_type size = 0;
+                const auto first = cache.get(key_of(0), size);
+                ++num_read;
+                while (num_read < NUM_THREADS) {
+                    std::this_thread::yield();
+                }
+                ok = ok && first != nullptr &&
+                     std::string{first} == value_of(0);
+
+                // Mix synchronous and pipelined requests
+                std::vector<std::future<std::optional<std::string>>> gets;
+                for (auto i = 1U; i < NUM_KEYS; ++i) {
+                    const auto value = value_of(i);
+                    cache.set(key_of(i), value.c_str(), value.length() + 1);
+                    const auto got = cache.get(key_of(i), size);
+                    ok = ok && got != nullptr && std::string{got} == value;
+                    gets.push_back(cache.get_async(key_of(i)));
+                }
+                for (auto i = 1U; i < NUM_KEYS; ++i) {
+                    ok = ok &&
+                         gets[i - 1].get() == with_terminator(value_of(i));
+                }
+                passed[t] = ok;
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        for (auto t = 0U; t < NUM_THREADS; ++t) {
+            CHECK(passed[t]);
+        }
+        CHECK_GT(cache.space_used(), 0);
+    });
+}
+
+TEST_CASE_TEMPLATE("Pooled Cache replaces a client whose connection failed",
+                   Protocol, PROTOCOLS) {
+    run_with_servers(
+        1, ENTRIES_SIZE, [&](std::vector<boost::process::child> &servers) {
+            auto cache = make_pool<Protocol>(1);
+            cache.set(FIRST_ENTRY.first, FIRST_ENTRY.second.c_str(),
+                      FIRST_ENTRY.second.length() + 1);
+            servers.front().terminate();
+            servers.front().wait();
+            Cache::size_type size = 0;
+            REQUIRE_THROWS(cache.get(FIRST_ENTRY.first, size));
+
+            // Once a server is running again, a new client connects to it
+            run_with_server(ENTRIES_SIZE, [&] {
+                REQUIRE_EQ(cache.get(FIRST_ENTRY.first, size), nullptr);
+                cache.set(FIRST_ENTRY.first, FIRST_ENTRY.second.c_str(),
+                          FIRST_ENTRY.second.length() + 1);
+                REQUIRE_NE(cache.get(FIRST_ENTRY.first, size), nullptr);
+                CHECK_EQ(size, FIRST_ENTRY.second.length() + 1);
+            });
+        });
+}
+
+TEST_CASE_TEMPLATE("Pooled Cache gives the slot of a thread that exited to "
+                   "the next thread",
+                   Protocol, PROTOCOLS) {
+    using namespace std::chrono_literals;
+    run_with_server(ENTRIES_SIZE, [&] {
+        // Each client has a near cache, so a read tells which client served
+        // it
+        Cache cache{[] {
+                        return std::make_unique<Cache>(
+                            std::make_unique<Cache>(SERVER_ADDRESS,
+                                                    Protocol::PORT,
+                                                    Protocol::PROTOCOL),
+                            ENTRIES_SIZE, 1h);
+                    },
+                    2};
+        auto other = make_client<Protocol>();
+        other.set(FIRST_ENTRY.first, FIRST_ENTRY.second.c_str(),
+                  FIRST_ENTRY.second.length() + 1);
+        other.set(LAST_ENTRY.first, LAST_ENTRY.second.c_str(),
+                  LAST_ENTRY.second.length() + 1);
+
+        // A thread that stays alive reads a key through the first client,
+        // and one that exits reads through the second (it is joined last, so
+        // that the next thread does not reuse its id)
+        struct Exited {
+            std::atomic<bool> &exited;
+            ~Exited() { exited = true; }
+        };
+        std::atomic<bool> read{false};
+        std::atomic<bool> done{false};
+        std::atomic<bool> exited{false};
+        std::thread stays{[&] {
+            Cache::size_type size = 0;
+            cache.get(FIRST_ENTRY.first, size);
+            read = true;
+            while (!done) {
+                std::this_thread::yield();
+            }
+        }};
+        while (!read) {
+            std::this_thread::yield();
+        }
+        std::thread exits{[&] {
+            // Destroyed after the pool's own thread-local state
+            thread_local Exited on_exit{exited};
+            Cache::size_type size = 0;
+            cache.get(LAST_ENTRY.first, size);
+        }};
+        while (!exited) {
+            std::this_thread::yield();
+        }
+
+        // The next thread gets the second client, which has not read the
+        // first key
+        std::thread{[&] {
+            Cache::size_type size = 0;
+            cache.get(FIRST_ENTRY.first, size);
+        }}.join();
+        done = true;
+        stays.join();
+        exits.join();
+        CHECK_EQ(cache.near_cache_stats().hits, 0);
+        CHECK_EQ(cache.near_cache_stats().misses, 3);
+    });
+}
+
+/// Returns a client using the given protocol with a near cache
+template <typename Protocol>
+Cache make_near_client(Cache::size_type maxmem, Cache::ttl_type ttl) {
+    return Cache{std::make_unique<Cache>(SERVER_ADDRESS, Protocol::PORT,
+                                         Protocol::PROTOCOL),
+                 maxmem, ttl};
+}
+
+TEST_CASE_TEMPLATE("Cache near cache serves repeated reads locally",
+                   Protocol, PROTOCOLS) {
+    using namespace std::chrono_literals;
+    run_with_server(2 * ENTRIES_SIZE, [&] {
+        auto cache = make_near_client<Protocol>(ENTRIES_SIZE, 1h);
+        auto other = make_client<Protocol>();
+        std::vector<key_type> keys;
+        for (auto &entry : ENTRIES) {
+            cache.set(entry.first, entry.second.c_str(),
+                      entry.second.length() + 1);
+            keys.push_back(entry.first);
+        }
+
+        // The first read of each key goes to the server, and the next ones
+        // are served by the near cache, even after another client changes
+        // the value
+        Cache::size_type size = 0;
+        REQUIRE_NE(cache.get(FIRST_ENTRY.first, size), nullptr);
+        other.set(FIRST_ENTRY.first, "new", 4);
+        const auto value = cache.get(FIRST_ENTRY.first, size);
+        REQUIRE_NE(value, nullptr);
+        CHECK_EQ(std::string{value}, FIRST_ENTRY.second);
+        CHECK_EQ(size, FIRST_ENTRY.second.length() + 1);
+        CHECK_EQ(cache.near_cache_stats().hits, 1);
+        CHECK_EQ(cache.near_cache_stats().misses, 1);
+
+        // Batches and pipelined reads use the near cache too
+        std::vector<Cache::size_type> sizes;
+        const auto values = cache.mget(keys, sizes);
+        CHECK_EQ(std::string{values.front()}, FIRST_ENTRY.second);
+        CHECK_EQ(std::string{values.back()}, LAST_ENTRY.second);
+        CHECK_EQ(cache.get_async(LAST_ENTRY.first).get(),
+                 with_terminator(LAST_ENTRY.second));
+        CHECK_EQ(cache.near_cache_stats().hits, 3);
+        CHECK_EQ(cache.near_cache_stats().misses, keys.size());
+
+        // Writes through the client remove keys from the near cache
+        cache.set(FIRST_ENTRY.first, "newer", 6);
+        CHECK_EQ(std::string{cache.get(FIRST_ENTRY.first, size)}, "newer");
+        CHECK(cache.del(FIRST_ENTRY.first));
+        CHECK_EQ(cache.get(FIRST_ENTRY.first, size), nullptr);
+        CHECK_EQ(cache.mdel(keys), keys.size() - 1);
+        CHECK_EQ(cache.mget(keys, sizes),
+                 std::vector<Cache::val_type>(keys.size(), nullptr));
+        CHECK_EQ(cache.space_used(), 0);
+    });
+}
+
+TEST_CASE_TEMPLATE("Cache near cache values expire after its TTL", Protocol,
+                   PROTOCOLS) {
+    using namespace std::chrono_literals;
+    run_with_server(ENTRIES_SIZE, [&] {
+        auto cache = make_near_client<Protocol>(ENTRIES_SIZE, 30ms);
+        auto other = make_client<Protocol>();
+        other.set(FIRST_ENTRY.first, FIRST_ENTRY.second.c_str(),
+                  FIRST_ENTRY.second.length() + 1);
+        Cache::size_type size = 0;
+        REQUIRE_NE(cache.get(FIRST_ENTRY.first, size), nullptr);
+        other.del(FIRST_ENTRY.first);
+        CHECK_NE(cache.get(FIRST_ENTRY.first, size), nullptr);
+        std::this_thread::sleep_for(40ms);
+        CHECK_EQ(cache.get(FIRST_ENTRY.first, size), nullptr);
+    });
+}
+
+TEST_CASE_TEMPLATE("Cache::get_or_compute() loads a missing key once across "
+                   "threads",
+                   Protocol, PROTOCOLS) {
+    using namespace std::chrono_literals;
+    constexpr auto NUM_THREADS = 8U;
+    run_with_server(ENTRIES_SIZE, [&] {
+        auto cache = make_pool<Protocol>(NUM_THREADS);
+        std::atomic<unsigned> num_loads{0}, num_started{0};
+        const auto load = [&](key_type key) {
+            ++num_loads;
+            // Give every other thread the time to miss the key too
+            while (num_started < NUM_THREADS) {
+                std::this_thread::yield();
+            }
+            std::this_thread::sleep_for(50ms);
+            return std::optional<std::string>{key + "_value"};
+        };
+        std::vector<std::optional<std::string>> values(NUM_THREADS);
+        std::vector<std::thread> threads;
+        for (auto t = 0U; t < NUM_THREADS; ++t) {
+            threads.emplace_back([&, t] {
+                ++num_started;
+                values[t] = cache.get_or_compute("key", load);
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        CHECK_EQ(num_loads, 1);
+        for (const auto &value : values) {
+            CHECK_EQ(value, "key_value");
+        }
+        Cache::size_type size = 0;
+        const auto stored = cache.get("key", size);
+        REQUIRE_NE(stored, nullptr);
+        CHECK_EQ(std::string(stored, size), "key_value");
+    });
+}
+
+TEST_CASE_TEMPLATE("Cache::get_or_compute() only loads on a miss", Protocol,
+                   PROTOCOLS) {
+    run_with_server(ENTRIES_SIZE, [&] {
+        auto cache = make_client<Protocol>();
+        auto num_loads = 0;
+        const auto load = [&](key_type) -> std::optional<std::string> {
+            ++num_loads;
+            return std::nullopt;
+        };
+        // Nothing is set when the loader finds no value
+        CHECK_EQ(cache.get_or_compute(FIRST_ENTRY.first, load), std::nullopt);
+        CHECK_EQ(cache.get_or_compute(FIRST_ENTRY.first, load), std::nullopt);
+        CHECK_EQ(num_loads, 2);
+
+        cache.set(FIRST_ENTRY.first, FIRST_ENTRY.second.c_str(),
+                  FIRST_ENTRY.second.length() + 1);
+        CHECK_EQ(cache.get_or_compute(FIRST_ENTRY.first, load),
+                 with_terminator(FIRST_ENTRY.second));
+        CHECK_EQ(num_loads, 2);
+    });
+}
+
+TEST_CASE_TEMPLATE("Cache::get_or_compute() throws the loader's exception",
+                   Protocol, PROTOCOLS) {
+    run_with_server(ENTRIES_SIZE, [&] {
+        auto cache = make_client<Protocol>();
+        CHECK_THROWS_AS(cache.get_or_compute(
+                            "key",
+                            [](key_type) -> std::optional<std::string> {
+                                throw std::runtime_error{"down"};
+                            }),
+                        std::runtime_error);
+        Cache::size_type size = 0;
+        CHECK_EQ(cache.get("key", size), nullptr);
+    });
+}
+
+TEST_CASE_TEMPLATE("Cache::get_or_compute() reloads stale values in the "
+                   "background",
+                   Protocol, PROTOCOLS) {
+    using namespace std::chrono_literals;
+    run_with_server(ENTRIES_SIZE, [&] {
+        auto cache = make_pool<Protocol>(2);
+        std::atomic<unsigned> version{0};
+        const auto load = [&](key_type) {
+            return std::optional<std::string>{std::to_string(++version)};
+        };
+        const auto get = [&] {
+            return cache.get_or_compute("key", load, Cache::ttl_type::zero(),
+                                        30ms);
+        };
+        CHECK_EQ(get(), "1");
+        // Still fresh
+        CHECK_EQ(get(), "1");
+        CHECK_EQ(version, 1);
+
+        // Stale: the old value is returned, and only one reload starts
+        std::this_thread::sleep_for(40ms);
+        CHECK_EQ(get(), "1");
+        get();
+        auto refreshed = false;
+        for (auto i = 0; i < 100 && !refreshed; ++i) {
+            std::this_thread::sleep_for(5ms);
+            Cache::size_type size = 0;
+            const auto stored = cache.get("key", size);
+            refreshed = stored != nullptr && std::string(stored, size) == "2";
+        }
+        CHECK(refreshed);
+        CHECK_EQ(version, 2);
+    });
+}
+
+TEST_CASE_TEMPLATE("Cache::get_or_compute() only reloads in the background "
+                   "through a thread-safe client",
+                   Protocol, PROTOCOLS) {
+    using namespace std::chrono_literals;
+    run_with_server(ENTRIES_SIZE, [&] {
+        const auto load = [](key_type) {
+            return std::optional<std::string>{"value"};
+        };
+        auto plain = make_client<Protocol>();
+        CHECK_THROWS_AS(plain.get_or_compute("key", load,
+                                             Cache::ttl_type::zero(), 30ms),
+                        std::invalid_argument);
+        auto near = make_near_client<Protocol>(ENTRIES_SIZE, 1h);
+        CHECK_THROWS_AS(near.get_or_compute("key", load,
+                                            Cache::ttl_type::zero(), 30ms),
+                        std::invalid_argument);
+        // Nothing was loaded, and loading without reloads still works
+        CHECK_EQ(plain.get_or_compute("key", load), "value");
+
+        Cache pooled_near{std::make_unique<Cache>(
+                              [] {
+                                  return std::make_unique<Cache>(
+                                      SERVER_ADDRESS, Protocol::PORT,
+                                      Protocol::PROTOCOL);
+                              },
+                              2),
+                          ENTRIES_SIZE, 1h};
+        CHECK_EQ(pooled_near.get_or_compute("other", load,
+                                            Cache::ttl_type::zero(), 30ms),
+                 "value");
+    });
+}
+
+TEST_CASE_TEMPLATE("Cache::get_or_compute() forgets keys with no hits for "
+                   "a refresh window",
+                   Protocol, PROTOCOLS) {
+    using namespace std::chrono_literals;
+    constexpr auto NUM_KEYS = 300U;
+    run_with_server(1 << 20, [&] {
+        auto cache = make_pool<Protocol>(2);
+        std::atomic<unsigned> loads{0};
+        const auto load = [&](const key_type &key) {
+            if (key == "old") {
+                ++loads;
+            }
+            return std::optional<std::string>{key};
+        };
+        const auto get = [&](const key_type &key) {
+            return cache.get_or_compute(key, load, Cache::ttl_type::zero(),
+                                        100ms);
+        };
+        CHECK_EQ(get("old"), "old");
+
+        // Loading many other keys once "old" has had no hits for a window
+        // drops it, so a later hit does not reload it
+        std::this_thread::sleep_for(150ms);
+        for (auto i = 0U; i < NUM_KEYS; ++i) {
+            get(std::to_string(i));
+        }
+        CHECK_EQ(get("old"), "old");
+        std::this_thread::sleep_for(50ms);
+        CHECK_EQ(loads, 1);
+    });
+}
@@ -0,0 +1,387 @@
+#include "cache.hh"
+#include "cache_index.hh"
+#include "intrusive_lru_evictor.hh"
+#include "test_common.hh"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Index types under test
+using chained_index = ChainedIndex<int, std::hash<key_type>>;
+using flat_index = FlatIndex<int, StringHasher>;
+
+/// Number of keys to use for tests that fill an index
+constexpr auto NUM_KEYS = 10000;
+
+/// Make a key that is too long to be stored inline
+std::string long_key(int i) {
+    return std::string(40, 'k') + std::to_string(i);
+}
+
+////////////////////////////////////////////////
+// Index Unit Tests
+////////////////////////////////////////////////
+
+TEST_CASE_TEMPLATE("Index::find() on empty index returns nullptr", Index,
+                   chained_index, flat_index) {
+    Index index{0.75f, {}};
+    for (auto &entry : ENTRIES) {
+        REQUIRE_EQ(index.find(entry.first), nullptr);
+    }
+}
+
+TEST_CASE_TEMPLATE("Index::emplace() adds or returns existing entries", Index,
+                   chained_index, flat_index) {
+    Index index{0.75f, {}};
+
+    // Add many entries so that the index has to grow
+    for (auto i = 0; i < NUM_KEYS; ++i) {
+        index.emplace(std::to_string(i)) = i;
+        index.emplace(long_key(i)) = -i;
+    }
+    REQUIRE_EQ(index.size(), 2 * NUM_KEYS);
+
+    // Assert that every entry can be found
+    for (auto i = 0; i < NUM_KEYS; ++i) {
+        auto value = index.find(std::to_string(i));
+        REQUIRE_NE(value, nullptr);
+        CHECK_EQ(*value, i);
+        value = index.find(long_key(i));
+        REQUIRE_NE(value, nullptr);
+        CHECK_EQ(*value, -i);
+    }
+
+    // Assert that `emplace()` returns existing entries
+    REQUIRE_EQ(index.emplace("1"), 1);
+    REQUIRE_EQ(index.size(), 2 * NUM_KEYS);
+}
+
+TEST_CASE_TEMPLATE("Index::take() removes entries", Index, chained_index,
+                   flat_index) {
+    Index index{0.75f, {}};
+    for (auto i = 0; i < NUM_KEYS; ++i) {
+        index.emplace(std::to_string(i)) = i;
+    }
+
+    // Remove the even keys
+    for (auto i = 0; i < NUM_KEYS; i += 2) {
+        const auto value = index.take(std::to_string(i));
+        REQUIRE(value);
+        CHECK_EQ(*value, i);
+        CHECK(!index.take(std::to_string(i)));
+    }
+    REQUIRE_EQ(index.size(), NUM_KEYS / 2);
+
+    // Assert that only the odd keys are left
+    for (auto i = 0; i < NUM_KEYS; ++i) {
+        CHECK_EQ(index.find(std::to_string(i)) != nullptr, i % 2 == 1);
+    }
+}
+
+TEST_CASE_TEMPLATE("Index handles repeated insertion and removal", Index,
+                   chained_index, flat_index) {
+    Index index{0.75f, {}};
+
+    // Keep a sliding window of keys so that removed slots must be reused
+    constexpr auto WINDOW = 100;
+    for (auto i = 0; i < NUM_KEYS; ++i) {
+        index.emplace(std::to_string(i)) = i;
+        if (i >= WINDOW) {
+            REQUIRE(index.take(std::to_string(i - WINDOW)));
+        }
+    }
+    REQUIRE_EQ(index.size(), WINDOW);
+    for (auto i = NUM_KEYS - WINDOW; i < NUM_KEYS; ++i) {
+        CHECK_NE(index.find(std::to_string(i)), nullptr);
+    }
+}
+
+TEST_CASE_TEMPLATE("Index::clear() removes all entries", Index, chained_index,
+                   flat_index) {
+    Index index{0.75f, {}};
+    for (auto i = 0; i < NUM_KEYS; ++i) {
+        index.emplace(long_key(i));
+    }
+    index.clear();
+    REQUIRE_EQ(index.size(), 0);
+    for (auto i = 0; i < NUM_KEYS; ++i) {
+        CHECK_EQ(index.find(long_key(i)), nullptr);
+    }
+}
+
+TEST_CASE_TEMPLATE("Index::for_each() visits every entry once", Index,
+                   chained_index, flat_index) {
+    Index index{0.75f, {}};
+    for (auto i = 0; i < NUM_KEYS; ++i) {
+        index.emplace(long_key(i)) = i;
+    }
+    // Remove every other key so that the flat index has deleted slots
+    for (auto i = 0; i < NUM_KEYS; i += 2) {
+        index.take(long_key(i));
+    }
+    std::vector<int> seen(NUM_KEYS);
+    index.for_each([&](int &value) { ++seen[value]; });
+    for (auto i = 0; i < NUM_KEYS; ++i) {
+        CHECK_EQ(seen[i], i % 2);
+    }
+}
+
+TEST_CASE_TEMPLATE("Index finds every entry while it grows", Index,
+                   chained_index, flat_index) {
+    Index index{0.75f, {}};
+    auto rehashed = false;
+    for (auto i = 0; i < NUM_KEYS; ++i) {
+        index.emplace(std::to_string(i)) = i;
+        if (!index.rehashing()) {
+            continue;
+        }
+        // Check the entries and remove some while they are split between
+        // the old table and the new one
+        rehashed = true;
+        if (i % 3 == 0) {
+            REQUIRE(index.take(std::to_string(i / 3)));
+        }
+        if (i % 1000 == 0) {
+            auto num_seen = 0U;
+            index.for_each([&](int &) { ++num_seen; });
+            REQUIRE_EQ(num_seen, index.size());
+        }
+    }
+    CHECK(rehashed);
+    for (auto i = 0; i < NUM_KEYS; ++i) {
+        const auto value = index.find(std::to_string(i));
+        if (value != nullptr) {
+            CHECK_EQ(*value, i);
+        }
+    }
+    // The entries left are exactly the ones that were not removed
+    std::vector<int> seen(NUM_KEYS);
+    index.for_each([&](int &value) { ++seen[value]; });
+    auto num_left = 0U;
+    for (auto i = 0; i < NUM_KEYS; ++i) {
+        num_left += seen[i];
+        CHECK_LE(seen[i], 1);
+    }
+    CHECK_EQ(num_left, index.size());
+}
+
+TEST_CASE_TEMPLATE("Index can be moved while it grows", Index, chained_index,
+                   flat_index) {
+    Index index{0.75f, {}};
+    auto i = 0;
+    do {
+        index.emplace(std::to_string(i)) = i;
+        ++i;
+    } while (!index.rehashing() || i < 100);
+    const auto num_keys = i;
+
+    Index moved{std::move(index)};
+    REQUIRE_EQ(moved.size(), num_keys);
+    REQUIRE_EQ(index.size(), 0);
+    for (i = 0; i < num_keys; ++i) {
+        CHECK_EQ(index.find(std::to_string(i)), nullptr);
+        const auto value = moved.find(std::to_string(i));
+        REQUIRE_NE(value, nullptr);
+        CHECK_EQ(*value, i);
+    }
+    // Both indexes are still usable
+    index.emplace("key") = 1;
+    CHECK_EQ(*index.find("key"), 1);
+    moved.emplace("key") = 2;
+    CHECK_EQ(*moved.find("key"), 2);
+}
+
+TEST_CASE("FlatIndex with a load factor below 1/16 has room in its first "
+          "table") {
+    // A single group has no room at this load factor, so the first table
+    // must be larger (one with no room used to make inserts spin forever
+    // once it filled up)
+    flat_index index{0.01f, {}};
+    for (auto i = 0; i < 2 * 16; ++i) {
+        index.emplace(std::to_string(i)) = i;
+        REQUIRE_EQ(index.size(), i + 1);
+    }
+    for (auto i = 0; i < 2 * 16; ++i) {
+        const auto value = index.find(std::to_string(i));
+        REQUIRE_NE(value, nullptr);
+        CHECK_EQ(*value, i);
+    }
+
+    // The same goes for a cache using the index
+    Cache cache{ENTRIES_SIZE, 0.01f, nullptr, std::hash<key_type>(),
+                Cache::IndexType::FLAT};
+    for (auto &entry : ENTRIES) {
+        cache.set(entry.first, entry.second.c_str(), entry.second.length() + 1);
+    }
+    for (auto &entry : ENTRIES) {
+        Cache::size_type size = 0;
+        REQUIRE_NE(cache.get(entry.first, size), nullptr);
+    }
+}
+
+TEST_CASE("FlatIndex grows with a very small load factor") {
+    // The new table fills up before the old one has been moved into it
+    flat_index index{0.01f, {}};
+    for (auto i = 0; i < NUM_KEYS; ++i) {
+        index.emplace(std::to_string(i)) = i;
+    }
+    REQUIRE_EQ(index.size(), NUM_KEYS);
+    for (auto i = 0; i < NUM_KEYS; ++i) {
+        const auto value = index.find(std::to_string(i));
+        REQUIRE_NE(value, nullptr);
+        CHECK_EQ(*value, i);
+    }
+}
+
+/// Gets the key of a value of a flat index that reads keys from values
+struct DerefKey {
+    std::string_view operator()(const std::string *value) const {
+        return *value;
+    }
+};
+
+TEST_CASE("FlatIndex with a KeyOf reads keys from its values") {
+    FlatIndex<const std::string *, StringHasher, DerefKey> index{0.75f, {}};
+    std::vector<std::unique_ptr<std::string>> keys;
+    for (auto i = 0; i < NUM_KEYS; ++i) {
+        keys.push_back(std::make_unique<std::string>(long_key(i)));
+        index.emplace(*keys.back(), keys.back().get());
+    }
+    REQUIRE_EQ(index.size(), NUM_KEYS);
+    // Every key is still found after the table has been rehashed
+    for (auto i = 0; i < NUM_KEYS; ++i) {
+        const auto value = index.find(long_key(i));
+        REQUIRE_NE(value, nullptr);
+        REQUIRE_EQ(*value, keys[i].get());
+    }
+    for (auto i = 0; i < NUM_KEYS; i += 2) {
+        REQUIRE_EQ(index.take(long_key(i)), keys[i].get());
+    }
+    for (auto i = 0; i < NUM_KEYS; ++i) {
+        CHECK_EQ(index.find(long_key(i)) != nullptr, i % 2 == 1);
+    }
+}
+
+////////////////////////////////////////////////
+// Cache Unit Tests (flat index)
+////////////////////////////////////////////////
+
+TEST_CASE("Cache with a flat index stores and deletes entries") {
+    Cache cache{ENTRIES_SIZE, 0.75f, nullptr, std::hash<key_type>(),
+                Cache::IndexType::FLAT};
+
+    for (auto &entry : ENTRIES) {
+        cache.set(entry.first, entry.second.c_str(), entry.second.length() + 1);
+    }
+    REQUIRE_EQ(cache.space_used(), ENTRIES_SIZE);
+    for (auto &entry : ENTRIES) {
+        Cache::size_type size = 0;
+        auto value = cache.get(entry.first, size);
+        REQUIRE_NE(value, nullptr);
+        CHECK_EQ(entry.second, std::string(value));
+        CHECK_EQ(entry.second.length() + 1, size);
+    }
+    for (auto &entry : ENTRIES) {
+        CHECK(cache.del(entry.first));
+    }
+    REQUIRE_EQ(cache.space_used(), 0);
+}
+
+TEST_CASE("Cache with a flat index uses a custom hash function") {
+    auto calls = 0;
+    Cache cache{ENTRIES_SIZE, 0.75f, nullptr,
+                [&calls](key_type key) {
+                    ++calls;
+                    return std::hash<key_type>{}(key);
+                },
+                Cache::IndexType::FLAT};
+    cache.set(FIRST_ENTRY.first, FIRST_ENTRY.second.c_str(),
+              FIRST_ENTRY.second.length() + 1);
+    Cache::size_type size;
+    REQUIRE_NE(cache.get(FIRST_ENTRY.first, size), nullptr);
+    REQUIRE_GT(calls, 0);
+}
+
+////////////////////////////////////////////////
+// Cache Unit Tests (compact index)
+////////////////////////////////////////////////
+
+/// Memory limit for tests of the compact index, which also counts overhead
+constexpr Cache::size_type COMPACT_MAXMEM = 1 << 12;
+
+TEST_CASE("Cache with a compact index stores and deletes entries") {
+    Cache cache{COMPACT_MAXMEM, 0.75f, nullptr, std::hash<key_type>(),
+                Cache::IndexType::COMPACT};
+
+    for (auto &entry : ENTRIES) {
+        cache.set(entry.first, entry.second.c_str(), entry.second.length() + 1);
+    }
+    // Each entry's header, key and index slot are counted too
+    REQUIRE_GT(cache.space_used(), ENTRIES_SIZE);
+    for (auto &entry : ENTRIES) {
+        Cache::size_type size = 0;
+        auto value = cache.get(entry.first, size);
+        REQUIRE_NE(value, nullptr);
+        CHECK_EQ(entry.second, std::string(value));
+        CHECK_EQ(entry.second.length() + 1, size);
+    }
+    // Replacing a value does not leave its old entry behind
+    const auto space_used = cache.space_used();
+    cache.set(FIRST_ENTRY.first, FIRST_ENTRY.second.c_str(),
+              FIRST_ENTRY.second.length() + 1);
+    REQUIRE_EQ(cache.space_used(), space_used);
+    for (auto &entry : ENTRIES) {
+        CHECK(cache.del(entry.first));
+    }
+    REQUIRE_EQ(cache.space_used(), 0);
+}
+
+TEST_CASE("Cache with a compact index counts each entry's whole chunk") {
+    Cache cache{COMPACT_MAXMEM, 0.75f, nullptr, std::hash<key_type>(),
+                Cache::IndexType::COMPACT};
+    for (auto &entry : ENTRIES) {
+        cache.set(entry.first, entry.second.c_str(), entry.second.length() + 1);
+    }
+    std::size_t chunk_bytes = 0;
+    for (const auto &stats : cache.slab_stats()) {
+        chunk_bytes += std::size_t{stats.chunk_size} * stats.chunks_used;
+    }
+    // Beyond the chunks, every entry is charged the same slot in the index
+    REQUIRE_GT(cache.space_used(), chunk_bytes);
+    CHECK_EQ((cache.space_used() - chunk_bytes) % ENTRIES.size(), 0);
+}
+
+TEST_CASE("Cache with a compact index keeps its overhead within maxmem") {
+    IntrusiveLruEvictor evictor;
+    Cache cache{COMPACT_MAXMEM, 0.75f, &evictor, std::hash<key_type>(),
+                Cache::IndexType::COMPACT};
+    const std::string value(20, 'v');
+    for (auto i = 0; i < NUM_KEYS; ++i) {
+        cache.set(std::to_string(i), value.c_str(), value.length() + 1);
+        REQUIRE_LE(cache.space_used(), COMPACT_MAXMEM);
+    }
+    // Fewer entries fit than if only their values were counted, and the
+    // most recent ones are kept
+    const auto kept = NUM_KEYS - cache.evictions();
+    REQUIRE_LT(kept, COMPACT_MAXMEM / (2 * (value.length() + 1)));
+    Cache::size_type size;
+    CHECK_NE(cache.get(std::to_string(NUM_KEYS - 1), size), nullptr);
+    CHECK_EQ(cache.get("0", size), nullptr);
+}
+
+TEST_CASE("Cache with a compact index uses a custom hash function") {
+    auto calls = 0;
+    Cache cache{COMPACT_MAXMEM, 0.75f, nullptr,
+                [&calls](key_type key) {
+                    ++calls;
+                    return std::hash<key_type>{}(key);
+                },
+                Cache::IndexType::COMPACT};
+    cache.set(FIRST_ENTRY.first, FIRST_ENTRY.second.c_str(),
+              FIRST_ENTRY.second.length() + 1);
+    Cache::size_type size;
+    REQUIRE_NE(cache.get(FIRST_ENTRY.first, size), nullptr);
+    REQUIRE_GT(calls, 0);
+}
@@ -5,6 +5,18 @@
 #include "fifo_evictor.hh"
 #include "test_common.hh"
 
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+/// TTL short enough to pass during a test, and how long to wait for it to
+/// pass
+constexpr auto SHORT_TTL = 10ms;
+constexpr auto WAIT_FOR_TTL = 30ms;
+
 ////////////////////////////////////////////////
 // Cache Unit Tests
 ////////////////////////////////////////////////
@@ -155,6 +167,37 @@ TEST_CASE("Cache::reset() removes all entries") {
     REQUIRE_EQ(cache.space_used(), 0);
 }
 
+TEST_CASE("Cache::reset() of a large cache leaves it empty and usable") {
+    // Enough entries for the index to be freed in the background
+    constexpr auto NUM_KEYS = 20000;
+    const std::string value = "value";
+    for (const auto index :
+         {Cache::IndexType::CHAINED, Cache::IndexType::FLAT,
+          Cache::IndexType::COMPACT}) {
+        Cache cache{NUM_KEYS * 128, 0.75f, nullptr, std::hash<key_type>(),
+                    index};
+        // Reset twice in a row, so that the second waits for the first
+        for (auto round = 0; round < 2; ++round) {
+            for (auto i = 0; i < NUM_KEYS; ++i) {
+                cache.set(std::to_string(i), value.c_str(),
+                          value.length() + 1);
+            }
+            cache.reset();
+            REQUIRE_EQ(cache.space_used(), 0);
+            Cache::size_type size;
+            for (auto i = 0; i < NUM_KEYS; i += 97) {
+                REQUIRE_EQ(cache.get(std::to_string(i), size), nullptr);
+            }
+        }
+        cache.set(FIRST_ENTRY.first, FIRST_ENTRY.second.c_str(),
+                  FIRST_ENTRY.second.length() + 1);
+        Cache::size_type size;
+        const auto got = cache.get(FIRST_ENTRY.first, size);
+        REQUIRE_NE(got, nullptr);
+        CHECK_EQ(std::string{got}, FIRST_ENTRY.second);
+    }
+}
+
 TEST_CASE("Cache::set() succeeds when cache has an evictor and entry can fit") {
     const Cache::size_type MAXMEM =
         ENTRIES_SIZE - (LAST_ENTRY.second.length() + 1);
@@ -170,6 +213,7 @@ TEST_CASE("Cache::set() succeeds when cache has an evictor and entry can fit") {
     }
     // Assert that cache is at capacity
     REQUIRE_EQ(cache.space_used(), MAXMEM);
+    REQUIRE_EQ(cache.evictions(), 0);
 
     // Add the last entry
     cache.set(LAST_ENTRY.first, LAST_ENTRY.second.c_str(),
@@ -179,4 +223,289 @@ TEST_CASE("Cache::set() succeeds when cache has an evictor and entry can fit") {
     REQUIRE_NE(cache.get(LAST_ENTRY.first, size), nullptr);
     // Assert that cache is at or below capacity (eviction occurred)
     REQUIRE_LE(cache.space_used(), MAXMEM);
+    REQUIRE_GE(cache.evictions(), 1);
+    // Evictions are still counted after a reset
+    const auto evictions = cache.evictions();
+    cache.reset();
+    REQUIRE_EQ(cache.evictions(), evictions);
+}
+
+TEST_CASE("Cache::set() reuses memory when replacing values") {
+    Cache cache{ENTRIES_SIZE};
+
+    // Replace the value of the same key many times
+    for (auto i = 0; i < 1000; ++i) {
+        for (auto &entry : ENTRIES) {
+            cache.set(FIRST_ENTRY.first, entry.second.c_str(),
+                      entry.second.length() + 1);
+        }
+    }
+    // Assert that the values did not use more memory than a single page
+    const auto reserved = cache.space_reserved();
+    REQUIRE_GT(reserved, 0);
+    for (auto &entry : ENTRIES) {
+        cache.set(FIRST_ENTRY.first, entry.second.c_str(),
+                  entry.second.length() + 1);
+    }
+    REQUIRE_EQ(cache.space_reserved(), reserved);
+
+    // Assert that the slab statistics account for the value
+    Cache::size_type chunks_used = 0;
+    for (const auto &stats : cache.slab_stats()) {
+        chunks_used += stats.chunks_used;
+    }
+    REQUIRE_EQ(chunks_used, 1);
+}
+
+TEST_CASE("Cache::set() moves a page to a size class that has none free") {
+    constexpr Cache::size_type MAXMEM = 1 << 20;
+    const std::string small(100, 's');
+    const std::string large(20000, 'l');
+
+    // Fill every page with small values
+    FifoEvictor evictor;
+    Cache cache{MAXMEM, 0.75, &evictor};
+    for (auto i = 0; i < 20000; ++i) {
+        cache.set("small" + std::to_string(i), small.data(), small.size());
+    }
+    const auto full = cache.space_used();
+    Cache::size_type chunks_per_page = 0;
+    for (const auto &stats : cache.slab_stats()) {
+        if (stats.num_pages != 0 && stats.chunk_size != 0) {
+            chunks_per_page = (stats.chunks_used + stats.chunks_free) /
+                              stats.num_pages;
+        }
+    }
+    REQUIRE_GT(chunks_per_page, 1);
+
+    // Each large value only evicts the entries on the page it takes, and
+    // the memory they freed is used by the large value
+    for (auto i = 0; i < 10; ++i) {
+        const auto evictions = cache.evictions();
+        const auto key = "large" + std::to_string(i);
+        cache.set(key, large.data(), large.size());
+        Cache::size_type size = 0;
+        REQUIRE_NE(cache.get(key, size), nullptr);
+        CHECK_LE(cache.evictions() - evictions, chunks_per_page);
+    }
+    CHECK_GE(cache.space_used(), full - full / 20);
+}
+
+TEST_CASE("Cache::mset(), mget() and mdel() act on every key") {
+    Cache cache{ENTRIES_SIZE};
+
+    // Add every entry in one batch
+    std::vector<Cache::KeyValue> entries;
+    std::vector<key_type> keys;
+    for (auto &entry : ENTRIES) {
+        entries.push_back({entry.first, entry.second.c_str(),
+                           static_cast<Cache::size_type>(
+                               entry.second.length() + 1)});
+        keys.push_back(entry.first);
+    }
+    cache.mset(entries);
+    REQUIRE_EQ(cache.space_used(), ENTRIES_SIZE);
+
+    // Delete the first entry and a missing key
+    REQUIRE_EQ(cache.mdel({FIRST_ENTRY.first, "missing"}), 1);
+
+    // Assert that every value but the first is returned, in order
+    std::vector<Cache::size_type> sizes;
+    const auto values = cache.mget(keys, sizes);
+    REQUIRE_EQ(values.size(), keys.size());
+    REQUIRE_EQ(sizes.size(), keys.size());
+    CHECK_EQ(values.front(), nullptr);
+    auto i = 1U;
+    for (auto entry = std::next(ENTRIES.begin()); entry != ENTRIES.end();
+         ++entry, ++i) {
+        REQUIRE_NE(values[i], nullptr);
+        CHECK_EQ(std::string{values[i]}, entry->second);
+        CHECK_EQ(sizes[i], entry->second.length() + 1);
+    }
+}
+
+TEST_CASE("Cache::pin() keeps values valid until they are unpinned") {
+    Cache cache{ENTRIES_SIZE};
+    const auto count_chunks = [&] {
+        Cache::size_type chunks_used = 0;
+        for (const auto &stats : cache.slab_stats()) {
+            chunks_used += stats.chunks_used;
+        }
+        return chunks_used;
+    };
+
+    cache.set(FIRST_ENTRY.first, FIRST_ENTRY.second.c_str(),
+              FIRST_ENTRY.second.length() + 1);
+    Cache::size_type size;
+    const auto value = cache.get(FIRST_ENTRY.first, size);
+    REQUIRE_NE(value, nullptr);
+    cache.pin(value);
+    cache.pin(value);
+
+    // Replace and then delete the entry
+    cache.set(FIRST_ENTRY.first, LAST_ENTRY.second.c_str(),
+              LAST_ENTRY.second.length() + 1);
+    REQUIRE(cache.del(FIRST_ENTRY.first));
+    // Assert that the pinned value is unchanged, but no longer counted
+    CHECK_EQ(std::string{value}, FIRST_ENTRY.second);
+    CHECK_EQ(cache.space_used(), 0);
+    CHECK_EQ(count_chunks(), 1);
+
+    // Assert that the memory is freed by the next set after the last unpin
+    cache.unpin(value);
+    cache.set(LAST_ENTRY.first, LAST_ENTRY.second.c_str(),
+              LAST_ENTRY.second.length() + 1);
+    CHECK_EQ(count_chunks(), 2);
+    cache.unpin(value);
+    cache.set(LAST_ENTRY.first, LAST_ENTRY.second.c_str(),
+              LAST_ENTRY.second.length() + 1);
+    CHECK_EQ(count_chunks(), 1);
+}
+
+TEST_CASE("Cache::reset() keeps pinned values") {
+    Cache cache{ENTRIES_SIZE};
+    for (auto &entry : ENTRIES) {
+        cache.set(entry.first, entry.second.c_str(), entry.second.length() + 1);
+    }
+    Cache::size_type size;
+    const auto value = cache.get(LAST_ENTRY.first, size);
+    cache.pin(value);
+
+    cache.reset();
+    REQUIRE_EQ(cache.space_used(), 0);
+    REQUIRE_EQ(cache.get(LAST_ENTRY.first, size), nullptr);
+    CHECK_EQ(std::string{value}, LAST_ENTRY.second);
+    cache.unpin(value);
+
+    // Assert that the cache still works, and that a reset with nothing pinned
+    // frees everything
+    cache.set(FIRST_ENTRY.first, FIRST_ENTRY.second.c_str(),
+              FIRST_ENTRY.second.length() + 1);
+    cache.reset();
+    for (const auto &stats : cache.slab_stats()) {
+        CHECK_EQ(stats.chunks_used, 0);
+    }
+}
+
+TEST_CASE("Cache::set() with a TTL expires the entry") {
+    Cache cache{ENTRIES_SIZE};
+    Cache::size_type size;
+    const auto &[key, value] = FIRST_ENTRY;
+    const auto &[long_key, long_value] = LAST_ENTRY;
+    cache.set(key, value.c_str(), value.length() + 1, SHORT_TTL);
+    cache.set(long_key, long_value.c_str(), long_value.length() + 1, 1h);
+    REQUIRE_NE(cache.get(long_key, size), nullptr);
+    std::this_thread::sleep_for(WAIT_FOR_TTL);
+
+    // Assert that the expired entry is gone, but still takes up space until
+    // it is removed
+    CHECK_EQ(cache.get(key, size), nullptr);
+    CHECK_EQ(cache.peek(key, size), nullptr);
+    CHECK_EQ(cache.space_used(), value.length() + long_value.length() + 2);
+    CHECK_EQ(cache.expire(), 1);
+    CHECK_EQ(cache.expire(), 0);
+    CHECK_EQ(cache.space_used(), long_value.length() + 1);
+    CHECK_NE(cache.get(long_key, size), nullptr);
+
+    // Assert that an expired entry cannot be deleted
+    cache.set(key, value.c_str(), value.length() + 1, SHORT_TTL);
+    std::this_thread::sleep_for(WAIT_FOR_TTL);
+    CHECK(!cache.del(key));
+    CHECK_EQ(cache.space_used(), long_value.length() + 1);
+}
+
+TEST_CASE("Cache::set() replaces the TTL of an entry") {
+    Cache cache{ENTRIES_SIZE};
+    Cache::size_type size;
+    const auto &[key, value] = FIRST_ENTRY;
+    cache.set(key, value.c_str(), value.length() + 1, SHORT_TTL);
+    cache.set(key, value.c_str(), value.length() + 1);
+    std::this_thread::sleep_for(WAIT_FOR_TTL);
+    CHECK_EQ(cache.expire(), 0);
+    CHECK_NE(cache.get(key, size), nullptr);
+
+    // Assert that deleted and reset entries do not expire later
+    cache.set(key, value.c_str(), value.length() + 1, SHORT_TTL);
+    cache.del(key);
+    cache.set(LAST_ENTRY.first, value.c_str(), value.length() + 1, SHORT_TTL);
+    cache.reset();
+    std::this_thread::sleep_for(WAIT_FOR_TTL);
+    CHECK_EQ(cache.expire(), 0);
+}
+
+TEST_CASE("Cache::set() reclaims expired entries before evicting") {
+    FifoEvictor evictor;
+    Cache cache{ENTRIES_SIZE, 0.75, &evictor};
+    Cache::size_type size;
+
+    // Fill the cache, with only the newest entry expiring
+    for (auto &entry : ENTRIES) {
+        if (entry != LAST_ENTRY) {
+            cache.set(entry.first, entry.second.c_str(),
+                      entry.second.length() + 1);
+        }
+    }
+    cache.set(LAST_ENTRY.first, LAST_ENTRY.second.c_str(),
+              LAST_ENTRY.second.length() + 1, SHORT_TTL);
+    std::this_thread::sleep_for(WAIT_FOR_TTL);
+
+    // Assert that a new entry takes the expired entry's space instead of
+    // evicting the oldest one
+    const std::string new_value(LAST_ENTRY.second.length(), 'x');
+    cache.set("new", new_value.c_str(), new_value.length() + 1);
+    CHECK_EQ(cache.space_used(), ENTRIES_SIZE);
+    CHECK_NE(cache.get(FIRST_ENTRY.first, size), nullptr);
+    CHECK_NE(cache.get("new", size), nullptr);
+    CHECK_EQ(cache.get(LAST_ENTRY.first, size), nullptr);
+}
+
+TEST_CASE("Cache::for_each() visits live entries in eviction order") {
+    FifoEvictor evictor;
+    Cache cache{ENTRIES_SIZE, 0.75, &evictor};
+    for (auto &entry : ENTRIES) {
+        cache.set(entry.first, entry.second.c_str(),
+                  entry.second.length() + 1);
+    }
+    // Delete one entry and give another a TTL that passes
+    cache.del(FIRST_ENTRY.first);
+    cache.set(LAST_ENTRY.first, LAST_ENTRY.second.c_str(),
+              LAST_ENTRY.second.length() + 1, SHORT_TTL);
+    std::this_thread::sleep_for(WAIT_FOR_TTL);
+    const auto &[key, value] = *std::next(ENTRIES.begin());
+    cache.set(key, value.c_str(), value.length() + 1, 1h);
+
+    // Assert that the remaining entries are visited oldest first, with the
+    // time they have left
+    std::vector<std::string> keys;
+    cache.for_each([&](std::string_view entry_key, Cache::val_type val,
+                       Cache::size_type size, Cache::ttl_type ttl) {
+        keys.emplace_back(entry_key);
+        const auto &expected = ENTRIES.at(keys.back());
+        CHECK_EQ(std::string{val}, expected);
+        CHECK_EQ(size, expected.length() + 1);
+        if (entry_key == key) {
+            CHECK_GT(ttl, 59min);
+            CHECK_LE(ttl, 1h);
+        } else {
+            CHECK_EQ(ttl, Cache::ttl_type::zero());
+        }
+    });
+    std::vector<std::string> expected;
+    for (auto &entry : ENTRIES) {
+        if (entry != FIRST_ENTRY && entry != LAST_ENTRY) {
+            expected.push_back(entry.first);
+        }
+    }
+    CHECK_EQ(keys, expected);
+
+    // Assert that every entry is visited without an evictor too
+    Cache unordered{ENTRIES_SIZE};
+    for (auto &entry : ENTRIES) {
+        unordered.set(entry.first, entry.second.c_str(),
+                      entry.second.length() + 1);
+    }
+    auto num_visited = 0U;
+    unordered.for_each([&](std::string_view, Cache::val_type, Cache::size_type,
+                           Cache::ttl_type) { ++num_visited; });
+    CHECK_EQ(num_visited, ENTRIES.size());
 }
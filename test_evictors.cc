@@ -1,8 +1,12 @@
 #include "cache.hh"
+#include "clock_evictor.hh"
 #include "fifo_evictor.hh"
+#include "intrusive_lru_evictor.hh"
 #include "lru_evictor.hh"
 #include "test_common.hh"
 
+#include <vector>
+
 ////////////////////////////////////////////////
 // FifoEvictor Unit Tests
 ////////////////////////////////////////////////
@@ -50,3 +54,263 @@ TEST_CASE("LruEvictor::evict() returns keys in LRU order") {
         REQUIRE_EQ(evictor.evict(), i->first);
     }
 }
+
+////////////////////////////////////////////////
+// IntrusiveLruEvictor Unit Tests
+////////////////////////////////////////////////
+
+TEST_CASE("IntrusiveLruEvictor::evict_hook() returns nullptr when there are "
+          "no entries") {
+    REQUIRE_EQ(IntrusiveLruEvictor{}.evict_hook(), nullptr);
+}
+
+TEST_CASE("IntrusiveLruEvictor::evict_hook() returns entries in LRU order") {
+    IntrusiveLruEvictor evictor;
+    std::vector<EvictionHook> hooks(ENTRIES.size());
+    // Link entries in forward order
+    for (auto &hook : hooks) {
+        evictor.link(hook);
+    }
+    // Touch entries in reverse order
+    for (auto i = hooks.rbegin(); i != hooks.rend(); ++i) {
+        evictor.touch(*i);
+    }
+    // Assert that entries are evicted in reverse order
+    for (auto i = hooks.rbegin(); i != hooks.rend(); ++i) {
+        REQUIRE_EQ(evictor.evict_hook(), &*i);
+    }
+    REQUIRE_EQ(evictor.evict_hook(), nullptr);
+}
+
+TEST_CASE("IntrusiveLruEvictor::unlink() removes entries") {
+    IntrusiveLruEvictor evictor;
+    EvictionHook first, second;
+    evictor.link(first);
+    evictor.link(second);
+    evictor.unlink(first);
+    REQUIRE_EQ(evictor.evict_hook(), &second);
+    REQUIRE_EQ(evictor.evict_hook(), nullptr);
+}
+
+TEST_CASE("IntrusiveLruEvictor does not support the key-based interface") {
+    IntrusiveLruEvictor evictor;
+    REQUIRE_THROWS_AS(evictor.touch_key(FIRST_ENTRY.first), std::logic_error);
+    REQUIRE_THROWS_AS(evictor.evict(), std::logic_error);
+}
+
+TEST_CASE("Cache with an IntrusiveLruEvictor evicts the least recently used "
+          "entry") {
+    // Create a cache with enough space for all but the last entry
+    const Cache::size_type MAXMEM =
+        ENTRIES_SIZE - (LAST_ENTRY.second.length() + 1);
+    IntrusiveLruEvictor evictor;
+    Cache cache{MAXMEM, 0.75f, &evictor};
+
+    // Add all but the last entry
+    for (auto i = ENTRIES.begin(); i != std::prev(ENTRIES.end()); ++i) {
+        cache.set(i->first, i->second.c_str(), i->second.length() + 1);
+    }
+    // Read the first entry so that the second one is least recently used
+    Cache::size_type size;
+    REQUIRE_NE(cache.get(FIRST_ENTRY.first, size), nullptr);
+
+    // Add the last entry, which requires evicting something
+    cache.set(LAST_ENTRY.first, LAST_ENTRY.second.c_str(),
+              LAST_ENTRY.second.length() + 1);
+    // Assert that the second entry was evicted and the others were not
+    CHECK_NE(cache.get(LAST_ENTRY.first, size), nullptr);
+    CHECK_NE(cache.get(FIRST_ENTRY.first, size), nullptr);
+    CHECK_EQ(cache.get(std::next(ENTRIES.begin())->first, size), nullptr);
+    REQUIRE_LE(cache.space_used(), MAXMEM);
+
+    // Assert that resetting the cache also resets the evictor
+    cache.reset();
+    REQUIRE_EQ(evictor.evict_hook(), nullptr);
+}
+
+////////////////////////////////////////////////
+// ClockEvictor Unit Tests
+////////////////////////////////////////////////
+
+TEST_CASE("ClockEvictor::evict_hook() returns nullptr when there are no "
+          "entries") {
+    REQUIRE_EQ(ClockEvictor{}.evict_hook(), nullptr);
+}
+
+TEST_CASE("ClockEvictor::evict_hook() returns unreferenced entries in FIFO "
+          "order") {
+    ClockEvictor evictor;
+    std::vector<EvictionHook> hooks(ENTRIES.size());
+    for (auto &hook : hooks) {
+        evictor.link(hook);
+    }
+    for (auto &hook : hooks) {
+        REQUIRE_EQ(evictor.evict_hook(), &hook);
+    }
+    REQUIRE_EQ(evictor.evict_hook(), nullptr);
+}
+
+TEST_CASE("ClockEvictor::evict_hook() gives referenced entries a second "
+          "chance") {
+    ClockEvictor evictor;
+    std::vector<EvictionHook> hooks(ENTRIES.size());
+    for (auto &hook : hooks) {
+        evictor.link(hook);
+    }
+    // Reference every other entry
+    for (auto i = 0U; i < hooks.size(); i += 2) {
+        evictor.touch(hooks[i]);
+    }
+    // Assert that the unreferenced entries are evicted first
+    for (auto i = 1U; i < hooks.size(); i += 2) {
+        REQUIRE_EQ(evictor.evict_hook(), &hooks[i]);
+    }
+    // Assert that the referenced entries are evicted afterwards, in order
+    for (auto i = 0U; i < hooks.size(); i += 2) {
+        REQUIRE_EQ(evictor.evict_hook(), &hooks[i]);
+    }
+    REQUIRE_EQ(evictor.evict_hook(), nullptr);
+}
+
+TEST_CASE("ClockEvictor::unlink() removes entries, including the one under "
+          "the hand") {
+    ClockEvictor evictor;
+    EvictionHook first, second, third;
+    evictor.link(first);
+    evictor.link(second);
+    evictor.link(third);
+    // The hand starts at the first entry
+    evictor.unlink(first);
+    evictor.unlink(third);
+    REQUIRE_EQ(evictor.evict_hook(), &second);
+    REQUIRE_EQ(evictor.evict_hook(), nullptr);
+    // The evictor must still work after becoming empty
+    evictor.link(first);
+    REQUIRE_EQ(evictor.evict_hook(), &first);
+}
+
+TEST_CASE("ClockEvictor supports concurrent touches") {
+    REQUIRE(ClockEvictor{}.concurrent_touch());
+    REQUIRE_THROWS_AS(ClockEvictor{}.touch_key(FIRST_ENTRY.first),
+                      std::logic_error);
+}
+
+TEST_CASE("Cache with a ClockEvictor keeps recently used entries") {
+    // Create a cache with enough space for all but the last entry
+    const Cache::size_type MAXMEM =
+        ENTRIES_SIZE - (LAST_ENTRY.second.length() + 1);
+    ClockEvictor evictor;
+    Cache cache{MAXMEM, 0.75f, &evictor};
+
+    // Add all but the last entry
+    for (auto i = ENTRIES.begin(); i != std::prev(ENTRIES.end()); ++i) {
+        cache.set(i->first, i->second.c_str(), i->second.length() + 1);
+    }
+    // Read the first entry so that it gets a second chance
+    Cache::size_type size;
+    REQUIRE_NE(cache.get(FIRST_ENTRY.first, size), nullptr);
+
+    // Add the last entry, which requires evicting something
+    cache.set(LAST_ENTRY.first, LAST_ENTRY.second.c_str(),
+              LAST_ENTRY.second.length() + 1);
+    // Assert that the second entry was evicted instead of the first
+    CHECK_NE(cache.get(LAST_ENTRY.first, size), nullptr);
+    CHECK_NE(cache.get(FIRST_ENTRY.first, size), nullptr);
+    CHECK_EQ(cache.get(std::next(ENTRIES.begin())->first, size), nullptr);
+    REQUIRE_LE(cache.space_used(), MAXMEM);
+}
+
+////////////////////////////////////////////////
+// Eviction Order Unit Tests
+////////////////////////////////////////////////
+
+/// Get the keys of a cache holding every entry, after reading the first one,
+/// in the order `Cache::for_each()` visits them
+std::vector<std::string> visit_order(Evictor &evictor) {
+    Cache cache{ENTRIES_SIZE, 0.75f, &evictor};
+    for (auto &entry : ENTRIES) {
+        cache.set(entry.first, entry.second.c_str(), entry.second.length() + 1);
+    }
+    Cache::size_type size;
+    REQUIRE_NE(cache.get(FIRST_ENTRY.first, size), nullptr);
+    std::vector<std::string> keys;
+    cache.for_each([&](std::string_view key, Cache::val_type, Cache::size_type,
+                       Cache::ttl_type) { keys.emplace_back(key); });
+    return keys;
+}
+
+TEST_CASE_TEMPLATE("Cache passes over pinned entries instead of evicting "
+                   "them", Evictor, FifoEvictor, IntrusiveLruEvictor) {
+    // Create a cache with enough space for all but the last entry
+    const Cache::size_type MAXMEM =
+        ENTRIES_SIZE - (LAST_ENTRY.second.length() + 1);
+    Evictor evictor;
+    Cache cache{MAXMEM, 0.75f, &evictor};
+    for (auto i = ENTRIES.begin(); i != std::prev(ENTRIES.end()); ++i) {
+        cache.set(i->first, i->second.c_str(), i->second.length() + 1);
+    }
+
+    // Pin the first entry to be evicted (without touching it)
+    Cache::size_type size;
+    const auto first = cache.peek(FIRST_ENTRY.first, size);
+    REQUIRE_NE(first, nullptr);
+    cache.pin(first);
+    // Assert that the next entry is evicted instead
+    cache.set(LAST_ENTRY.first, LAST_ENTRY.second.c_str(),
+              LAST_ENTRY.second.length() + 1);
+    CHECK_NE(cache.get(LAST_ENTRY.first, size), nullptr);
+    CHECK_NE(cache.get(FIRST_ENTRY.first, size), nullptr);
+    CHECK_EQ(cache.get(std::next(ENTRIES.begin())->first, size), nullptr);
+    CHECK_EQ(cache.evictions(), 1);
+
+    // Pin every entry, and assert that a new one (larger than the space left)
+    // is not added, rather than every entry being evicted without freeing
+    // any memory
+    std::vector<Cache::val_type> pinned{first};
+    for (auto entry = std::next(ENTRIES.begin(), 2); entry != ENTRIES.end();
+         ++entry) {
+        const auto value = cache.peek(entry->first, size);
+        REQUIRE_NE(value, nullptr);
+        cache.pin(value);
+        pinned.push_back(value);
+    }
+    cache.set("new", "newer", 6);
+    CHECK_EQ(cache.get("new", size), nullptr);
+    CHECK_EQ(cache.evictions(), 1);
+    for (auto entry = std::next(ENTRIES.begin(), 2); entry != ENTRIES.end();
+         ++entry) {
+        CHECK_NE(cache.get(entry->first, size), nullptr);
+    }
+    for (auto value : pinned) {
+        cache.unpin(value);
+    }
+
+    // Once they are unpinned, entries are evicted again
+    cache.set("new", "newer", 6);
+    CHECK_NE(cache.get("new", size), nullptr);
+    CHECK_GT(cache.evictions(), 1);
+}
+
+TEST_CASE("Cache::for_each() visits entries in each evictor's order") {
+    // Least recently used first for the LRU evictors
+    std::vector<std::string> lru_order;
+    for (auto entry = std::next(ENTRIES.begin()); entry != ENTRIES.end();
+         ++entry) {
+        lru_order.push_back(entry->first);
+    }
+    lru_order.push_back(FIRST_ENTRY.first);
+    LruEvictor lru;
+    CHECK_EQ(visit_order(lru), lru_order);
+    IntrusiveLruEvictor intrusive_lru;
+    CHECK_EQ(visit_order(intrusive_lru), lru_order);
+
+    // Insertion order starting at the hand for CLOCK and FIFO
+    std::vector<std::string> insertion_order;
+    for (auto &entry : ENTRIES) {
+        insertion_order.push_back(entry.first);
+    }
+    ClockEvictor clock;
+    CHECK_EQ(visit_order(clock), insertion_order);
+    FifoEvictor fifo;
+    CHECK_EQ(visit_order(fifo), insertion_order);
+}
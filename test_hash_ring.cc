@@ -0,0 +1,86 @@
+#include "hash_ring.hh"
+#include "test_common.hh"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Names of the nodes the tests use
+const std::vector<std::string> NODES = {"localhost:4022", "localhost:4024",
+                                        "localhost:4026", "localhost:4028"};
+
+constexpr auto NUM_KEYS = 40000U;
+
+std::string key_of(unsigned i) {
+    return "key" + std::to_string(i);
+}
+
+////////////////////////////////////////////////
+// Hash Ring Unit Tests
+////////////////////////////////////////////////
+
+TEST_CASE("HashRing::nodes_for() returns distinct nodes") {
+    const HashRing ring{NODES};
+    REQUIRE_EQ(ring.size(), NODES.size());
+    for (auto i = 0U; i < 1000; ++i) {
+        const auto nodes = ring.nodes_for(key_of(i), 3);
+        REQUIRE_EQ(nodes.size(), 3);
+        REQUIRE_NE(nodes[0], nodes[1]);
+        REQUIRE_NE(nodes[0], nodes[2]);
+        REQUIRE_NE(nodes[1], nodes[2]);
+        // The first replica is the node the key belongs to
+        REQUIRE_EQ(ring.nodes_for(key_of(i)), std::vector<unsigned>{nodes[0]});
+    }
+    // Asking for more replicas than there are nodes returns every node
+    auto nodes = ring.nodes_for("foo", 10);
+    std::sort(nodes.begin(), nodes.end());
+    REQUIRE_EQ(nodes, std::vector<unsigned>{0, 1, 2, 3});
+}
+
+TEST_CASE("HashRing spreads keys evenly over the nodes") {
+    const HashRing ring{NODES};
+    std::vector<unsigned> counts(NODES.size());
+    for (auto i = 0U; i < NUM_KEYS; ++i) {
+        ++counts[ring.nodes_for(key_of(i)).front()];
+    }
+    for (const auto count : counts) {
+        CHECK_GT(count, NUM_KEYS / NODES.size() * 8 / 10);
+        CHECK_LT(count, NUM_KEYS / NODES.size() * 12 / 10);
+    }
+}
+
+TEST_CASE("HashRing only moves the keys of nodes that are added or removed") {
+    const HashRing ring{NODES};
+    // Ring without the last node
+    const HashRing smaller{{NODES.begin(), NODES.end() - 1}};
+    auto moved = 0U;
+    for (auto i = 0U; i < NUM_KEYS; ++i) {
+        const auto node = ring.nodes_for(key_of(i)).front();
+        const auto before = smaller.nodes_for(key_of(i)).front();
+        if (node != before) {
+            // Keys only move to the new node
+            REQUIRE_EQ(node, NODES.size() - 1);
+            ++moved;
+        }
+    }
+    // About a quarter of the keys move
+    CHECK_GT(moved, NUM_KEYS / NODES.size() * 8 / 10);
+    CHECK_LT(moved, NUM_KEYS / NODES.size() * 12 / 10);
+}
+
+TEST_CASE("HashRing routes keys by node name, not by position") {
+    const HashRing ring{NODES};
+    const HashRing reversed{{NODES.rbegin(), NODES.rend()}};
+    for (auto i = 0U; i < 1000; ++i) {
+        const auto nodes = ring.nodes_for(key_of(i), 2);
+        const auto reversed_nodes = reversed.nodes_for(key_of(i), 2);
+        for (auto j = 0U; j < 2; ++j) {
+            REQUIRE_EQ(NODES[nodes[j]],
+                       NODES[NODES.size() - 1 - reversed_nodes[j]]);
+        }
+    }
+}
+
+TEST_CASE("HashRing::HashRing() rejects an empty ring") {
+    REQUIRE_THROWS_AS(HashRing{{}}, std::invalid_argument);
+}
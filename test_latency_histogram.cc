@@ -0,0 +1,92 @@
+#include "latency_histogram.hh"
+#include "test_common.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+////////////////////////////////////////////////
+// Latency Histogram Unit Tests
+////////////////////////////////////////////////
+
+TEST_CASE("LatencyHistogram is empty when created") {
+    const LatencyHistogram histogram;
+    REQUIRE_EQ(histogram.count(), 0);
+    REQUIRE_EQ(histogram.min(), 0);
+    REQUIRE_EQ(histogram.max(), 0);
+    REQUIRE_EQ(histogram.mean(), 0);
+    REQUIRE_EQ(histogram.percentile(0.5), 0);
+}
+
+TEST_CASE("LatencyHistogram counts small values exactly") {
+    LatencyHistogram histogram;
+    for (auto value = 1U; value <= 100; ++value) {
+        histogram.record(value);
+    }
+    REQUIRE_EQ(histogram.count(), 100);
+    REQUIRE_EQ(histogram.min(), 1);
+    REQUIRE_EQ(histogram.max(), 100);
+    REQUIRE_EQ(histogram.mean(), doctest::Approx(50.5));
+    REQUIRE_EQ(histogram.percentile(0), 1);
+    REQUIRE_EQ(histogram.percentile(0.5), 50);
+    REQUIRE_EQ(histogram.percentile(0.9), 90);
+    REQUIRE_EQ(histogram.percentile(0.999), 100);
+    REQUIRE_EQ(histogram.percentile(1), 100);
+}
+
+TEST_CASE("LatencyHistogram percentiles are within 1% of the exact ones") {
+    std::mt19937_64 random;
+    std::lognormal_distribution<double> dist{12, 3};
+    LatencyHistogram histogram;
+    std::vector<uint64_t> values;
+    for (auto i = 0U; i < 100000; ++i) {
+        const auto value = static_cast<uint64_t>(std::min(dist(random), 1e18));
+        histogram.record(value);
+        values.push_back(value);
+    }
+    std::sort(values.begin(), values.end());
+    for (const auto fraction : {0.1, 0.5, 0.9, 0.99, 0.999, 1.0}) {
+        const auto rank = static_cast<std::size_t>(
+            std::ceil(fraction * values.size()));
+        const auto exact = values[rank - 1];
+        const auto estimate = histogram.percentile(fraction);
+        // Percentiles are rounded up to the top of their bucket
+        REQUIRE_GE(estimate, exact);
+        REQUIRE_LE(estimate - exact, exact / 100);
+    }
+    REQUIRE_EQ(histogram.max(), values.back());
+    REQUIRE_EQ(histogram.min(), values.front());
+}
+
+TEST_CASE("LatencyHistogram counts values up to the largest one") {
+    LatencyHistogram histogram;
+    histogram.record(UINT64_MAX);
+    histogram.record(0);
+    REQUIRE_EQ(histogram.percentile(0.5), 0);
+    REQUIRE_EQ(histogram.percentile(1), UINT64_MAX);
+}
+
+TEST_CASE("LatencyHistogram::merge() counts the other histogram's values") {
+    LatencyHistogram all;
+    LatencyHistogram halves[2];
+    for (auto value = 0U; value < 10000; ++value) {
+        all.record(value * 37);
+        halves[value % 2].record(value * 37);
+    }
+    // Values recorded several times at once count as separate values
+    halves[0].record(5, 3);
+    all.record(5);
+    all.record(5);
+    all.record(5);
+
+    halves[0].merge(halves[1]);
+    REQUIRE_EQ(halves[0].count(), all.count());
+    REQUIRE_EQ(halves[0].min(), all.min());
+    REQUIRE_EQ(halves[0].max(), all.max());
+    REQUIRE_EQ(halves[0].mean(), doctest::Approx(all.mean()));
+    for (const auto fraction : {0.0, 0.25, 0.5, 0.75, 0.99, 1.0}) {
+        REQUIRE_EQ(halves[0].percentile(fraction), all.percentile(fraction));
+    }
+}
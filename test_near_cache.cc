@@ -0,0 +1,105 @@
+#include "near_cache.hh"
+#include "test_common.hh"
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+// Combined size of the entries' values, without terminating null bytes
+const NearCache::size_type VALUES_SIZE = ENTRIES_SIZE - ENTRIES.size();
+
+////////////////////////////////////////////////
+// Near Cache Unit Tests
+////////////////////////////////////////////////
+
+TEST_CASE("NearCache::get() returns the values that were put") {
+    NearCache near{VALUES_SIZE, 1h};
+    for (const auto &entry : ENTRIES) {
+        REQUIRE_EQ(near.get(entry.first), nullptr);
+        near.put(entry.first, entry.second);
+    }
+    for (const auto &entry : ENTRIES) {
+        const auto value = near.get(entry.first);
+        REQUIRE_NE(value, nullptr);
+        CHECK_EQ(*value, entry.second);
+    }
+    // Replacing a value only counts the new one
+    near.put(FIRST_ENTRY.first, "");
+    CHECK_EQ(*near.get(FIRST_ENTRY.first), "");
+    CHECK_EQ(near.space_used(), VALUES_SIZE - FIRST_ENTRY.second.length());
+}
+
+TEST_CASE("NearCache::put() evicts the least recently used values") {
+    NearCache near{10, 1h};
+    near.put("a", "1234");
+    near.put("b", "1234");
+    // Reading "a" makes "b" the least recently used
+    REQUIRE_NE(near.get("a"), nullptr);
+    near.put("c", "1234");
+    CHECK_NE(near.get("a"), nullptr);
+    CHECK_EQ(near.get("b"), nullptr);
+    CHECK_NE(near.get("c"), nullptr);
+    CHECK_EQ(near.space_used(), 8);
+    // Values larger than the whole near cache are not stored
+    near.put("d", std::string(11, 'x'));
+    CHECK_EQ(near.get("d"), nullptr);
+    CHECK_EQ(near.space_used(), 8);
+}
+
+TEST_CASE("NearCache::get() does not return expired values") {
+    NearCache near{VALUES_SIZE, 20ms};
+    near.put(FIRST_ENTRY.first, FIRST_ENTRY.second);
+    REQUIRE_NE(near.get(FIRST_ENTRY.first), nullptr);
+    std::this_thread::sleep_for(30ms);
+    CHECK_EQ(near.get(FIRST_ENTRY.first), nullptr);
+    CHECK_EQ(near.space_used(), 0);
+}
+
+TEST_CASE("NearCache::erase() and NearCache::clear() remove values") {
+    NearCache near{VALUES_SIZE, 1h};
+    for (const auto &entry : ENTRIES) {
+        near.put(entry.first, entry.second);
+    }
+    near.erase(FIRST_ENTRY.first);
+    near.erase("missing");
+    CHECK_EQ(near.get(FIRST_ENTRY.first), nullptr);
+    CHECK_EQ(near.space_used(), VALUES_SIZE - FIRST_ENTRY.second.length());
+    near.clear();
+    CHECK_EQ(near.get(LAST_ENTRY.first), nullptr);
+    CHECK_EQ(near.space_used(), 0);
+    // The near cache can be filled again after being cleared
+    for (const auto &entry : ENTRIES) {
+        near.put(entry.first, entry.second);
+    }
+    CHECK_EQ(near.space_used(), VALUES_SIZE);
+}
+
+TEST_CASE("NearCache evicts correctly after values expire or are erased") {
+    NearCache near{12, 1h};
+    near.put("a", "1234", 10ms);
+    near.put("b", "1234");
+    near.put("c", "1234");
+    std::this_thread::sleep_for(20ms);
+    REQUIRE_EQ(near.get("a"), nullptr);
+    near.erase("b");
+    CHECK_EQ(near.space_used(), 4);
+    // The removed values left the eviction queue, so "c" is the least
+    // recently used value once the cache is full again
+    near.put("d", "1234");
+    near.put("e", "1234");
+    near.put("f", "1234");
+    CHECK_EQ(near.get("c"), nullptr);
+    CHECK_NE(near.get("d"), nullptr);
+    CHECK_NE(near.get("e"), nullptr);
+    CHECK_NE(near.get("f"), nullptr);
+    CHECK_EQ(near.space_used(), 12);
+    // Removed values can be put again
+    near.put("a", "12");
+    near.put("b", "12");
+    CHECK_EQ(near.get("d"), nullptr);
+    CHECK_NE(near.get("a"), nullptr);
+    CHECK_NE(near.get("b"), nullptr);
+    CHECK_EQ(near.space_used(), 12);
+}
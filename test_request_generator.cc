@@ -0,0 +1,166 @@
+#include "request_generator.hh"
+#include "test_common.hh"
+
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/// Number of requests generated by each test
+constexpr auto NUM_REQUESTS = 100000U;
+
+/// Workload parameters like request_driver's defaults, with `key_dist`
+WorkloadParams params_with(KeyDistribution key_dist) {
+    WorkloadParams params = {15, 8, 1, 1000, 0.08};
+    params.key_dist = key_dist;
+    return params;
+}
+
+/// Count the requests for each key index, checking every request as it goes
+std::vector<unsigned> key_counts(const Workload &workload) {
+    RequestGenerator<std::mt19937> generator{42};
+    std::vector<unsigned> counts(workload.num_keys());
+    for (auto i = 0U; i < NUM_REQUESTS; ++i) {
+        const auto request = generator(workload);
+        const auto index = std::stoul(std::string{request.key});
+        REQUIRE_LT(index, counts.size());
+        REQUIRE_EQ(request.key, workload.key(index));
+        ++counts[index];
+        if (request.type == Request::Type::SET) {
+            REQUIRE(request.value.has_value());
+            REQUIRE_GE(request.value->size(), 2);
+            REQUIRE_EQ(request.value->back(), '\0');
+            REQUIRE_EQ(request.value->find('\0'), request.value->size() - 1);
+        } else {
+            REQUIRE_FALSE(request.value.has_value());
+        }
+    }
+    return counts;
+}
+
+////////////////////////////////////////////////
+// Request Generator Unit Tests
+////////////////////////////////////////////////
+
+TEST_CASE("RequestGenerator with a seed always makes the same requests") {
+    const Workload workload{params_with(KeyDistribution::ZIPF)};
+    RequestGenerator<std::mt19937> first{7}, second{7};
+    for (auto i = 0U; i < 1000; ++i) {
+        const auto a = first(workload);
+        const auto b = second(workload);
+        REQUIRE_EQ(a.type, b.type);
+        REQUIRE_EQ(a.key, b.key);
+        REQUIRE_EQ(a.value, b.value);
+    }
+}
+
+TEST_CASE("RequestGenerator makes requests of each type by ratio") {
+    const Workload workload{params_with(KeyDistribution::UNIFORM)};
+    RequestGenerator<std::mt19937> generator{42};
+    unsigned counts[3] = {};
+    for (auto i = 0U; i < NUM_REQUESTS; ++i) {
+        ++counts[static_cast<int>(generator(workload).type)];
+    }
+    CHECK_EQ(counts[0] / double{NUM_REQUESTS},
+             doctest::Approx(15 / 24.0).epsilon(0.02));
+    CHECK_EQ(counts[1] / double{NUM_REQUESTS},
+             doctest::Approx(8 / 24.0).epsilon(0.02));
+    CHECK_EQ(counts[2] / double{NUM_REQUESTS},
+             doctest::Approx(1 / 24.0).epsilon(0.1));
+}
+
+TEST_CASE("RequestGenerator chooses geometrically distributed keys") {
+    const Workload workload{params_with(KeyDistribution::GEOMETRIC)};
+    // Keys past `num_keys` are rendered too
+    REQUIRE_GT(workload.num_keys(), 1000);
+    const auto counts = key_counts(workload);
+    double mean = 0;
+    for (std::size_t i = 0; i < counts.size(); ++i) {
+        mean += static_cast<double>(i) * counts[i] / NUM_REQUESTS;
+    }
+    CHECK_EQ(mean, doctest::Approx(999).epsilon(0.02));
+}
+
+TEST_CASE("RequestGenerator chooses uniformly distributed keys") {
+    const Workload workload{params_with(KeyDistribution::UNIFORM)};
+    REQUIRE_EQ(workload.num_keys(), 1000);
+    for (const auto count : key_counts(workload)) {
+        // 100 requests expected for each key
+        CHECK_GT(count, 50);
+        CHECK_LT(count, 150);
+    }
+}
+
+TEST_CASE("RequestGenerator chooses Zipf distributed keys") {
+    const auto params = params_with(KeyDistribution::ZIPF);
+    const Workload workload{params};
+    REQUIRE_EQ(workload.num_keys(), 1000);
+    const auto counts = key_counts(workload);
+
+    // Each of the most popular keys is chosen in proportion to 1 / rank^skew
+    double harmonic = 0;
+    for (auto rank = 1U; rank <= params.num_keys; ++rank) {
+        harmonic += 1 / std::pow(rank, params.zipf_skew);
+    }
+    for (auto rank = 1U; rank <= 4; ++rank) {
+        const auto expected = 1 / std::pow(rank, params.zipf_skew) / harmonic;
+        CHECK_EQ(counts[rank - 1] / double{NUM_REQUESTS},
+                 doctest::Approx(expected).epsilon(0.05));
+    }
+    CHECK_GT(counts[0], counts[9]);
+    CHECK_GT(counts[9], counts[99]);
+}
+
+TEST_CASE("RequestGenerator chooses hotspot distributed keys") {
+    auto params = params_with(KeyDistribution::HOTSPOT);
+    params.hot_key_fraction = 0.1;
+    params.hot_request_fraction = 0.9;
+    const Workload workload{params};
+    const auto counts = key_counts(workload);
+    unsigned hot = 0;
+    for (auto i = 0U; i < 100; ++i) {
+        hot += counts[i];
+    }
+    CHECK_EQ(hot / double{NUM_REQUESTS}, doctest::Approx(0.9).epsilon(0.01));
+    // Every key is chosen, hot or not
+    for (const auto count : counts) {
+        CHECK_GT(count, 0);
+    }
+
+    // With every key hot, the keys are uniformly distributed
+    params.hot_key_fraction = 1;
+    const Workload all_hot{params};
+    for (const auto count : key_counts(all_hot)) {
+        CHECK_GT(count, 50);
+    }
+}
+
+TEST_CASE("Workload values are the geometric size plus a null byte") {
+    const Workload workload{params_with(KeyDistribution::UNIFORM)};
+    REQUIRE_GT(workload.max_value_size(), 100);
+    for (const auto size : {0U, 1U, 10U, workload.max_value_size()}) {
+        const auto value = workload.value(size);
+        REQUIRE_EQ(value.size(), size + 2);
+        CHECK_EQ(value.substr(0, size + 1), std::string(size + 1, 'a'));
+        CHECK_EQ(value.back(), '\0');
+    }
+}
+
+TEST_CASE("Workload rejects parameters that make no sense") {
+    auto params = params_with(KeyDistribution::UNIFORM);
+    params.num_keys = 0;
+    CHECK_THROWS_AS(Workload{params}, std::invalid_argument);
+
+    params = params_with(KeyDistribution::UNIFORM);
+    params.prob_get = params.prob_set = params.prob_del = 0;
+    CHECK_THROWS_AS(Workload{params}, std::invalid_argument);
+
+    params = params_with(KeyDistribution::HOTSPOT);
+    params.hot_key_fraction = 0;
+    CHECK_THROWS_AS(Workload{params}, std::invalid_argument);
+
+    params = params_with(KeyDistribution::ZIPF);
+    params.zipf_skew = -1;
+    CHECK_THROWS_AS(Workload{params}, std::invalid_argument);
+}
@@ -0,0 +1,144 @@
+#include "request_parser.hh"
+#include "test_common.hh"
+
+#include <regex>
+#include <string>
+#include <vector>
+
+/// Regular expressions previously used by the server and client, which the
+/// parsers must agree with
+const std::regex KEY_RE{R"(/([A-Za-z0-9\._-]+))"};
+const std::regex KEY_VALUE_RE{R"(/([A-Za-z0-9\._-]+)/([A-Za-z0-9\._-]+))"};
+const std::regex KEY_VALUE_JSON_RE{
+    R"re(\{\s*"key"\s*:\s*"([A-Za-z0-9\._-]+)"\s*,\s*)re"
+    R"re("value"\s*:\s*"([A-Za-z0-9\._-]+)"\}\s*)re"};
+
+/// Targets to compare the parsers and the regular expressions on
+const std::vector<std::string> TARGETS = {
+    "",      "/",        "//",      "/foo",    "foo",      "/foo/",
+    "//foo", "/foo/bar", "/a.b_c-", "/a/b/c",  "/foo bar", "/foo/b%20r",
+    "/f?o",  "/foo/bar/", "/0",     "/0/1",    "/k/v!",    "/\xc3\xa9",
+};
+
+/// Bodies to compare the JSON parser and the regular expression on
+const std::vector<std::string> BODIES = {
+    R"({"key":"foo","value":"bar"})",
+    R"(  { "key" : "foo" ,	"value":"bar"}  )",
+    R"(junk{"key":"foo","value":"bar"}junk)",
+    R"({{"key":"foo","value":"bar"})",
+    R"({"key":"foo","value":"bar" })",
+    R"({"key":"","value":"bar"})",
+    R"({"key":"foo","value":""})",
+    R"({"key":"foo","value":"b r"})",
+    R"({"value":"bar","key":"foo"})",
+    R"({"key":"foo","value":"bar")",
+    R"({"key":"foo""value":"bar"})",
+    R"({"key":"foo",)",
+    R"({)",
+    "",
+};
+
+TEST_CASE("parse_key_target() agrees with KEY_RE") {
+    for (const auto &target : TARGETS) {
+        std::smatch match;
+        const auto matched = std::regex_match(target, match, KEY_RE);
+        const auto key = parse_key_target(target);
+        INFO("target: " << target);
+        REQUIRE_EQ(key.has_value(), matched);
+        if (matched) {
+            REQUIRE_EQ(std::string{*key}, match[1].str());
+        }
+    }
+}
+
+TEST_CASE("parse_key_value_target() agrees with KEY_VALUE_RE") {
+    for (const auto &target : TARGETS) {
+        std::smatch match;
+        const auto matched = std::regex_match(target, match, KEY_VALUE_RE);
+        const auto kv_pair = parse_key_value_target(target);
+        INFO("target: " << target);
+        REQUIRE_EQ(kv_pair.has_value(), matched);
+        if (matched) {
+            REQUIRE_EQ(std::string{kv_pair->first}, match[1].str());
+            REQUIRE_EQ(std::string{kv_pair->second}, match[2].str());
+        }
+    }
+}
+
+TEST_CASE("parse_key_value_json() agrees with KEY_VALUE_JSON_RE") {
+    for (const auto &body : BODIES) {
+        std::smatch match;
+        const auto matched = std::regex_search(body, match, KEY_VALUE_JSON_RE);
+        const auto kv_pair = parse_key_value_json(body);
+        INFO("body: " << body);
+        REQUIRE_EQ(kv_pair.has_value(), matched);
+        if (matched) {
+            REQUIRE_EQ(std::string{kv_pair->first}, match[1].str());
+            REQUIRE_EQ(std::string{kv_pair->second}, match[2].str());
+        }
+    }
+}
+
+TEST_CASE("parse_key_value_target() returns views into the target") {
+    const std::string target = "/foo/bar";
+    const auto kv_pair = parse_key_value_target(target);
+    REQUIRE(kv_pair.has_value());
+    REQUIRE_EQ(kv_pair->first.data(), target.data() + 1);
+    REQUIRE_EQ(kv_pair->second.data(), target.data() + 5);
+}
+
+TEST_CASE("Batch target parsers accept single targets like the other parsers") {
+    for (const auto &target : TARGETS) {
+        std::vector<std::string_view> keys;
+        std::vector<key_value_view> pairs;
+        INFO("target: " << target);
+        const auto key = parse_key_target(target);
+        REQUIRE_EQ(parse_key_list_target(target, keys), key.has_value());
+        if (key) {
+            REQUIRE_EQ(keys, std::vector<std::string_view>{*key});
+        }
+        const auto kv_pair = parse_key_value_target(target);
+        REQUIRE_EQ(parse_key_value_list_target(target, pairs),
+                   kv_pair.has_value());
+        if (kv_pair) {
+            REQUIRE_EQ(pairs, std::vector<key_value_view>{*kv_pair});
+        }
+    }
+}
+
+TEST_CASE("Batch target parsers split targets at commas") {
+    std::vector<std::string_view> keys;
+    REQUIRE(parse_key_list_target("/a,b.c,d", keys));
+    REQUIRE_EQ(keys, std::vector<std::string_view>{"a", "b.c", "d"});
+    std::vector<key_value_view> pairs;
+    REQUIRE(parse_key_value_list_target("/a/1,b/2", pairs));
+    REQUIRE_EQ(pairs, std::vector<key_value_view>{{"a", "1"}, {"b", "2"}});
+
+    // Assert that empty items and stray separators are rejected
+    for (const auto target : {"/a,", "/,a", "/a,,b", "/a/1,", "/a/1,b",
+                              "/a/1,/2", "/a/1/b/2", "/a/1,b/"}) {
+        INFO("target: " << target);
+        keys.clear();
+        pairs.clear();
+        CHECK(!parse_key_list_target(target, keys));
+        CHECK(!parse_key_value_list_target(target, pairs));
+    }
+}
+
+TEST_CASE("parse_key_value_json_array() parses arrays of key-value pairs") {
+    std::vector<key_value_view> pairs;
+    REQUIRE(parse_key_value_json_array("[]", pairs));
+    REQUIRE(pairs.empty());
+    REQUIRE(parse_key_value_json_array(
+        R"( [ {"key":"a","value":"1"} , {"key":"b","value":"2"}] )", pairs));
+    REQUIRE_EQ(pairs, std::vector<key_value_view>{{"a", "1"}, {"b", "2"}});
+
+    for (const auto body :
+         {"", "[", "[,]", R"([{"key":"a","value":"1"})",
+          R"([{"key":"a","value":"1"},])",
+          R"([{"key":"a","value":"1"}{"key":"b","value":"2"}])",
+          R"({"key":"a","value":"1"})"}) {
+        INFO("body: " << body);
+        CHECK(!parse_key_value_json_array(body, pairs));
+    }
+}
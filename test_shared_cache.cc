@@ -0,0 +1,396 @@
+#include "clock_evictor.hh"
+#include "fifo_evictor.hh"
+#include "lru_evictor.hh"
+#include "shared_cache.hh"
+#include "test_common.hh"
+#include "tinylfu_admission.hh"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+/// Number of shards to use for tests
+constexpr auto NUM_SHARDS = 4U;
+
+////////////////////////////////////////////////
+// SharedCache Unit Tests
+////////////////////////////////////////////////
+
+TEST_CASE("SharedCache::space_used() on empty cache returns 0") {
+    REQUIRE_EQ(SharedCache{ENTRIES_SIZE, NUM_SHARDS}.space_used(), 0);
+}
+
+TEST_CASE("SharedCache::get() returns values stored with SharedCache::set()") {
+    // Give every shard enough space for all of the entries
+    SharedCache cache{ENTRIES_SIZE * NUM_SHARDS, NUM_SHARDS};
+    auto space_used = 0;
+
+    // Add entries to the cache
+    for (auto &entry : ENTRIES) {
+        cache.set(entry.first, entry.second);
+        space_used += entry.second.length();
+    }
+
+    // Assert that `space_used()` is the sum over all of the shards
+    REQUIRE_EQ(cache.space_used(), space_used);
+
+    // Assert that entries are in the cache
+    for (auto &entry : ENTRIES) {
+        CHECK_EQ(cache.get(entry.first), entry.second);
+    }
+}
+
+TEST_CASE("SharedCache::del() and SharedCache::reset() update every shard") {
+    SharedCache cache{ENTRIES_SIZE * NUM_SHARDS, NUM_SHARDS};
+
+    // Add entries to the cache
+    for (auto &entry : ENTRIES) {
+        cache.set(entry.first, entry.second);
+    }
+
+    // Delete the first entry
+    REQUIRE(cache.del(FIRST_ENTRY.first));
+    REQUIRE(!cache.del(FIRST_ENTRY.first));
+    REQUIRE_EQ(cache.get(FIRST_ENTRY.first), "");
+    REQUIRE_EQ(cache.space_used(),
+               ENTRIES_SIZE - ENTRIES.size() - FIRST_ENTRY.second.length());
+
+    // Remove all entries from the cache
+    cache.reset();
+
+    // Assert that entries are no longer in the cache
+    for (auto &entry : ENTRIES) {
+        CHECK_EQ(cache.get(entry.first), "");
+    }
+    REQUIRE_EQ(cache.space_used(), 0);
+}
+
+TEST_CASE("SharedCache evicts within a shard when it has an evictor") {
+    // Give the whole cache only enough space for all but the last entry, so
+    // at least one shard must evict
+    const Cache::size_type MAXMEM = ENTRIES_SIZE / 2;
+    SharedCache cache{MAXMEM, NUM_SHARDS,
+                      [] { return std::make_unique<FifoEvictor>(); }};
+
+    // Add entries to the cache
+    for (auto &entry : ENTRIES) {
+        cache.set(entry.first, entry.second);
+    }
+
+    // Assert that the cache has not exceeded its capacity
+    REQUIRE_LE(cache.space_used(), MAXMEM);
+
+    // Assert that the evictions are counted per shard, and that a single
+    // thread never waited for a lock
+    const auto stats = cache.shard_stats();
+    REQUIRE_EQ(stats.size(), NUM_SHARDS);
+    uint64_t evictions = 0;
+    for (const auto &shard : stats) {
+        evictions += shard.evictions;
+        CHECK_EQ(shard.lock_waits, 0);
+        CHECK_EQ(shard.lock_wait_ns, 0);
+    }
+    CHECK_GE(evictions, 1);
+}
+
+TEST_CASE("SharedCache applies buffered touches in shared locking mode") {
+    // Use a single shard with enough space for the first two entries
+    auto entry = ENTRIES.begin();
+    const auto &first = *entry++;
+    const auto &second = *entry++;
+    const auto &third = *entry++;
+    const Cache::size_type MAXMEM =
+        first.second.length() + second.second.length();
+    SharedCache cache{MAXMEM, 1, [] { return std::make_unique<LruEvictor>(); },
+                      SharedCache::LockMode::SHARED};
+
+    cache.set(first.first, first.second);
+    cache.set(second.first, second.second);
+    // Read the first entry so that the second one is least recently used
+    REQUIRE_EQ(cache.get(first.first), first.second);
+    // Add the third entry, which must evict something
+    cache.set(third.first, third.second);
+
+    // Assert that the touch was applied before evicting
+    CHECK_EQ(cache.get(first.first), first.second);
+    CHECK_EQ(cache.get(second.first), "");
+}
+
+TEST_CASE("SharedCache records buffered accesses for the admission policy in "
+          "shared locking mode") {
+    // Use a single shard with enough space for one entry, and an evictor
+    // that would otherwise be touched directly under the shared lock
+    const std::string value = "val";
+    SharedCache cache{static_cast<Cache::size_type>(value.size()), 1,
+                      [] { return std::make_unique<ClockEvictor>(); },
+                      SharedCache::LockMode::SHARED, Cache::IndexType::CHAINED,
+                      [](Cache::size_type) {
+                          return std::make_unique<TinyLfuAdmission>(64);
+                      }};
+
+    cache.set("hot", value);
+    for (auto i = 0; i < 4; ++i) {
+        REQUIRE_EQ(cache.get("hot"), value);
+    }
+    // Assert that keys used once (a miss and a set) cannot evict the hot key
+    for (auto i = 0; i < 10; ++i) {
+        const auto key = "scan" + std::to_string(i);
+        REQUIRE_EQ(cache.get(key), "");
+        cache.set(key, value);
+    }
+    CHECK_EQ(cache.get("hot"), value);
+}
+
+TEST_CASE("SharedCache::get_pinned() returns values that outlive their "
+          "entries") {
+    for (const auto lock_mode :
+         {SharedCache::LockMode::EXCLUSIVE, SharedCache::LockMode::SHARED}) {
+        SharedCache cache{ENTRIES_SIZE * NUM_SHARDS, NUM_SHARDS,
+                          [] { return std::make_unique<LruEvictor>(); },
+                          lock_mode};
+        REQUIRE(!cache.get_pinned(FIRST_ENTRY.first));
+
+        cache.set(FIRST_ENTRY.first, FIRST_ENTRY.second);
+        auto pinned = cache.get_pinned(FIRST_ENTRY.first);
+        REQUIRE(pinned);
+        REQUIRE_EQ(pinned.view(), FIRST_ENTRY.second);
+        // Assert that moving the pin keeps the value pinned
+        auto moved = std::move(pinned);
+        REQUIRE(!pinned);
+        cache.set(FIRST_ENTRY.first, LAST_ENTRY.second);
+        REQUIRE(cache.del(FIRST_ENTRY.first));
+        CHECK_EQ(moved.view(), FIRST_ENTRY.second);
+    }
+}
+
+/// Check that batch operations act on keys in every shard
+void check_batches(const SharedCache::LockMode lock_mode) {
+    SharedCache cache{ENTRIES_SIZE * NUM_SHARDS, NUM_SHARDS,
+                      [] { return std::make_unique<LruEvictor>(); },
+                      lock_mode};
+
+    std::vector<std::pair<key_type, std::string>> entries{ENTRIES.begin(),
+                                                          ENTRIES.end()};
+    std::vector<key_type> keys;
+    for (auto &entry : ENTRIES) {
+        keys.push_back(entry.first);
+    }
+    cache.mset(entries);
+    REQUIRE_EQ(cache.space_used(), ENTRIES_SIZE - ENTRIES.size());
+
+    // Delete the first entry and a missing key
+    REQUIRE_EQ(cache.mdel({FIRST_ENTRY.first, "missing"}), 1U);
+    // Assert that the values are returned in the order of the keys
+    keys.push_back(FIRST_ENTRY.first);
+    const auto values = cache.mget(keys);
+    REQUIRE_EQ(values.size(), keys.size());
+    CHECK_FALSE(values.front());
+    CHECK_FALSE(values.back());
+    auto i = 1U;
+    for (auto entry = std::next(ENTRIES.begin()); entry != ENTRIES.end();
+         ++entry, ++i) {
+        REQUIRE(values[i]);
+        CHECK_EQ(*values[i], entry->second);
+    }
+
+    // Assert that an empty value is found, unlike a missing key
+    cache.set("empty", "");
+    const auto empty = cache.mget({"empty", FIRST_ENTRY.first});
+    REQUIRE(empty.front());
+    CHECK_EQ(*empty.front(), "");
+    CHECK_FALSE(empty.back());
+}
+
+TEST_CASE("SharedCache batch operations act on every shard") {
+    check_batches(SharedCache::LockMode::EXCLUSIVE);
+    check_batches(SharedCache::LockMode::SHARED);
+}
+
+TEST_CASE("SharedCache::mset() applies repeated keys in order") {
+    SharedCache cache{ENTRIES_SIZE * NUM_SHARDS, NUM_SHARDS};
+    cache.mset({{"key", "first"}, {"other", "value"}, {"key", "second"}});
+    REQUIRE_EQ(cache.get("key"), "second");
+}
+
+TEST_CASE("SharedCache::expire() removes expired entries from every shard") {
+    using namespace std::chrono_literals;
+    SharedCache cache{ENTRIES_SIZE * NUM_SHARDS, NUM_SHARDS, nullptr,
+                      SharedCache::LockMode::SHARED};
+    std::vector<std::pair<key_type, std::string>> entries{ENTRIES.begin(),
+                                                          ENTRIES.end()};
+    cache.mset(entries, 10ms);
+    cache.set("kept", "value", 1h);
+    std::this_thread::sleep_for(30ms);
+
+    CHECK_EQ(cache.get(FIRST_ENTRY.first), "");
+    CHECK_EQ(cache.get_pinned(LAST_ENTRY.first).view(), "");
+    REQUIRE_EQ(cache.expire(), ENTRIES.size());
+    CHECK_EQ(cache.space_used(), 5);
+    CHECK_EQ(cache.get("kept"), "value");
+}
+
+/// Have several threads set and read back their own keys concurrently and
+/// check the final `space_used()`
+void check_concurrent_requests(
+    const SharedCache::LockMode lock_mode,
+    const SharedCache::evictor_factory &make_evictor =
+        [] { return std::make_unique<LruEvictor>(); }) {
+    constexpr auto NUM_THREADS = 8;
+    constexpr auto NUM_KEYS = 256;
+    // Leave plenty of room for per-entry overhead so that nothing is evicted
+    SharedCache cache{NUM_KEYS * NUM_THREADS * 256, NUM_SHARDS, make_evictor,
+                      lock_mode};
+
+    // Have each thread set and read back its own keys
+    std::vector<std::future<bool>> futures;
+    for (auto t = 0; t < NUM_THREADS; ++t) {
+        futures.push_back(std::async(std::launch::async, [&cache, t] {
+            auto ok = true;
+            for (auto i = 0; i < NUM_KEYS; ++i) {
+                const auto key = std::to_string(t) + "." + std::to_string(i);
+                cache.set(key, key);
+                ok &= cache.get(key) == key;
+            }
+            return ok;
+        }));
+    }
+    for (auto &future : futures) {
+        CHECK(future.get());
+    }
+    // Every key is stored as its own value
+    Cache::size_type expected = 0;
+    for (auto t = 0; t < NUM_THREADS; ++t) {
+        for (auto i = 0; i < NUM_KEYS; ++i) {
+            expected += (std::to_string(t) + "." + std::to_string(i)).size();
+        }
+    }
+    REQUIRE_EQ(cache.space_used(), expected);
+}
+
+TEST_CASE("SharedCache handles concurrent requests with exclusive locking") {
+    check_concurrent_requests(SharedCache::LockMode::EXCLUSIVE);
+}
+
+TEST_CASE("SharedCache handles concurrent requests with shared locking") {
+    check_concurrent_requests(SharedCache::LockMode::SHARED);
+}
+
+TEST_CASE("SharedCache handles concurrent requests with shared locking and a "
+          "ClockEvictor") {
+    check_concurrent_requests(SharedCache::LockMode::SHARED,
+                              [] { return std::make_unique<ClockEvictor>(); });
+}
+
+TEST_CASE("SharedCache::load() restores the entries saved by "
+          "SharedCache::save()") {
+    using namespace std::chrono_literals;
+    constexpr auto PATH = "test_shared_cache.snapshot";
+    const auto make_lru = [] { return std::make_unique<LruEvictor>(); };
+
+    // Fill a single-shard cache exactly, reading the first entry so that the
+    // second one is least recently used
+    const Cache::size_type MAXMEM = ENTRIES_SIZE - ENTRIES.size();
+    SharedCache cache{MAXMEM, 1, make_lru};
+    for (auto &entry : ENTRIES) {
+        cache.set(entry.first, entry.second);
+    }
+    cache.set(LAST_ENTRY.first, LAST_ENTRY.second, 1h);
+    REQUIRE_EQ(cache.get(FIRST_ENTRY.first), FIRST_ENTRY.second);
+    REQUIRE_EQ(cache.save(PATH), ENTRIES.size());
+
+    // Assert that every entry is restored along with the eviction order, so
+    // that adding another entry evicts the second one
+    SharedCache restored{MAXMEM, 1, make_lru};
+    REQUIRE_EQ(restored.load(PATH), ENTRIES.size());
+    REQUIRE_EQ(restored.space_used(), MAXMEM);
+    const auto &second = *std::next(ENTRIES.begin());
+    restored.set("new", std::string(second.second.length(), 'x'));
+    for (auto &entry : ENTRIES) {
+        CHECK_EQ(restored.get(entry.first),
+                 entry == second ? "" : entry.second);
+    }
+
+    // Assert that snapshots also load into a different number of shards,
+    // and that entries that expired in the meantime are skipped
+    cache.set(FIRST_ENTRY.first, FIRST_ENTRY.second, 10ms);
+    REQUIRE_EQ(cache.save(PATH), ENTRIES.size());
+    std::this_thread::sleep_for(30ms);
+    SharedCache sharded{ENTRIES_SIZE * NUM_SHARDS, NUM_SHARDS};
+    REQUIRE_EQ(sharded.load(PATH), ENTRIES.size() - 1);
+    CHECK_EQ(sharded.get(FIRST_ENTRY.first), "");
+    CHECK_EQ(sharded.get(LAST_ENTRY.first), LAST_ENTRY.second);
+    CHECK_EQ(sharded.space_used(),
+             ENTRIES_SIZE - ENTRIES.size() - FIRST_ENTRY.second.length());
+    std::remove(PATH);
+}
+
+TEST_CASE("SharedCache::save() lets the cache evict while it writes") {
+    constexpr auto PATH = "test_shared_cache.snapshot";
+    constexpr auto NUM_KEYS = 20000;
+    const std::string value(100, 'v');
+    const auto make_lru = [] { return std::make_unique<LruEvictor>(); };
+
+    // Fill a cache with more values than are copied in one batch
+    SharedCache cache{NUM_KEYS * 100, 1, make_lru};
+    for (auto i = 0; i < NUM_KEYS; ++i) {
+        cache.set(std::to_string(i), value);
+    }
+
+    // New keys set during the save evict old ones rather than failing
+    auto setter = std::async(std::launch::async, [&] {
+        auto stored = true;
+        for (auto i = 0; i < NUM_KEYS; ++i) {
+            const auto key = "new" + std::to_string(i);
+            cache.set(key, value);
+            stored &= cache.get(key) == value;
+        }
+        return stored;
+    });
+    const auto saved = cache.save(PATH);
+    CHECK(setter.get());
+
+    // Every entry saved is restored
+    SharedCache restored{NUM_KEYS * 100, 1, make_lru};
+    CHECK_EQ(restored.load(PATH), saved);
+    CHECK_EQ(restored.space_used(), saved * value.size());
+
+    // Values too large to copy are saved too
+    const std::string large(1 << 17, 'l');
+    cache.set("large", large);
+    const auto saved_large = cache.save(PATH);
+    REQUIRE_EQ(restored.load(PATH), saved_large);
+    CHECK_EQ(restored.get("large"), large);
+    std::remove(PATH);
+}
+
+TEST_CASE("SharedCache::load() rejects missing and malformed snapshots") {
+    constexpr auto PATH = "test_shared_cache.snapshot";
+    SharedCache cache{ENTRIES_SIZE, NUM_SHARDS};
+    std::remove(PATH);
+    CHECK_THROWS_AS(cache.load(PATH), std::system_error);
+
+    // Not a snapshot
+    std::ofstream{PATH} << "not a snapshot at all";
+    CHECK_THROWS_AS(cache.load(PATH), std::runtime_error);
+
+    // A snapshot cut off in the middle of an entry
+    for (auto &entry : ENTRIES) {
+        cache.set(entry.first, entry.second);
+    }
+    cache.save(PATH);
+    std::string contents;
+    {
+        std::ifstream file{PATH, std::ios::binary};
+        contents.assign(std::istreambuf_iterator<char>{file}, {});
+    }
+    std::ofstream{PATH, std::ios::binary} << contents.substr(
+        0, contents.size() - 2);
+    SharedCache truncated{ENTRIES_SIZE, NUM_SHARDS};
+    CHECK_THROWS_AS(truncated.load(PATH), std::runtime_error);
+    std::remove(PATH);
+}
@@ -0,0 +1,135 @@
+#include "single_flight.hh"
+#include "test_common.hh"
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+/// Number of threads asking for the same key at once
+constexpr auto NUM_THREADS = 8U;
+
+/// Run `fn(i)` on `NUM_THREADS` threads at once and wait for all of them
+template <typename F> void on_threads(F &&fn) {
+    std::vector<std::thread> threads;
+    for (auto i = 0U; i < NUM_THREADS; ++i) {
+        threads.emplace_back([&fn, i] { fn(i); });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+////////////////////////////////////////////////
+// Single Flight Unit Tests
+////////////////////////////////////////////////
+
+TEST_CASE("SingleFlight::run() loads a key once for concurrent callers") {
+    SingleFlight flights;
+    std::atomic<unsigned> num_loads{0};
+    std::vector<SingleFlight::value_type> results(NUM_THREADS);
+    on_threads([&](unsigned i) {
+        results[i] = flights.run("key", [&] {
+            ++num_loads;
+            // Keep loading until every other thread is waiting
+            while (flights.coalesced() < NUM_THREADS - 1) {
+                std::this_thread::sleep_for(1ms);
+            }
+            return SingleFlight::value_type{"value"};
+        });
+    });
+    CHECK_EQ(num_loads, 1);
+    CHECK_EQ(flights.loads(), 1);
+    CHECK_EQ(flights.coalesced(), NUM_THREADS - 1);
+    for (const auto &result : results) {
+        CHECK_EQ(result, "value");
+    }
+    CHECK_FALSE(flights.loading("key"));
+}
+
+TEST_CASE("SingleFlight::run() loads again once a load has finished") {
+    SingleFlight flights;
+    auto num_loads = 0;
+    const auto load = [&] {
+        ++num_loads;
+        return SingleFlight::value_type{};
+    };
+    CHECK_EQ(flights.run("key", load), std::nullopt);
+    CHECK_EQ(flights.run("key", load), std::nullopt);
+    CHECK_EQ(num_loads, 2);
+    CHECK_EQ(flights.coalesced(), 0);
+}
+
+TEST_CASE("SingleFlight::run() loads different keys separately") {
+    SingleFlight flights;
+    std::atomic<unsigned> num_loads{0};
+    on_threads([&](unsigned i) {
+        const auto key = std::to_string(i);
+        CHECK_EQ(flights.run(key,
+                             [&] {
+                                 ++num_loads;
+                                 return SingleFlight::value_type{key};
+                             }),
+                 key);
+    });
+    CHECK_EQ(num_loads, NUM_THREADS);
+}
+
+TEST_CASE("SingleFlight::run() throws the loader's exception to every "
+          "caller") {
+    SingleFlight flights;
+    std::atomic<unsigned> num_thrown{0};
+    on_threads([&](unsigned) {
+        try {
+            flights.run("key", [&]() -> SingleFlight::value_type {
+                while (flights.coalesced() < NUM_THREADS - 1) {
+                    std::this_thread::sleep_for(1ms);
+                }
+                throw std::runtime_error{"backing store is down"};
+            });
+        } catch (const std::runtime_error &) {
+            ++num_thrown;
+        }
+    });
+    CHECK_EQ(flights.loads(), 1);
+    CHECK_EQ(num_thrown, NUM_THREADS);
+    // The failed load is not remembered
+    CHECK_EQ(flights.run("key", [] { return SingleFlight::value_type{"ok"}; }),
+             "ok");
+}
+
+TEST_CASE("SingleFlight::run_if_idle() skips keys that are being loaded") {
+    SingleFlight flights;
+    std::atomic<bool> loading{false}, done{false};
+    std::thread loader{[&] {
+        flights.run("key", [&] {
+            loading = true;
+            while (!done) {
+                std::this_thread::sleep_for(1ms);
+            }
+            return SingleFlight::value_type{"value"};
+        });
+    }};
+    while (!loading) {
+        std::this_thread::sleep_for(1ms);
+    }
+    CHECK(flights.loading("key"));
+    auto ran = false;
+    CHECK_FALSE(flights.run_if_idle("key", [&] {
+        ran = true;
+        return SingleFlight::value_type{};
+    }));
+    CHECK_FALSE(ran);
+    done = true;
+    loader.join();
+
+    CHECK(flights.run_if_idle("key", [&] {
+        ran = true;
+        return SingleFlight::value_type{};
+    }));
+    CHECK(ran);
+}
@@ -0,0 +1,156 @@
+#include "slab_allocator.hh"
+#include "test_common.hh"
+
+#include <algorithm>
+#include <vector>
+
+/// Memory limit used for tests
+constexpr auto MEMORY_LIMIT = 1 << 16; // 64KiB
+
+////////////////////////////////////////////////
+// SlabAllocator Unit Tests
+////////////////////////////////////////////////
+
+TEST_CASE("SlabAllocator reserves nothing until the first allocation") {
+    SlabAllocator arena{MEMORY_LIMIT};
+    REQUIRE_EQ(arena.reserved(), 0);
+    REQUIRE_GE(arena.limit(), MEMORY_LIMIT);
+}
+
+TEST_CASE("SlabAllocator::allocate() reuses freed chunks") {
+    SlabAllocator arena{MEMORY_LIMIT};
+    auto chunk = arena.allocate(100);
+    REQUIRE_NE(chunk, nullptr);
+    const auto reserved = arena.reserved();
+
+    // Freeing and allocating the same size repeatedly must not reserve more
+    for (auto i = 0; i < 1000; ++i) {
+        arena.deallocate(chunk, 100);
+        chunk = arena.allocate(100);
+        REQUIRE_NE(chunk, nullptr);
+    }
+    REQUIRE_EQ(arena.reserved(), reserved);
+    arena.deallocate(chunk, 100);
+}
+
+TEST_CASE("SlabAllocator::allocate() never exceeds the memory limit") {
+    SlabAllocator arena{MEMORY_LIMIT};
+    std::vector<void *> chunks;
+
+    // Allocate until the arena runs out of memory
+    for (void *chunk; (chunk = arena.allocate(64)) != nullptr;) {
+        chunks.push_back(chunk);
+    }
+    REQUIRE_LE(arena.reserved(), arena.limit());
+    REQUIRE_GT(chunks.size() * 64, MEMORY_LIMIT / 2);
+
+    // Chunks of other sizes cannot be allocated either, since every page is
+    // in use
+    REQUIRE_EQ(arena.allocate(1000), nullptr);
+
+    // Once every chunk is freed, the pages can be used by other size classes
+    for (auto chunk : chunks) {
+        arena.deallocate(chunk, 64);
+    }
+    auto chunk = arena.allocate(1000);
+    REQUIRE_NE(chunk, nullptr);
+    arena.deallocate(chunk, 1000);
+}
+
+TEST_CASE("SlabAllocator::reassign_page() frees a page for another class") {
+    SlabAllocator arena{MEMORY_LIMIT};
+    std::vector<void *> chunks;
+    for (void *chunk; (chunk = arena.allocate(64)) != nullptr;) {
+        chunks.push_back(chunk);
+    }
+    REQUIRE_EQ(arena.allocate(1000), nullptr);
+
+    // A page cannot be emptied if one of its chunks stays in use
+    std::vector<void *> evicted;
+    REQUIRE_FALSE(arena.reassign_page(1000, [&](void *chunk) {
+        if (!evicted.empty()) {
+            arena.deallocate(chunk, 64);
+        }
+        evicted.push_back(chunk);
+    }));
+    REQUIRE_EQ(arena.allocate(1000), nullptr);
+
+    // Once it is emptied, it can be used by the other class
+    const auto kept = evicted.front();
+    evicted.clear();
+    REQUIRE(arena.reassign_page(1000, [&](void *chunk) {
+        arena.deallocate(chunk, 64);
+        evicted.push_back(chunk);
+    }));
+    REQUIRE_EQ(evicted, std::vector<void *>{kept});
+    auto chunk = arena.allocate(1000);
+    REQUIRE_NE(chunk, nullptr);
+    arena.deallocate(chunk, 1000);
+}
+
+TEST_CASE("SlabAllocator::chunk_size() is the size of the chunk allocated") {
+    SlabAllocator arena{MEMORY_LIMIT};
+    for (const auto size : {1U, 16U, 17U, 100U, 1000U}) {
+        const auto chunk_size = arena.chunk_size(size);
+        REQUIRE_GE(chunk_size, size);
+        auto chunk = arena.allocate(size);
+        REQUIRE_NE(chunk, nullptr);
+        for (const auto &stats : arena.stats()) {
+            if (stats.chunks_used != 0) {
+                CHECK_EQ(stats.chunk_size, chunk_size);
+            }
+        }
+        arena.deallocate(chunk, size);
+    }
+    // Large allocations take whole pages
+    CHECK_GE(arena.chunk_size(MEMORY_LIMIT / 4), MEMORY_LIMIT / 4);
+}
+
+TEST_CASE("SlabAllocator::stats() reports usage per size class") {
+    SlabAllocator arena{MEMORY_LIMIT};
+    auto small = arena.allocate(10);
+    auto medium = arena.allocate(500);
+
+    auto chunks_used = 0U;
+    std::size_t bytes_used = 0;
+    for (const auto &stats : arena.stats()) {
+        chunks_used += stats.chunks_used;
+        bytes_used += stats.bytes_used;
+        // Chunks must be large enough for the bytes stored in them
+        if (stats.chunk_size != 0) {
+            CHECK_LE(stats.bytes_used, stats.chunks_used * stats.chunk_size);
+        }
+    }
+    REQUIRE_EQ(chunks_used, 2);
+    REQUIRE_EQ(bytes_used, 510);
+
+    arena.deallocate(small, 10);
+    arena.deallocate(medium, 500);
+}
+
+TEST_CASE("SlabAllocator handles allocations larger than a page") {
+    SlabAllocator arena{MEMORY_LIMIT};
+    auto chunk = static_cast<char *>(arena.allocate(MEMORY_LIMIT / 2));
+    REQUIRE_NE(chunk, nullptr);
+    // The whole allocation must be usable
+    std::fill(chunk, chunk + MEMORY_LIMIT / 2, 'a');
+    REQUIRE_EQ(arena.stats().back().chunks_used, 1);
+    // Allocations larger than the limit must fail
+    REQUIRE_EQ(arena.allocate(MEMORY_LIMIT), nullptr);
+    arena.deallocate(chunk, MEMORY_LIMIT / 2);
+    REQUIRE_EQ(arena.stats().back().chunks_used, 0);
+}
+
+TEST_CASE("SlabAllocator::clear() frees every chunk") {
+    SlabAllocator arena{MEMORY_LIMIT};
+    while (arena.allocate(64) != nullptr) {
+    }
+    const auto reserved = arena.reserved();
+    arena.clear();
+    for (const auto &stats : arena.stats()) {
+        CHECK_EQ(stats.chunks_used, 0);
+    }
+    // The pages are kept for reuse
+    REQUIRE_EQ(arena.reserved(), reserved);
+    REQUIRE_NE(arena.allocate(64), nullptr);
+}
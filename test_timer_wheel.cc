@@ -0,0 +1,130 @@
+#include "test_common.hh"
+#include "timer_wheel.hh"
+
+#include <map>
+#include <random>
+#include <vector>
+
+using wheel_type = TimerWheel<int>;
+
+////////////////////////////////////////////////
+// Timer Wheel Unit Tests
+////////////////////////////////////////////////
+
+TEST_CASE("TimerWheel::advance() expires timers at their deadlines") {
+    wheel_type wheel;
+    wheel.schedule(1, 10);
+    wheel.schedule(2, 100);
+    wheel.schedule(3, 100);
+    REQUIRE_EQ(wheel.size(), 3);
+
+    std::vector<int> expired;
+    const auto collect = [&](int value) { expired.push_back(value); };
+    REQUIRE_EQ(wheel.advance(9, collect), 0);
+    REQUIRE_EQ(wheel.advance(10, collect), 1);
+    REQUIRE_EQ(expired, std::vector<int>{1});
+    REQUIRE_EQ(wheel.advance(99, collect), 0);
+    REQUIRE_EQ(wheel.advance(1000, collect), 2);
+    REQUIRE_EQ(wheel.size(), 0);
+    REQUIRE_EQ(wheel.now(), 1000);
+}
+
+TEST_CASE("TimerWheel::schedule() in the past expires on the next tick") {
+    wheel_type wheel{50};
+    wheel.schedule(1, 10);
+    auto expired = 0;
+    REQUIRE_EQ(wheel.advance(51, [&](int) { ++expired; }), 1);
+    REQUIRE_EQ(expired, 1);
+}
+
+TEST_CASE("TimerWheel::cancel() removes a timer") {
+    wheel_type wheel;
+    const auto first = wheel.schedule(1, 5000);
+    wheel.schedule(2, 5000);
+    wheel.cancel(first);
+    REQUIRE_EQ(wheel.size(), 1);
+
+    std::vector<int> expired;
+    wheel.advance(5000, [&](int value) { expired.push_back(value); });
+    REQUIRE_EQ(expired, std::vector<int>{2});
+}
+
+TEST_CASE("TimerWheel expires timers at every distance at their deadlines") {
+    // Deadlines spread over every level, including past the wheel's range
+    std::mt19937_64 random{389};
+    wheel_type wheel{12345};
+    std::map<int, wheel_type::tick_type> deadlines;
+    for (auto i = 0; i < 2000; ++i) {
+        const auto bits = random() % 40;
+        const auto deadline =
+            wheel.now() + 1 + random() % (uint64_t{1} << bits);
+        wheel.schedule(i, deadline);
+        deadlines.emplace(i, deadline);
+    }
+
+    // Advance in uneven steps, checking every expiry against its deadline
+    auto now = wheel.now();
+    auto num_expired = 0U;
+    while (wheel.size() > 0) {
+        now += 1 + random() % (uint64_t{1} << (random() % 36));
+        wheel.advance(now, [&](int value) {
+            const auto deadline = deadlines.at(value);
+            INFO("deadline " << deadline << ", now " << now);
+            REQUIRE_LE(deadline, now);
+            ++num_expired;
+            deadlines.erase(value);
+        });
+        // Nothing that is due may be left behind
+        for (const auto &[value, deadline] : deadlines) {
+            REQUIRE_GT(deadline, now);
+        }
+    }
+    REQUIRE_EQ(num_expired, 2000);
+}
+
+TEST_CASE("TimerWheel::advance() expires each timer on its exact tick") {
+    // Advance one tick at a time over a few coarse slots
+    wheel_type wheel;
+    std::mt19937 random{389};
+    std::vector<wheel_type::tick_type> deadlines;
+    for (auto i = 0; i < 500; ++i) {
+        deadlines.push_back(1 + random() % 20000);
+        wheel.schedule(i, deadlines.back());
+    }
+    for (wheel_type::tick_type tick = 1; tick <= 20000; ++tick) {
+        wheel.advance(tick, [&](int value) {
+            REQUIRE_EQ(deadlines[value], tick);
+        });
+    }
+    REQUIRE_EQ(wheel.size(), 0);
+}
+
+TEST_CASE("TimerWheel::advance() allows scheduling and cancelling timers "
+          "while expiring") {
+    wheel_type wheel;
+    const auto other = wheel.schedule(2, 10);
+    wheel.schedule(1, 10);
+    std::vector<int> expired;
+    wheel.advance(20, [&](int value) {
+        expired.push_back(value);
+        if (value == 1) {
+            // Cancel the other timer in the same slot and schedule a new one
+            wheel.cancel(other);
+            wheel.schedule(3, 15);
+        }
+    });
+    REQUIRE_EQ(expired, std::vector<int>{1, 3});
+    REQUIRE_EQ(wheel.size(), 0);
+}
+
+TEST_CASE("TimerWheel::clear() cancels every timer") {
+    wheel_type wheel;
+    for (auto i = 0; i < 100; ++i) {
+        wheel.schedule(i, i * 1000);
+    }
+    wheel.clear();
+    REQUIRE_EQ(wheel.size(), 0);
+    auto expired = 0;
+    wheel.advance(1000000, [&](int) { ++expired; });
+    REQUIRE_EQ(expired, 0);
+}
@@ -0,0 +1,136 @@
+#include "test_common.hh"
+#include "trace.hh"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+/// File the tests write traces to
+constexpr auto PATH = "test_trace.trace";
+
+/// Read every record in a trace, copying the keys
+std::vector<std::pair<trace::Record, std::string>>
+read_all(const std::string &path) {
+    trace::Reader reader{path};
+    std::vector<std::pair<trace::Record, std::string>> records;
+    trace::Record record;
+    while (reader.next(record)) {
+        records.emplace_back(record, record.key);
+    }
+    return records;
+}
+
+////////////////////////////////////////////////
+// Trace Unit Tests
+////////////////////////////////////////////////
+
+TEST_CASE("trace::Reader reads back the records added to a trace::Writer") {
+    using namespace std::chrono_literals;
+    {
+        trace::Writer writer{PATH};
+        for (auto &entry : ENTRIES) {
+            writer.add(trace::Op::SET, entry.first, entry.second.length());
+        }
+        std::this_thread::sleep_for(2ms);
+        writer.add(trace::Op::GET, FIRST_ENTRY.first);
+        writer.add(trace::Op::DEL, LAST_ENTRY.first);
+    }
+
+    // Assert that the records are read back in order, with timestamps that
+    // never go backwards
+    const auto records = read_all(PATH);
+    REQUIRE_EQ(records.size(), ENTRIES.size() + 2);
+    auto entry = ENTRIES.begin();
+    for (std::size_t i = 0; i < ENTRIES.size(); ++i, ++entry) {
+        CHECK_EQ(records[i].first.op, trace::Op::SET);
+        CHECK_EQ(records[i].second, entry->first);
+        CHECK_EQ(records[i].first.value_size, entry->second.length());
+        if (i > 0) {
+            CHECK_GE(records[i].first.timestamp,
+                     records[i - 1].first.timestamp);
+        }
+    }
+    const auto &get = records[ENTRIES.size()];
+    CHECK_EQ(get.first.op, trace::Op::GET);
+    CHECK_EQ(get.second, FIRST_ENTRY.first);
+    CHECK_EQ(get.first.value_size, 0);
+    CHECK_GE(get.first.timestamp - records.front().first.timestamp, 2ms);
+    CHECK_EQ(records.back().first.op, trace::Op::DEL);
+    CHECK_EQ(records.back().second, LAST_ENTRY.first);
+    std::remove(PATH);
+}
+
+TEST_CASE("trace::Writer records requests from several threads") {
+    constexpr auto NUM_THREADS = 4;
+    constexpr auto NUM_RECORDS = 10000;
+    {
+        trace::Writer writer{PATH};
+        std::vector<std::thread> threads;
+        for (auto i = 0; i < NUM_THREADS; ++i) {
+            threads.emplace_back([&, i] {
+                for (auto j = 0; j < NUM_RECORDS; ++j) {
+                    writer.add(trace::Op::GET, std::to_string(i));
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+
+    // Assert that no record was lost or interleaved with another
+    const auto records = read_all(PATH);
+    REQUIRE_EQ(records.size(), NUM_THREADS * NUM_RECORDS);
+    std::vector<unsigned> counts(NUM_THREADS);
+    for (std::size_t i = 0; i < records.size(); ++i) {
+        REQUIRE_EQ(records[i].second.size(), 1);
+        ++counts.at(std::stoi(records[i].second));
+        if (i > 0) {
+            CHECK_GE(records[i].first.timestamp,
+                     records[i - 1].first.timestamp);
+        }
+    }
+    for (const auto count : counts) {
+        CHECK_EQ(count, NUM_RECORDS);
+    }
+    std::remove(PATH);
+}
+
+TEST_CASE("trace::Reader rejects missing and malformed traces") {
+    std::remove(PATH);
+    CHECK_THROWS_AS(trace::Reader{PATH}, std::system_error);
+
+    // Not a trace
+    std::ofstream{PATH} << "not a trace at all";
+    CHECK_THROWS_AS(trace::Reader{PATH}, std::runtime_error);
+
+    // A trace cut off in the middle of its last record, as when the server
+    // recording it is killed, reads up to the last whole record
+    {
+        trace::Writer writer{PATH};
+        writer.add(trace::Op::SET, FIRST_ENTRY.first, 1);
+        writer.add(trace::Op::GET, LAST_ENTRY.first);
+    }
+    std::string contents;
+    {
+        std::ifstream file{PATH, std::ios::binary};
+        contents.assign(std::istreambuf_iterator<char>{file}, {});
+    }
+    std::ofstream{PATH, std::ios::binary} << contents.substr(
+        0, contents.size() - 1);
+    const auto records = read_all(PATH);
+    REQUIRE_EQ(records.size(), 1);
+    CHECK_EQ(records.front().second, FIRST_ENTRY.first);
+
+    // A record of an unknown type
+    contents[8 + 14] = '\x7f';
+    std::ofstream{PATH, std::ios::binary} << contents;
+    CHECK_THROWS_AS(read_all(PATH), std::runtime_error);
+    std::remove(PATH);
+}
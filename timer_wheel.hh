@@ -0,0 +1,227 @@
+/*
+ * Hierarchical timer wheel used by the cache library to expire entries.
+ * Time is measured in integer ticks. Each level has 64 slots, and each slot of
+ * a level spans 64 slots of the level below, so a timer is placed in the
+ * level whose slots are just fine enough for how far away its deadline is.
+ * Advancing the wheel only visits the slots that come due (moving the timers
+ * in a coarse slot down to finer ones when the slot is reached), and skips
+ * straight over stretches of time with no timers in the finer levels, so
+ * expiring timers never scans every timer.
+ */
+
+#ifndef TIMER_WHEEL_HH
+#define TIMER_WHEEL_HH
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+template <typename Value> class TimerWheel {
+  public:
+    using tick_type = uint64_t;
+    // Handle for a scheduled timer (valid until the timer expires or is
+    // cancelled)
+    using timer_id = uint32_t;
+
+    // Handle that never refers to a timer
+    static constexpr timer_id NONE = UINT32_MAX;
+
+  private:
+    static constexpr unsigned SLOT_BITS = 6;
+    static constexpr unsigned SLOTS = 1U << SLOT_BITS;
+    // Six levels cover 2^36 ticks (over two years of milliseconds); later
+    // deadlines wait in the last level until they come within range
+    static constexpr unsigned LEVELS = 6;
+    static constexpr tick_type RANGE = tick_type{1} << (SLOT_BITS * LEVELS);
+
+    struct Node {
+        Value value;
+        tick_type deadline;
+        // Links in the slot's list (or in the free list, through `next`)
+        timer_id prev;
+        timer_id next;
+        // Index of the slot the timer is in
+        uint16_t slot;
+    };
+
+    // Timers are stored by index, so that handles stay small and valid as
+    // the vector grows
+    std::vector<Node> nodes;
+    timer_id free_list = NONE;
+    // First timer in each slot of each level
+    std::array<timer_id, LEVELS * SLOTS> slots;
+    // Number of timers in each level
+    std::array<std::size_t, LEVELS> level_sizes{};
+    std::size_t num_timers = 0;
+    tick_type current;
+
+    // Add a timer to the slot for its deadline (which must be after the
+    // current tick, unless the timer is being moved down at that tick)
+    void place(timer_id id) {
+        auto &node = nodes[id];
+        auto delta = node.deadline - current;
+        auto deadline = node.deadline;
+        if (delta >= RANGE) {
+            delta = RANGE - 1;
+            deadline = current + delta;
+        }
+        auto level = 0U;
+        while (delta >= tick_type{SLOTS} << (SLOT_BITS * level)) {
+            ++level;
+        }
+        const auto index =
+            level * SLOTS + ((deadline >> (SLOT_BITS * level)) & (SLOTS - 1));
+        node.slot = static_cast<uint16_t>(index);
+        node.prev = NONE;
+        node.next = slots[index];
+        if (node.next != NONE) {
+            nodes[node.next].prev = id;
+        }
+        slots[index] = id;
+        ++level_sizes[level];
+    }
+
+    // Remove a timer from its slot
+    void unlink(timer_id id) {
+        const auto &node = nodes[id];
+        if (node.prev != NONE) {
+            nodes[node.prev].next = node.next;
+        } else {
+            slots[node.slot] = node.next;
+        }
+        if (node.next != NONE) {
+            nodes[node.next].prev = node.prev;
+        }
+        --level_sizes[node.slot / SLOTS];
+    }
+
+    // Return an unlinked timer to the free list
+    void release(timer_id id) {
+        nodes[id].next = free_list;
+        free_list = id;
+        --num_timers;
+    }
+
+    // Handle every slot that is reached at the current tick, calling
+    // `on_expire` for the timers that expire; returns how many did
+    template <typename F> std::size_t run_slots(F &on_expire) {
+        // Move the timers in each coarse slot that is reached down to finer
+        // slots, from the coarsest level down (so that timers moved into a
+        // slot that is also reached now are handled in the same tick)
+        for (auto level = LEVELS - 1; level > 0; --level) {
+            const auto shift = SLOT_BITS * level;
+            if ((current & ((tick_type{1} << shift) - 1)) != 0) {
+                continue;
+            }
+            const auto index =
+                level * SLOTS + ((current >> shift) & (SLOTS - 1));
+            // Timers due at exactly the current tick land in the finest slot
+            // for it, which is handled below
+            for (auto id = slots[index]; id != NONE; id = slots[index]) {
+                unlink(id);
+                place(id);
+            }
+        }
+        // Expire the timers in the finest slot for the current tick (taking
+        // them one at a time, since `on_expire` may cancel the others)
+        std::size_t expired = 0;
+        const auto index = current & (SLOTS - 1);
+        for (auto id = slots[index]; id != NONE; id = slots[index]) {
+            unlink(id);
+            const auto value = nodes[id].value;
+            release(id);
+            ++expired;
+            on_expire(value);
+        }
+        return expired;
+    }
+
+  public:
+    // Create an empty wheel starting at the given tick
+    explicit TimerWheel(tick_type now = 0) : current{now} {
+        slots.fill(NONE);
+    }
+
+    // Get the tick the wheel has been advanced to
+    tick_type now() const {
+        return current;
+    }
+
+    // Get the number of scheduled timers
+    std::size_t size() const {
+        return num_timers;
+    }
+
+    // Schedule a timer for `value` that expires once the wheel is advanced
+    // to `deadline` (or to the next tick, if the deadline has passed)
+    timer_id schedule(const Value &value, tick_type deadline) {
+        if (deadline <= current) {
+            deadline = current + 1;
+        }
+        timer_id id;
+        if (free_list != NONE) {
+            id = free_list;
+            free_list = nodes[id].next;
+        } else {
+            id = static_cast<timer_id>(nodes.size());
+            nodes.emplace_back();
+        }
+        nodes[id].value = value;
+        nodes[id].deadline = deadline;
+        ++num_timers;
+        place(id);
+        return id;
+    }
+
+    // Get the deadline of a scheduled timer
+    tick_type deadline(timer_id id) const {
+        return nodes[id].deadline;
+    }
+
+    // Cancel a scheduled timer
+    void cancel(timer_id id) {
+        unlink(id);
+        release(id);
+    }
+
+    // Advance the wheel to tick `now`, removing every timer whose deadline
+    // is at or before it and calling `on_expire(value)` for each one after it
+    // has been removed (which may schedule or cancel other timers); returns
+    // the number of timers that expired
+    template <typename F> std::size_t advance(tick_type now, F &&on_expire) {
+        std::size_t expired = 0;
+        while (current < now) {
+            // Find the finest level with any timers; nothing happens until
+            // the next tick that reaches one of its slots
+            auto level = 0U;
+            while (level < LEVELS && level_sizes[level] == 0) {
+                ++level;
+            }
+            if (level == LEVELS) {
+                current = now;
+                break;
+            }
+            const auto shift = SLOT_BITS * level;
+            const auto next = ((current >> shift) + 1) << shift;
+            if (next > now) {
+                current = now;
+                break;
+            }
+            current = next;
+            expired += run_slots(on_expire);
+        }
+        return expired;
+    }
+
+    // Cancel every timer
+    void clear() {
+        nodes.clear();
+        free_list = NONE;
+        slots.fill(NONE);
+        level_sizes.fill(0);
+        num_timers = 0;
+    }
+};
+
+#endif // TIMER_WHEEL_HH
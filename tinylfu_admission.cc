@@ -0,0 +1,134 @@
+#include "tinylfu_admission.hh"
+
+#include <algorithm>
+#include <functional>
+
+namespace {
+
+// Mask of the low 3 bits of every counter in a word, used to halve them all
+constexpr uint64_t HALF_MASK = 0x7777777777777777ULL;
+
+// Maximum value of a counter
+constexpr uint64_t MAX_COUNT = 15;
+
+// Finalizer from MurmurHash3, used to derive a different hash for each row
+uint64_t mix(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+uint64_t hash_key(const key_type &key) {
+    return std::hash<key_type>{}(key);
+}
+
+} // namespace
+
+////////////////////////////////////////////////
+// FrequencySketch
+////////////////////////////////////////////////
+
+FrequencySketch::FrequencySketch(std::size_t expected_entries)
+: sample_size{10 * std::max<std::size_t>(expected_entries, 1)} {
+    // Use a power of two number of words, with at least one for every four
+    // entries (so about four counters per entry in each row)
+    std::size_t num_words = 1;
+    while (num_words * 4 < expected_entries) {
+        num_words *= 2;
+    }
+    table.resize(num_words);
+    counter_mask = num_words * 16 - 1;
+}
+
+uint64_t FrequencySketch::counter_index(uint64_t hash, unsigned row) const {
+    return mix(hash + row * 0x9e3779b97f4a7c15ULL) & counter_mask;
+}
+
+void FrequencySketch::age() {
+    for (auto &word : table) {
+        word = (word >> 1) & HALF_MASK;
+    }
+    additions /= 2;
+}
+
+void FrequencySketch::increment(uint64_t hash) {
+    bool incremented = false;
+    for (auto row = 0U; row < DEPTH; ++row) {
+        const auto index = counter_index(hash, row);
+        auto &word = table[index / 16];
+        const auto shift = (index % 16) * 4;
+        if (((word >> shift) & MAX_COUNT) != MAX_COUNT) {
+            word += uint64_t{1} << shift;
+            incremented = true;
+        }
+    }
+    // Keys whose counters are all saturated do not count towards aging
+    if (incremented && ++additions == sample_size) {
+        age();
+    }
+}
+
+unsigned FrequencySketch::frequency(uint64_t hash) const {
+    auto result = MAX_COUNT;
+    for (auto row = 0U; row < DEPTH; ++row) {
+        const auto index = counter_index(hash, row);
+        const auto shift = (index % 16) * 4;
+        result = std::min(result, (table[index / 16] >> shift) & MAX_COUNT);
+    }
+    return static_cast<unsigned>(result);
+}
+
+void FrequencySketch::clear() {
+    std::fill(table.begin(), table.end(), 0);
+    additions = 0;
+}
+
+////////////////////////////////////////////////
+// TinyLfuAdmission
+////////////////////////////////////////////////
+
+TinyLfuAdmission::TinyLfuAdmission(std::size_t expected_entries,
+                                   std::size_t window_size)
+: sketch{expected_entries}, window_size{window_size} {}
+
+void TinyLfuAdmission::record(const key_type &key) {
+    sketch.increment(hash_key(key));
+    // A key in the window has proven itself once it is accessed again
+    if (!window.empty()) {
+        window.erase(key);
+    }
+}
+
+bool TinyLfuAdmission::admit(const key_type &candidate,
+                             const key_type &victim) {
+    // Keys in the window are replaced in the evictor's order, so a new key
+    // can always take the place of one (this is also how the window is
+    // emptied of keys that were never accessed again)
+    if (window.erase(victim) != 0 ||
+        (window_size != 0 && window.size() < window_size)) {
+        window.insert(candidate);
+        return true;
+    }
+    // Otherwise only admit keys that are used more often than the victim
+    return sketch.frequency(hash_key(candidate)) >
+           sketch.frequency(hash_key(victim));
+}
+
+void TinyLfuAdmission::forget(const key_type &key) {
+    if (!window.empty()) {
+        window.erase(key);
+    }
+}
+
+void TinyLfuAdmission::clear() {
+    // Keep the frequencies, since they describe the workload rather than the
+    // contents of the cache
+    window.clear();
+}
+
+unsigned TinyLfuAdmission::frequency(const key_type &key) const {
+    return sketch.frequency(hash_key(key));
+}
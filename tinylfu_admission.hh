@@ -0,0 +1,75 @@
+#ifndef TINYLFU_ADMISSION_HH
+#define TINYLFU_ADMISSION_HH
+
+#include "admission.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_set>
+#include <vector>
+
+// Count-min sketch of 4-bit counters estimating how often each key has been
+// accessed recently. Every `10 * expected_entries` increments, all counters
+// are halved, so keys that were popular a long time ago are forgotten.
+class FrequencySketch {
+  private:
+    // Number of counters incremented for each key (one in each "row")
+    static constexpr unsigned DEPTH = 4;
+
+    // Each word holds 16 counters
+    std::vector<uint64_t> table;
+    // Mask giving the index of a counter (the number of counters is a power
+    // of two)
+    uint64_t counter_mask;
+    std::size_t additions = 0;
+    std::size_t sample_size;
+
+    // Index of the counter for a hash in the given row
+    uint64_t counter_index(uint64_t hash, unsigned row) const;
+    // Halve every counter
+    void age();
+
+  public:
+    // The sketch uses roughly 2 bytes per expected entry
+    explicit FrequencySketch(std::size_t expected_entries);
+
+    // Record an access to the key with the given hash
+    void increment(uint64_t hash);
+
+    // Estimate the number of accesses to the key with the given hash (at
+    // most 15)
+    unsigned frequency(uint64_t hash) const;
+
+    // Reset every counter to zero
+    void clear();
+};
+
+// TinyLFU admission: a new key is admitted only if it has been accessed more
+// often than the victim it would replace, according to a frequency sketch.
+//
+// If `window_size` is nonzero, up to that many newly added keys are also
+// admitted without a frequency check (W-TinyLFU), so a key that has just
+// become popular is not rejected while its count is still low. Such a key
+// leaves the window when it is accessed again or removed, and a key from the
+// window may always be replaced by another new key.
+class TinyLfuAdmission final : public Admission {
+  private:
+    FrequencySketch sketch;
+    const std::size_t window_size;
+    // Keys admitted through the window that have not been accessed since
+    std::unordered_set<key_type> window;
+
+  public:
+    TinyLfuAdmission(std::size_t expected_entries,
+                     std::size_t window_size = 0);
+
+    void record(const key_type &key) override;
+    bool admit(const key_type &candidate, const key_type &victim) override;
+    void forget(const key_type &key) override;
+    void clear() override;
+
+    // Estimate the number of accesses to a key (at most 15)
+    unsigned frequency(const key_type &key) const;
+};
+
+#endif // TINYLFU_ADMISSION_HH
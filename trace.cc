@@ -0,0 +1,163 @@
+#include "trace.hh"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <system_error>
+
+namespace {
+
+constexpr char MAGIC[8] = {'C', 'T', 'R', 'A', 'C', 'E', '0', '1'};
+constexpr std::size_t RECORD_HEADER_SIZE = 8 + 4 + 2 + 1;
+
+/// Largest key a record can hold
+constexpr std::size_t MAX_KEY_SIZE = UINT16_MAX;
+
+/// Bytes buffered before they are written out
+constexpr std::size_t BUFFER_SIZE = 1 << 20; // 1MiB
+
+void append_le(std::string &out, std::uint64_t value, unsigned bytes) {
+    for (auto i = 0U; i < bytes; ++i) {
+        out.push_back(static_cast<char>(value >> (8 * i)));
+    }
+}
+
+std::uint64_t decode_le(const char *in, unsigned bytes) {
+    std::uint64_t value = 0;
+    for (auto i = 0U; i < bytes; ++i) {
+        value |= std::uint64_t{static_cast<unsigned char>(in[i])} << (8 * i);
+    }
+    return value;
+}
+
+std::system_error system_error(const std::string &what) {
+    return {errno, std::generic_category(), what};
+}
+
+} // namespace
+
+namespace trace {
+
+Writer::Writer(std::string path) : path{std::move(path)} {
+    fd = open(this->path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+              0644);
+    if (fd < 0) {
+        throw system_error("unable to create " + this->path);
+    }
+    buffer.reserve(BUFFER_SIZE + RECORD_HEADER_SIZE + MAX_KEY_SIZE);
+    buffer.assign(MAGIC, sizeof(MAGIC));
+}
+
+Writer::~Writer() {
+    try {
+        flush();
+    } catch (const std::system_error &error) {
+        std::cerr << "error: " << error.what() << std::endl;
+    }
+    close(fd);
+}
+
+void Writer::flush_locked() {
+    for (std::size_t written = 0; written < buffer.size();) {
+        const auto result =
+            write(fd, buffer.data() + written, buffer.size() - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            buffer.clear();
+            throw system_error("unable to write " + path);
+        }
+        written += static_cast<std::size_t>(result);
+    }
+    buffer.clear();
+}
+
+void Writer::flush() {
+    const std::lock_guard lock{mutex};
+    flush_locked();
+}
+
+void Writer::add(Op op, std::string_view key, std::size_t value_size) {
+    key = key.substr(0, MAX_KEY_SIZE);
+    const std::lock_guard lock{mutex};
+    // Timestamped with the lock held, so the records stay in order
+    const auto timestamp =
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start)
+            .count();
+    append_le(buffer, static_cast<std::uint64_t>(timestamp), 8);
+    append_le(buffer, std::min<std::size_t>(value_size, UINT32_MAX), 4);
+    append_le(buffer, key.size(), 2);
+    buffer.push_back(static_cast<char>(op));
+    buffer.append(key);
+    if (buffer.size() >= BUFFER_SIZE) {
+        flush_locked();
+    }
+}
+
+Reader::Reader(const std::string &path) {
+    const auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw system_error("unable to open " + path);
+    }
+    struct stat stats;
+    if (fstat(fd, &stats) != 0) {
+        const auto error = system_error("unable to read " + path);
+        close(fd);
+        throw error;
+    }
+    file_size = static_cast<std::size_t>(stats.st_size);
+    if (file_size < sizeof(MAGIC)) {
+        close(fd);
+        throw std::runtime_error(path + " is not a trace");
+    }
+    const auto mapping =
+        mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        throw system_error("unable to map " + path);
+    }
+    data = static_cast<const char *>(mapping);
+    // Records are read from start to end
+    madvise(mapping, file_size, MADV_SEQUENTIAL | MADV_WILLNEED);
+    if (std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0) {
+        munmap(mapping, file_size);
+        throw std::runtime_error(path + " is not a trace");
+    }
+    offset = sizeof(MAGIC);
+}
+
+Reader::~Reader() {
+    munmap(const_cast<char *>(data), file_size);
+}
+
+bool Reader::next(Record &record) {
+    if (file_size - offset < RECORD_HEADER_SIZE) {
+        return false;
+    }
+    const auto header = data + offset;
+    const auto key_size = decode_le(header + 12, 2);
+    if (file_size - offset - RECORD_HEADER_SIZE < key_size) {
+        return false;
+    }
+    const auto op = static_cast<unsigned char>(header[14]);
+    if (op > static_cast<unsigned char>(Op::DEL)) {
+        throw std::runtime_error("trace has a record of unknown type");
+    }
+    record.timestamp = std::chrono::microseconds{decode_le(header, 8)};
+    record.value_size = static_cast<std::uint32_t>(decode_le(header + 8, 4));
+    record.op = static_cast<Op>(op);
+    record.key = {header + RECORD_HEADER_SIZE, key_size};
+    offset += RECORD_HEADER_SIZE + key_size;
+    return true;
+}
+
+} // namespace trace
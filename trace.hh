@@ -0,0 +1,97 @@
+/*
+ * Request traces, recorded by cache_server with `--record-trace` and replayed
+ * by request_driver. A trace is the 8-byte magic "CTRACE01" followed by a
+ * record for each request for a key (a batch request has one for each of its
+ * keys), in the order the server handled them:
+ *
+ *     u64 timestamp | u32 value_size | u16 key_size | u8 op | key
+ *
+ * where `timestamp` is in microseconds since recording started, and
+ * `value_size` is the size of the value set (0 for GETs and DELs). Values
+ * themselves are not recorded. All integers are little-endian. There is no
+ * count of records, so a trace can be read up to wherever recording stopped;
+ * a partial record at the end (from a server that was killed) is ignored.
+ */
+
+#ifndef TRACE_HH
+#define TRACE_HH
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace trace {
+
+/// Types of request in a trace
+enum class Op : std::uint8_t { GET = 0, SET = 1, DEL = 2 };
+
+/// A record read from a trace (the key points into the mapped file)
+struct Record {
+    /// Time since recording started
+    std::chrono::microseconds timestamp;
+    Op op;
+    std::string_view key;
+    std::uint32_t value_size;
+};
+
+/// Writes a trace, buffering records and writing them out in large chunks.
+/// Records may be added from several threads at once.
+class Writer {
+  private:
+    const std::string path;
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    int fd;
+    std::mutex mutex;
+    std::string buffer;
+
+    /// Write out the buffer (with `mutex` held)
+    void flush_locked();
+
+  public:
+    /// Create the trace file, replacing any file at `path` (throws
+    /// `std::system_error` on failure, as do the other methods)
+    explicit Writer(std::string path);
+    /// Write out the remaining records and close the file (errors are
+    /// reported rather than thrown)
+    ~Writer();
+
+    Writer(const Writer &) = delete;
+    Writer &operator=(const Writer &) = delete;
+
+    /// Record a request, timestamped now (keys longer than 64KiB are cut
+    /// short)
+    void add(Op op, std::string_view key, std::size_t value_size = 0);
+
+    /// Write out every record added so far
+    void flush();
+};
+
+/// Reads a trace by mapping it into memory, so several readers of the same
+/// trace (one per replaying thread) share the file's pages
+class Reader {
+  private:
+    const char *data = nullptr;
+    std::size_t file_size = 0;
+    std::size_t offset;
+
+  public:
+    /// Map a trace (throws `std::system_error` if it cannot be opened, and
+    /// `std::runtime_error` if it is not a trace)
+    explicit Reader(const std::string &path);
+    ~Reader();
+
+    Reader(const Reader &) = delete;
+    Reader &operator=(const Reader &) = delete;
+
+    /// Read the next record; returns false after the last one (throws
+    /// `std::runtime_error` if a record has an unknown type)
+    bool next(Record &record);
+};
+
+} // namespace trace
+
+#endif // TRACE_HH
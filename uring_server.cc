@@ -0,0 +1,541 @@
+#include "uring_server.hh"
+
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <system_error>
+#include <vector>
+
+namespace {
+
+// Number of submission queue entries (the completion queue gets four times as
+// many, since every multishot receive can complete many times)
+constexpr unsigned RING_ENTRIES = 512;
+
+// Number and size of the receive buffers registered with the kernel
+constexpr unsigned NUM_BUFFERS = 256; // Must be a power of two
+constexpr unsigned BUFFER_SIZE = 16U << 10; // 16KiB
+constexpr uint16_t BUFFER_GROUP = 0;
+
+// Kinds of operation, stored in the low bits of each submission's user data
+// (above them is the connection's index)
+enum Operation : uint64_t { ACCEPT, RECEIVE, SEND, WAKE };
+constexpr unsigned OPERATION_BITS = 2;
+
+uint64_t user_data(Operation operation, uint64_t id = 0) {
+    return id << OPERATION_BITS | operation;
+}
+
+// There is no liburing, so the system calls are made directly
+int io_uring_setup(unsigned entries, io_uring_params *params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                   unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit,
+                                    min_complete, flags, nullptr, 0));
+}
+
+int io_uring_register(int fd, unsigned opcode, const void *arg,
+                      unsigned nr_args) {
+    return static_cast<int>(
+        syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+std::system_error system_error(int error, const char *what) {
+    return {error, std::generic_category(), what};
+}
+
+// Indices shared with the kernel must be accessed atomically, with acquire
+// and release ordering around the entries they guard
+template <typename T> T load_acquire(const T *pointer) {
+    return __atomic_load_n(pointer, __ATOMIC_ACQUIRE);
+}
+
+template <typename T> void store_release(T *pointer, T value) {
+    __atomic_store_n(pointer, value, __ATOMIC_RELEASE);
+}
+
+// Map part of the ring into memory
+void *map_ring(int fd, std::size_t size, off_t offset) {
+    const auto pointer = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, fd, offset);
+    if (pointer == MAP_FAILED) {
+        throw system_error(errno, "unable to map io_uring");
+    }
+    return pointer;
+}
+
+// Get a field of a ring at an offset given by the kernel
+template <typename T> T *at_offset(void *ring, unsigned offset) {
+    return reinterpret_cast<T *>(static_cast<char *>(ring) + offset);
+}
+
+} // namespace
+
+class UringServer::Impl {
+  private:
+    struct Connection {
+        int fd;
+        // Bytes received but not handled yet (at most one partial request)
+        std::string input;
+        // Responses waiting to be sent, and the responses being sent (which
+        // must stay put until the send completes)
+        std::string output;
+        std::string sending;
+        std::size_t sent = 0;
+        // Whether a multishot receive or a send is in flight
+        bool receiving = false;
+        bool send_in_flight = false;
+        // Whether the connection is being closed (it is freed once nothing is
+        // in flight)
+        bool closing = false;
+
+        explicit Connection(int fd) : fd{fd} {}
+    };
+
+    const int listen_fd;
+    const handler_type handler;
+    const connection_hook_type on_connection;
+
+    int ring_fd = -1;
+    io_uring_params params{};
+
+    // Submission queue
+    void *sq_ring = nullptr;
+    std::size_t sq_ring_size = 0;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned *sq_array;
+    io_uring_sqe *sqes = nullptr;
+    std::size_t sqes_size = 0;
+    // Tail of the entries filled in but not handed to the kernel yet
+    unsigned sq_pending_tail;
+    unsigned to_submit = 0;
+
+    // Completion queue (shares the submission queue's mapping if the kernel
+    // supports it)
+    void *cq_ring = nullptr;
+    std::size_t cq_ring_size = 0;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    io_uring_cqe *cqes;
+
+    // Ring of receive buffers registered with the kernel
+    // (The ring is accessed as an array of entries, since the kernel header's
+    // `bufs` member is at the wrong offset when compiled as C++; the ring's
+    // tail overlays the first entry's reserved field)
+    io_uring_buf *buffer_ring = nullptr;
+    std::size_t buffer_ring_size = 0;
+    std::vector<char> buffers;
+    uint16_t buffer_tail = 0;
+
+    // Event file written to by `stop()`
+    int wake_fd = -1;
+    uint64_t wake_value;
+    bool stopping = false;
+
+    // Connections by index (nullptr once freed), and the free indices
+    std::vector<std::unique_ptr<Connection>> connections;
+    std::vector<uint64_t> free_ids;
+    // Connections with responses to send once the current batch of
+    // completions has been handled
+    std::vector<uint64_t> to_flush;
+
+    // Hand every pending submission to the kernel, and wait for at least
+    // `wait_for` completions
+    void submit(unsigned wait_for) {
+        store_release(sq_tail, sq_pending_tail);
+        while (true) {
+            const auto result =
+                io_uring_enter(ring_fd, to_submit, wait_for,
+                               wait_for != 0 ? IORING_ENTER_GETEVENTS : 0);
+            if (result >= 0) {
+                to_submit -= std::min<unsigned>(to_submit, result);
+                if (to_submit == 0) {
+                    return;
+                }
+            } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                throw system_error(errno, "unable to enter io_uring");
+            }
+        }
+    }
+
+    // Get a submission queue entry to fill in (it is submitted by the next
+    // call to `submit()`)
+    io_uring_sqe *get_sqe() {
+        if (sq_pending_tail - load_acquire(sq_head) == params.sq_entries) {
+            submit(0);
+        }
+        const auto index = sq_pending_tail & sq_mask;
+        sq_array[index] = index;
+        ++sq_pending_tail;
+        ++to_submit;
+        auto sqe = &sqes[index];
+        *sqe = {};
+        return sqe;
+    }
+
+    // Give a receive buffer back to the kernel
+    void recycle_buffer(uint16_t id) {
+        auto &buffer = buffer_ring[buffer_tail & (NUM_BUFFERS - 1)];
+        buffer.addr = reinterpret_cast<uint64_t>(
+            buffers.data() + std::size_t{id} * BUFFER_SIZE);
+        buffer.len = BUFFER_SIZE;
+        buffer.bid = id;
+        ++buffer_tail;
+        store_release(&buffer_ring->resv, buffer_tail);
+    }
+
+    void submit_accept() {
+        auto sqe = get_sqe();
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = listen_fd;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_CLOEXEC;
+        sqe->user_data = user_data(ACCEPT);
+    }
+
+    void submit_wake() {
+        auto sqe = get_sqe();
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = wake_fd;
+        sqe->addr = reinterpret_cast<uint64_t>(&wake_value);
+        sqe->len = sizeof(wake_value);
+        sqe->user_data = user_data(WAKE);
+    }
+
+    void submit_receive(uint64_t id) {
+        auto &connection = *connections[id];
+        auto sqe = get_sqe();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = connection.fd;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUFFER_GROUP;
+        sqe->user_data = user_data(RECEIVE, id);
+        connection.receiving = true;
+    }
+
+    void submit_send(uint64_t id) {
+        auto &connection = *connections[id];
+        auto sqe = get_sqe();
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = connection.fd;
+        sqe->addr = reinterpret_cast<uint64_t>(connection.sending.data() +
+                                               connection.sent);
+        sqe->len =
+            static_cast<uint32_t>(connection.sending.size() - connection.sent);
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = user_data(SEND, id);
+        connection.send_in_flight = true;
+    }
+
+    // Start sending the connection's responses, unless a send is already in
+    // flight (they are sent once it completes)
+    void flush(uint64_t id) {
+        auto &connection = *connections[id];
+        if (connection.closing || connection.send_in_flight ||
+            connection.output.empty()) {
+            return;
+        }
+        connection.sending.swap(connection.output);
+        connection.output.clear();
+        connection.sent = 0;
+        submit_send(id);
+    }
+
+    // Start closing a connection: shutting it down ends its receive, and it
+    // is freed once nothing is in flight
+    void close_connection(uint64_t id) {
+        auto &connection = *connections[id];
+        if (!connection.closing) {
+            connection.closing = true;
+            shutdown(connection.fd, SHUT_RDWR);
+        }
+        if (!connection.receiving && !connection.send_in_flight) {
+            close(connection.fd);
+            connections[id] = nullptr;
+            free_ids.push_back(id);
+            if (on_connection) {
+                on_connection(false);
+            }
+        }
+    }
+
+    void on_accept(const io_uring_cqe &cqe) {
+        if (!(cqe.flags & IORING_CQE_F_MORE) && !stopping) {
+            submit_accept();
+        }
+        if (cqe.res < 0) {
+            return;
+        }
+        const auto fd = cqe.res;
+        const int no_delay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+        uint64_t id;
+        if (!free_ids.empty()) {
+            id = free_ids.back();
+            free_ids.pop_back();
+        } else {
+            id = connections.size();
+            connections.emplace_back();
+        }
+        connections[id] = std::make_unique<Connection>(fd);
+        if (on_connection) {
+            on_connection(true);
+        }
+        submit_receive(id);
+    }
+
+    void on_receive(uint64_t id, const io_uring_cqe &cqe) {
+        auto &connection = *connections[id];
+        if (cqe.res > 0 && !connection.closing) {
+            const auto buffer_id =
+                static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            const std::string_view data{
+                buffers.data() + std::size_t{buffer_id} * BUFFER_SIZE,
+                static_cast<std::size_t>(cqe.res)};
+            // Handle the requests straight from the buffer unless part of one
+            // is left over from before
+            std::optional<std::size_t> used;
+            if (connection.input.empty()) {
+                used = handler(data, connection.output);
+                if (used) {
+                    connection.input.assign(data.substr(*used));
+                }
+            } else {
+                connection.input.append(data);
+                used = handler(connection.input, connection.output);
+                if (used) {
+                    connection.input.erase(0, *used);
+                }
+            }
+            if (!used) {
+                close_connection(id);
+            } else if (!connection.output.empty()) {
+                to_flush.push_back(id);
+            }
+        }
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            recycle_buffer(
+                static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+        }
+        if (cqe.flags & IORING_CQE_F_MORE) {
+            return;
+        }
+        connection.receiving = false;
+        // The receive ends when the kernel runs out of buffers, in which case
+        // it is simply started again; otherwise the connection is done
+        if (cqe.res == -ENOBUFS && !connection.closing) {
+            submit_receive(id);
+        } else {
+            close_connection(id);
+        }
+    }
+
+    void on_send(uint64_t id, const io_uring_cqe &cqe) {
+        auto &connection = *connections[id];
+        connection.send_in_flight = false;
+        if (cqe.res < 0 || connection.closing) {
+            return close_connection(id);
+        }
+        // Send the rest if the send was short, and then anything produced in
+        // the meantime
+        connection.sent += static_cast<std::size_t>(cqe.res);
+        if (connection.sent < connection.sending.size()) {
+            return submit_send(id);
+        }
+        flush(id);
+    }
+
+    // Close everything (the ring first, so that the kernel is done with the
+    // memory shared with it)
+    void release() {
+        if (ring_fd >= 0) {
+            close(ring_fd);
+            ring_fd = -1;
+        }
+        for (const auto &connection : connections) {
+            if (connection != nullptr) {
+                close(connection->fd);
+            }
+        }
+        connections.clear();
+        if (wake_fd >= 0) {
+            close(wake_fd);
+            wake_fd = -1;
+        }
+        if (buffer_ring != nullptr) {
+            munmap(buffer_ring, buffer_ring_size);
+            buffer_ring = nullptr;
+        }
+        if (sqes != nullptr) {
+            munmap(sqes, sqes_size);
+            sqes = nullptr;
+        }
+        if (cq_ring != nullptr && cq_ring != sq_ring) {
+            munmap(cq_ring, cq_ring_size);
+        }
+        cq_ring = nullptr;
+        if (sq_ring != nullptr) {
+            munmap(sq_ring, sq_ring_size);
+            sq_ring = nullptr;
+        }
+        close(listen_fd);
+    }
+
+  public:
+    Impl(int listen_fd, handler_type handler,
+         connection_hook_type on_connection)
+    : listen_fd{listen_fd}, handler{std::move(handler)},
+      on_connection{std::move(on_connection)},
+      buffers(std::size_t{NUM_BUFFERS} * BUFFER_SIZE) {
+        // Create the ring, letting the kernel defer its work until the next
+        // system call if it supports that
+        params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL |
+                       IORING_SETUP_COOP_TASKRUN;
+        params.cq_entries = RING_ENTRIES * 4;
+        ring_fd = io_uring_setup(RING_ENTRIES, &params);
+        if (ring_fd < 0 && errno == EINVAL) {
+            params = {};
+            params.flags = IORING_SETUP_CQSIZE;
+            params.cq_entries = RING_ENTRIES * 4;
+            ring_fd = io_uring_setup(RING_ENTRIES, &params);
+        }
+        try {
+            if (ring_fd < 0) {
+                throw system_error(errno, "unable to set up io_uring");
+            }
+            // Map the queues
+            sq_ring_size =
+                params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cq_ring_size =
+                params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            if (params.features & IORING_FEAT_SINGLE_MMAP) {
+                sq_ring_size = cq_ring_size =
+                    std::max(sq_ring_size, cq_ring_size);
+            }
+            sq_ring = map_ring(ring_fd, sq_ring_size, IORING_OFF_SQ_RING);
+            cq_ring = params.features & IORING_FEAT_SINGLE_MMAP
+                          ? sq_ring
+                          : map_ring(ring_fd, cq_ring_size, IORING_OFF_CQ_RING);
+            sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+            sqes = static_cast<io_uring_sqe *>(
+                map_ring(ring_fd, sqes_size, IORING_OFF_SQES));
+            sq_head = at_offset<unsigned>(sq_ring, params.sq_off.head);
+            sq_tail = at_offset<unsigned>(sq_ring, params.sq_off.tail);
+            sq_mask = *at_offset<unsigned>(sq_ring, params.sq_off.ring_mask);
+            sq_array = at_offset<unsigned>(sq_ring, params.sq_off.array);
+            sq_pending_tail = *sq_tail;
+            cq_head = at_offset<unsigned>(cq_ring, params.cq_off.head);
+            cq_tail = at_offset<unsigned>(cq_ring, params.cq_off.tail);
+            cq_mask = *at_offset<unsigned>(cq_ring, params.cq_off.ring_mask);
+            cqes = at_offset<io_uring_cqe>(cq_ring, params.cq_off.cqes);
+
+            // Register the receive buffers
+            buffer_ring_size = NUM_BUFFERS * sizeof(io_uring_buf);
+            const auto ring_memory =
+                mmap(nullptr, buffer_ring_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (ring_memory == MAP_FAILED) {
+                throw system_error(errno, "unable to allocate buffer ring");
+            }
+            buffer_ring = static_cast<io_uring_buf *>(ring_memory);
+            io_uring_buf_reg registration{};
+            registration.ring_addr = reinterpret_cast<uint64_t>(buffer_ring);
+            registration.ring_entries = NUM_BUFFERS;
+            registration.bgid = BUFFER_GROUP;
+            if (io_uring_register(ring_fd, IORING_REGISTER_PBUF_RING,
+                                  &registration, 1) < 0) {
+                throw system_error(errno, "unable to register buffers");
+            }
+            for (auto id = 0U; id < NUM_BUFFERS; ++id) {
+                recycle_buffer(static_cast<uint16_t>(id));
+            }
+
+            wake_fd = eventfd(0, EFD_CLOEXEC);
+            if (wake_fd < 0) {
+                throw system_error(errno, "unable to create event file");
+            }
+        } catch (...) {
+            release();
+            throw;
+        }
+    }
+
+    ~Impl() {
+        release();
+    }
+    void run() {
+        submit_accept();
+        submit_wake();
+        while (!stopping) {
+            // Submit everything queued by the last batch, and wait for the
+            // next one
+            submit(1);
+            auto head = *cq_head;
+            const auto tail = load_acquire(cq_tail);
+            for (; head != tail; ++head) {
+                const auto cqe = cqes[head & cq_mask];
+                const auto id = cqe.user_data >> OPERATION_BITS;
+                switch (static_cast<Operation>(
+                    cqe.user_data & ((1U << OPERATION_BITS) - 1))) {
+                case ACCEPT:
+                    on_accept(cqe);
+                    break;
+                case RECEIVE:
+                    on_receive(id, cqe);
+                    break;
+                case SEND:
+                    on_send(id, cqe);
+                    break;
+                case WAKE:
+                    stopping = true;
+                    break;
+                }
+            }
+            store_release(cq_head, head);
+            // Send the responses to every request in the batch
+            for (const auto id : to_flush) {
+                if (connections[id] != nullptr) {
+                    flush(id);
+                }
+            }
+            to_flush.clear();
+        }
+    }
+
+    void stop() {
+        const uint64_t value = 1;
+        [[maybe_unused]] const auto result =
+            write(wake_fd, &value, sizeof(value));
+    }
+};
+
+UringServer::UringServer(int listen_fd, handler_type handler,
+                         connection_hook_type on_connection)
+: pImpl_{std::make_unique<Impl>(listen_fd, std::move(handler),
+                                std::move(on_connection))} {}
+
+UringServer::~UringServer() = default;
+
+void UringServer::run() {
+    pImpl_->run();
+}
+
+void UringServer::stop() {
+    pImpl_->stop();
+}
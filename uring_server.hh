@@ -0,0 +1,55 @@
+/*
+ * Event loop that serves a request/response protocol over TCP with io_uring
+ * (Linux only), used by cache_server for the binary protocol with
+ * `--io-uring`. Connections are accepted with a multishot accept and read
+ * with multishot receives into a ring of buffers registered with the kernel,
+ * so one submission keeps delivering data for as long as the connection is
+ * open. All of the responses produced while handling a batch of completions
+ * are sent together, and every request queued in the meantime is submitted
+ * along with the wait for the next batch, in a single system call.
+ */
+
+#ifndef URING_SERVER_HH
+#define URING_SERVER_HH
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+class UringServer {
+  public:
+    // Handles the bytes received on a connection: handles every complete
+    // request at the start of `input`, appending the responses to `output`,
+    // and returns the number of bytes used (or nothing if the input is
+    // malformed and the connection should be closed)
+    using handler_type = std::function<std::optional<std::size_t>(
+        std::string_view input, std::string &output)>;
+    // Called with true when a connection is accepted, and with false when
+    // it is closed
+    using connection_hook_type = std::function<void(bool opened)>;
+
+  private:
+    class Impl;
+    std::unique_ptr<Impl> pImpl_;
+
+  public:
+    // Serve connections accepted on a listening socket, which is closed along
+    // with the server (throws `std::system_error` if io_uring is unavailable)
+    UringServer(int listen_fd, handler_type handler,
+                connection_hook_type on_connection = nullptr);
+    ~UringServer();
+
+    UringServer(const UringServer &) = delete;
+    UringServer &operator=(const UringServer &) = delete;
+
+    // Run the event loop on the current thread until `stop()` is called
+    void run();
+
+    // Make `run()` return (may be called from any thread)
+    void stop();
+};
+
+#endif // URING_SERVER_HH